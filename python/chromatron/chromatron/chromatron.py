@@ -63,6 +63,8 @@ BACKUP_SETTINGS = [
     'gfx_balance_green',
     'gfx_balance_red',
     'gfx_dimmer_curve',
+    'gfx_fader_curve',
+    'gfx_dither',
     'gfx_frame_rate',
     'gfx_hsfade',
     'gfx_vfade',
@@ -85,7 +87,9 @@ BACKUP_SETTINGS = [
     'pix_clock',
     'pix_count',
     'pix_dither',
+    'pix_latch',
     'pix_mode',
+    'pix_outputs',
     'pix_rgb_order',
     'pix_size_x',
     'pix_size_y',
@@ -154,7 +158,9 @@ PIXEL_SETTINGS = [
     'pix_clock',
     'pix_count',
     'pix_dither',
+    'pix_latch',
     'pix_mode',
+    'pix_outputs',
     'pix_rgb_order',
     'pix_size_x',
     'pix_size_y',
@@ -32,7 +32,7 @@ from catbus import catbus_string_hash
 import trig
 from copy import copy
 
-VM_ISA_VERSION  = 8
+VM_ISA_VERSION  = 9
 
 RETURN_VAL_ADDR = 0
 RETURN_VAL_NAME = '___return_val'
@@ -43,6 +43,9 @@ MAXIMUM_VARS = 128
 
 reserved = ['pixels']
 
+# calls compiled to VM instructions instead of library calls
+builtin_funcs = ['halt', 'rand']
+
 PIX_ATTRS = {
     'hue': 0,
     'sat': 1,
@@ -1802,6 +1805,8 @@ class CodeGeneratorPass2(object):
 
         self.include_return = include_return
 
+        self.script_functions = []
+
     def get_unique_register(self, line_no=0):
         self.next_unique += 1
         return TempIR('_r%d' % (self.next_unique), line_no=line_no)
@@ -1810,6 +1815,9 @@ class CodeGeneratorPass2(object):
         self.next_label += 1
         return LabelIR('L%d' % (self.next_label))
 
+    def is_lib_call(self, name):
+        return (name not in self.script_functions) and (name not in builtin_funcs)
+
     def generate(self, node, parent=None):
         try:
             self.level += 1
@@ -1817,6 +1825,9 @@ class CodeGeneratorPass2(object):
             if isinstance(node, ModuleNode):
                 code = []
 
+                # functions can be called before they are defined
+                self.script_functions = [i.name for i in node.body if isinstance(i, FunctionNode)]
+
                 for i in node.body:
                     ir = self.generate(i)
 
@@ -1881,7 +1892,22 @@ class CodeGeneratorPass2(object):
                 ir = []
 
                 params = []
+                lib_call = self.is_lib_call(node.name)
+
                 for i in node.params:
+                    # pixel arrays are passed to library calls
+                    # by their object address
+                    if lib_call and isinstance(i, VarNode) and (i.name in self.pixel_arrays):
+                        params.append(ConstIR(self.pixel_arrays[i.name].addr, level=self.level, line_no=node.line_no))
+                        continue
+
+                    # pixels.val and such are passed as
+                    # the object address, with the attribute in the next byte
+                    if lib_call and isinstance(i, ObjNode) and (i.obj in self.pixel_arrays) and (i.attr in ['hue', 'sat', 'val', 'hs_fade', 'v_fade']):
+                        addr = self.pixel_arrays[i.obj].addr | (PIX_ATTRS[i.attr] << 8)
+                        params.append(ConstIR(addr, level=self.level, line_no=node.line_no))
+                        continue
+
                     param_code = self.generate(i)
 
                     try:
@@ -3282,6 +3308,141 @@ class DBStoreInstruction(Instruction):
         return [self.opcode, (kv_hash >> 24) & 0xff, (kv_hash >> 16) & 0xff, (kv_hash >> 8) & 0xff, (kv_hash >> 0) & 0xff, self.op1.addr]
 
 
+# superinstructions.
+# these are generated by the fusion pass from common
+# instruction sequences and are not emitted directly.
+# each one has the same effect as the sequence it replaces.
+class CompareJmpIfZero(Instruction):
+    def __init__(self, compare, jmp):
+        super(CompareJmpIfZero, self).__init__()
+        self.compare = compare
+        self.label = jmp.label
+
+    def __str__(self):
+        return "%-16s %16s <- %16s %4s %16s -> %s" % (self.mnemonic, self.compare.result, self.compare.op1, self.compare.symbol, self.compare.op2, self.label)
+
+    def assemble(self):
+        return [self.opcode, self.compare.result.addr, self.compare.op1.addr, self.compare.op2.addr, ('label', self.label.name), 0]
+
+class CompareEqJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_EQ_JMP_IF_Z'
+    opcode = 0x3B
+
+class CompareNeqJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_NEQ_JMP_IF_Z'
+    opcode = 0x3C
+
+class CompareGtJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_GT_JMP_IF_Z'
+    opcode = 0x3D
+
+class CompareGtEJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_GTE_JMP_IF_Z'
+    opcode = 0x3E
+
+class CompareLtJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_LT_JMP_IF_Z'
+    opcode = 0x3F
+
+class CompareLtEJmpIfZero(CompareJmpIfZero):
+    mnemonic = 'COMP_LTE_JMP_IF_Z'
+    opcode = 0x40
+
+# dest = src; dest = dest op op2
+class MovBinInstruction(Instruction):
+    def __init__(self, mov, binop):
+        super(MovBinInstruction, self).__init__()
+        self.dest = mov.dest
+        self.src = mov.src
+        self.op2 = binop.op2
+        self.symbol = binop.symbol
+
+    def __str__(self):
+        return "%-16s %16s <- %16s %4s %16s" % (self.mnemonic, self.dest, self.src, self.symbol, self.op2)
+
+    def assemble(self):
+        return [self.opcode, self.dest.addr, self.src.addr, self.op2.addr]
+
+class MovAdd(MovBinInstruction):
+    mnemonic = 'MOV_ADD'
+    opcode = 0x41
+
+class MovSub(MovBinInstruction):
+    mnemonic = 'MOV_SUB'
+    opcode = 0x42
+
+# pixel attribute read-modify-write:
+# temp = pixels[x][y].attr; temp = temp op op2; pixels[x][y].attr = temp
+class PixArrayBinInstruction(Instruction):
+    def __init__(self, load, binop, store):
+        super(PixArrayBinInstruction, self).__init__()
+        self.dest = load.dest
+        self.obj = load.obj
+        self.index_x = load.index_x
+        self.index_y = load.index_y
+        self.op2 = binop.op2
+        self.symbol = binop.symbol
+
+    def __str__(self):
+        return "%-16s %s.%s[%s][%s] %s= %s" % (self.mnemonic, self.obj.obj, self.name, self.index_x, self.index_y, self.symbol, self.op2)
+
+    def assemble(self):
+        return [self.opcode, self.dest.addr, self.index_x.addr, self.index_y.addr, self.obj.addr, self.op2.addr]
+
+class PixArrayHueAdd(PixArrayBinInstruction):
+    mnemonic = 'HUE_ADD'
+    opcode = 0x43
+    name = 'hue'
+
+class PixArrayHueSub(PixArrayBinInstruction):
+    mnemonic = 'HUE_SUB'
+    opcode = 0x44
+    name = 'hue'
+
+class PixArraySatAdd(PixArrayBinInstruction):
+    mnemonic = 'SAT_ADD'
+    opcode = 0x45
+    name = 'sat'
+
+class PixArraySatSub(PixArrayBinInstruction):
+    mnemonic = 'SAT_SUB'
+    opcode = 0x46
+    name = 'sat'
+
+class PixArrayValAdd(PixArrayBinInstruction):
+    mnemonic = 'VAL_ADD'
+    opcode = 0x47
+    name = 'val'
+
+class PixArrayValSub(PixArrayBinInstruction):
+    mnemonic = 'VAL_SUB'
+    opcode = 0x48
+    name = 'val'
+
+fused_compare_jmps = {
+    CompareEq:  CompareEqJmpIfZero,
+    CompareNeq: CompareNeqJmpIfZero,
+    CompareGt:  CompareGtJmpIfZero,
+    CompareGtE: CompareGtEJmpIfZero,
+    CompareLt:  CompareLtJmpIfZero,
+    CompareLtE: CompareLtEJmpIfZero,
+}
+
+fused_mov_ops = {
+    Add: MovAdd,
+    Sub: MovSub,
+}
+
+fused_pix_ops = {
+    (LoadFromArrayHue, Add, LoadToArrayHue): PixArrayHueAdd,
+    (LoadFromArrayHue, Sub, LoadToArrayHue): PixArrayHueSub,
+    (LoadFromArraySat, Add, LoadToArraySat): PixArraySatAdd,
+    (LoadFromArraySat, Sub, LoadToArraySat): PixArraySatSub,
+    (LoadFromArrayVal, Add, LoadToArrayVal): PixArrayValAdd,
+    (LoadFromArrayVal, Sub, LoadToArrayVal): PixArrayValSub,
+}
+
+
 conditional_jumps = [
     JmpIfZero,
 ]
@@ -3573,6 +3734,123 @@ class CodeGeneratorPass5(object):
         return state
 
 
+# Superinstruction fusion.
+# Replaces common instruction sequences with fused opcodes
+# to reduce dispatch overhead in the VM.
+# Only the code for the FX VM is fused, the instruction
+# list used by the Python VM (vm_code) is left as is.
+class CodeGeneratorPassFusion(object):
+    def __init__(self, state):
+        self.code = state['code']
+        self.state = state
+
+        self.enable_fusion = True
+
+    def fuse_compare_jmp(self, code, i):
+        # COMP_xx t <- a, b
+        # JMP_IF_Z t -> L
+        ins = code[i]
+        nxt = code[i + 1]
+
+        if type(ins) not in fused_compare_jmps:
+            return None
+
+        if not isinstance(nxt, JmpIfZero):
+            return None
+
+        if nxt.op1.addr != ins.result.addr:
+            return None
+
+        return fused_compare_jmps[type(ins)](ins, nxt), 2
+
+    def fuse_mov_op(self, code, i):
+        # MOV x <- a
+        # ADD x <- x, b
+        ins = code[i]
+        nxt = code[i + 1]
+
+        if not isinstance(ins, Mov):
+            return None
+
+        if type(nxt) not in fused_mov_ops:
+            return None
+
+        if nxt.result.addr != ins.dest.addr or nxt.op1.addr != ins.dest.addr:
+            return None
+
+        return fused_mov_ops[type(nxt)](ins, nxt), 2
+
+    def fuse_pix_op(self, code, i):
+        # LFAH t <- pixels[x][y].hue
+        # ADD t <- t, b
+        # LTAH pixels[x][y].hue <- t
+        if i + 2 >= len(code):
+            return None
+
+        load = code[i]
+        binop = code[i + 1]
+        store = code[i + 2]
+
+        try:
+            fused = fused_pix_ops[(type(load), type(binop), type(store))]
+
+        except KeyError:
+            return None
+
+        temp = load.dest.addr
+
+        if binop.result.addr != temp or binop.op1.addr != temp or store.src.addr != temp:
+            return None
+
+        if store.obj.addr != load.obj.addr or \
+           store.index_x.addr != load.index_x.addr or \
+           store.index_y.addr != load.index_y.addr:
+            return None
+
+        # the store must see the same indexes as the load
+        if temp in [load.index_x.addr, load.index_y.addr]:
+            return None
+
+        return fused(load, binop, store), 3
+
+    def fuse(self, code):
+        fused_code = []
+
+        i = 0
+        while i < len(code):
+            result = None
+
+            if i + 1 < len(code):
+                for f in [self.fuse_pix_op, self.fuse_compare_jmp, self.fuse_mov_op]:
+                    result = f(code, i)
+
+                    if result is not None:
+                        break
+
+            if result is None:
+                fused_code.append(code[i])
+                i += 1
+
+            else:
+                fused_code.append(result[0])
+                i += result[1]
+
+        return fused_code
+
+    def generate(self):
+        if not self.enable_fusion:
+            return self.state
+
+        fused_code = {}
+
+        for func in self.code:
+            fused_code[func] = self.fuse(self.code[func])
+
+        self.state['code'] = fused_code
+
+        return self.state
+
+
 # Process labels and jumps
 class CodeGeneratorPass6(object):
     def __init__(self, state):
@@ -4687,6 +4965,18 @@ def compile_text(text, debug_print=False, script_name=''):
             for ins in state5['code'][func]:
                 print '    ', ins
 
+    cg_fusion = CodeGeneratorPassFusion(state5)
+    state5 = cg_fusion.generate()
+
+    if debug_print:
+        print ''
+        print ''
+        print 'FUSION'
+        for func in state5['code']:
+            print func
+            for ins in state5['code'][func]:
+                print '    ', ins
+
     cg6 = CodeGeneratorPass6(state5)
     state6 = cg6.generate()
 
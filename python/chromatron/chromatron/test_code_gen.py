@@ -1876,6 +1876,106 @@ class CGHSVArrayTests(unittest.TestCase):
         self.assertEqual(regs['d'], 4)
 
 
+fused_ops = """
+
+a = Number(publish=True)
+b = Number(publish=True)
+
+def init():
+    pass
+
+def loop():
+    for i in pixels.count:
+        pixels[i].hue = pixels[i].hue + a
+
+    if a < b:
+        a += 1
+
+    c = Number()
+    c = b
+    c += 2
+    a = c
+
+"""
+
+class CGFusionTests(unittest.TestCase):
+    def test_fused_ops(self):
+        code = code_gen.compile_text(fused_ops)
+
+        fused = [type(ins) for ins in code['vm_code']['loop']]
+        self.assertNotIn(code_gen.PixArrayHueAdd, fused)
+
+        fused = [type(ins) for ins in code_gen.CodeGeneratorPassFusion(code).fuse(code['vm_code']['loop'])]
+        self.assertIn(code_gen.PixArrayHueAdd, fused)
+        self.assertIn(code_gen.CompareLtJmpIfZero, fused)
+        self.assertIn(code_gen.MovAdd, fused)
+
+
+lib_call_pixel_params = """
+
+p1 = PixelArray(2, 12, size_x=3, size_y=4)
+
+def init():
+    fill_rect(p1, 0, 0, 1, 1, 0, 0, 0)
+    noise_fill(p1.val, 0, 0, 0, 1, 1)
+
+def loop():
+    pass
+
+"""
+
+func_call_pixel_array = """
+
+def test(_a):
+    return _a
+
+def init():
+    test(pixels)
+
+def loop():
+    pass
+
+"""
+
+func_call_pixel_attr = """
+
+a = Number(publish=True)
+
+def test(_a):
+    a = _a
+
+def init():
+    test(pixels.val)
+
+def loop():
+    pass
+
+"""
+
+class CGLibCallTests(unittest.TestCase):
+    def test_lib_call_pixel_params(self):
+        code = code_gen.compile_text(lib_call_pixel_params)
+
+        calls = [ins for ins in code['vm_code']['init'] if isinstance(ins, code_gen.LibCall)]
+        addr = 1 # pixels is object 0
+
+        self.assertEqual(calls[0].params[0].name, addr)
+        self.assertEqual(calls[1].params[0].name, addr | (code_gen.PIX_ATTRS['val'] << 8))
+
+    def test_func_call_pixel_array(self):
+        # pixel arrays can only be passed to library calls
+        with self.assertRaises(code_gen.ReservedKeyword):
+            code_gen.compile_text(func_call_pixel_array)
+
+    def test_func_call_pixel_attr(self):
+        # script functions get the attribute value, not an object address
+        code = code_gen.compile_text(func_call_pixel_attr)
+
+        ins = [type(ins) for ins in code['vm_code']['init']]
+        self.assertIn(code_gen.ObjectLoadInstruction, ins)
+        self.assertNotIn(code_gen.LibCall, ins)
+
+
 class CGTestsLocal(CGTestsBase):
     def run_test(self, program, expected={}):
         code = code_gen.compile_text(program)
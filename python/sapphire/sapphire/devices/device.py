@@ -655,6 +655,14 @@ class Device(object):
 
         return info
 
+    def get_vm_profile(self):
+        data = self.get_file("vm_profile")
+
+        info = sapphiredata.VMProfileArray()
+        info.unpack(data)
+
+        return info
+
     def get_thread_info_dump(self):
         data = self.get_file("threadinfo.dump")
 
@@ -1403,7 +1411,76 @@ class Device(object):
         self.put_file('vm.bin', data)
 
         self.set_key('vm_run', True)
-        self.set_key('vm_reset', True)
+
+        # hot reload swaps the program in without resetting the pixels
+        if line == 'hot':
+            self.set_key('vm_hot_reload', True)
+
+        else:
+            self.set_key('vm_reset', True)
+
+    def cli_vmprofile(self, line):
+        info = self.get_vm_profile()
+
+        # opcode names come from the compiler's instruction table,
+        # function names from compiling the script named on the command line
+        opcode_names = {}
+        func_names = {}
+
+        try:
+            from chromatron import code_gen
+
+            for cls in vars(code_gen).itervalues():
+                if isinstance(cls, type) and \
+                   issubclass(cls, code_gen.Instruction) and \
+                   cls.opcode is not None:
+
+                    opcode_names[cls.opcode] = cls.mnemonic
+
+            if line:
+                result = code_gen.compile_script(line)
+
+                for name, addr in result['functions'].iteritems():
+                    func_names[addr] = name
+
+        except ImportError:
+            pass
+
+        total_ticks = sum([n.ticks for n in info if n.type == 0])
+
+        s = "\nOpcode            Count        Ticks    Avg    %\n"
+
+        for n in sorted([n for n in info if n.type == 0], key=lambda a: a.ticks, reverse=True):
+            try:
+                avg = n.ticks / n.count
+
+            except ZeroDivisionError:
+                avg = 0
+
+            try:
+                pct = (n.ticks * 100.0) / total_ticks
+
+            except ZeroDivisionError:
+                pct = 0.0
+
+            name = opcode_names.get(n.id, '0x%02x' % (n.id))
+
+            s += "%-14s %8d %12d %6d %5.1f\n" % (name, n.count, n.ticks, avg, pct)
+
+        s += "\nFunction          Calls        Ticks    Avg\n"
+
+        for n in sorted([n for n in info if n.type == 1], key=lambda a: a.ticks, reverse=True):
+            try:
+                avg = n.ticks / n.count
+
+            except ZeroDivisionError:
+                avg = 0
+
+            name = func_names.get(n.id, '@%d' % (n.id))
+
+            s += "%-14s %8d %12d %6d\n" % (name, n.count, n.ticks, avg)
+
+        return s
 
     def cli_dumpkvmeta(self, line):
         data = self.get_file("kvmeta")
@@ -109,6 +109,22 @@ class ThreadInfoArray(ArrayField):
 
         super(ThreadInfoArray, self).__init__(_field=field, **kwargs)
 
+class VMProfileEntryField(StructField):
+    def __init__(self, **kwargs):
+        fields = [Uint8Field(_name="type"),
+                  Uint8Field(_name="padding"),
+                  Uint16Field(_name="id"),
+                  Uint32Field(_name="count"),
+                  Uint32Field(_name="ticks")]
+
+        super(VMProfileEntryField, self).__init__(_fields=fields, **kwargs)
+
+class VMProfileArray(ArrayField):
+    def __init__(self, **kwargs):
+        field = VMProfileEntryField
+
+        super(VMProfileArray, self).__init__(_field=field, **kwargs)
+
 class NTPTimestampField(StructField):
     def __init__(self, **kwargs):
         fields = [Uint32Field(_name="seconds"),
@@ -26,6 +26,7 @@
 #include "comm_intf.h"
 #include "wifi.h"
 #include "irq_line.h"
+#include "comm_link.h"
 #include "version.h"
 #include <ESP8266WiFi.h>
 
@@ -63,35 +64,36 @@ static int32_t elapsed( uint32_t start ){
 
 
 
-static bool connected;
-static uint32_t comm_timeout;
 static bool request_status;
 static bool request_info;
 static bool request_debug;
 static bool request_vm_info;
+static uint8_t vm_info_index;
 static bool request_rgb_pix0;
 static bool request_rgb_array;
 static bool request_vm_frame_sync;
 static uint8_t vm_frame_sync_index;
 static bool request_vm_frame_sync_status;
+static bool request_vm_profile;
+static uint8_t vm_profile_index;
 static uint8_t vm_frame_sync_status;
-static volatile bool request_reset_ready_timeout;
 
 static uint16_t rgb_index;
 
+// the pixels the pixel MCU has, so only changes need to be sent
+static uint8_t rgb_sent[4][MAX_PIXELS];
+static uint16_t rgb_sent_count;
+static uint8_t rgb_frame_count;
+static bool request_rgb_keyframe;
+static bool rgb_keyframe;
+static bool request_rgb_present;
+
 static uint16_t comm_errors;
 
 static process_stats_t process_stats;
 
-static volatile uint32_t last_rx_ready_ts;
-static volatile bool wifi_rx_ready;
 static uint32_t last_status_ts;
 
-static wifi_data_header_t intf_data_header;
-static uint8_t intf_comm_buf[WIFI_BUF_LEN];
-static uint16_t intf_comm_len;
-static uint8_t intf_comm_state;
-
 static wifi_msg_udp_header_t udp_header;
 static uint8_t udp_data[WIFI_UDP_BUF_LEN];
 static uint16_t udp_len;
@@ -99,12 +101,6 @@ static uint16_t udp_len;
 static wifi_msg_udp_header_t rx_udp_header;
 static uint16_t rx_udp_index;
 
-#define COMM_STATE_IDLE          0
-#define COMM_STATE_RX_HEADER     1
-#define COMM_STATE_RX_DATA       2
-
-
-
 void intf_v_led_on(){
 
     digitalWrite( LED_GPIO, LOW );
@@ -115,58 +111,13 @@ void intf_v_led_off(){
     digitalWrite( LED_GPIO, HIGH );
 }
 
-static void _intf_v_flush(){
-
-    Serial.flush();
-    while( Serial.read() >= 0 );
-}
-
-static bool wifi_ready( void ){
-
-    noInterrupts();
-    bool temp = wifi_rx_ready;
-    interrupts();
+void intf_v_link_reset( void ){
 
-    return temp;
+    // the pixel MCU may have restarted
+    request_rgb_keyframe = true;
 }
 
-static int8_t _intf_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len ){
-
-    if( len > WIFI_MAIN_MAX_DATA_LEN ){
-
-        return -1;
-    }
-    else if( !wifi_ready() ){
-
-        return -2;  
-    }
-
-    wifi_data_header_t header;
-    header.len      = len;
-    header.data_id  = data_id;
-    header.msg_id   = 0;
-    header.crc      = 0;
-
-    uint16_t crc = crc_u16_start();
-    crc = crc_u16_partial_block( crc, (uint8_t *)&header, sizeof(header) );
-
-    crc = crc_u16_partial_block( crc, data, len );
-
-    header.crc = crc_u16_finish( crc );
-
-
-    noInterrupts();
-    wifi_rx_ready = false;
-    interrupts();
-
-    Serial.write( WIFI_COMM_DATA );
-    Serial.write( (uint8_t *)&header, sizeof(header) );
-    Serial.write( data, len );
-
-    return 0;
-}
-
-static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16_t len ){
+void intf_v_receive_msg( uint8_t data_id, uint8_t *data, uint16_t len ){
 
     if( data_id == WIFI_DATA_ID_CONNECT ){
 
@@ -220,6 +171,17 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
 
         vm_v_reset();
     }
+    else if( data_id == WIFI_DATA_ID_SELECT_VM ){
+
+        if( len != sizeof(wifi_msg_select_vm_t) ){
+
+            return;
+        }
+
+        wifi_msg_select_vm_t *msg = (wifi_msg_select_vm_t *)data;
+
+        vm_i8_select( msg->vm_id, msg->flags, msg->pix_index, msg->pix_count );
+    }
     else if( data_id == WIFI_DATA_ID_LOAD_VM ){
 
         vm_i8_load( data, len );
@@ -235,6 +197,10 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
         
         intf_v_request_vm_frame_sync();
     }
+    else if( data_id == WIFI_DATA_ID_REQUEST_RGB_KEYFRAME ){
+
+        request_rgb_keyframe = true;
+    }
     else if( data_id == WIFI_DATA_ID_RUN_VM ){
 
         vm_v_run_vm();
@@ -256,8 +222,7 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
 
         if( len != sizeof(wifi_msg_udp_header_t) ){
 
-            Serial.write( 0x99 );
-            Serial.write( 0x01 );
+            comm_errors++;
 
             intf_v_led_on();
             return;
@@ -273,12 +238,7 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
         // bounds check
         if( ( udp_len + len ) > sizeof(udp_data) ){
 
-            Serial.write( 0x99 );
-            Serial.write( 0x02 );
-            Serial.write( udp_len >> 8 );
-            Serial.write( udp_len & 0xff );
-            Serial.write( len >> 8 );
-            Serial.write( len & 0xff );
+            comm_errors++;
 
             intf_v_led_on();
             return;
@@ -293,8 +253,7 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
             // check crc
             if( crc_u16_block( udp_data, udp_len ) != udp_header.crc ){
 
-                Serial.write( 0x99 );
-                Serial.write( 0x03 );
+                comm_errors++;
 
                 intf_v_led_on();
                 return;
@@ -305,124 +264,128 @@ static void process_data( uint8_t data_id, uint8_t msg_id, uint8_t *data, uint16
     }
 }
 
-static void set_rx_ready( void ){
-
-    // flush serial buffers
-    _intf_v_flush();
+static bool rgb_pixel_equal( uint8_t *rgbd[4], uint16_t a, uint16_t b ){
 
-    // Serial.write( WIFI_COMM_READY );  
-
-    irqline_v_strobe_irq();
+    return ( rgbd[0][a] == rgbd[0][b] ) &&
+           ( rgbd[1][a] == rgbd[1][b] ) &&
+           ( rgbd[2][a] == rgbd[2][b] ) &&
+           ( rgbd[3][a] == rgbd[3][b] );
 }
 
-void intf_v_process( void ){
+static bool rgb_pixel_changed( uint8_t *rgbd[4], uint16_t i ){
 
-    noInterrupts();
+    if( rgb_keyframe ){
 
-    if( request_reset_ready_timeout ){
+        return true;
+    }
 
-        request_reset_ready_timeout = false;
+    return ( rgbd[0][i] != rgb_sent[0][i] ) ||
+           ( rgbd[1][i] != rgb_sent[1][i] ) ||
+           ( rgbd[2][i] != rgb_sent[2][i] ) ||
+           ( rgbd[3][i] != rgb_sent[3][i] );
+}
 
-        last_rx_ready_ts = start_timeout();
-    }   
+// encode changed pixels from rgb_index on into runs.
+// returns the message length, 0 if nothing changed.
+static uint8_t encode_rgb_delta( uint8_t *buf, uint8_t buf_len ){
 
-    interrupts();
+    uint8_t *rgbd[4];
+    rgbd[0] = gfx_u8p_get_red();
+    rgbd[1] = gfx_u8p_get_green();
+    rgbd[2] = gfx_u8p_get_blue();
+    rgbd[3] = gfx_u8p_get_dither();
 
-    if( ( intf_comm_state != COMM_STATE_IDLE ) &&
-        ( elapsed( comm_timeout ) > 20000 ) ){
+    uint16_t pix_count = gfx_u16_get_pix_count();
+    uint8_t len = 0;
 
-        // reset comm state
-        intf_comm_state = COMM_STATE_IDLE;
+    while( rgb_index < pix_count ){
 
-        comm_errors++;
+        if( !rgb_pixel_changed( rgbd, rgb_index ) ){
 
-        set_rx_ready();
-    }
+            rgb_index++;
+            continue;
+        }
 
-    if( intf_comm_state == COMM_STATE_IDLE ){    
-        
-        char c = Serial.read();
+        if( ( len + sizeof(wifi_rgb_run_t) + 4 ) > buf_len ){
 
-        if( c == WIFI_COMM_RESET ){
+            break;
+        }
 
-            if( connected == false ){
-                
-                connected = true;
+        wifi_rgb_run_t *run = (wifi_rgb_run_t *)&buf[len];
+        len += sizeof(wifi_rgb_run_t);
 
-                irqline_v_enable();
-            }
+        uint16_t fill_count = 1;
 
-            set_rx_ready();
-        }
-        else if( c == WIFI_COMM_DATA ){
-
-            intf_comm_state = COMM_STATE_RX_HEADER;
+        while( ( ( rgb_index + fill_count ) < pix_count ) &&
+               ( fill_count < WIFI_RGB_RUN_MAX_COUNT ) &&
+               rgb_pixel_equal( rgbd, rgb_index, rgb_index + fill_count ) ){
 
-            comm_timeout = start_timeout();
+            fill_count++;
         }
-    }
-    else if( intf_comm_state == COMM_STATE_RX_HEADER ){    
-        
-        if( Serial.available() >= (sizeof(wifi_data_header_t) ) ){
 
-            Serial.readBytes( (uint8_t *)&intf_data_header, sizeof(intf_data_header) );
+        uint8_t count;
 
-            intf_comm_state = COMM_STATE_RX_DATA;
-        }   
-    }    
-    else if( intf_comm_state == COMM_STATE_RX_DATA ){    
+        // a fill run is smaller than copying 2 or more pixels
+        if( fill_count >= 2 ){
 
-        if( Serial.available() >= intf_data_header.len ){
+            count = fill_count;
 
-            Serial.readBytes( intf_comm_buf, intf_data_header.len );
+            for( uint8_t c = 0; c < 4; c++ ){
 
-            // we've copied the data out of the FIFO, so we can go ahead and send RX ready
-            // before we process the data.
-            set_rx_ready();
+                buf[len++] = rgbd[c][rgb_index];
+            }
 
-            // check crc
+            run->count = count | WIFI_RGB_RUN_FILL;
+        }
+        else{
 
-            uint16_t msg_crc = intf_data_header.crc;
-            intf_data_header.crc = 0;
-            uint16_t crc = crc_u16_start();
-            crc = crc_u16_partial_block( crc, (uint8_t *)&intf_data_header, sizeof(intf_data_header) );
-            crc = crc_u16_partial_block( crc, intf_comm_buf, intf_data_header.len );
-            crc = crc_u16_finish( crc );
+            uint8_t max_count = ( buf_len - len ) / 4;
 
-            if( crc == msg_crc ){
+            if( max_count > WIFI_RGB_RUN_MAX_COUNT ){
 
-                process_data( intf_data_header.data_id, intf_data_header.msg_id, intf_comm_buf, intf_data_header.len );
+                max_count = WIFI_RGB_RUN_MAX_COUNT;
             }
-            else{
 
-                comm_errors++;
+            // copy changed pixels, stopping where a fill run would start.
+            // an unchanged pixel ends the run, a new run header is smaller.
+            count = 1;
+
+            while( ( count < max_count ) &&
+                   ( ( rgb_index + count ) < pix_count ) &&
+                   rgb_pixel_changed( rgbd, rgb_index + count ) &&
+                   !( ( ( rgb_index + count + 1 ) < pix_count ) &&
+                      rgb_pixel_equal( rgbd, rgb_index + count, rgb_index + count + 1 ) ) ){
+
+                count++;
             }
 
-            intf_comm_state = COMM_STATE_IDLE;
-        }
-    }
+            for( uint8_t c = 0; c < 4; c++ ){
 
+                memcpy( &buf[len], &rgbd[c][rgb_index], count );
+                len += count;
+            }
 
+            run->count = count;
+        }
 
+        run->index = rgb_index;
 
+        for( uint8_t c = 0; c < 4; c++ ){
 
+            memcpy( &rgb_sent[c][rgb_index], &rgbd[c][rgb_index], count );
+        }
 
-    if( !wifi_ready() ){
+        rgb_index += count;
+    }
 
-        // check timeout
-        noInterrupts();
-        uint32_t temp_last_rx_ready_ts = last_rx_ready_ts;
-        interrupts();
+    return len;
+}
 
-        if( elapsed( temp_last_rx_ready_ts ) > 50000 ){
+void intf_v_process( void ){
 
-            // query for ready status
-            Serial.write( WIFI_COMM_QUERY_READY );
+    link_v_process();
 
-            noInterrupts();
-            last_rx_ready_ts = start_timeout();
-            interrupts();
-        }
+    if( !link_b_ready() ){
 
         goto done;
     }
@@ -438,7 +401,7 @@ void intf_v_process( void ){
         wifi_msg_status_t status_msg;
         status_msg.flags = wifi_u8_get_status();
 
-        _intf_i8_send_msg( WIFI_DATA_ID_STATUS, (uint8_t *)&status_msg, sizeof(status_msg) );
+        link_i8_send_msg( WIFI_DATA_ID_STATUS, (uint8_t *)&status_msg, sizeof(status_msg) );
     }
     else if( request_info ){
 
@@ -485,7 +448,7 @@ void intf_v_process( void ){
         mem_rt_data_t rt_data;
         mem2_v_get_rt_data( &rt_data );
 
-        info_msg.comm_errors            = comm_errors;
+        info_msg.comm_errors            = comm_errors + link_u16_get_comm_errors();
 
         info_msg.mem_heap_peak          = rt_data.peak_usage;
 
@@ -494,16 +457,24 @@ void intf_v_process( void ){
         info_msg.wifi_max_time          = process_stats.wifi_max_time;
         info_msg.mem_max_time           = process_stats.mem_max_time;
 
-        _intf_i8_send_msg( WIFI_DATA_ID_INFO, (uint8_t *)&info_msg, sizeof(info_msg) );
+        link_i8_send_msg( WIFI_DATA_ID_INFO, (uint8_t *)&info_msg, sizeof(info_msg) );
     }
     else if( request_vm_info ){
 
-        request_vm_info = false;
-
+        // send info for each loaded VM instance in turn
         vm_info_t info;
-        vm_v_get_info( &info );
+        
+        if( vm_i8_get_info( vm_info_index, &info ) < 0 ){
 
-        _intf_i8_send_msg( WIFI_DATA_ID_VM_INFO, (uint8_t *)&info, sizeof(info) );
+            request_vm_info = false;
+            vm_info_index = 0;
+        }
+        else{
+
+            link_i8_send_msg( WIFI_DATA_ID_VM_INFO, (uint8_t *)&info, sizeof(info) );
+
+            vm_info_index++;
+        }
     }
     else if( request_vm_frame_sync ){
 
@@ -512,7 +483,7 @@ void intf_v_process( void ){
 
         if( vm_i8_get_frame_sync( vm_frame_sync_index, &msg ) == 0 ){
 
-            _intf_i8_send_msg( WIFI_DATA_ID_VM_FRAME_SYNC, (uint8_t *)&msg, sizeof(msg) );
+            link_i8_send_msg( WIFI_DATA_ID_VM_FRAME_SYNC, (uint8_t *)&msg, sizeof(msg) );
 
             vm_frame_sync_index++;
         }
@@ -521,6 +492,22 @@ void intf_v_process( void ){
             request_vm_frame_sync = false;
         }
     }
+    else if( request_vm_profile ){
+
+        wifi_msg_vm_profile_t msg;
+        memset( &msg, 0, sizeof(msg) );
+
+        if( vm_i8_get_profile( vm_profile_index, &msg ) == 0 ){
+
+            link_i8_send_msg( WIFI_DATA_ID_VM_PROFILE, (uint8_t *)&msg, sizeof(msg) );
+
+            vm_profile_index++;
+        }
+        else{
+
+            request_vm_profile = false;
+        }
+    }
     else if( request_vm_frame_sync_status ){
 
         request_vm_frame_sync_status = false;
@@ -529,7 +516,7 @@ void intf_v_process( void ){
         msg.status = vm_frame_sync_status;
         msg.frame_number = vm_u16_get_frame_number();
 
-        _intf_i8_send_msg( WIFI_DATA_ID_FRAME_SYNC_STATUS, (uint8_t *)&msg, sizeof(msg) );        
+        link_i8_send_msg( WIFI_DATA_ID_FRAME_SYNC_STATUS, (uint8_t *)&msg, sizeof(msg) );        
     }
     else if( request_rgb_pix0 ){
 
@@ -540,51 +527,59 @@ void intf_v_process( void ){
         msg.g = gfx_u16_get_pix0_green();
         msg.b = gfx_u16_get_pix0_blue();
 
-        _intf_i8_send_msg( WIFI_DATA_ID_RGB_PIX0, (uint8_t *)&msg, sizeof(msg) );
+        link_i8_send_msg( WIFI_DATA_ID_RGB_PIX0, (uint8_t *)&msg, sizeof(msg) );
     }
     else if( request_rgb_array ){
 
-        // get pointers to the arrays
-        uint8_t *r = gfx_u8p_get_red();
-        uint8_t *g = gfx_u8p_get_green();
-        uint8_t *b = gfx_u8p_get_blue();
-        uint8_t *d = gfx_u8p_get_dither();
-
         uint16_t pix_count = gfx_u16_get_pix_count();
 
-        wifi_msg_rgb_array_t msg;
+        // start of a frame
+        if( rgb_index == 0 ){
 
-        uint16_t remaining = pix_count - rgb_index;
-        uint8_t count = WIFI_RGB_DATA_N_PIXELS;
+            if( pix_count != rgb_sent_count ){
 
-        if( count > remaining ){
+                rgb_sent_count = pix_count;
+                request_rgb_keyframe = true;
+            }
+
+            if( rgb_frame_count == 0 ){
+
+                request_rgb_keyframe = true;
+            }
 
-            count = remaining;
+            rgb_keyframe = request_rgb_keyframe;
+            request_rgb_keyframe = false;
+
+            rgb_frame_count++;
+
+            if( rgb_frame_count >= WIFI_RGB_KEYFRAME_INTERVAL ){
+
+                rgb_frame_count = 0;
+            }
         }
 
-        msg.index = rgb_index;
-        msg.count = count;
-        uint8_t *ptr = msg.rgbd_array;
-        memcpy( ptr, r + rgb_index, count );
-        ptr += count;
-        memcpy( ptr, g + rgb_index, count );
-        ptr += count;
-        memcpy( ptr, b + rgb_index, count );
-        ptr += count;
-        memcpy( ptr, d + rgb_index, count );
-
-        _intf_i8_send_msg( WIFI_DATA_ID_RGB_ARRAY, 
-                           (uint8_t *)&msg, 
-                           sizeof(msg.index) + sizeof(msg.count) + ( count * 4 ) );
+        // short frames keep more of them in the pixel MCU's receive buffer
+        uint8_t buf[WIFI_MAX_DATA_LEN];
+        uint8_t len = encode_rgb_delta( buf, sizeof(buf) );
 
-        rgb_index += count;
+        if( len > 0 ){
+
+            link_i8_send_msg( WIFI_DATA_ID_RGB_DELTA, buf, len );
+        }
 
         if( rgb_index >= pix_count ){
 
             rgb_index = 0;
             request_rgb_array = false;
+            request_rgb_present = true;
         }
     }
+    else if( request_rgb_present ){
+
+        request_rgb_present = false;
+
+        link_i8_send_msg( WIFI_DATA_ID_RGB_PRESENT, 0, 0 );
+    }
     else if( request_debug ){
 
         request_debug = false;
@@ -592,7 +587,7 @@ void intf_v_process( void ){
         wifi_msg_debug_t msg;
         msg.free_heap = ESP.getFreeHeap();
 
-        _intf_i8_send_msg( WIFI_DATA_ID_DEBUG, 
+        link_i8_send_msg( WIFI_DATA_ID_DEBUG, 
                            (uint8_t *)&msg, 
                            sizeof(msg) );
     }
@@ -605,7 +600,7 @@ void intf_v_process( void ){
             // get header
             wifi_i8_get_rx_udp_header( &rx_udp_header );
             
-            _intf_i8_send_msg( WIFI_DATA_ID_UDP_HEADER, (uint8_t *)&rx_udp_header, sizeof(wifi_msg_udp_header_t) );
+            link_i8_send_msg( WIFI_DATA_ID_UDP_HEADER, (uint8_t *)&rx_udp_header, sizeof(wifi_msg_udp_header_t) );
         }
         else{
 
@@ -618,7 +613,7 @@ void intf_v_process( void ){
 
             uint8_t *data = wifi_u8p_get_rx_udp_data();
 
-            _intf_i8_send_msg( WIFI_DATA_ID_UDP_DATA, &data[rx_udp_index], data_len );
+            link_i8_send_msg( WIFI_DATA_ID_UDP_DATA, &data[rx_udp_index], data_len );
 
             rx_udp_index += data_len;
 
@@ -635,7 +630,7 @@ void intf_v_process( void ){
 
         list_node_t ln = list_ln_remove_tail( vm_send_list );
 
-        _intf_i8_send_msg( WIFI_DATA_ID_KV_BATCH, (uint8_t *)list_vp_get_data( ln ), sizeof(wifi_msg_kv_batch_t) );
+        link_i8_send_msg( WIFI_DATA_ID_KV_BATCH, (uint8_t *)list_vp_get_data( ln ), sizeof(wifi_msg_kv_batch_t) );
 
         list_v_release_node( ln );
     }
@@ -643,7 +638,7 @@ void intf_v_process( void ){
 
         list_node_t ln = list_ln_remove_tail( &print_list );
 
-        _intf_i8_send_msg( WIFI_DATA_ID_DEBUG_PRINT, (uint8_t *)list_vp_get_data( ln ), list_u16_node_size( ln ) ); 
+        link_i8_send_msg( WIFI_DATA_ID_DEBUG_PRINT, (uint8_t *)list_vp_get_data( ln ), list_u16_node_size( ln ) ); 
         
         list_v_release_node( ln );
     }
@@ -663,28 +658,14 @@ done:
     return;
 }
 
-void ICACHE_RAM_ATTR buf_ready_irq( void ){
-
-    wifi_rx_ready = true;
-    request_reset_ready_timeout = true;
-}
-
 void intf_v_init( void ){
 
-    noInterrupts();
-    wifi_rx_ready = false;
-    interrupts();
-
     pinMode( BUF_READY_GPIO, INPUT );
-    attachInterrupt( digitalPinToInterrupt( BUF_READY_GPIO ), buf_ready_irq, FALLING );
 
     pinMode( LED_GPIO, OUTPUT );
     intf_v_led_off();
 
-    Serial.begin( 4000000 );
-
-    // flush serial buffers
-    _intf_v_flush();
+    link_v_init();
 
     request_debug = true;
 
@@ -717,6 +698,12 @@ void intf_v_request_vm_frame_sync( void ){
     request_vm_frame_sync = true;
 }
 
+void intf_v_request_vm_profile( void ){
+
+    vm_profile_index = 0;
+    request_vm_profile = true;
+}
+
 void intf_v_get_mac( uint8_t mac[6] ){
 
     WiFi.macAddress( mac );
@@ -759,7 +746,7 @@ void intf_v_printf( const char *format, ... ){
 
 int8_t intf_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len ){
 
-    return _intf_i8_send_msg( data_id, data, len );
+    return link_i8_send_msg( data_id, data, len );
 }
 
 void intf_v_get_proc_stats( process_stats_t **stats ){
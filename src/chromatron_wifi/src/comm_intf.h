@@ -46,6 +46,7 @@ void intf_v_request_vm_info( void );
 void intf_v_request_rgb_pix0( void );
 void intf_v_request_rgb_array( void );
 void intf_v_request_vm_frame_sync( void );
+void intf_v_request_vm_profile( void );
 void intf_v_get_mac( uint8_t mac[6] );
 void intf_v_printf( const char *format, ... );
 int8_t intf_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len );
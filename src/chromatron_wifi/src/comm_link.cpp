@@ -0,0 +1,556 @@
+/*
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+ */
+
+/*
+
+Link layer of the UART transport to the pixel MCU, see wifi_cmd.h.
+
+*/
+
+#include "Arduino.h"
+#include "comm_link.h"
+#include "irq_line.h"
+
+extern "C"{
+    #include "crc.h"
+    #include "wifi_cmd.h"
+}
+
+static bool connected;
+static uint32_t comm_timeout;
+static uint16_t comm_errors;
+
+static wifi_data_header_t intf_data_header;
+static wifi_comm_ack_t intf_ack;
+static uint8_t intf_comm_buf[WIFI_BUF_LEN];
+static uint8_t intf_comm_state;
+
+// transmit window.
+// frames are kept until acked, so they can be resent.
+#define INTF_TX_FRAME_LEN ( 1 + sizeof(wifi_data_header_t) + WIFI_MAIN_MAX_DATA_LEN )
+
+typedef struct{
+    uint32_t sent_ts;
+    uint16_t len;
+    bool nak_resent;
+    uint8_t frame[INTF_TX_FRAME_LEN];
+} tx_frame_t;
+
+static tx_frame_t tx_frames[WIFI_COMM_WINDOW];
+static uint8_t tx_seq;
+static uint8_t tx_base;
+static uint16_t tx_total;
+static uint16_t tx_limit;
+
+// receive window.
+// frames that arrive after a gap are held until the gap is filled.
+static uint8_t rx_seq;
+static uint16_t rx_total;
+static uint16_t rx_limit;
+static uint32_t ack_ts;
+static bool rx_held_valid[WIFI_COMM_WINDOW];
+static uint8_t rx_held[WIFI_COMM_WINDOW][WIFI_BUF_LEN];
+static bool send_ack;
+static bool send_nak;
+
+// bytes the pixel MCU may have in our buffer past the last one read,
+// room for one ack is kept beyond the limit.
+#define LINK_RX_LIMIT_SPACE ( LINK_RX_BUF_SIZE - 1 - WIFI_COMM_ACK_FRAME_LEN )
+
+#define COMM_STATE_IDLE          0
+#define COMM_STATE_RX_HEADER     1
+#define COMM_STATE_RX_DATA       2
+#define COMM_STATE_RX_ACK        3
+#define COMM_STATE_RX_RESET      4
+
+
+static uint32_t start_timeout( void ){
+
+    return micros();
+}
+
+static int32_t elapsed( uint32_t start ){
+
+    uint32_t now = micros();
+    int32_t distance = (int32_t)( now - start );
+
+    // check for rollover
+    if( distance < 0 ){
+
+        distance = ( UINT32_MAX - now ) + abs(distance);
+    }
+
+    return distance;
+}
+
+static void _intf_v_flush(){
+
+    Serial.flush();
+    while( Serial.read() >= 0 );
+}
+
+void link_v_reset( void ){
+
+    tx_seq = 0;
+    tx_base = 0;
+    tx_total = 0;
+    tx_limit = WIFI_COMM_INITIAL_LIMIT;
+
+    rx_seq = 0;
+    rx_total = 0;
+    rx_limit = LINK_RX_LIMIT_SPACE;
+    memset( rx_held_valid, 0, sizeof(rx_held_valid) );
+
+    send_ack = false;
+    send_nak = false;
+
+    // the pixel MCU may have restarted
+    intf_v_link_reset();
+}
+
+static void line_write( uint8_t *data, uint16_t len ){
+
+    Serial.write( data, len );
+    tx_total += len;
+}
+
+static void line_read( uint8_t *data, uint16_t len ){
+
+    Serial.readBytes( data, len );
+    rx_total += len;
+}
+
+// check if len more bytes fit in the peer's receive buffer
+static bool tx_credit( uint16_t len ){
+
+    return (int16_t)( tx_limit - (uint16_t)( tx_total + len ) ) >= 0;
+}
+
+static void send_frame( tx_frame_t *tx ){
+
+    line_write( tx->frame, tx->len );
+    tx->sent_ts = millis();
+}
+
+bool link_b_connected( void ){
+
+    return connected;
+}
+
+bool link_b_ready( void ){
+
+    if( !connected ){
+
+        return false;
+    }
+
+    if( (uint8_t)( tx_seq - tx_base ) >= WIFI_COMM_WINDOW ){
+
+        return false;
+    }
+
+    // leave room for an ack after the frame
+    return tx_credit( INTF_TX_FRAME_LEN + WIFI_COMM_ACK_FRAME_LEN );
+}
+
+int8_t link_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len ){
+
+    if( len > WIFI_MAIN_MAX_DATA_LEN ){
+
+        return -1;
+    }
+    else if( !link_b_ready() ){
+
+        return -2;  
+    }
+
+    wifi_data_header_t header;
+    header.len      = len;
+    header.data_id  = data_id;
+    header.msg_id   = tx_seq;
+    header.crc      = 0;
+
+    uint16_t crc = crc_u16_start();
+    crc = crc_u16_partial_block( crc, (uint8_t *)&header, sizeof(header) );
+
+    crc = crc_u16_partial_block( crc, data, len );
+
+    header.crc = crc_u16_finish( crc );
+
+    tx_frame_t *tx = &tx_frames[tx_seq % WIFI_COMM_WINDOW];
+    tx->len = 1 + sizeof(header) + len;
+    tx->nak_resent = false;
+    tx->frame[0] = WIFI_COMM_DATA;
+    memcpy( &tx->frame[1], &header, sizeof(header) );
+
+    if( len > 0 ){
+
+        memcpy( &tx->frame[1 + sizeof(header)], data, len );
+    }
+
+    tx_seq++;
+
+    send_frame( tx );
+
+    return 0;
+}
+
+static bool ack_due( void ){
+
+    return ( millis() - ack_ts ) >= WIFI_COMM_ACK_INTERVAL;
+}
+
+static void send_ack_frame( void ){
+
+    if( !tx_credit( WIFI_COMM_ACK_FRAME_LEN ) && !ack_due() ){
+
+        return;
+    }
+
+    rx_limit = rx_total + LINK_RX_LIMIT_SPACE;
+
+    wifi_comm_ack_t ack;
+    ack.ack     = rx_seq;
+    ack.flags   = send_nak ? WIFI_COMM_ACK_FLAGS_NAK : 0;
+    ack.held    = 0;
+
+    for( uint8_t i = 0; i < ( WIFI_COMM_WINDOW - 1 ); i++ ){
+
+        if( rx_held_valid[(uint8_t)( rx_seq + 1 + i ) % WIFI_COMM_WINDOW] ){
+
+            ack.held |= ( 1 << i );
+        }
+    }
+    ack.limit   = rx_limit;
+    ack.crc     = 0;
+    ack.crc     = crc_u16_block( (uint8_t *)&ack, sizeof(ack) );
+
+    uint8_t c = WIFI_COMM_ACK;
+    line_write( &c, sizeof(c) );
+    line_write( (uint8_t *)&ack, sizeof(ack) );
+
+    send_ack = false;
+    send_nak = false;
+
+    ack_ts = millis();
+}
+
+static void process_ack( wifi_comm_ack_t *ack ){
+
+    // frames up to ack are done
+    if( (uint8_t)( ack->ack - tx_base ) <= (uint8_t)( tx_seq - tx_base ) ){
+
+        tx_base = ack->ack;
+    }
+
+    if( (int16_t)( ack->limit - tx_limit ) > 0 ){
+
+        tx_limit = ack->limit;
+    }
+
+    // resend the frames the receiver is missing
+    if( ( ack->flags & WIFI_COMM_ACK_FLAGS_NAK ) && ( ack->ack == tx_base ) ){
+
+        for( uint8_t seq = tx_base; seq != tx_seq; seq++ ){
+
+            uint8_t offset = seq - tx_base;
+
+            if( ( offset > 0 ) && ( ack->held & ( 1 << ( offset - 1 ) ) ) ){
+
+                continue;
+            }
+
+            tx_frame_t *tx = &tx_frames[seq % WIFI_COMM_WINDOW];
+
+            if( tx->nak_resent && ( ( millis() - tx->sent_ts ) < WIFI_COMM_NAK_HOLDOFF ) ){
+
+                continue;
+            }
+
+            if( !tx_credit( tx->len ) ){
+
+                break;
+            }
+
+            tx->nak_resent = true;
+
+            send_frame( tx );
+        }
+    }
+}
+// deliver frames in sequence order.
+// a frame after a gap is held and the missing one is NAKed.
+static void receive_frame( wifi_data_header_t *header, uint8_t *data ){
+
+    uint8_t offset = header->msg_id - rx_seq;
+
+    if( offset == 0 ){
+
+        intf_v_receive_msg( header->data_id, data, header->len );
+        rx_seq++;
+
+        // deliver frames that were waiting on this one
+        while( rx_held_valid[rx_seq % WIFI_COMM_WINDOW] ){
+
+            uint8_t *held = rx_held[rx_seq % WIFI_COMM_WINDOW];
+            wifi_data_header_t *held_header = (wifi_data_header_t *)held;
+
+            rx_held_valid[rx_seq % WIFI_COMM_WINDOW] = false;
+
+            intf_v_receive_msg( held_header->data_id, held + sizeof(wifi_data_header_t), held_header->len );
+            rx_seq++;
+        }
+    }
+    else if( offset < WIFI_COMM_WINDOW ){
+
+        uint8_t *held = rx_held[header->msg_id % WIFI_COMM_WINDOW];
+
+        memcpy( held, header, sizeof(wifi_data_header_t) );
+        memcpy( held + sizeof(wifi_data_header_t), data, header->len );
+
+        rx_held_valid[header->msg_id % WIFI_COMM_WINDOW] = true;
+
+        send_nak = true;
+    }
+    // otherwise this is a resend of a frame that was already delivered,
+    // the ack must have been lost.
+
+    send_ack = true;
+}
+
+// run one step of the receive state machine.
+// returns true if there may be more to do.
+static bool process_rx( void ){
+
+    if( ( intf_comm_state != COMM_STATE_IDLE ) &&
+        ( elapsed( comm_timeout ) > 20000 ) ){
+
+        // reset comm state
+        intf_comm_state = COMM_STATE_IDLE;
+
+        comm_errors++;
+
+        send_nak = true;
+    }
+
+    if( intf_comm_state == COMM_STATE_IDLE ){    
+        
+        if( Serial.available() <= 0 ){
+
+            return false;
+        }
+
+        uint8_t c;
+        line_read( &c, sizeof(c) );
+
+        if( c == WIFI_COMM_RESET ){
+
+            intf_comm_state = COMM_STATE_RX_RESET;
+
+            comm_timeout = start_timeout();
+        }
+        else if( c == WIFI_COMM_DATA ){
+
+            intf_comm_state = COMM_STATE_RX_HEADER;
+
+            comm_timeout = start_timeout();
+        }
+        else if( c == WIFI_COMM_ACK ){
+
+            intf_comm_state = COMM_STATE_RX_ACK;
+
+            comm_timeout = start_timeout();
+        }
+
+        return true;
+    }
+    else if( intf_comm_state == COMM_STATE_RX_HEADER ){    
+        
+        if( Serial.available() < (int)sizeof(wifi_data_header_t) ){
+
+            return false;
+        }
+
+        line_read( (uint8_t *)&intf_data_header, sizeof(intf_data_header) );
+
+        if( intf_data_header.len > WIFI_MAX_DATA_LEN ){
+
+            comm_errors++;
+
+            send_nak = true;
+
+            intf_comm_state = COMM_STATE_IDLE;
+        }
+        else{
+
+            intf_comm_state = COMM_STATE_RX_DATA;
+        }
+
+        return true;
+    }    
+    else if( intf_comm_state == COMM_STATE_RX_DATA ){    
+
+        if( Serial.available() < intf_data_header.len ){
+
+            return false;
+        }
+
+        line_read( intf_comm_buf, intf_data_header.len );
+
+        // check crc
+        uint16_t msg_crc = intf_data_header.crc;
+        intf_data_header.crc = 0;
+        uint16_t crc = crc_u16_start();
+        crc = crc_u16_partial_block( crc, (uint8_t *)&intf_data_header, sizeof(intf_data_header) );
+        crc = crc_u16_partial_block( crc, intf_comm_buf, intf_data_header.len );
+        crc = crc_u16_finish( crc );
+
+        if( crc == msg_crc ){
+
+            receive_frame( &intf_data_header, intf_comm_buf );
+        }
+        else{
+
+            comm_errors++;
+
+            send_nak = true;
+        }
+
+        intf_comm_state = COMM_STATE_IDLE;
+
+        return true;
+    }
+    else if( intf_comm_state == COMM_STATE_RX_RESET ){    
+
+        if( Serial.available() < (int)sizeof(uint32_t) ){
+
+            return false;
+        }
+
+        uint32_t magic;
+        Serial.readBytes( (uint8_t *)&magic, sizeof(magic) );
+
+        intf_comm_state = COMM_STATE_IDLE;
+
+        if( magic != WIFI_COMM_RESET_MAGIC ){
+
+            comm_errors++;
+
+            return true;
+        }
+
+        if( connected == false ){
+            
+            connected = true;
+
+            irqline_v_enable();
+        }
+
+        // flush serial buffers and start the windows over
+        _intf_v_flush();
+        link_v_reset();
+
+        irqline_v_strobe_irq();
+
+        return true;
+    }
+    else if( intf_comm_state == COMM_STATE_RX_ACK ){    
+
+        if( Serial.available() < (int)sizeof(wifi_comm_ack_t) ){
+
+            return false;
+        }
+
+        line_read( (uint8_t *)&intf_ack, sizeof(intf_ack) );
+
+        uint16_t msg_crc = intf_ack.crc;
+        intf_ack.crc = 0;
+
+        if( crc_u16_block( (uint8_t *)&intf_ack, sizeof(intf_ack) ) == msg_crc ){
+
+            process_ack( &intf_ack );
+        }
+        else{
+
+            comm_errors++;
+        }
+
+        intf_comm_state = COMM_STATE_IDLE;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+void link_v_process( void ){
+
+    // the peer's flow control bounds how much can be waiting
+    while( process_rx() );
+
+    if( !connected ){
+
+        return;
+    }
+
+    // resend the oldest frame if it was not acked in time
+    if( tx_base != tx_seq ){
+
+        tx_frame_t *tx = &tx_frames[tx_base % WIFI_COMM_WINDOW];
+
+        if( ( ( millis() - tx->sent_ts ) > WIFI_COMM_RETRY_TIMEOUT ) &&
+            tx_credit( tx->len ) ){
+
+            tx->nak_resent = false;
+
+            send_frame( tx );
+        }
+    }
+
+    // ack received frames, and report freed buffer space
+    // so the peer's flow control limit keeps moving.
+    if( send_ack || send_nak || ack_due() ||
+        ( (uint16_t)( rx_total + LINK_RX_LIMIT_SPACE - rx_limit ) >= WIFI_COMM_LIMIT_UPDATE ) ){
+
+        send_ack_frame();
+    }
+}
+
+void link_v_init( void ){
+
+    link_v_reset();
+
+    // the receive buffer must cover the flow control limit we report
+    Serial.setRxBufferSize( LINK_RX_BUF_SIZE );
+    Serial.begin( 4000000 );
+
+    // flush serial buffers
+    _intf_v_flush();
+}
+
+uint16_t link_u16_get_comm_errors( void ){
+
+    return comm_errors;
+}
@@ -0,0 +1,41 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+#ifndef _COMM_LINK_H
+#define _COMM_LINK_H
+
+// serial receive buffer, it must cover the flow control limit we report
+#define LINK_RX_BUF_SIZE 1024
+
+void link_v_init( void );
+void link_v_reset( void );
+void link_v_process( void );
+bool link_b_connected( void );
+bool link_b_ready( void );
+int8_t link_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len );
+uint16_t link_u16_get_comm_errors( void );
+
+// provided by the interface
+void intf_v_link_reset( void );
+void intf_v_receive_msg( uint8_t data_id, uint8_t *data, uint16_t len );
+
+#endif
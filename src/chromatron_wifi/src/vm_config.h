@@ -29,4 +29,47 @@
 
 #define VM_MAX_IMAGE_SIZE   4096
 
+// frame budget watchdog.
+// if loop() runs longer than the frame interval, the runner skips
+// frames to catch up and runs the faders at a reduced rate until the
+// script is back on time.
+#define VM_ENABLE_FRAME_BUDGET
+
+#ifdef VM_ENABLE_FRAME_BUDGET
+// maximum fader rate divisor while overrunning
+#define VM_MAX_FADER_DIVISOR        4
+// consecutive on time frames before stepping the fader rate back up
+#define VM_BUDGET_RECOVER_FRAMES    32
+#endif
+
+// load programs into a staging slab and swap them in at a frame
+// boundary, without resetting the running instance.
+// the staging slab is allocated while a swap is loading.
+#define VM_ENABLE_HOT_SWAP
+
+#ifdef VM_ENABLE_HOT_SWAP
+// maximum number of published vars carried over to the new program
+#define VM_HOT_SWAP_MAX_CARRY       32
+#endif
+
+// per opcode and per function profiler.
+// results are sent to the main CPU as the vm_profile file.
+// #define VM_ENABLE_PROFILE
+
+#ifdef VM_ENABLE_PROFILE
+// CPU cycle counter
+static inline uint32_t vm_u32_get_ccount( void ){
+
+    uint32_t ccount;
+    __asm__ __volatile__( "rsr %0, ccount" : "=a"( ccount ) );
+
+    return ccount;
+}
+
+#define VM_PROFILE_TICKS() vm_u32_get_ccount()
+
+// frames between sending profile data
+#define VM_PROFILE_SEND_INTERVAL    100
+#endif
+
 #endif
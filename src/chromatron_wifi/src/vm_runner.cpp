@@ -25,6 +25,7 @@
 
 extern "C"{
     #include "vm_runner.h"
+    #include "vm_config.h"
     #include "vm_core.h"
     #include "gfx_lib.h"
     #include "list.h"
@@ -32,12 +33,41 @@ extern "C"{
     #include "kvdb.h"
 }
 
-static uint16_t vm_offset;
-static uint16_t vm_len;
-static uint8_t vm_slab[4096];
-static vm_state_t vm_state;
-
-static vm_info_t vm_info;
+// the frame budget and profiler paths are all behind vm_config.h
+// options, without it they silently compile out.
+#ifndef _VM_CONFIG_H
+#error "vm_runner.cpp requires vm_config.h"
+#endif
+
+typedef struct{
+    uint8_t *slab;
+    vm_state_t state;
+    vm_info_t info;
+    uint16_t offset;
+    uint16_t len;
+    uint16_t pix_index;
+    uint16_t pix_count;
+} vm_instance_t;
+
+// instance 0 is the base program, the others are overlays bound
+// to a sub range of the pixel strip.
+static vm_instance_t vms[VM_MAX_VMS];
+
+// the base instance always has a slab. overlay and staging slabs
+// are allocated when a program is selected into them.
+static uint8_t base_slab[VM_MAX_IMAGE_SIZE] __attribute__((aligned(4)));
+
+// instance receiving LOAD_VM data
+static uint8_t vm_select;
+
+#ifdef VM_ENABLE_HOT_SWAP
+// staging area for a program being hot swapped into vm_select
+static vm_instance_t vm_staging;
+static bool hot_swap;
+static bool swap_pending;
+#endif
+
+static uint16_t fader_time;
 
 static uint32_t fader_time_start;
 static uint32_t vm_time_start;
@@ -46,32 +76,184 @@ static uint32_t last_frame_sync;
 static bool run_vm;
 static bool run_faders;
 
+#ifdef VM_ENABLE_FRAME_BUDGET
+static uint8_t skip_frames;
+static uint8_t fader_ticks;
+static uint8_t on_time_frames;
+#endif
+
+static uint16_t overruns;
+static uint16_t skipped_frames;
+static uint16_t max_overrun;
+static uint8_t fader_divisor = 1;
+
 static list_t kv_send_list;
 
 
-static int8_t _vm_i8_run_vm( bool init ){
+#ifdef VM_ENABLE_FRAME_BUDGET
+static void _vm_v_set_fader_divisor( uint8_t divisor ){
+
+    fader_divisor = divisor;
+    fader_ticks = 0;
+
+    gfx_v_set_fader_rate( FADER_RATE * divisor );
+}
+
+static void _vm_v_reset_budget( void ){
+
+    skip_frames = 0;
+    on_time_frames = 0;
+
+    overruns = 0;
+    skipped_frames = 0;
+    max_overrun = 0;
+
+    _vm_v_set_fader_divisor( 1 );
+}
+
+// check frame time against the frame interval.
+// on an overrun, skip enough frames to get back on schedule and
+// halve the fader rate so the faders don't compete with the scripts.
+// the fader rate is restored in steps once the scripts keep up again.
+static void _vm_v_check_budget( uint32_t elapsed ){
+
+    uint32_t budget = (uint32_t)gfx_u16_get_vm_frame_rate() * 1000;
+
+    if( elapsed > budget ){
+
+        uint32_t overrun = elapsed - budget;
+
+        if( overruns < UINT16_MAX ){
+
+            overruns++;
+        }
+
+        if( overrun > max_overrun ){
+
+            if( overrun > UINT16_MAX ){
+
+                overrun = UINT16_MAX;
+            }
+
+            max_overrun = overrun;
+        }
+
+        uint32_t skip = elapsed / budget;
+
+        if( skip > UINT8_MAX ){
+
+            skip = UINT8_MAX;
+        }
+
+        skip_frames = skip;
+        on_time_frames = 0;
+
+        if( fader_divisor < VM_MAX_FADER_DIVISOR ){
+
+            _vm_v_set_fader_divisor( fader_divisor * 2 );
+        }
+    }
+    else if( fader_divisor > 1 ){
+
+        on_time_frames++;
+
+        if( on_time_frames >= VM_BUDGET_RECOVER_FRAMES ){
+
+            on_time_frames = 0;
+
+            _vm_v_set_fader_divisor( fader_divisor / 2 );
+        }
+    }
+}
+#endif
+
+static bool _vm_b_alloc_slab( vm_instance_t *vm ){
+
+    if( vm->slab == 0 ){
+
+        vm->slab = (uint8_t *)malloc( VM_MAX_IMAGE_SIZE );
+
+        if( vm->slab == 0 ){
+
+            return false;
+        }
+    }
+
+    memset( vm->slab, 0, VM_MAX_IMAGE_SIZE );
+
+    return true;
+}
+
+static void _vm_v_free_slab( vm_instance_t *vm ){
+
+    if( vm->slab != base_slab ){
+
+        free( vm->slab );
+    }
+
+    vm->slab = 0;
+}
+
+static bool _vm_b_is_running( vm_instance_t *vm ){
+
+    return ( vm->info.status == 0 ) && ( vm->info.return_code != VM_STATUS_HALT );
+}
+
+static void _vm_v_reset_instance( uint8_t vm_id ){
+
+    vm_instance_t *vm = &vms[vm_id];
+
+    vm->info.status = -127;
+    vm->info.return_code = -127;
+    vm->info.loop_time = 0;
+    vm->info.max_cycles = 0;
+    vm->info.vm_id = vm_id;
+
+    vm->offset = 0;
+    vm->len = 0;
+    vm->pix_index = 0;
+    vm->pix_count = 0;
+
+    if( vm_id == 0 ){
+
+        vm->slab = base_slab;
+        memset( vm->slab, 0, VM_MAX_IMAGE_SIZE );
+    }
+    else{
+
+        _vm_v_free_slab( vm );
+    }
+
+    kvdb_v_delete_tag( KVDB_VM_RUNNER_TAG + vm_id );
+}
+
+static int8_t _vm_i8_run_vm( uint8_t vm_id, bool init ){
+
+    vm_instance_t *vm = &vms[vm_id];
+    uint8_t *vm_slab = vm->slab;
+    vm_state_t *vm_state = &vm->state;
 
     // check that VM was loaded with no errors
-    if( vm_info.status < 0 ){
+    if( vm->info.status < 0 ){
 
         return -20;
     }
 
     // check that VM has not halted:
-    if( vm_info.return_code == VM_STATUS_HALT ){
+    if( vm->info.return_code == VM_STATUS_HALT ){
 
         return 0;
     }
 
-    int32_t *data_table = (int32_t *)&vm_slab[vm_state.data_start];
+    int32_t *data_table = (int32_t *)&vm_slab[vm_state->data_start];
 
     // init pixel array pointer
-    gfx_pixel_array_t *pix_array = (gfx_pixel_array_t *)( vm_slab + vm_state.pix_obj_start );
+    gfx_pixel_array_t *pix_array = (gfx_pixel_array_t *)( vm_slab + vm_state->pix_obj_start );
 
     // load published vars
-    vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+    vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state->publish_start];
 
-    uint32_t count = vm_state.publish_count;
+    uint32_t count = vm_state->publish_count;
 
     while( count > 0 ){
 
@@ -85,16 +267,20 @@ static int8_t _vm_i8_run_vm( bool init ){
 
     int8_t return_code;
 
+    gfx_v_set_partition( vm->pix_index, vm->pix_count );
+
     if( init ){
 
         // gfx_v_reset();
-        gfx_v_init_pixel_arrays( pix_array, vm_state.pix_obj_count );
+        gfx_v_init_pixel_arrays( pix_array, vm_state->pix_obj_count );
 
-        return_code = vm_i8_run_init( vm_slab, &vm_state );
+        return_code = vm_i8_run_init( vm_slab, vm_state );
     }
     else{
 
-        return_code = vm_i8_run_loop( vm_slab, &vm_state );
+        gfx_v_set_pixel_arrays( pix_array, vm_state->pix_obj_count );
+
+        return_code = vm_i8_run_loop( vm_slab, vm_state );
     }
 
     // if return is anything other than OK, send status immediately
@@ -115,20 +301,17 @@ static int8_t _vm_i8_run_vm( bool init ){
         elapsed = UINT32_MAX - ( start_time - end_time );
     }
 
-    vm_info.loop_time = elapsed;
-    vm_info.max_cycles = vm_state.max_cycles;
-    vm_info.return_code = return_code;
+    vm->info.loop_time = elapsed;
+    vm->info.max_cycles = vm_state->max_cycles;
+    vm->info.return_code = return_code;
 
     wifi_msg_kv_batch_t batch;
     list_node_t ln = -1;
 
-    // reset send list
-    list_v_destroy( &kv_send_list );
-
     // store published vars back to DB
-    publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+    publish = (vm_publish_t *)&vm_slab[vm_state->publish_start];
 
-    count = vm_state.publish_count;
+    count = vm_state->publish_count;
 
     while( count > 0 ){
 
@@ -139,9 +322,9 @@ static int8_t _vm_i8_run_vm( bool init ){
     }
 
     // load published vars to messages for transport
-    publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+    publish = (vm_publish_t *)&vm_slab[vm_state->publish_start];
 
-    count = vm_state.publish_count;
+    count = vm_state->publish_count;
 
     while( count > 0 ){
 
@@ -173,8 +356,8 @@ static int8_t _vm_i8_run_vm( bool init ){
     }
 
     // load write keys from DB
-    count = vm_state.write_keys_count;
-    uint32_t *hash = (uint32_t *)&vm_slab[vm_state.write_keys_start];
+    count = vm_state->write_keys_count;
+    uint32_t *hash = (uint32_t *)&vm_slab[vm_state->write_keys_start];
 
     while( count > 0 ){
 
@@ -216,6 +399,13 @@ end:
 }
 
 
+// network time is sent from the main CPU with the read keys,
+// before each VM frame.
+static int32_t lib_network_time( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return kvdb_i32_read( __KV__net_time );
+}
+
 void vm_v_init( void ){
 
     vm_v_reset();
@@ -225,6 +415,8 @@ void vm_v_init( void ){
     gfxlib_v_init();
     gfx_v_reset();
 
+    gfx_i8_lib_register( __KV__network_time, lib_network_time, 0, 0 );
+
     list_v_init( &kv_send_list );
 }
 
@@ -242,10 +434,44 @@ void vm_v_process( void ){
 
     if( run_vm ){
 
-        vm_v_run_loop();
         run_vm = false;
+
+        #ifdef VM_ENABLE_FRAME_BUDGET
+        if( skip_frames > 0 ){
+
+            skip_frames--;
+
+            if( skipped_frames < UINT16_MAX ){
+
+                skipped_frames++;
+            }
+        }
+        else{
+
+            vm_v_run_loop();
+        }
+        #else
+        vm_v_run_loop();
+        #endif
     }
 
+    #ifdef VM_ENABLE_FRAME_BUDGET
+    // fader is run on every Nth fader tick while degraded
+    if( run_faders ){
+
+        fader_ticks++;
+
+        if( fader_ticks < fader_divisor ){
+
+            run_faders = false;
+        }
+        else{
+
+            fader_ticks = 0;
+        }
+    }
+    #endif
+
     if( run_faders ){
 
         uint32_t start = micros();
@@ -259,51 +485,268 @@ void vm_v_process( void ){
         // TODO this will have rollover issues
         uint32_t elapsed = micros() - start;
 
-        vm_info.fader_time = elapsed;
+        fader_time = elapsed;
 
         run_faders = false;
     }
 }
 
+// reset all instances
 void vm_v_reset( void ){
 
-    vm_info.status = -127;
-    vm_info.return_code = -127;
+    for( uint8_t i = 0; i < VM_MAX_VMS; i++ ){
+
+        _vm_v_reset_instance( i );
+    }
+
+    vm_select = 0;
+
+    #ifdef VM_ENABLE_HOT_SWAP
+    hot_swap = false;
+    swap_pending = false;
+    _vm_v_free_slab( &vm_staging );
+    #endif
+
+    #ifdef VM_ENABLE_FRAME_BUDGET
+    _vm_v_reset_budget();
+    #endif
+}
+
+// reset one instance and direct the next load to it.
+// with hot swap, the instance keeps running and the program is
+// loaded into the staging slab instead.
+int8_t vm_i8_select( uint8_t vm_id, uint8_t flags, uint16_t pix_index, uint16_t pix_count ){
+
+    if( vm_id >= VM_MAX_VMS ){
+
+        return -1;
+    }
+
+    vm_select = vm_id;
+
+    #ifdef VM_ENABLE_HOT_SWAP
+    swap_pending = false;
+    hot_swap = ( flags & WIFI_SELECT_VM_FLAGS_HOT_SWAP ) != 0;
+
+    // nothing to swap with, do a normal load
+    if( hot_swap && !_vm_b_is_running( &vms[vm_id] ) ){
+
+        hot_swap = false;
+    }
+
+    // no room to stage, do a normal load
+    if( hot_swap && !_vm_b_alloc_slab( &vm_staging ) ){
+
+        intf_v_printf( "VM hot swap: no memory" );
+
+        hot_swap = false;
+    }
+
+    if( hot_swap ){
+
+        vm_staging.info.status = -127;
+        vm_staging.info.return_code = -127;
+        vm_staging.info.vm_id = vm_id;
+        vm_staging.offset = 0;
+        vm_staging.len = 0;
+        vm_staging.pix_index = pix_index;
+        vm_staging.pix_count = pix_count;
+
+        return 0;
+    }
+    #endif
+
+    _vm_v_reset_instance( vm_id );
+
+    vms[vm_id].pix_index = pix_index;
+    vms[vm_id].pix_count = pix_count;
+
+    if( !_vm_b_alloc_slab( &vms[vm_id] ) ){
+
+        intf_v_printf( "VM %d: no memory", vm_id );
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static void _vm_v_init_keys( uint8_t vm_id ){
+
+    vm_instance_t *vm = &vms[vm_id];
+    uint8_t *vm_slab = vm->slab;
+    vm_state_t *vm_state = &vm->state;
+    uint8_t tag = KVDB_VM_RUNNER_TAG + vm_id;
+
+    kvdb_v_delete_tag( tag );
 
-    vm_offset = 0;
-    vm_len = 0;
-    memset( vm_slab, 0, sizeof(vm_slab) );
+    uint32_t count = vm_state->write_keys_count;
+    uint32_t *hash = (uint32_t *)&vm_slab[vm_state->write_keys_start];
 
+    while( count > 0 ){        
+
+        kvdb_i8_add( *hash, 0, tag, 0 );
+
+        hash++;
+        count--;
+    }
+
+    count = vm_state->read_keys_count;
+    hash = (uint32_t *)&vm_slab[vm_state->read_keys_start];
+
+    while( count > 0 ){        
+
+        kvdb_i8_add( *hash, 0, tag, 0 );
+
+        hash++;
+        count--;
+    }
+
+    count = vm_state->publish_count;
+    vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state->publish_start];
+
+    while( count > 0 ){        
+
+        kvdb_i8_add( publish->hash, 0, tag, 0 );
+
+        publish++;
+        count--;
+    }
+}
+
+#ifdef VM_ENABLE_HOT_SWAP
+typedef struct{
+    uint8_t addr;
+    int32_t data;
+} vm_carry_t;
+
+// replace a running instance with the staged program.
+// published vars with matching names keep their values, and the
+// frame number and RNG carry over so synced nodes stay in step.
+// the pixel and fader state is not touched, the new init() runs
+// against the live pixels.
+static void _vm_v_hot_swap( void ){
+
+    swap_pending = false;
+
+    vm_instance_t *vm = &vms[vm_select];
+    vm_state_t *old_state = &vm->state;
+    vm_state_t *new_state = &vm_staging.state;
+
+    vm_carry_t carry[VM_HOT_SWAP_MAX_CARRY];
+    uint8_t carry_count = 0;
+
+    int32_t *old_data = (int32_t *)&vm->slab[old_state->data_start];
+    vm_publish_t *new_publish = (vm_publish_t *)&vm_staging.slab[new_state->publish_start];
+
+    for( uint32_t i = 0; i < new_state->publish_count; i++ ){
+
+        vm_publish_t *old_publish = (vm_publish_t *)&vm->slab[old_state->publish_start];
+
+        for( uint32_t j = 0; j < old_state->publish_count; j++ ){
+
+            if( old_publish[j].hash != new_publish[i].hash ){
+
+                continue;
+            }
+
+            if( carry_count < VM_HOT_SWAP_MAX_CARRY ){
+
+                carry[carry_count].addr = new_publish[i].addr;
+                carry[carry_count].data = old_data[old_publish[j].addr];
+                carry_count++;
+            }
+
+            break;
+        }
+    }
+
+    uint16_t frame_number = old_state->frame_number;
+    uint64_t rng_seed = old_state->rng_seed;
+
+    memcpy( vm->slab, vm_staging.slab, vm_staging.len );
+    memset( &vm->slab[vm_staging.len], 0, VM_MAX_IMAGE_SIZE - vm_staging.len );
+
+    _vm_v_free_slab( &vm_staging );
+
+    vm->state = *new_state;
+    vm->state.frame_number = frame_number;
+    vm->state.rng_seed = rng_seed;
+
+    vm->offset = vm_staging.offset;
+    vm->len = vm_staging.len;
+    vm->pix_index = vm_staging.pix_index;
+    vm->pix_count = vm_staging.pix_count;
+
+    vm->info.status = 0;
+    vm->info.return_code = -127;
+
+    _vm_v_init_keys( vm_select );
+
+    _vm_i8_run_vm( vm_select, true );
+
+    // restore carried values after init, so they win over initializers
+    int32_t *data_table = (int32_t *)&vm->slab[vm->state.data_start];
+    vm_publish_t *publish = (vm_publish_t *)&vm->slab[vm->state.publish_start];
+
+    for( uint8_t i = 0; i < carry_count; i++ ){
+
+        data_table[carry[i].addr] = carry[i].data;
+    }
+
+    for( uint32_t i = 0; i < vm->state.publish_count; i++ ){
+
+        kvdb_i8_set( publish[i].hash, data_table[publish[i].addr] );
+    }
 }
+#endif
 
 int8_t vm_i8_load( uint8_t *data, uint16_t len ){
 
+    vm_instance_t *vm = &vms[vm_select];
+
+    #ifdef VM_ENABLE_HOT_SWAP
+    if( hot_swap ){
+
+        vm = &vm_staging;
+    }
+    #endif
+
+    uint8_t *vm_slab = vm->slab;
+    vm_state_t *vm_state = &vm->state;
+
     // reset status codes
-    vm_info.status = -127;
-    vm_info.return_code = -127;
+    vm->info.status = -127;
+    vm->info.return_code = -127;
 
     int8_t status = 0;
 
-    if( ( len + vm_offset ) > sizeof(vm_slab) ){
+    // select failed to allocate a slab
+    if( vm_slab == 0 ){
 
-        vm_info.status = VM_STATUS_IMAGE_TOO_LARGE;
         return -1;
     }
 
-    memcpy( &vm_slab[vm_offset], data, len );
-    vm_offset += len;
-    vm_len += len;
+    if( ( len + vm->offset ) > VM_MAX_IMAGE_SIZE ){
+
+        vm->info.status = VM_STATUS_IMAGE_TOO_LARGE;
+        return -1;
+    }
+
+    memcpy( &vm_slab[vm->offset], data, len );
+    vm->offset += len;
+    vm->len += len;
 
     // length of 0 indicates loading is finished
     if( len == 0 ){
 
-        vm_state.prog_size = vm_len;
+        vm_state->prog_size = vm->len;
 
-        status = vm_i8_load_program( 0, vm_slab, vm_len, &vm_state );
+        status = vm_i8_load_program( 0, vm_slab, vm->len, vm_state );
 
         uint8_t *ptr = vm_slab;
-        uint8_t *code_start = (uint8_t *)( ptr + vm_state.code_start );
-        int32_t *data_start = (int32_t *)( ptr + vm_state.data_start );
+        uint8_t *code_start = (uint8_t *)( ptr + vm_state->code_start );
+        int32_t *data_start = (int32_t *)( ptr + vm_state->data_start );
 
         // check that code pointer starts on 32 bit boundary
         if( ( (uint32_t)code_start & 0x03 ) != 0 ){
@@ -317,7 +760,29 @@ int8_t vm_i8_load( uint8_t *data, uint16_t len ){
             status = VM_STATUS_DATA_MISALIGN;
         }
 
-        vm_info.status = status;
+        vm->info.status = status;
+
+        #ifdef VM_ENABLE_HOT_SWAP
+        if( hot_swap ){
+
+            hot_swap = false;
+
+            if( status < 0 ){
+
+                // the running program is kept
+                intf_v_printf( "VM hot swap failed: %d", status );
+
+                _vm_v_free_slab( &vm_staging );
+
+                return status;
+            }
+
+            // swap on the next frame
+            swap_pending = true;
+
+            return 0;
+        }
+        #endif
 
         if( status < 0 ){
 
@@ -334,78 +799,103 @@ int8_t vm_i8_load( uint8_t *data, uint16_t len ){
             rng_seed = 1;
         }
 
-        vm_state.rng_seed = rng_seed;
+        // give each instance its own random sequence
+        rng_seed += vm_select;
+
+        vm_state->rng_seed = rng_seed;
 
         // init database
-        kvdb_v_delete_tag( KVDB_VM_RUNNER_TAG );
+        _vm_v_init_keys( vm_select );
 
-        uint32_t count = vm_state.write_keys_count;
-        uint32_t *hash = (uint32_t *)&vm_slab[vm_state.write_keys_start];
-    
-        while( count > 0 ){        
+        status = _vm_i8_run_vm( vm_select, true );
+    }
 
-            kvdb_i8_add( *hash, 0, KVDB_VM_RUNNER_TAG, 0 );
+    return status;
+}
 
-            hash++;
-            count--;
-        }
+// run each loaded instance once, in order, within the frame
+void vm_v_run_loop( void ){
 
-        count = vm_state.read_keys_count;
-        hash = (uint32_t *)&vm_slab[vm_state.read_keys_start];
-    
-        while( count > 0 ){        
+    // reset send list
+    list_v_destroy( &kv_send_list );
 
-            kvdb_i8_add( *hash, 0, KVDB_VM_RUNNER_TAG, 0 );
+    #ifdef VM_ENABLE_HOT_SWAP
+    if( swap_pending ){
 
-            hash++;
-            count--;
-        }
+        _vm_v_hot_swap();
+    }
+    #endif
 
-        count = vm_state.publish_count;
-        vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
-    
-        while( count > 0 ){        
+    uint32_t frame_time = 0;
 
-            kvdb_i8_add( publish->hash, 0, KVDB_VM_RUNNER_TAG, 0 );
+    for( uint8_t i = 0; i < VM_MAX_VMS; i++ ){
 
-            publish++;
-            count--;
+        if( !_vm_b_is_running( &vms[i] ) ){
+
+            continue;
         }
 
-        status = _vm_i8_run_vm( true );
+        _vm_i8_run_vm( i, false );
+
+        frame_time += vms[i].info.loop_time;
     }
 
-    return status;
-}
+    #ifdef VM_ENABLE_FRAME_BUDGET
+    _vm_v_check_budget( frame_time );
+    #endif
 
-void vm_v_run_loop( void ){
+    #ifdef VM_ENABLE_PROFILE
+    if( ( vms[0].state.frame_number % VM_PROFILE_SEND_INTERVAL ) == 0 ){
 
-    int8_t status = _vm_i8_run_vm( false );    
+        intf_v_request_vm_profile();
+    }
+    #endif
 }
 
+// register access and frame sync apply to the base instance
 int32_t vm_i32_get_reg( uint8_t addr ){
 
-    if( vm_info.status < 0 ){
+    if( vms[0].info.status < 0 ){
 
         return 0;
     }
 
-    return vm_i32_get_data( vm_slab, &vm_state, addr );
+    return vm_i32_get_data( vms[0].slab, &vms[0].state, addr );
 }
 
 void vm_v_set_reg( uint8_t addr, int32_t data ){
 
-    if( vm_info.status < 0 ){
+    if( vms[0].info.status < 0 ){
 
         return;
     }
 
-    vm_v_set_data( vm_slab, &vm_state, addr, data );
+    vm_v_set_data( vms[0].slab, &vms[0].state, addr, data );
 }
 
-void vm_v_get_info( vm_info_t *info ){
+// returns -1 if the instance is not loaded.
+// instance 0 is always reported.
+int8_t vm_i8_get_info( uint8_t vm_id, vm_info_t *info ){
+
+    if( vm_id >= VM_MAX_VMS ){
+
+        return -1;
+    }
 
-    *info = vm_info;
+    if( ( vm_id > 0 ) && ( vms[vm_id].len == 0 ) ){
+
+        return -1;
+    }
+
+    *info = vms[vm_id].info;
+
+    info->fader_time        = fader_time;
+    info->overruns          = overruns;
+    info->skipped_frames    = skipped_frames;
+    info->max_overrun       = max_overrun;
+    info->fader_divisor     = fader_divisor;
+
+    return 0;
 }
 
 int8_t vm_i8_get_frame_sync( uint8_t index, wifi_msg_vm_frame_sync_t *sync ){
@@ -415,51 +905,124 @@ int8_t vm_i8_get_frame_sync( uint8_t index, wifi_msg_vm_frame_sync_t *sync ){
         return -1;
     }
 
-    sync->frame_number  = vm_state.frame_number;
-    sync->rng_seed      = vm_state.rng_seed;
+    sync->frame_number  = vms[0].state.frame_number;
+    sync->rng_seed      = vms[0].state.rng_seed;
 
     // for now, we only send one chunk of register data
     sync->data_index    = 0;
-    sync->data_count    = vm_state.data_count;
+    sync->data_count    = vms[0].state.data_count;
 
     if( sync->data_count > WIFI_DATA_FRAME_SYNC_MAX_DATA ){
 
         sync->data_count = WIFI_DATA_FRAME_SYNC_MAX_DATA;
     }
 
-    vm_v_get_data_multi( vm_slab, &vm_state, sync->data_index, sync->data_count, sync->data );
+    vm_v_get_data_multi( vms[0].slab, &vms[0].state, sync->data_index, sync->data_count, sync->data );
 
     return 0;
 }
 
 
+// profile entries are sent in chunks, opcodes first, then functions.
+// only opcodes that have run are sent.
+int8_t vm_i8_get_profile( uint8_t index, wifi_msg_vm_profile_t *msg ){
+
+    msg->index = index;
+    msg->count = 0;
+
+    #ifdef VM_ENABLE_PROFILE
+    uint16_t skip = (uint16_t)index * WIFI_VM_PROFILE_ENTRIES;
+
+    vm_profile_t profile;
+
+    for( uint16_t i = 0; vm_i8_get_opcode_profile( i, &profile ) == 0; i++ ){
+
+        if( profile.count == 0 ){
+
+            continue;
+        }
+
+        if( skip > 0 ){
+
+            skip--;
+            continue;
+        }
+
+        if( msg->count >= WIFI_VM_PROFILE_ENTRIES ){
+
+            return 0;
+        }
+
+        wifi_vm_profile_entry_t *entry = &msg->entries[msg->count];
+        entry->type     = WIFI_VM_PROFILE_TYPE_OPCODE;
+        entry->id       = i;
+        entry->count    = profile.count;
+        entry->ticks    = profile.ticks;
+
+        msg->count++;
+    }
+
+    vm_func_profile_t func;
+
+    for( uint8_t i = 0; vm_i8_get_func_profile( i, &func ) == 0; i++ ){
+
+        if( skip > 0 ){
+
+            skip--;
+            continue;
+        }
+
+        if( msg->count >= WIFI_VM_PROFILE_ENTRIES ){
+
+            return 0;
+        }
+
+        wifi_vm_profile_entry_t *entry = &msg->entries[msg->count];
+        entry->type     = WIFI_VM_PROFILE_TYPE_FUNC;
+        entry->id       = func.addr;
+        entry->count    = func.calls;
+        entry->ticks    = func.ticks;
+
+        msg->count++;
+    }
+    #endif
+
+    // always send the first message, so the receiver clears old data
+    if( ( msg->count == 0 ) && ( index > 0 ) ){
+
+        return -1;
+    }
+
+    return 0;
+}
+
 uint8_t vm_u8_set_frame_sync( wifi_msg_vm_frame_sync_t *sync ){
 
     uint8_t status = 0;
 
-    int32_t frame_diff = (int32_t)vm_state.frame_number - (int32_t)sync->frame_number;
+    int32_t frame_diff = (int32_t)vms[0].state.frame_number - (int32_t)sync->frame_number;
 
     if( ( frame_diff > 1 ) || ( frame_diff < -1 ) ){
 
         status |= 0x80;
     }
 
-    if( vm_state.frame_number > sync->frame_number ){
+    if( vms[0].state.frame_number > sync->frame_number ){
 
         status |= 0x40;
 
-        vm_state.frame_number   = sync->frame_number;
+        vms[0].state.frame_number   = sync->frame_number;
     }
-    else if( vm_state.frame_number < sync->frame_number ){
+    else if( vms[0].state.frame_number < sync->frame_number ){
 
         status |= 0x20;
 
-        vm_state.frame_number   = sync->frame_number;
+        vms[0].state.frame_number   = sync->frame_number;
     }
 
-    if( vm_state.rng_seed != sync->rng_seed ){
+    if( vms[0].state.rng_seed != sync->rng_seed ){
 
-        vm_state.rng_seed       = sync->rng_seed;
+        vms[0].state.rng_seed       = sync->rng_seed;
         status |= 0x01;   
     }
 
@@ -477,7 +1040,7 @@ uint8_t vm_u8_set_frame_sync( wifi_msg_vm_frame_sync_t *sync ){
 
 uint16_t vm_u16_get_frame_number( void ){
 
-    return vm_state.frame_number;
+    return vms[0].state.frame_number;
 }
 
 void vm_v_get_send_list( list_t **list ){
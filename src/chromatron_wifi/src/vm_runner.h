@@ -28,6 +28,7 @@
 #include "vm_core.h"
 #include "wifi_cmd.h"
 
+// each VM instance uses KVDB_VM_RUNNER_TAG + instance
 #define KVDB_VM_RUNNER_TAG      70
 
 void vm_v_init( void );
@@ -36,11 +37,13 @@ void vm_v_run_vm( void );
 void vm_v_process( void );
 
 void vm_v_reset( void );
+int8_t vm_i8_select( uint8_t vm_id, uint8_t flags, uint16_t pix_index, uint16_t pix_count );
 int8_t vm_i8_load( uint8_t *data, uint16_t len );
 void vm_v_request( void );
-void vm_v_get_info( vm_info_t *info );
+int8_t vm_i8_get_info( uint8_t vm_id, vm_info_t *info );
 int8_t vm_i8_get_frame_sync( uint8_t index, wifi_msg_vm_frame_sync_t *sync );
 uint8_t vm_u8_set_frame_sync( wifi_msg_vm_frame_sync_t *sync );
+int8_t vm_i8_get_profile( uint8_t index, wifi_msg_vm_profile_t *msg );
 uint16_t vm_u16_get_frame_number( void );
 void vm_v_run_loop( void );
 int32_t vm_i32_get_reg( uint8_t addr );
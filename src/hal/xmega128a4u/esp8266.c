@@ -61,6 +61,7 @@ theoretical fastest speed for a 576 byte packet is 1.44 ms.
 #include "hal_status_led.h"
 #include "hal_dma.h"
 #include "hash.h"
+#include "wifi_link.h"
 
 // #define NO_LOGGING
 #include "logging.h"
@@ -79,17 +80,13 @@ theoretical fastest speed for a 576 byte packet is 1.44 ms.
 #define WIFI_USART_TIMEOUT 20000
 #define WIFI_CONNECT_TIMEOUT 10000
 
-#define WIFI_UART_RX_BUF_SIZE   WIFI_MAIN_BUF_LEN
-
-static uint8_t rx_buf[WIFI_UART_RX_BUF_SIZE];
-
-
 static uint16_t ports[WIFI_MAX_PORTS];
 static bool run_manager;
 
 #define WIFI_RESET_DELAY_MS     20
 
-static volatile bool wifi_rx_ready;
+// set when the ESP answers a comm reset
+static volatile bool wifi_reset_ready;
 
 static int8_t wifi_status;
 static uint8_t wifi_mac[6];
@@ -118,8 +115,6 @@ static uint16_t mem_max_time;
 
 static uint16_t wifi_version;
 
-static uint8_t next_msg_id;
-
 static netmsg_t rx_netmsg;
 static uint16_t rx_netmsg_index;
 static uint16_t rx_netmsg_crc;
@@ -216,11 +211,11 @@ static uint16_t dma_rx_bytes( void ){
     ATOMIC;
     if( ( DMA.INTFLAGS & WIFI_DMA_CHTRNIF ) != 0 ){
 
-        len = sizeof(rx_buf);
+        len = sizeof(wifi_link_rx_buf);
     }
     else{
 
-        len = sizeof(rx_buf) - DMA.WIFI_DMA_CH.TRFCNT;
+        len = sizeof(wifi_link_rx_buf) - DMA.WIFI_DMA_CH.TRFCNT;
     }
     END_ATOMIC;
 
@@ -235,7 +230,9 @@ static void disable_rx_dma( void ){
     END_ATOMIC;
 }
 
-static void enable_rx_dma( void ){
+// ring mode repeats the block forever, wrapping to the start of wifi_link_rx_buf.
+// otherwise the transfer stops when wifi_link_rx_buf is full.
+static void _enable_rx_dma( bool ring ){
 
     ATOMIC;
 
@@ -246,24 +243,43 @@ static void enable_rx_dma( void ){
 
     DMA.INTFLAGS = WIFI_DMA_CHTRNIF | WIFI_DMA_CHERRIF; // clear transaction complete interrupt
 
-    DMA.WIFI_DMA_CH.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
-    DMA.WIFI_DMA_CH.REPCNT = 0;
-    DMA.WIFI_DMA_CH.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc;
+    if( ring ){
+
+        DMA.WIFI_DMA_CH.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc | DMA_CH_REPEAT_bm;
+        DMA.WIFI_DMA_CH.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_BLOCK_gc | DMA_CH_DESTDIR_INC_gc;
+    }
+    else{
+
+        DMA.WIFI_DMA_CH.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+        DMA.WIFI_DMA_CH.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc;
+    }
+
+    DMA.WIFI_DMA_CH.REPCNT = 0; // unlimited repeats in ring mode
     DMA.WIFI_DMA_CH.TRIGSRC = WIFI_USART_DMA_TRIG;
-    DMA.WIFI_DMA_CH.TRFCNT = sizeof(rx_buf);
+    DMA.WIFI_DMA_CH.TRFCNT = sizeof(wifi_link_rx_buf);
 
     DMA.WIFI_DMA_CH.SRCADDR0 = ( ( (uint16_t)&WIFI_USART.DATA ) >> 0 ) & 0xFF;
     DMA.WIFI_DMA_CH.SRCADDR1 = ( ( (uint16_t)&WIFI_USART.DATA ) >> 8 ) & 0xFF;
     DMA.WIFI_DMA_CH.SRCADDR2 = 0;
 
-    DMA.WIFI_DMA_CH.DESTADDR0 = ( ( (uint16_t)rx_buf ) >> 0 ) & 0xFF;
-    DMA.WIFI_DMA_CH.DESTADDR1 = ( ( (uint16_t)rx_buf ) >> 8 ) & 0xFF;
+    DMA.WIFI_DMA_CH.DESTADDR0 = ( ( (uint16_t)wifi_link_rx_buf ) >> 0 ) & 0xFF;
+    DMA.WIFI_DMA_CH.DESTADDR1 = ( ( (uint16_t)wifi_link_rx_buf ) >> 8 ) & 0xFF;
     DMA.WIFI_DMA_CH.DESTADDR2 = 0;
 
     DMA.WIFI_DMA_CH.CTRLA |= DMA_CH_ENABLE_bm;
     END_ATOMIC;
 }
 
+static void enable_rx_dma( void ){
+
+    _enable_rx_dma( FALSE );
+}
+
+static void enable_rx_ring( void ){
+
+    _enable_rx_dma( TRUE );
+}
+
 
 static void disable_irq( void ){
 
@@ -398,60 +414,55 @@ static void _wifi_v_enter_normal_mode( void ){
 }
 
 
-static void wifi_v_reset_rx_buffer( void ){
-
-    disable_rx_dma();
-
-    rx_buf[0] = WIFI_COMM_IDLE;
+// ring position the DMA will write next
+uint16_t wifi_u16_rx_dma_pos( void ){
 
-    // set up DMA
-    enable_rx_dma();
-}
+    uint16_t count;
 
-static void wifi_v_reset_comm( void ){
+    ATOMIC;
+    count = DMA.WIFI_DMA_CH.TRFCNT;
+    END_ATOMIC;
 
-    wifi_v_reset_rx_buffer();
-    _wifi_v_usart_send_char( WIFI_COMM_RESET );   
-}
+    // count reads 0 between the last byte of a block and the reload
+    if( ( count == 0 ) || ( count > sizeof(wifi_link_rx_buf) ) ){
 
-static void wifi_v_set_rx_ready( void ){
-        
-    wifi_v_reset_rx_buffer();
+        return 0;
+    }
 
-    WIFI_USART_XCK_PORT.OUTCLR = ( 1 << WIFI_USART_XCK_PIN );
-    _delay_us( 10 );
-    WIFI_USART_XCK_PORT.OUTSET = ( 1 << WIFI_USART_XCK_PIN );
+    return sizeof(wifi_link_rx_buf) - count;
 }
 
-static uint8_t wifi_u8_get_control_byte( void ){
+void wifi_v_line_write( uint8_t *data, uint16_t len ){
 
-    return rx_buf[0];
+    _wifi_v_usart_send_data( data, len );
 }
 
-static int8_t wifi_i8_rx_data_received( void ){
-
-    if( wifi_u8_get_control_byte() == WIFI_COMM_IDLE ){
+static void wifi_v_reset_comm( void ){
 
-        return -1;
-    }
+    ATOMIC;
+    wifi_reset_ready = FALSE;
+    END_ATOMIC;
 
-    wifi_data_header_t *header = (wifi_data_header_t *)&rx_buf[1];
+    disable_rx_dma();
 
-    if( dma_rx_bytes() >= ( 1 + sizeof(wifi_data_header_t) + header->len ) ){
+    wifi_link_v_reset();
 
-        return 0;
-    }
+    enable_rx_ring();
 
-    return -2;
+    // the reset is not part of the flow control count
+    uint32_t magic = WIFI_COMM_RESET_MAGIC;
+    _wifi_v_usart_send_char( WIFI_COMM_RESET );   
+    _wifi_v_usart_send_data( (uint8_t *)&magic, sizeof(magic) );
 }
 
 bool wifi_b_comm_ready( void ){
 
-    ATOMIC;
-    bool temp = wifi_rx_ready;
-    END_ATOMIC;
+    if( !wifi_b_attached() ){
+
+        return FALSE;
+    }
 
-    return temp;
+    return wifi_link_b_tx_ready();
 }
 
 // waits up to WIFI_USART_TIMEOUT microseconds for comm to be ready
@@ -459,7 +470,11 @@ bool wifi_b_wait_comm_ready( void ){
     
     uint32_t timeout = tmr_u32_get_system_time_us();
 
-    SAFE_BUSY_WAIT( ( tmr_u32_elapsed_time_us( timeout ) < WIFI_USART_TIMEOUT ) && !wifi_b_comm_ready() );
+    while( ( tmr_u32_elapsed_time_us( timeout ) < WIFI_USART_TIMEOUT ) && !wifi_b_comm_ready() ){
+
+        // the comm thread can't run while we wait here
+        wifi_link_v_poll_tx();
+    }
 
     return wifi_b_comm_ready();
 }
@@ -476,29 +491,10 @@ int8_t wifi_i8_send_msg( uint8_t data_id, uint8_t *data, uint8_t len ){
         return -1;  
     }
 
-    next_msg_id++;
+    if( wifi_link_i8_send( data_id, data, len ) < 0 ){
 
-    uint16_t crc = crc_u16_start();
-
-    wifi_data_header_t header;
-    header.msg_id   = next_msg_id;
-    header.len      = len;
-    header.data_id  = data_id;
-    header.crc      = 0;
-    crc = crc_u16_partial_block( crc, (uint8_t *)&header, sizeof(header) );    
-
-    crc = crc_u16_partial_block( crc, data, len );
-
-    header.crc = crc_u16_finish( crc );
-
-
-    ATOMIC;
-    wifi_rx_ready = FALSE;
-    END_ATOMIC;
-
-    _wifi_v_usart_send_char( WIFI_COMM_DATA );
-    _wifi_v_usart_send_data( (uint8_t *)&header, sizeof(header) );
-    _wifi_v_usart_send_data( data, len );
+        return -2;
+    }
 
     return 0;
 }
@@ -518,59 +514,6 @@ int8_t wifi_i8_send_msg_blocking( uint8_t data_id, uint8_t *data, uint8_t len ){
     return 0;
 }
 
-int8_t wifi_i8_send_msg_response( 
-    uint8_t data_id, 
-    uint8_t *data, 
-    uint8_t len,
-    uint8_t *response,
-    uint8_t response_len ){
-
-    int8_t status = 0;
-
-    uint32_t timeout = tmr_u32_get_system_time_us();
-
-    SAFE_BUSY_WAIT( ( tmr_u32_elapsed_time_us( timeout ) < WIFI_USART_TIMEOUT ) && !wifi_b_comm_ready() );
-
-    if( wifi_i8_send_msg( data_id, data, len ) < 0 ){
-
-        status = -1;
-        goto end;
-    }
-
-    SAFE_BUSY_WAIT( ( tmr_u32_elapsed_time_us( timeout ) < WIFI_USART_TIMEOUT ) && ( wifi_i8_rx_data_received() < 0 ) );
-
-    if( wifi_i8_rx_data_received() < 0 ){
-
-        status = -2;
-        goto end;
-    }
-
-
-    wifi_data_header_t *header = (wifi_data_header_t *)&rx_buf[1];
-    uint8_t *response_data = (uint8_t *)( header + 1 );
-
-    if( crc_u16_block( response_data, header->len ) == header->crc ){
-
-        // bounds check
-        if( header->len < response_len ){
-
-            response_len = header->len;
-        }
-
-        memcpy( response, response_data, response_len );
-    }
-    else{
-
-        log_v_debug_P( PSTR("Wifi crc error") );
-        status = -3;
-    }
-
-end:
-    wifi_v_set_rx_ready();
-
-    return status;
-}
-
 void open_close_port( uint8_t protocol, uint16_t port, bool open ){
 
     if( protocol == IP_PROTO_UDP ){
@@ -886,11 +829,11 @@ int8_t esp_i8_wait_response( uint8_t *buf, uint8_t len, uint32_t timeout ){
     uint32_t start_time = tmr_u32_get_system_time_us();
 
     uint8_t next_byte = 0;
-    memset( rx_buf, 0xff, sizeof(rx_buf) );
+    memset( wifi_link_rx_buf, 0xff, sizeof(wifi_link_rx_buf) );
     enable_rx_dma();
 
     // waiting for frame start
-    while( rx_buf[next_byte] != SLIP_END ){
+    while( wifi_link_rx_buf[next_byte] != SLIP_END ){
 
         if( tmr_u32_elapsed_time_us( start_time ) > timeout ){
 
@@ -919,7 +862,7 @@ int8_t esp_i8_wait_response( uint8_t *buf, uint8_t len, uint32_t timeout ){
             }
         }
 
-        uint8_t b = rx_buf[next_byte];
+        uint8_t b = wifi_link_rx_buf[next_byte];
         next_byte++;
 
         if( b == SLIP_END ){
@@ -939,7 +882,7 @@ int8_t esp_i8_wait_response( uint8_t *buf, uint8_t len, uint32_t timeout ){
                 }
             }
 
-            b = rx_buf[next_byte];
+            b = wifi_link_rx_buf[next_byte];
             next_byte++;
 
             if( b == SLIP_ESC_END ){
@@ -973,7 +916,7 @@ end:
     if( status != 0 ){
 
         log_v_debug_P( PSTR("loader error: %d"), status );
-        log_v_debug_P( PSTR("%2x %2x %2x %2x %2x %2x %2x %2x"), rx_buf[0], rx_buf[1], rx_buf[2], rx_buf[3], rx_buf[4], rx_buf[5], rx_buf[6], rx_buf[7] );
+        log_v_debug_P( PSTR("%2x %2x %2x %2x %2x %2x %2x %2x"), wifi_link_rx_buf[0], wifi_link_rx_buf[1], wifi_link_rx_buf[2], wifi_link_rx_buf[3], wifi_link_rx_buf[4], wifi_link_rx_buf[5], wifi_link_rx_buf[6], wifi_link_rx_buf[7] );
     }
 
     disable_rx_dma();
@@ -1176,14 +1119,14 @@ int8_t esp_i8_load_flash( file_t file ){
         return -1;
     }
 
-    memset( (uint8_t *)rx_buf, 0xff, sizeof(rx_buf) );
+    memset( (uint8_t *)wifi_link_rx_buf, 0xff, sizeof(wifi_link_rx_buf) );
     enable_rx_dma();
 
-    // cast rx_buf to a volatile pointer.
+    // cast wifi_link_rx_buf to a volatile pointer.
     // otherwise, GCC will attempt to be clever and cache
-    // the first byte of rx_buf, which will cause
+    // the first byte of wifi_link_rx_buf, which will cause
     // the check for SLIP_END to fail.
-    volatile uint8_t *buf = rx_buf;
+    volatile uint8_t *buf = wifi_link_rx_buf;
 
     esp_write_flash_t cmd;
     cmd.addr = 0;
@@ -1222,7 +1165,7 @@ int8_t esp_i8_load_flash( file_t file ){
     }
 
     // This buffer eats a lot of stack.
-    // At some point we could rework this to use the rx_buf,
+    // At some point we could rework this to use the wifi_link_rx_buf,
     // or load the data in smaller chunks.
     uint8_t file_buf[256];
     int32_t len = 0;
@@ -1253,7 +1196,7 @@ int8_t esp_i8_load_flash( file_t file ){
 
         if( ( len % 1024 ) == 0 ){
 
-            memset( (uint8_t *)rx_buf, 0xff, sizeof(rx_buf) );
+            memset( (uint8_t *)wifi_link_rx_buf, 0xff, sizeof(wifi_link_rx_buf) );
             enable_rx_dma();
 
             for( uint8_t i = 0; i < 250; i++ ){
@@ -1286,7 +1229,7 @@ typedef struct{
 
 int8_t esp_i8_md5( uint32_t len, uint8_t digest[MD5_LEN] ){
 
-    memset( rx_buf, 0xff, sizeof(rx_buf) );
+    memset( wifi_link_rx_buf, 0xff, sizeof(wifi_link_rx_buf) );
     enable_rx_dma();
 
     esp_digest_t cmd;
@@ -1303,11 +1246,11 @@ int8_t esp_i8_md5( uint32_t len, uint8_t digest[MD5_LEN] ){
     slip_v_send_data( (uint8_t *)&cmd, sizeof(cmd) );
     _wifi_v_usart_send_char( SLIP_END );
 
-    // cast rx_buf to a volatile pointer.
+    // cast wifi_link_rx_buf to a volatile pointer.
     // otherwise, GCC will attempt to be clever and cache
-    // the first byte of rx_buf, which will cause
+    // the first byte of wifi_link_rx_buf, which will cause
     // the check for SLIP_END to fail.
-    volatile uint8_t *buf = rx_buf;
+    volatile uint8_t *buf = wifi_link_rx_buf;
 
     for( uint8_t i = 0; i < 250; i++ ){
 
@@ -1334,27 +1277,27 @@ int8_t esp_i8_md5( uint32_t len, uint8_t digest[MD5_LEN] ){
     uint8_t md5_idx = 0;
 
     // parse response
-    for( uint8_t i = 1; i < sizeof(rx_buf); i++ ){
+    for( uint16_t i = 1; i < sizeof(wifi_link_rx_buf); i++ ){
 
         if( md5_idx >= MD5_LEN ){
 
             break;
         }
 
-        if( rx_buf[i] == SLIP_END ){
+        if( wifi_link_rx_buf[i] == SLIP_END ){
 
             break;
         }
-        else if( rx_buf[i] == SLIP_ESC ){
+        else if( wifi_link_rx_buf[i] == SLIP_ESC ){
 
             i++;
 
-            if( rx_buf[i] == SLIP_ESC_END ){
+            if( wifi_link_rx_buf[i] == SLIP_ESC_END ){
 
                 digest[md5_idx] = SLIP_END;
                 md5_idx++;
             }
-            else if( rx_buf[i] == SLIP_ESC_ESC ){
+            else if( wifi_link_rx_buf[i] == SLIP_ESC_ESC ){
 
                 digest[md5_idx] = SLIP_ESC;
                 md5_idx++;
@@ -1362,7 +1305,7 @@ int8_t esp_i8_md5( uint32_t len, uint8_t digest[MD5_LEN] ){
         }
         else{
 
-            digest[md5_idx] = rx_buf[i];
+            digest[md5_idx] = wifi_link_rx_buf[i];
             md5_idx++;
         }
     }
@@ -1650,34 +1593,9 @@ PT_END( pt );
 }
 
 
-static int8_t process_rx_data( void ){
-
-    if( wifi_i8_rx_data_received() < 0 ){
-
-        return -1;
-    }
-
-    
-    uint8_t buf[WIFI_UART_RX_BUF_SIZE];
-    wifi_data_header_t *header = (wifi_data_header_t *)&rx_buf[1];
-
-    memcpy( buf, &rx_buf[1], sizeof(wifi_data_header_t) + header->len );
-
-    wifi_v_set_rx_ready();
-
-    header = (wifi_data_header_t *)buf;
-    uint8_t *data = (uint8_t *)( header + 1 );
-
-    uint16_t msg_crc = header->crc;
-    header->crc = 0;
-
-
-    if( crc_u16_block( (uint8_t *)header, header->len + sizeof(wifi_data_header_t) ) != msg_crc ){
-
-        log_v_debug_P( PSTR("Wifi crc error") );
-        return -2;
-    }
-
+// handle a data frame from the link.
+// data may point into the receive ring, it is only valid during the call.
+int8_t wifi_i8_receive_frame( wifi_data_header_t *header, uint8_t *data ){
 
     if( header->data_id == WIFI_DATA_ID_STATUS ){
 
@@ -1882,19 +1800,14 @@ error:
     return -4;    
 }
 
-
 PT_THREAD( wifi_comm_thread( pt_t *pt, void *state ) )
 {
 PT_BEGIN( pt );
-    
+
 restart:
     
     _wifi_v_enter_normal_mode();
 
-    ATOMIC;
-    wifi_rx_ready = FALSE;
-    END_ATOMIC;
-
     // delay while wifi boots up
     TMR_WAIT( pt, 300 );
 
@@ -1904,7 +1817,11 @@ restart:
 
     TMR_WAIT( pt, 100 );
 
-    if( !wifi_b_comm_ready() ){
+    ATOMIC;
+    bool reset_ready = wifi_reset_ready;
+    END_ATOMIC;
+
+    if( !reset_ready ){
 
         goto restart;
     }
@@ -1913,39 +1830,14 @@ restart:
 
     // log_v_debug_P( PSTR("Wifi RX ready") );
 
-
-    // set ready and wait for message
-    wifi_v_set_rx_ready();
-
+    // give the ESP its first flow control limit
+    wifi_link_v_start();
         
     while(1){
 
-        THREAD_WAIT_WHILE( pt, wifi_u8_get_control_byte() == WIFI_COMM_IDLE );
-
-        uint8_t control_byte = wifi_u8_get_control_byte();
-
-        if( control_byte == WIFI_COMM_DATA ){
-
-            thread_v_set_alarm( tmr_u32_get_system_time_ms() + 20 );    
-            THREAD_WAIT_WHILE( pt, ( process_rx_data() < 0 ) &&
-                                   ( thread_b_alarm_set() ) );
-
-            if( thread_b_alarm() ){
+        THREAD_WAIT_WHILE( pt, wifi_link_b_idle() );
 
-                log_v_debug_P( PSTR("Wifi rx timeout") );
-
-                wifi_v_set_rx_ready();
-            }
-        }
-        else if( control_byte == WIFI_COMM_QUERY_READY ){
-
-            log_v_debug_P( PSTR("query ready") );
-            wifi_v_set_rx_ready();
-        }
-        else{
-            log_v_debug_P( PSTR("control: %x %c"), control_byte, control_byte );
-            wifi_v_set_rx_ready();
-        }
+        wifi_link_v_process();
     
         THREAD_YIELD( pt );
     }
@@ -2064,19 +1956,19 @@ restart:
     usart_v_set_baud( &WIFI_USART, ESP_CESANTA_BAUD_USART_SETTING );
     _wifi_v_usart_flush();
 
-    memset( rx_buf, 0, sizeof(rx_buf) );
+    memset( wifi_link_rx_buf, 0, sizeof(wifi_link_rx_buf) );
     enable_rx_dma();
 
     // cesanta stub has a delay, so make sure we wait plenty long enough
     _delay_ms( 50 );
 
     // now check buffer, Cesanta will send us a hello message
-    if( !( ( rx_buf[0] == SLIP_END ) &&
-           ( rx_buf[1] == 'O' ) &&
-           ( rx_buf[2] == 'H' ) &&
-           ( rx_buf[3] == 'A' ) &&
-           ( rx_buf[4] == 'I' ) &&
-           ( rx_buf[5] == SLIP_END ) ) ){
+    if( !( ( wifi_link_rx_buf[0] == SLIP_END ) &&
+           ( wifi_link_rx_buf[1] == 'O' ) &&
+           ( wifi_link_rx_buf[2] == 'H' ) &&
+           ( wifi_link_rx_buf[3] == 'A' ) &&
+           ( wifi_link_rx_buf[4] == 'I' ) &&
+           ( wifi_link_rx_buf[5] == SLIP_END ) ) ){
 
         log_v_debug_P( PSTR("error") );
 
@@ -2303,6 +2195,8 @@ void wifi_v_init( void ){
 
     wifi_status = WIFI_STATE_BOOT;
 
+    wifi_link_v_init();
+
     // enable DMA controller
     DMA.CTRL |= DMA_ENABLE_bm;
 
@@ -2385,7 +2279,7 @@ uint32_t wifi_u32_get_received( void ){
 ISR(WIFI_IRQ_VECTOR){
 // OS_IRQ_BEGIN(WIFI_IRQ_VECTOR);
 
-    wifi_rx_ready = TRUE;
+    wifi_reset_ready = TRUE;
 
 // OS_IRQ_END();
 }
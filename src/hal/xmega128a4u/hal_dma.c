@@ -25,6 +25,7 @@
 #include "system.h"
 
 #include "hal_dma.h"
+#include "crc.h"
 
 /*
 
@@ -32,8 +33,22 @@ DMA accelerated memcpy and CRC routines
 
 */
 
+static bool ch_claimed;
+
+void dma_v_claim_ch( bool claim ){
+
+    ch_claimed = claim;
+}
+
 void dma_v_memcpy( void *dest, const void *src, uint16_t len ){
 
+    if( ch_claimed ){
+
+        memcpy( dest, src, len );
+
+        return;
+    }
+
     DMA.INTFLAGS = DMA_CHTRNIF | DMA_CHERRIF;
 
     DMA.DMA_CH.REPCNT = 1;
@@ -60,6 +75,11 @@ void dma_v_memcpy( void *dest, const void *src, uint16_t len ){
 
 uint16_t dma_u16_crc( uint8_t *ptr, uint16_t len ){
 
+    if( ch_claimed ){
+
+        return crc_u16_block( ptr, len );
+    }
+
     // reset CRC to 0xFFFF and IO interface
     CRC.CTRL = CRC_RESET_RESET1_gc;
     asm volatile("nop"); // nop to allow one cycle delay for CRC to reset.
@@ -79,7 +99,6 @@ uint16_t dma_u16_crc( uint8_t *ptr, uint16_t len ){
 
 #include "timers.h"
 #include "logging.h"
-#include "crc.h"
 
 void dma_test( void ){
 
@@ -30,6 +30,10 @@
 #define DMA_CHERRIF        DMA_CH3ERRIF_bm
 
 
+// the second pixel output claims CH3 while it is enabled.
+// memcpy and CRC fall back to the CPU until it is released.
+void dma_v_claim_ch( bool claim );
+
 void dma_v_memcpy( void *dest, const void *src, uint16_t len );
 uint16_t dma_u16_crc( uint8_t *ptr, uint16_t len );
 
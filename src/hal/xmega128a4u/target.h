@@ -32,7 +32,7 @@
 // #define ENABLE_AUTOMATON
 // #define ENABLE_CATBUS_LINK
 // #define ENABLE_CMD2
-// #define ENABLE_TIME_SYNC
+#define ENABLE_TIME_SYNC
 #define ENABLE_USB_UDP_TRANSPORT
 #define ENABLE_WIFI
 #define ENABLE_FFS
@@ -49,16 +49,58 @@ typedef ip_addr_t sos_ip_addr_t;
 
 #define WIFI_COMM_RESET                 0x27
 #define WIFI_COMM_DATA                  0x36
-#define WIFI_COMM_QUERY_READY           0x68
+#define WIFI_COMM_ACK                   0x4B
 #define WIFI_COMM_IDLE                  0xff
 
 typedef struct __attribute__((packed)){
     uint8_t data_id;
     uint8_t len;
-    uint8_t msg_id;
+    uint8_t msg_id; // sequence number
     uint16_t crc;
 } wifi_data_header_t;
 
+// Sliding window transport
+//
+// Each side may have up to WIFI_COMM_WINDOW data frames in flight.
+// The receiver delivers frames in sequence order, holding frames that
+// arrive after a gap and asking for the missing ones with a NAK.
+// The ack lists the held frames, so only the missing ones are resent.
+// Frames that are not acked are resent after WIFI_COMM_RETRY_TIMEOUT.
+//
+// Acks also carry flow control: limit is the running byte count,
+// since the last WIFI_COMM_RESET, the sender may have written to the
+// line. All bytes count, data and ack frames alike.
+#define WIFI_COMM_WINDOW                4
+#define WIFI_COMM_RETRY_TIMEOUT         20 // ms
+#define WIFI_COMM_INITIAL_LIMIT         WIFI_MAIN_BUF_LEN
+// a receiver also acks after freeing this many bytes since its last ack
+#define WIFI_COMM_LIMIT_UPDATE          64
+// acks are repeated at this interval, so a lost limit update can't
+// stall the link. if the last one left the sender without credit for
+// its own acks, this one is sent anyway, receivers keep room for one
+// ack beyond the limit they give.
+#define WIFI_COMM_ACK_INTERVAL          WIFI_COMM_RETRY_TIMEOUT
+// a frame resent for a NAK is not resent for another NAK until this
+// much later, that NAK may have been sent before the resend arrived.
+// a full frame takes ~1.3 ms on the line.
+#define WIFI_COMM_NAK_HOLDOFF           3 // ms
+
+#define WIFI_COMM_ACK_FLAGS_NAK         0x01 // resend frame ack
+
+typedef struct __attribute__((packed)){
+    uint8_t ack; // next sequence number expected
+    uint8_t flags;
+    uint8_t held; // bit n set if frame ack + 1 + n is held
+    uint16_t limit;
+    uint16_t crc;
+} wifi_comm_ack_t;
+
+#define WIFI_COMM_ACK_FRAME_LEN         ( 1 + sizeof(wifi_comm_ack_t) )
+
+// WIFI_COMM_RESET is followed by this, so a corrupted byte
+// seen while resyncing can't reset the windows.
+#define WIFI_COMM_RESET_MAGIC           0x5AC3A53CUL
+
 #define WIFI_BUF_SLACK_SPACE            4
 #define WIFI_BUF_LEN                    128
 #define WIFI_MAX_DATA_LEN (WIFI_BUF_LEN - (sizeof(wifi_data_header_t) + 1 + WIFI_BUF_SLACK_SPACE))
@@ -122,6 +164,27 @@ typedef struct __attribute__((packed)){
 } wifi_msg_rgb_array_t;
 #define WIFI_DATA_ID_RGB_ARRAY          0x07
 
+// RGB frame transfer, sending only the pixels that changed.
+// the message is a series of runs, each a wifi_rgb_run_t followed by:
+// fill run: one r, g, b, d pixel for all count pixels.
+// copy run: count bytes of r, then count of g, b and d.
+// every WIFI_RGB_KEYFRAME_INTERVAL frames all pixels are sent.
+typedef struct __attribute__((packed)){
+    uint16_t index;
+    uint8_t count;
+} wifi_rgb_run_t;
+#define WIFI_RGB_RUN_FILL               0x80
+#define WIFI_RGB_RUN_MAX_COUNT          0x7f
+#define WIFI_RGB_KEYFRAME_INTERVAL      32
+#define WIFI_DATA_ID_RGB_DELTA          0x0A
+
+// next frame is sent in full
+#define WIFI_DATA_ID_REQUEST_RGB_KEYFRAME 0x0B
+
+// sent after the last RGB message of a frame,
+// the frame is complete and can be presented.
+#define WIFI_DATA_ID_RGB_PRESENT        0x0C
+
 typedef struct __attribute__((packed)){
     char ssid[WIFI_SSID_LEN];
     char pass[WIFI_SSID_LEN];
@@ -187,6 +250,38 @@ typedef struct __attribute__((packed)){
 } wifi_msg_vm_frame_sync_status_t;
 #define WIFI_DATA_ID_FRAME_SYNC_STATUS  0x29
 
+#define WIFI_VM_PROFILE_TYPE_OPCODE     0
+#define WIFI_VM_PROFILE_TYPE_FUNC       1
+typedef struct __attribute__((packed)){
+    uint8_t type;
+    uint8_t padding;
+    uint16_t id; // opcode or function address
+    uint32_t count;
+    uint32_t ticks;
+} wifi_vm_profile_entry_t;
+
+#define WIFI_VM_PROFILE_ENTRIES         16
+typedef struct __attribute__((packed)){
+    uint8_t index; // index 0 starts a new profile
+    uint8_t count;
+    uint8_t padding[2];
+    wifi_vm_profile_entry_t entries[WIFI_VM_PROFILE_ENTRIES];
+} wifi_msg_vm_profile_t;
+#define WIFI_DATA_ID_VM_PROFILE         0x2A
+
+// resets a VM instance and directs the following LOAD_VM messages to it.
+// RESET_VM resets all instances and selects instance 0.
+// with HOT_SWAP, the instance keeps running and the new program
+// replaces it at a frame boundary once loaded.
+#define WIFI_SELECT_VM_FLAGS_HOT_SWAP   0x01
+typedef struct __attribute__((packed)){
+    uint8_t vm_id;
+    uint8_t flags;
+    uint16_t pix_index;
+    uint16_t pix_count; // 0 for the full strip
+} wifi_msg_select_vm_t;
+#define WIFI_DATA_ID_SELECT_VM          0x2B
+
 
 #define WIFI_DATA_ID_KV_BATCH           0x31
 #define WIFI_KV_BATCH_LEN               14
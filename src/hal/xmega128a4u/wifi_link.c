@@ -0,0 +1,753 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+/*
+
+Link layer of the ESP8266 UART transport, see wifi_cmd.h.
+
+Frames from the ESP are parsed where the DMA put them in the receive
+ring. The CRC runs over the ring and the data is handed to the driver
+in place, only a frame that wraps around the end of the ring is copied
+out, into a temporary mem2 buffer.
+
+*/
+
+#include "system.h"
+
+#include "timers.h"
+#include "memory.h"
+#include "crc.h"
+#include "wifi_link.h"
+
+// #define NO_LOGGING
+#include "logging.h"
+
+
+uint8_t wifi_link_rx_buf[WIFI_LINK_RX_BUF_SIZE];
+
+// receive window.
+// frames that arrive after a gap stay in the ring until the gap is
+// filled, so the ring is only freed up to the oldest held frame.
+#define RX_NOT_HELD -1
+
+static uint16_t rx_parse;
+static uint16_t rx_free;
+static uint16_t rx_freed;
+static uint16_t rx_limit;
+static uint32_t ack_time;
+static uint8_t rx_seq;
+static int16_t rx_held[WIFI_COMM_WINDOW];
+static bool send_ack;
+static bool send_nak;
+
+static bool rx_partial;
+static uint16_t rx_partial_pos;
+static uint32_t rx_partial_time;
+
+// transmit window.
+// frames are kept until acked, so they can be resent.
+typedef struct{
+    mem_handle_t handle;
+    uint32_t sent_time;
+    bool nak_resent;
+} tx_frame_t;
+
+// bytes the ESP may have in the ring past the last freed one
+#define RX_LIMIT_SPACE ( WIFI_LINK_RX_BUF_SIZE - 1 - WIFI_COMM_ACK_FRAME_LEN )
+
+// largest frame the ESP will send us
+#define RX_MAX_FRAME_LEN ( 1 + sizeof(wifi_data_header_t) + WIFI_MAIN_MAX_DATA_LEN )
+#define TX_MAX_FRAME_LEN ( 1 + sizeof(wifi_data_header_t) + WIFI_MAX_DATA_LEN )
+
+static tx_frame_t tx_frames[WIFI_LINK_TX_WINDOW];
+static uint8_t tx_seq;
+static uint8_t tx_base;
+static uint16_t tx_total;
+static uint16_t tx_limit;
+
+
+static uint16_t ring_add( uint16_t pos, uint16_t len ){
+
+    pos += len;
+
+    if( pos >= WIFI_LINK_RX_BUF_SIZE ){
+
+        pos -= WIFI_LINK_RX_BUF_SIZE;
+    }
+
+    return pos;
+}
+
+// bytes from start up to end, going forward around the ring
+static uint16_t ring_distance( uint16_t start, uint16_t end ){
+
+    if( end >= start ){
+
+        return end - start;
+    }
+
+    return ( WIFI_LINK_RX_BUF_SIZE - start ) + end;
+}
+
+static void ring_copy( uint16_t pos, uint8_t *dest, uint16_t len ){
+
+    while( len > 0 ){
+
+        uint16_t copy_len = WIFI_LINK_RX_BUF_SIZE - pos;
+
+        if( copy_len > len ){
+
+            copy_len = len;
+        }
+
+        memcpy( dest, &wifi_link_rx_buf[pos], copy_len );
+
+        dest += copy_len;
+        len -= copy_len;
+        pos = ring_add( pos, copy_len );
+    }
+}
+
+// continue a CRC over len bytes of the ring
+static uint16_t ring_crc( uint16_t crc, uint16_t pos, uint16_t len ){
+
+    uint16_t first_len = WIFI_LINK_RX_BUF_SIZE - pos;
+
+    if( first_len > len ){
+
+        first_len = len;
+    }
+
+    crc = crc_u16_partial_block( crc, &wifi_link_rx_buf[pos], first_len );
+
+    if( len > first_len ){
+
+        crc = crc_u16_partial_block( crc, wifi_link_rx_buf, len - first_len );
+    }
+
+    return crc;
+}
+
+static uint16_t rx_available( void ){
+
+    return ring_distance( rx_parse, wifi_u16_rx_dma_pos() );
+}
+
+static void line_write( uint8_t *data, uint16_t len ){
+
+    wifi_v_line_write( data, len );
+    tx_total += len;
+}
+
+// check if len more bytes fit in the ESP's receive buffer
+static bool tx_credit( uint16_t len ){
+
+    return (int16_t)( tx_limit - (uint16_t)( tx_total + len ) ) >= 0;
+}
+
+static void send_frame( tx_frame_t *tx ){
+
+    line_write( mem2_vp_get_ptr( tx->handle ), mem2_u16_get_size( tx->handle ) );
+
+    tx->sent_time = tmr_u32_get_system_time_ms();
+}
+
+static bool ack_due( void ){
+
+    return tmr_u32_elapsed_time_ms( ack_time ) >= WIFI_COMM_ACK_INTERVAL;
+}
+
+static void send_ack_frame( void ){
+
+    if( !tx_credit( WIFI_COMM_ACK_FRAME_LEN ) && !ack_due() ){
+
+        return;
+    }
+
+    rx_limit = rx_freed + RX_LIMIT_SPACE;
+
+    wifi_comm_ack_t ack;
+    ack.ack     = rx_seq;
+    ack.flags   = send_nak ? WIFI_COMM_ACK_FLAGS_NAK : 0;
+    ack.held    = 0;
+
+    for( uint8_t i = 0; i < ( WIFI_COMM_WINDOW - 1 ); i++ ){
+
+        if( rx_held[(uint8_t)( rx_seq + 1 + i ) % WIFI_COMM_WINDOW] != RX_NOT_HELD ){
+
+            ack.held |= ( 1 << i );
+        }
+    }
+    ack.limit   = rx_limit;
+    ack.crc     = 0;
+    ack.crc     = crc_u16_block( (uint8_t *)&ack, sizeof(ack) );
+
+    uint8_t c = WIFI_COMM_ACK;
+    line_write( &c, sizeof(c) );
+    line_write( (uint8_t *)&ack, sizeof(ack) );
+
+    send_ack = FALSE;
+    send_nak = FALSE;
+
+    ack_time = tmr_u32_get_system_time_ms();
+}
+
+// acks are idempotent, so they may be seen more than once.
+static void process_ack( wifi_comm_ack_t *ack ){
+
+    // frames up to ack are done
+    if( (uint8_t)( ack->ack - tx_base ) <= (uint8_t)( tx_seq - tx_base ) ){
+
+        while( tx_base != ack->ack ){
+
+            tx_frame_t *tx = &tx_frames[tx_base % WIFI_LINK_TX_WINDOW];
+
+            mem2_v_free( tx->handle );
+            tx->handle = -1;
+
+            tx_base++;
+        }
+    }
+
+    if( (int16_t)( ack->limit - tx_limit ) > 0 ){
+
+        tx_limit = ack->limit;
+    }
+
+    // resend the frames the receiver is missing
+    if( ( ack->flags & WIFI_COMM_ACK_FLAGS_NAK ) && ( ack->ack == tx_base ) ){
+
+        for( uint8_t seq = tx_base; seq != tx_seq; seq++ ){
+
+            uint8_t offset = seq - tx_base;
+
+            if( ( offset > 0 ) && ( ack->held & ( 1 << ( offset - 1 ) ) ) ){
+
+                continue;
+            }
+
+            tx_frame_t *tx = &tx_frames[seq % WIFI_LINK_TX_WINDOW];
+
+            if( tx->nak_resent && ( tmr_u32_elapsed_time_ms( tx->sent_time ) < WIFI_COMM_NAK_HOLDOFF ) ){
+
+                continue;
+            }
+
+            if( !tx_credit( mem2_u16_get_size( tx->handle ) ) ){
+
+                break;
+            }
+
+            tx->nak_resent = TRUE;
+
+            send_frame( tx );
+        }
+    }
+}
+
+// resend the oldest frame if it was not acked in time
+static void retry_tx( void ){
+
+    if( tx_base == tx_seq ){
+
+        return;
+    }
+
+    tx_frame_t *tx = &tx_frames[tx_base % WIFI_LINK_TX_WINDOW];
+
+    if( tmr_u32_elapsed_time_ms( tx->sent_time ) <= WIFI_COMM_RETRY_TIMEOUT ){
+
+        return;
+    }
+
+    if( !tx_credit( mem2_u16_get_size( tx->handle ) ) ){
+
+        return;
+    }
+
+    tx->nak_resent = FALSE;
+
+    send_frame( tx );
+}
+
+// read the ack frame at pos, if it is complete and valid
+static int8_t read_ack( uint16_t pos, uint16_t available, wifi_comm_ack_t *ack ){
+
+    if( available < WIFI_COMM_ACK_FRAME_LEN ){
+
+        return -1;
+    }
+
+    ring_copy( ring_add( pos, 1 ), (uint8_t *)ack, sizeof(wifi_comm_ack_t) );
+
+    uint16_t msg_crc = ack->crc;
+    ack->crc = 0;
+
+    if( crc_u16_block( (uint8_t *)ack, sizeof(wifi_comm_ack_t) ) != msg_crc ){
+
+        return -2;
+    }
+
+    return 0;
+}
+
+// apply acks waiting in the ring without consuming anything,
+// so a blocking send can see the window open up.
+// the comm thread will see them again later, which is harmless.
+static void scan_acks( void ){
+
+    uint16_t pos = rx_parse;
+    uint16_t available = rx_available();
+
+    while( available > 0 ){
+
+        uint16_t len = 1;
+
+        if( wifi_link_rx_buf[pos] == WIFI_COMM_DATA ){
+
+            if( available < ( 1 + sizeof(wifi_data_header_t) ) ){
+
+                return;
+            }
+
+            wifi_data_header_t header;
+            ring_copy( ring_add( pos, 1 ), (uint8_t *)&header, sizeof(header) );
+
+            if( header.len <= WIFI_MAIN_MAX_DATA_LEN ){
+
+                len = 1 + sizeof(header) + header.len;
+            }
+
+            if( available < len ){
+
+                return;
+            }
+        }
+        else if( wifi_link_rx_buf[pos] == WIFI_COMM_ACK ){
+
+            wifi_comm_ack_t ack;
+            int8_t status = read_ack( pos, available, &ack );
+
+            if( status == -1 ){
+
+                return;
+            }
+            else if( status == 0 ){
+
+                process_ack( &ack );
+
+                len = WIFI_COMM_ACK_FRAME_LEN;
+            }
+        }
+
+        pos = ring_add( pos, len );
+        available -= len;
+    }
+}
+
+// hand the frame at pos to the driver.
+// the data is passed in place, unless it wraps around the end of the ring.
+static int8_t deliver_frame( uint16_t pos ){
+
+    wifi_data_header_t header;
+    ring_copy( ring_add( pos, 1 ), (uint8_t *)&header, sizeof(header) );
+
+    uint16_t data_pos = ring_add( pos, 1 + sizeof(header) );
+
+    if( ( data_pos + header.len ) <= WIFI_LINK_RX_BUF_SIZE ){
+
+        wifi_i8_receive_frame( &header, &wifi_link_rx_buf[data_pos] );
+
+        return 0;
+    }
+
+    mem_handle_t h = mem2_h_alloc( header.len );
+
+    if( h < 0 ){
+
+        return -1;
+    }
+
+    uint8_t *data = mem2_vp_get_ptr( h );
+
+    ring_copy( data_pos, data, header.len );
+
+    wifi_i8_receive_frame( &header, data );
+
+    mem2_v_free( h );
+
+    return 0;
+}
+
+static void free_rx_ring( void ){
+
+    // held frames are still in the ring
+    for( uint8_t i = 0; i < WIFI_COMM_WINDOW; i++ ){
+
+        if( rx_held[i] != RX_NOT_HELD ){
+
+            return;
+        }
+    }
+
+    rx_freed += ring_distance( rx_free, rx_parse );
+    rx_free = rx_parse;
+}
+
+// deliver frames in sequence order.
+// a frame after a gap is held and the missing one is NAKed.
+// if a wrapped frame can't be copied out it is dropped and NAKed,
+// the ESP resends it.
+static void receive_frame( uint16_t pos, wifi_data_header_t *header ){
+
+    uint8_t offset = header->msg_id - rx_seq;
+
+    if( offset == 0 ){
+
+        if( deliver_frame( pos ) < 0 ){
+
+            send_nak = TRUE;
+
+            return;
+        }
+
+        rx_seq++;
+
+        // deliver frames that were waiting on this one
+        while( rx_held[rx_seq % WIFI_COMM_WINDOW] != RX_NOT_HELD ){
+
+            uint16_t held_pos = rx_held[rx_seq % WIFI_COMM_WINDOW];
+            rx_held[rx_seq % WIFI_COMM_WINDOW] = RX_NOT_HELD;
+
+            if( deliver_frame( held_pos ) < 0 ){
+
+                send_nak = TRUE;
+
+                break;
+            }
+
+            rx_seq++;
+        }
+    }
+    else if( offset < WIFI_COMM_WINDOW ){
+
+        rx_held[header->msg_id % WIFI_COMM_WINDOW] = pos;
+
+        send_nak = TRUE;
+    }
+    // otherwise this is a resend of a frame that was already delivered,
+    // the ack must have been lost.
+
+    send_ack = TRUE;
+}
+
+// parse the next frame in the ring.
+// returns -1 if the ring is empty, -2 if a frame is incomplete.
+static int8_t process_rx( void ){
+
+    uint16_t available = rx_available();
+
+    if( available == 0 ){
+
+        return -1;
+    }
+
+    uint8_t control_byte = wifi_link_rx_buf[rx_parse];
+
+    if( control_byte == WIFI_COMM_DATA ){
+
+        if( available < ( 1 + sizeof(wifi_data_header_t) ) ){
+
+            return -2;
+        }
+
+        wifi_data_header_t header;
+        ring_copy( ring_add( rx_parse, 1 ), (uint8_t *)&header, sizeof(header) );
+
+        if( header.len > WIFI_MAIN_MAX_DATA_LEN ){
+
+            // not a real frame start, resync on the next byte
+            rx_parse = ring_add( rx_parse, 1 );
+            send_nak = TRUE;
+
+            return 0;
+        }
+
+        uint16_t frame_len = 1 + sizeof(header) + header.len;
+
+        if( available < frame_len ){
+
+            return -2;
+        }
+
+        uint16_t pos = rx_parse;
+        rx_parse = ring_add( rx_parse, frame_len );
+
+        uint16_t msg_crc = header.crc;
+        header.crc = 0;
+
+        uint16_t crc = crc_u16_start();
+        crc = crc_u16_partial_block( crc, (uint8_t *)&header, sizeof(header) );
+        crc = ring_crc( crc, ring_add( pos, 1 + sizeof(header) ), header.len );
+
+        if( crc_u16_finish( crc ) != msg_crc ){
+
+            log_v_debug_P( PSTR("Wifi crc error") );
+
+            send_nak = TRUE;
+
+            return 0;
+        }
+
+        receive_frame( pos, &header );
+    }
+    else if( control_byte == WIFI_COMM_ACK ){
+
+        wifi_comm_ack_t ack;
+        int8_t status = read_ack( rx_parse, available, &ack );
+
+        if( status == -1 ){
+
+            return -2;
+        }
+        else if( status == 0 ){
+
+            process_ack( &ack );
+
+            rx_parse = ring_add( rx_parse, WIFI_COMM_ACK_FRAME_LEN );
+        }
+        else{
+
+            rx_parse = ring_add( rx_parse, 1 );
+        }
+    }
+    else{
+
+        // not a frame start
+        rx_parse = ring_add( rx_parse, 1 );
+    }
+
+    return 0;
+}
+
+// if held frames fill the ring, the ESP would not have room to send
+// the missing one. drop them, it will resend them later.
+static void check_rx_ring_space( void ){
+
+    if( rx_free == rx_parse ){
+
+        return;
+    }
+
+    uint16_t used = ring_distance( rx_free, wifi_u16_rx_dma_pos() );
+
+    if( ( WIFI_LINK_RX_BUF_SIZE - 1 - used ) >= ( RX_MAX_FRAME_LEN + WIFI_COMM_ACK_FRAME_LEN ) ){
+
+        return;
+    }
+
+    for( uint8_t i = 0; i < WIFI_COMM_WINDOW; i++ ){
+
+        rx_held[i] = RX_NOT_HELD;
+    }
+
+    send_nak = TRUE;
+
+    free_rx_ring();
+}
+
+static bool rx_limit_update( void ){
+
+    return (uint16_t)( ( rx_freed + RX_LIMIT_SPACE ) - rx_limit ) >= WIFI_COMM_LIMIT_UPDATE;
+}
+
+
+void wifi_link_v_init( void ){
+
+    for( uint8_t i = 0; i < WIFI_LINK_TX_WINDOW; i++ ){
+
+        tx_frames[i].handle = -1;
+    }
+}
+
+// start both windows over.
+// the receive DMA must be restarted at the beginning of the ring.
+void wifi_link_v_reset( void ){
+
+    rx_parse = 0;
+    rx_free = 0;
+    rx_freed = 0;
+    rx_limit = RX_LIMIT_SPACE;
+    rx_seq = 0;
+
+    for( uint8_t i = 0; i < WIFI_COMM_WINDOW; i++ ){
+
+        rx_held[i] = RX_NOT_HELD;
+    }
+
+    send_ack = FALSE;
+    send_nak = FALSE;
+    rx_partial = FALSE;
+
+    for( uint8_t i = 0; i < WIFI_LINK_TX_WINDOW; i++ ){
+
+        if( tx_frames[i].handle >= 0 ){
+
+            mem2_v_free( tx_frames[i].handle );
+        }
+
+        tx_frames[i].handle = -1;
+    }
+
+    tx_seq = 0;
+    tx_base = 0;
+    tx_total = 0;
+    tx_limit = WIFI_COMM_INITIAL_LIMIT;
+}
+
+// after the reset handshake, give the ESP its first flow control limit
+void wifi_link_v_start( void ){
+
+    send_ack = TRUE;
+    rx_partial = FALSE;
+}
+
+bool wifi_link_b_idle( void ){
+
+    if( ( rx_available() > 0 ) || send_ack || send_nak || rx_limit_update() || ack_due() ){
+
+        return FALSE;
+    }
+
+    if( ( tx_base != tx_seq ) &&
+        ( tmr_u32_elapsed_time_ms( tx_frames[tx_base % WIFI_LINK_TX_WINDOW].sent_time ) > WIFI_COMM_RETRY_TIMEOUT ) ){
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void wifi_link_v_process( void ){
+
+    int8_t status;
+
+    do{
+
+        status = process_rx();
+
+    } while( status == 0 );
+
+    if( status == -2 ){
+
+        if( !rx_partial || ( rx_partial_pos != rx_parse ) ){
+
+            rx_partial = TRUE;
+            rx_partial_pos = rx_parse;
+            rx_partial_time = tmr_u32_get_system_time_ms();
+        }
+        else if( tmr_u32_elapsed_time_ms( rx_partial_time ) > 20 ){
+
+            log_v_debug_P( PSTR("Wifi rx timeout") );
+
+            // the frame is broken, resync on the next byte
+            rx_parse = ring_add( rx_parse, 1 );
+            send_nak = TRUE;
+            rx_partial = FALSE;
+        }
+    }
+    else{
+
+        rx_partial = FALSE;
+    }
+
+    free_rx_ring();
+    check_rx_ring_space();
+
+    retry_tx();
+
+    if( send_ack || send_nak || rx_limit_update() || ack_due() ){
+
+        send_ack_frame();
+    }
+}
+
+// for senders waiting on the window while the comm thread can't run
+void wifi_link_v_poll_tx( void ){
+
+    scan_acks();
+    retry_tx();
+}
+
+bool wifi_link_b_tx_ready( void ){
+
+    if( (uint8_t)( tx_seq - tx_base ) >= WIFI_LINK_TX_WINDOW ){
+
+        return FALSE;
+    }
+
+    // leave room for an ack after the frame
+    return tx_credit( TX_MAX_FRAME_LEN + WIFI_COMM_ACK_FRAME_LEN );
+}
+
+int8_t wifi_link_i8_send( uint8_t data_id, uint8_t *data, uint8_t len ){
+
+    if( !wifi_link_b_tx_ready() ){
+
+        return -1;
+    }
+
+    tx_frame_t *tx = &tx_frames[tx_seq % WIFI_LINK_TX_WINDOW];
+
+    tx->handle = mem2_h_alloc( 1 + sizeof(wifi_data_header_t) + len );
+
+    if( tx->handle < 0 ){
+
+        return -2;
+    }
+
+    uint16_t crc = crc_u16_start();
+
+    wifi_data_header_t header;
+    header.msg_id   = tx_seq;
+    header.len      = len;
+    header.data_id  = data_id;
+    header.crc      = 0;
+    crc = crc_u16_partial_block( crc, (uint8_t *)&header, sizeof(header) );
+
+    crc = crc_u16_partial_block( crc, data, len );
+
+    header.crc = crc_u16_finish( crc );
+
+    uint8_t *frame = mem2_vp_get_ptr( tx->handle );
+    frame[0] = WIFI_COMM_DATA;
+    memcpy( &frame[1], &header, sizeof(header) );
+    memcpy( &frame[1 + sizeof(header)], data, len );
+
+    tx->nak_resent = FALSE;
+
+    tx_seq++;
+
+    send_frame( tx );
+
+    return 0;
+}
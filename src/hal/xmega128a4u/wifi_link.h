@@ -0,0 +1,55 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+#ifndef _WIFI_LINK_H
+#define _WIFI_LINK_H
+
+#include "wifi_cmd.h"
+
+// receive ring, filled by the UART DMA.
+// it holds two of the largest frames the ESP sends (251 bytes) and an ack.
+// frames are parsed in place, so this is all the receive RAM there is,
+// the same as the old 255 byte buffer plus the 255 byte copy on the stack.
+#define WIFI_LINK_RX_BUF_SIZE       512
+
+// our own frames in flight, each one is held in mem2 until it is acked.
+// the ESP can take WIFI_COMM_WINDOW, two keeps mem2 use to ~250 bytes
+// and is enough for the little traffic we send.
+#define WIFI_LINK_TX_WINDOW         2
+
+extern uint8_t wifi_link_rx_buf[WIFI_LINK_RX_BUF_SIZE];
+
+void wifi_link_v_init( void );
+void wifi_link_v_reset( void );
+void wifi_link_v_start( void );
+bool wifi_link_b_idle( void );
+void wifi_link_v_process( void );
+void wifi_link_v_poll_tx( void );
+bool wifi_link_b_tx_ready( void );
+int8_t wifi_link_i8_send( uint8_t data_id, uint8_t *data, uint8_t len );
+
+// provided by the driver
+uint16_t wifi_u16_rx_dma_pos( void );
+void wifi_v_line_write( uint8_t *data, uint16_t len );
+int8_t wifi_i8_receive_frame( wifi_data_header_t *header, uint8_t *data );
+
+#endif
@@ -22,7 +22,11 @@
 
 #include <inttypes.h>
 
-#ifdef ESP8266
+#if defined(ESP8266) || defined(VM_BENCH)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "bool.h"
 #include "trig.h"
@@ -38,31 +42,131 @@
 #define pgm_read_word(a) *a
 #endif
 
-static uint8_t array_red[MAX_PIXELS];
-static uint8_t array_green[MAX_PIXELS];
-static uint8_t array_blue[MAX_PIXELS];
-static uint8_t array_misc[MAX_PIXELS];
+// Pixel store
+//
+// all per pixel arrays live in one heap block, sized to pix_count when
+// it is set, so RAM use follows the actual installation.
+// MAX_PIXELS is the upper limit, the main CPU's output buffers are sized
+// by it.
+//
+// lower precision options to save RAM on large installations:
+// GFX_FADER_STEP8 stores fader steps in 8 bits, as a small float with
+// a 4 bit exponent and 3 bit mantissa. fade times are within ~6%.
+// GFX_SHARED_FADE_TIMES uses one hs_fade and one v_fade for every pixel,
+// the last fade time set applies to all of them.
+static uint8_t *pixel_store;
+static uint16_t pix_alloc;
+
+static uint8_t *array_red;
+static uint8_t *array_green;
+static uint8_t *array_blue;
+static uint8_t *array_misc;
 
 static uint16_t pix0_16bit_red;
 static uint16_t pix0_16bit_green;
 static uint16_t pix0_16bit_blue;
 
-static uint16_t hue[MAX_PIXELS];
-static uint16_t sat[MAX_PIXELS];
-static uint16_t val[MAX_PIXELS];
+static uint16_t *hue;
+static uint16_t *sat;
+static uint16_t *val;
 
-static uint16_t target_hue[MAX_PIXELS];
-static uint16_t target_sat[MAX_PIXELS];
-static uint16_t target_val[MAX_PIXELS];
+static uint16_t *target_hue;
+static uint16_t *target_sat;
+static uint16_t *target_val;
 
 static uint16_t global_hs_fade = 1000;
 static uint16_t global_v_fade = 1000;
-static uint16_t hs_fade[MAX_PIXELS];
-static uint16_t v_fade[MAX_PIXELS];
 
-static int16_t hue_step[MAX_PIXELS];
-static int16_t sat_step[MAX_PIXELS];
-static int16_t val_step[MAX_PIXELS];
+#ifdef GFX_SHARED_FADE_TIMES
+static uint16_t shared_hs_fade;
+static uint16_t shared_v_fade;
+
+#define HS_FADE( i )                shared_hs_fade
+#define V_FADE( i )                 shared_v_fade
+#else
+static uint16_t *hs_fade;
+static uint16_t *v_fade;
+
+#define HS_FADE( i )                hs_fade[i]
+#define V_FADE( i )                 v_fade[i]
+#endif
+
+// per pixel fader state.
+//
+// step is the fixed step for the step fader, or the progress increment
+// per frame for the interpolating curves. 0 means the channel is idle.
+// start and progress are only used by the interpolating curves.
+//
+// by default each field is its own array. GFX_PACKED_FADER_STATE
+// packs them into one struct per pixel, so a fader update touches one
+// cache line for its state instead of one per field.
+// targets, fades and current values stay as arrays either way, since
+// the array ops, pixel transfer and HSV conversion run along them.
+#define FADER_HUE   0
+#define FADER_SAT   1
+#define FADER_VAL   2
+
+#ifdef GFX_FADER_STEP8
+typedef int8_t gfx_fader_step_t;
+#else
+typedef int16_t gfx_fader_step_t;
+#endif
+
+#ifdef GFX_PACKED_FADER_STATE
+typedef struct{
+    gfx_fader_step_t step[3];
+    uint16_t start[3];
+    uint16_t progress[3];
+} gfx_fader_state_t;
+
+static gfx_fader_state_t *fader_state;
+
+#define FADER_STEP_RAW( ch, i )     fader_state[i].step[ch]
+#define FADER_START( ch, i )        fader_state[i].start[ch]
+#define FADER_PROGRESS( ch, i )     fader_state[i].progress[ch]
+#else
+static gfx_fader_step_t *fader_step[3];
+static uint16_t *fader_start[3];
+static uint16_t *fader_progress[3];
+
+#define FADER_STEP_RAW( ch, i )     fader_step[ch][i]
+#define FADER_START( ch, i )        fader_start[ch][i]
+#define FADER_PROGRESS( ch, i )     fader_progress[ch][i]
+#endif
+
+#ifdef GFX_FADER_STEP8
+#define FADER_STEP( ch, i )             decode_step( FADER_STEP_RAW( ch, i ) )
+#define SET_FADER_STEP( ch, i, step )   FADER_STEP_RAW( ch, i ) = encode_step( step )
+#else
+#define FADER_STEP( ch, i )             FADER_STEP_RAW( ch, i )
+#define SET_FADER_STEP( ch, i, step )   FADER_STEP_RAW( ch, i ) = ( step )
+#endif
+
+// one bit per pixel with a fade in progress.
+// a clear bit means target == current and all steps are 0.
+static uint32_t fader_active[( MAX_PIXELS + 31 ) / 32];
+
+// pixels whose HSV changed since the last sync.
+// sync_all forces a full conversion, for changes that affect every pixel.
+static uint32_t sync_dirty[( MAX_PIXELS + 31 ) / 32];
+static bool sync_all;
+
+// temporal dithering.
+// the sync keeps each pixel's 16 bit RGB, and every frame the low byte
+// is added to a carried residual per channel. when the residual
+// overflows the pixel goes out one step brighter for that frame,
+// so over time the 8 bit output averages to the 16 bit value.
+// dither_active marks pixels with a nonzero fraction, the rest
+// have nothing to carry and are skipped.
+// dither_state is only in the pixel store while dithering is on.
+typedef struct{
+    uint16_t rgb[3];
+    uint8_t err[3];
+} gfx_dither_t;
+
+static bool temporal_dither;
+static gfx_dither_t *dither_state;
+static uint32_t dither_active[( MAX_PIXELS + 31 ) / 32];
 
 static uint16_t pix_master_dimmer = 0;
 static uint16_t pix_sub_dimmer = 0;
@@ -80,20 +184,65 @@ static bool pix_transpose;
 static uint8_t pix_array_count;
 static gfx_pixel_array_t *pix_arrays;
 
+// pixel range owned by the running VM instance.
+// a count of 0 is the full strip.
+static uint16_t part_index;
+static uint16_t part_count;
+
 static uint16_t virtual_array_start;
 static uint16_t virtual_array_length;
 static uint8_t virtual_array_sub_position;
 static uint32_t scaled_pix_count;
 static uint32_t scaled_virtual_array_length;
 
+// cached results of calc_index, per pixel object.
+// 1D accesses below len_1d and 2D accesses within size_x by size_y
+// are a single lookup, anything else falls back to calc_index.
+#define GFX_INDEX_MAP_PER_PIXEL     4
+#define GFX_INDEX_MAP_OBJS          16
+
+// one set of maps per pixel array table, so VM instances switching
+// between their arrays every frame don't rebuild them.
+// sets share the map storage, in the order they are first used.
+#define GFX_INDEX_MAP_SETS          4
+
+typedef struct{
+    uint16_t offset_1d;
+    uint16_t len_1d;
+    uint16_t offset_2d;
+    uint16_t size_x; // 0 if there is no 2D map
+    uint16_t size_y;
+} gfx_index_map_t;
+
+typedef struct{
+    gfx_pixel_array_t *arrays; // 0 if the set is unused
+    uint8_t count;
+    gfx_index_map_t maps[GFX_INDEX_MAP_OBJS];
+} gfx_index_map_set_t;
+
+static uint16_t *index_map;
+static uint32_t index_map_used;
+static gfx_index_map_set_t index_map_sets[GFX_INDEX_MAP_SETS];
+static gfx_index_map_set_t *index_map_set; // set for pix_arrays, 0 if not looked up
+static bool index_map_valid; // FALSE when the geometry changed, clears all sets
+
+#ifdef VM_BENCH
+static uint32_t index_map_builds;
+#endif
+
 static uint16_t gfx_frame_rate = 100;
+static uint16_t fader_rate = FADER_RATE;
 
 static uint8_t dimmer_curve = GFX_DIMMER_CURVE_DEFAULT;
+static uint8_t fader_curve = GFX_FADER_CURVE_STEP;
 
 
 #define DIMMER_LOOKUP_SIZE 256
 static uint16_t dimmer_lookup[DIMMER_LOOKUP_SIZE];
 
+// easing curve for the interpolating fader, progress -> fraction of the fade
+static uint16_t fader_curve_lookup[DIMMER_LOOKUP_SIZE];
+
 
 // smootherstep is an 8 bit lookup table for the function:
 // 6 * pow(x, 5) - 15 * pow(x, 4) + 10 * pow(x, 3)
@@ -104,9 +253,314 @@ static uint8_t smootherstep_lookup[DIMMER_LOOKUP_SIZE] = {
 #define NOISE_TABLE_SIZE 256
 static uint8_t noise_table[NOISE_TABLE_SIZE];
 
+// gradient noise lattice hash and 16 bit fade curve
+static uint8_t noise_perm[NOISE_TABLE_SIZE];
+static uint16_t noise_fade_lookup[NOISE_TABLE_SIZE];
+
 static int32_t kv_test_key;
 
 
+static void reset_fader_steps( uint8_t ch, uint16_t start, uint16_t len ){
+
+    #ifdef GFX_PACKED_FADER_STATE
+    for( uint16_t i = start; i < ( start + len ); i++ ){
+
+        fader_state[i].step[ch] = 0;
+    }
+    #else
+    memset( &fader_step[ch][start], 0, len * sizeof(gfx_fader_step_t) );
+    #endif
+}
+
+#ifdef GFX_FADER_STEP8
+// 8 bit step: sign bit, then a 4 bit exponent and 3 bit mantissa.
+// exponent 0 is the exact values 0 to 7, above that the value is
+// ( 8 + mantissa ) << ( exponent - 1 ).
+static int16_t decode_step( int8_t code ){
+
+    uint8_t e = ( code >> 3 ) & 0x0f;
+    uint8_t m = code & 0x07;
+    int32_t mag;
+
+    if( e == 0 ){
+
+        mag = m;
+    }
+    else{
+
+        mag = (int32_t)( 8 | m ) << ( e - 1 );
+
+        if( mag > 32767 ){
+
+            mag = 32767;
+        }
+    }
+
+    if( code < 0 ){
+
+        return -mag;
+    }
+
+    return mag;
+}
+
+static int8_t encode_step( int32_t step ){
+
+    uint8_t sign = 0;
+
+    if( step < 0 ){
+
+        sign = 0x80;
+        step = -step;
+    }
+
+    uint32_t mag = step;
+
+    if( mag < 8 ){
+
+        return sign | mag;
+    }
+
+    // position of the top bit, 3 or more
+    uint8_t shift = 0;
+
+    while( ( mag >> shift ) >= 16 ){
+
+        shift++;
+    }
+
+    // round to nearest, this can carry into the next exponent.
+    // a nonzero step never encodes to 0.
+    if( shift > 0 ){
+
+        mag += (uint32_t)1 << ( shift - 1 );
+
+        if( ( mag >> shift ) >= 16 ){
+
+            shift++;
+        }
+    }
+
+    uint8_t e = shift + 1;
+    uint8_t m = ( mag >> shift ) & 0x07;
+
+    if( e > 15 ){
+
+        e = 15;
+        m = 7;
+    }
+
+    return sign | ( e << 3 ) | m;
+}
+#endif
+
+static void init_pixels( uint16_t start, uint16_t end ){
+
+    for( uint16_t i = start; i < end; i++ ){
+
+        hue[i] = 0;
+        sat[i] = 65535;
+        val[i] = 0;
+
+        target_hue[i] = 0;
+        target_sat[i] = 65535;
+        target_val[i] = 0;
+
+        SET_FADER_STEP( FADER_HUE, i, 0 );
+        SET_FADER_STEP( FADER_SAT, i, 0 );
+        SET_FADER_STEP( FADER_VAL, i, 0 );
+
+        HS_FADE( i ) = global_hs_fade;
+        V_FADE( i )  = global_v_fade;
+    }
+}
+
+// place one array in the pixel store.
+// with base == 0 this only counts the size and leaves the pointer as is.
+// otherwise the array moves into the new store, keeping the pixels
+// that are still in range.
+static void *store_place( uint8_t *base, uint32_t *offset, void *old, uint16_t elem_size, uint16_t count ){
+
+    uint32_t start = *offset;
+
+    // keep every array 32 bit aligned
+    *offset += ( (uint32_t)elem_size * count + 3 ) & ~(uint32_t)3;
+
+    if( base == 0 ){
+
+        return old;
+    }
+
+    uint16_t keep = count;
+
+    if( keep > pix_alloc ){
+
+        keep = pix_alloc;
+    }
+
+    // the one pixel store can be laid out again in place
+    if( ( old != 0 ) && ( old != &base[start] ) && ( keep > 0 ) ){
+
+        memcpy( &base[start], old, (uint32_t)elem_size * keep );
+    }
+
+    return &base[start];
+}
+
+// size of a one pixel store, same layout as layout_store()
+#define STORE_ALIGN( size )         ( ( (size) + 3 ) & ~3 )
+
+#ifndef GFX_SHARED_FADE_TIMES
+#define STORE_FADE_SIZE             ( 2 * STORE_ALIGN( sizeof(uint16_t) ) )
+#else
+#define STORE_FADE_SIZE             0
+#endif
+
+#ifdef GFX_PACKED_FADER_STATE
+#define STORE_FADER_SIZE            STORE_ALIGN( sizeof(gfx_fader_state_t) )
+#else
+#define STORE_FADER_SIZE            ( 3 * ( STORE_ALIGN( sizeof(gfx_fader_step_t) ) + \
+                                            2 * STORE_ALIGN( sizeof(uint16_t) ) ) )
+#endif
+
+#define STORE_ONE_PIXEL_SIZE        ( 6 * STORE_ALIGN( sizeof(uint16_t) ) + \
+                                      STORE_FADE_SIZE + \
+                                      STORE_FADER_SIZE + \
+                                      STORE_ALIGN( sizeof(uint16_t) * GFX_INDEX_MAP_PER_PIXEL ) + \
+                                      4 * STORE_ALIGN( sizeof(uint8_t) ) + \
+                                      STORE_ALIGN( sizeof(gfx_dither_t) ) )
+
+// static store for a single pixel.
+// used for pix_count 1 and when the first heap store can't be
+// allocated, so there is always at least one pixel and pix_count
+// never drops to 0.
+static uint32_t pixel_store_one[STORE_ONE_PIXEL_SIZE / 4];
+
+#ifdef VM_BENCH
+static bool store_alloc_fail;
+#endif
+
+// returns the store size in bytes for count pixels
+static uint32_t layout_store( uint8_t *base, uint16_t count ){
+
+    uint32_t offset = 0;
+
+    hue         = store_place( base, &offset, hue,          sizeof(uint16_t), count );
+    sat         = store_place( base, &offset, sat,          sizeof(uint16_t), count );
+    val         = store_place( base, &offset, val,          sizeof(uint16_t), count );
+    target_hue  = store_place( base, &offset, target_hue,   sizeof(uint16_t), count );
+    target_sat  = store_place( base, &offset, target_sat,   sizeof(uint16_t), count );
+    target_val  = store_place( base, &offset, target_val,   sizeof(uint16_t), count );
+
+    #ifndef GFX_SHARED_FADE_TIMES
+    hs_fade     = store_place( base, &offset, hs_fade,      sizeof(uint16_t), count );
+    v_fade      = store_place( base, &offset, v_fade,       sizeof(uint16_t), count );
+    #endif
+
+    #ifdef GFX_PACKED_FADER_STATE
+    fader_state = store_place( base, &offset, fader_state,  sizeof(gfx_fader_state_t), count );
+    #else
+    for( uint8_t ch = 0; ch < 3; ch++ ){
+
+        fader_step[ch]      = store_place( base, &offset, fader_step[ch],     sizeof(gfx_fader_step_t), count );
+        fader_start[ch]     = store_place( base, &offset, fader_start[ch],    sizeof(uint16_t), count );
+        fader_progress[ch]  = store_place( base, &offset, fader_progress[ch], sizeof(uint16_t), count );
+    }
+    #endif
+
+    index_map   = store_place( base, &offset, index_map,    sizeof(uint16_t) * GFX_INDEX_MAP_PER_PIXEL, count );
+
+    array_red   = store_place( base, &offset, array_red,    sizeof(uint8_t), count );
+    array_green = store_place( base, &offset, array_green,  sizeof(uint8_t), count );
+    array_blue  = store_place( base, &offset, array_blue,   sizeof(uint8_t), count );
+    array_misc  = store_place( base, &offset, array_misc,   sizeof(uint8_t), count );
+
+    if( temporal_dither ){
+
+        dither_state = store_place( base, &offset, dither_state, sizeof(gfx_dither_t), count );
+    }
+    else if( base != 0 ){
+
+        dither_state = 0;
+    }
+
+    return offset;
+}
+
+// resize the pixel store to count pixels, with the dither state
+// if temporal_dither is set.
+// returns -1 if the allocation fails. the old store is kept then, or
+// the one pixel store if there was none, callers must clamp pix_count
+// to pix_alloc and check dither_state.
+static int8_t resize_store( uint16_t count ){
+
+    if( ( count == pix_alloc ) && ( temporal_dither == ( dither_state != 0 ) ) ){
+
+        return 0;
+    }
+
+    int8_t status = 0;
+    uint8_t *store = (uint8_t *)pixel_store_one;
+
+    if( count > 1 ){
+
+        // the store is held by raw pointers, so it comes from the system heap
+        // and not from the compacting mem2 heap.
+        store = malloc( layout_store( 0, count ) );
+
+        #ifdef VM_BENCH
+        if( store_alloc_fail ){
+
+            free( store );
+            store = 0;
+        }
+        #endif
+
+        if( store == 0 ){
+
+            if( pix_alloc > 0 ){
+
+                return -1;
+            }
+
+            status = -1;
+            count = 1;
+            store = (uint8_t *)pixel_store_one;
+        }
+    }
+
+    if( store != pixel_store ){
+
+        memset( store, 0, layout_store( 0, count ) );
+    }
+
+    layout_store( store, count );
+
+    // dithering turned on in the one pixel store
+    if( ( store == pixel_store ) && ( dither_state != 0 ) ){
+
+        memset( dither_state, 0, sizeof(gfx_dither_t) );
+    }
+
+    if( pixel_store != (uint8_t *)pixel_store_one ){
+
+        free( pixel_store );
+    }
+
+    pixel_store = store;
+
+    uint16_t old_alloc = pix_alloc;
+    pix_alloc = count;
+
+    // new pixels start from the reset defaults
+    init_pixels( old_alloc, pix_alloc );
+
+    index_map_valid = FALSE;
+    sync_all = TRUE;
+
+    return status;
+}
+
 static void compute_dimmer_lookup( void ){
 
     float curve_exp = (float)dimmer_curve / 64.0;
@@ -119,6 +573,39 @@ static void compute_dimmer_lookup( void ){
     }
 }
 
+static void compute_fader_curve_lookup( void ){
+
+    for( uint32_t i = 0; i < DIMMER_LOOKUP_SIZE; i++ ){
+
+        if( fader_curve == GFX_FADER_CURVE_SMOOTHERSTEP ){
+
+            fader_curve_lookup[i] = (uint16_t)smootherstep_lookup[i] * 257;
+        }
+        else if( fader_curve == GFX_FADER_CURVE_EXP ){
+
+            // exponential ease out, normalized to reach 1.0
+            float input = ( (float)( i << 8 ) ) / 65535.0;
+
+            fader_curve_lookup[i] = (uint16_t)( ( ( 1.0 - pow( 2.0, -10.0 * input ) ) / ( 1.0 - pow( 2.0, -10.0 ) ) ) * 65535.0 );
+        }
+        else{
+
+            fader_curve_lookup[i] = i << 8;
+        }
+    }
+}
+
+// 6t^5 - 15t^4 + 10t^3 over the 8 bit cell fraction, as a 16 bit fraction
+static void compute_noise_fade_lookup( void ){
+
+    for( int64_t t = 0; t < NOISE_TABLE_SIZE; t++ ){
+
+        int64_t poly = t * ( 6 * t - 15 * 256 ) + 10 * 65536;
+
+        noise_fade_lookup[t] = ( t * t * t * poly ) >> 24;
+    }
+}
+
 static void setup_master_array( void ){
 
     // check if pixel arrays are configured
@@ -127,15 +614,40 @@ static void setup_master_array( void ){
         return;
     }
 
-    pix_arrays[0].index = 0;
-    pix_arrays[0].count = pix_count;
-    pix_arrays[0].size_x = pix_size_x;
-    pix_arrays[0].size_y = pix_size_y;    
+    gfx_pixel_array_t master = pix_arrays[0];
+
+    if( ( part_count == 0 ) || ( part_index >= pix_count ) ){
+
+        master.index = 0;
+        master.count = pix_count;
+        master.size_x = pix_size_x;
+        master.size_y = pix_size_y;    
+    }
+    else{
+
+        uint16_t count = part_count;
+
+        if( ( part_index + count ) > pix_count ){
+
+            count = pix_count - part_index;
+        }
+
+        master.index = part_index;
+        master.count = count;
+        master.size_x = count;
+        master.size_y = 1;
+    }
+
+    if( memcmp( &master, &pix_arrays[0], sizeof(master) ) != 0 ){
+
+        pix_arrays[0] = master;
+        index_map_valid = FALSE;
+    }
 }
 
 static void update_master_fader( void ){
 
-    uint16_t fade_steps = global_v_fade / FADER_RATE;
+    uint16_t fade_steps = global_v_fade / fader_rate;
 
     if( fade_steps <= 1 ){
 
@@ -185,6 +697,8 @@ static void sync_db( void ){
     kvdb_i8_add( __KV__gfx_frame_rate,              gfx_frame_rate,            0, 0 );
     kvdb_i8_add( __KV__gfx_virtual_array_start,     virtual_array_start,       0, 0 );
     kvdb_i8_add( __KV__gfx_virtual_array_length,    virtual_array_length,      0, 0 );
+    kvdb_i8_add( __KV__gfx_fader_curve,             fader_curve,               0, 0 );
+    kvdb_i8_add( __KV__gfx_dither,                  temporal_dither,           0, 0 );
 }
 
 static void param_error_check( void ){
@@ -202,6 +716,18 @@ static void param_error_check( void ){
         pix_count = 1;
     }
 
+    // pix_alloc is at least 1, even if the store can't grow
+    if( resize_store( pix_count ) < 0 ){
+
+        pix_count = pix_alloc;
+    }
+
+    // no room for the dither state
+    if( dither_state == 0 ){
+
+        temporal_dither = FALSE;
+    }
+
     if( ( (uint32_t)pix_size_x * (uint32_t)pix_size_y ) > pix_count ){
         
         pix_size_x = pix_count;
@@ -235,6 +761,11 @@ static void param_error_check( void ){
 
         gfx_frame_rate = 10;
     }
+
+    if( fader_curve >= GFX_FADER_CURVE_COUNT ){
+
+        fader_curve = GFX_FADER_CURVE_STEP;
+    }
 }
 
 
@@ -243,6 +774,37 @@ uint16_t gfx_u16_get_vm_frame_rate( void ){
     return gfx_frame_rate;
 }
 
+// set the interval, in ms, between calls to gfx_v_process_faders.
+// fade steps are computed from this so fade times are kept when the
+// fader is run at a lower rate.
+void gfx_v_set_fader_rate( uint16_t setting ){
+
+    if( setting < FADER_RATE ){
+
+        setting = FADER_RATE;
+    }
+
+    if( setting == fader_rate ){
+
+        return;
+    }
+
+    fader_rate = setting;
+
+    // steps for fades in progress were computed for the old rate,
+    // restart them from their current values.
+    reset_fader_steps( FADER_HUE, 0, pix_alloc );
+    reset_fader_steps( FADER_SAT, 0, pix_alloc );
+    reset_fader_steps( FADER_VAL, 0, pix_alloc );
+
+    update_master_fader();
+}
+
+uint16_t gfx_u16_get_fader_rate( void ){
+
+    return fader_rate;
+}
+
 void gfx_v_set_params( gfx_params_t *params ){
 
     // version check
@@ -252,6 +814,7 @@ void gfx_v_set_params( gfx_params_t *params ){
     }
 
     uint8_t old_dimmer_curve = dimmer_curve;
+    uint8_t old_fader_curve = fader_curve;
 
     dimmer_curve            = params->dimmer_curve;
     pix_count               = params->pix_count;
@@ -267,19 +830,37 @@ void gfx_v_set_params( gfx_params_t *params ){
     gfx_frame_rate          = params->frame_rate;
     virtual_array_start     = params->virtual_array_start;
     virtual_array_length    = params->virtual_array_length;
+    fader_curve             = params->fader_curve;
+    temporal_dither         = params->dither;
 
     param_error_check();
 
     setup_master_array();
 
+    index_map_valid = FALSE;
+
     // only run if dimmer curve is changing
     if( old_dimmer_curve != dimmer_curve ){
         
         compute_dimmer_lookup();
     }
 
+    if( old_fader_curve != fader_curve ){
+        
+        compute_fader_curve_lookup();
+
+        // the step arrays mean something else for the new curve,
+        // restart fades in progress from their current values.
+        reset_fader_steps( FADER_HUE, 0, pix_alloc );
+        reset_fader_steps( FADER_SAT, 0, pix_alloc );
+        reset_fader_steps( FADER_VAL, 0, pix_alloc );
+    }
+
     update_master_fader();
 
+    // pix mode, pix count, the dimmer curve or dithering may have changed
+    sync_all = TRUE;
+
     sync_db();
 
     virtual_array_sub_position      = virtual_array_start / pix_count;
@@ -304,51 +885,308 @@ void gfx_v_get_params( gfx_params_t *params ){
     params->dimmer_curve            = dimmer_curve;
     params->virtual_array_start     = virtual_array_start;
     params->virtual_array_length    = virtual_array_length;
+    params->fader_curve             = fader_curve;
+    params->dither                  = temporal_dither;
 }
 
-int32_t gfx_i32_lib_call( catbus_hash_t32 func_hash, int32_t *params, uint16_t param_len ){
+// library function registry.
+// sorted by hash so lookups can use a binary search.
+// functions must be registered before a program is loaded,
+// since the VM stores the table index at load time.
+static gfx_lib_func_t lib_funcs[GFX_LIB_MAX_FUNCS];
+static uint8_t lib_funcs_count;
 
-    switch( func_hash ){
+static int16_t find_lib_func( catbus_hash_t32 hash ){
 
-        case __KV__test_lib_call:
-            return params[0] + params[1];
-            break;
+    int16_t first = 0;
+    int16_t last = (int16_t)lib_funcs_count - 1;
 
+    while( first <= last ){
 
-        case __KV__noise:
-            return gfx_u16_noise( params[0] % 65536 );
-            break;
+        int16_t middle = ( first + last ) / 2;
 
-        default:
-            break;
-    }    
+        if( lib_funcs[middle].hash < hash ){
 
-    return 0;
-}
+            first = middle + 1;
+        }
+        else if( lib_funcs[middle].hash > hash ){
 
-int32_t gfx_i32_get_obj_attr( uint8_t obj, uint8_t attr, uint8_t addr ){
+            last = middle - 1;
+        }
+        else{
 
-    if( obj == PIX_OBJ_TYPE ){
+            return middle;
+        }
+    }
 
-        switch( attr ){
-            case PIX_ATTR_INDEX:
-                return pix_arrays[addr].index;
-                break;
+    return -1;
+}
 
-            case PIX_ATTR_COUNT:
-                // check if using virtual arrays
-                // AND if accessing master array
-                if( ( addr == 0 ) && ( virtual_array_length > 0 ) ){
+int8_t gfx_i8_lib_register(
+    catbus_hash_t32 hash,
+    gfx_lib_func_ptr_t func,
+    uint8_t arity,
+    uint8_t flags ){
 
-                    return virtual_array_length;          
-                }
+    // replace existing entry
+    int16_t index = find_lib_func( hash );
 
-                return pix_arrays[addr].count;
-                break;
+    if( index < 0 ){
 
-            case PIX_ATTR_SIZE_X:
-                return pix_arrays[addr].size_x;
-                break;
+        if( lib_funcs_count >= GFX_LIB_MAX_FUNCS ){
+
+            return -1;
+        }
+
+        // insert in sorted order
+        index = lib_funcs_count;
+
+        while( ( index > 0 ) && ( lib_funcs[index - 1].hash > hash ) ){
+
+            lib_funcs[index] = lib_funcs[index - 1];
+            index--;
+        }
+
+        lib_funcs_count++;
+    }
+
+    lib_funcs[index].hash   = hash;
+    lib_funcs[index].func   = func;
+    lib_funcs[index].arity  = arity;
+    lib_funcs[index].flags  = flags;
+
+    return 0;
+}
+
+// returns index of library function, or -1 if not found or the
+// parameter count does not match.
+// the VM resolves lib calls with this at load time.
+int16_t gfx_i16_get_lib_index( catbus_hash_t32 func_hash, uint8_t param_len ){
+
+    int16_t index = find_lib_func( func_hash );
+
+    if( index < 0 ){
+
+        return -1;
+    }
+
+    if( lib_funcs[index].flags & GFX_LIB_FLAGS_VAR_ARGS ){
+
+        if( param_len < lib_funcs[index].arity ){
+
+            return -1;
+        }
+    }
+    else if( param_len != lib_funcs[index].arity ){
+
+        return -1;
+    }
+
+    return index;
+}
+
+int32_t gfx_i32_lib_call_index( uint8_t index, int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    if( index >= lib_funcs_count ){
+
+        return 0;
+    }
+
+    return lib_funcs[index].func( params, param_len, rng_seed );
+}
+
+int32_t gfx_i32_lib_call( catbus_hash_t32 func_hash, int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    int16_t index = gfx_i16_get_lib_index( func_hash, param_len );
+
+    if( index < 0 ){
+
+        return 0;
+    }
+
+    return gfx_i32_lib_call_index( index, params, param_len, rng_seed );
+}
+
+static int32_t lib_test_lib_call( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return params[0] + params[1];
+}
+
+static int32_t lib_noise( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return gfx_u16_noise( params[0] % 65536 );
+}
+
+static int32_t lib_sine( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return sine( params[0] );
+}
+
+static int32_t lib_cosine( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return cosine( params[0] );
+}
+
+static int32_t lib_triangle( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return triangle( params[0] );
+}
+
+// rand_range(low, high): returns low <= n < high.
+// draws from the calling VM's generator, like rand().
+static int32_t lib_rand_range( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    int32_t low = params[0];
+    int32_t high = params[1];
+
+    if( high <= low ){
+
+        return low;
+    }
+
+    uint32_t r = ( (uint32_t)rnd_u16_get_int_with_seed( rng_seed ) << 16 ) | rnd_u16_get_int_with_seed( rng_seed );
+
+    return low + ( r % (uint32_t)( high - low ) );
+}
+
+// lerp(a, b, t): t is a 16 bit fraction
+static int32_t lib_lerp( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    int32_t a = params[0];
+    int32_t b = params[1];
+    int32_t t = params[2];
+
+    if( t < 0 ){
+
+        t = 0;
+    }
+    else if( t > 65535 ){
+
+        t = 65535;
+    }
+
+    return a + (int32_t)( ( (int64_t)( b - a ) * t ) / 65536 );
+}
+
+// smootherstep(x): x and result are 16 bit fractions.
+// interpolates between entries in the 8 bit lookup table.
+static int32_t lib_smootherstep( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    int32_t x = params[0];
+
+    if( x <= 0 ){
+
+        return 0;
+    }
+    else if( x >= 65535 ){
+
+        return 65535;
+    }
+
+    uint8_t i = x >> 8;
+    uint16_t t = x & 0xff;
+
+    uint16_t a = smootherstep_lookup[i];
+    uint16_t b = ( i < 255 ) ? smootherstep_lookup[i + 1] : 255;
+
+    return ( ( a * ( 256 - t ) + b * t ) * 257 ) >> 8;
+}
+
+// noise2(x, y): coordinates have 8 fractional bits
+static int32_t lib_noise2( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return gfx_u16_noise_2d( params[0], params[1] );
+}
+
+// noise3(x, y, z)
+static int32_t lib_noise3( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    return gfx_u16_noise_3d( params[0], params[1], params[2] );
+}
+
+// noise_fill(obj.attr, x, y, z, scale, octaves)
+// the compiler passes obj.attr as obj | ( attr << 8 )
+static int32_t lib_noise_fill( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    gfx_v_noise_fill( params[0] & 0xff, ( params[0] >> 8 ) & 0xff, params[1], params[2], params[3], params[4], params[5] );
+
+    return 0;
+}
+
+// fill_rect(obj, x, y, w, h, hue, sat, val): -1 leaves a channel as is
+static int32_t lib_fill_rect( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    gfx_v_fill_rect( params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7] );
+
+    return 0;
+}
+
+// draw_line(obj, x0, y0, x1, y1, hue, sat, val)
+static int32_t lib_draw_line( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    gfx_v_draw_line( params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7] );
+
+    return 0;
+}
+
+// blit(dest, x, y, src)
+static int32_t lib_blit( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    gfx_v_blit( params[0], params[1], params[2], params[3] );
+
+    return 0;
+}
+
+// scroll(obj, dx, dy)
+static int32_t lib_scroll( int32_t *params, uint16_t param_len, uint64_t *rng_seed ){
+
+    gfx_v_scroll( params[0], params[1], params[2] );
+
+    return 0;
+}
+
+static void register_lib_funcs( void ){
+
+    gfx_i8_lib_register( __KV__test_lib_call,   lib_test_lib_call,  2, 0 );
+    gfx_i8_lib_register( __KV__noise,           lib_noise,          1, 0 );
+    gfx_i8_lib_register( __KV__sine,            lib_sine,           1, 0 );
+    gfx_i8_lib_register( __KV__cosine,          lib_cosine,         1, 0 );
+    gfx_i8_lib_register( __KV__triangle,        lib_triangle,       1, 0 );
+    gfx_i8_lib_register( __KV__rand_range,      lib_rand_range,     2, 0 );
+    gfx_i8_lib_register( __KV__lerp,            lib_lerp,           3, 0 );
+    gfx_i8_lib_register( __KV__smootherstep,    lib_smootherstep,   1, 0 );
+    gfx_i8_lib_register( __KV__fill_rect,       lib_fill_rect,      8, 0 );
+    gfx_i8_lib_register( __KV__draw_line,       lib_draw_line,      8, 0 );
+    gfx_i8_lib_register( __KV__blit,            lib_blit,           4, 0 );
+    gfx_i8_lib_register( __KV__scroll,          lib_scroll,         3, 0 );
+    gfx_i8_lib_register( __KV__noise2,          lib_noise2,         2, 0 );
+    gfx_i8_lib_register( __KV__noise3,          lib_noise3,         3, 0 );
+    gfx_i8_lib_register( __KV__noise_fill,      lib_noise_fill,     6, 0 );
+}
+
+int32_t gfx_i32_get_obj_attr( uint8_t obj, uint8_t attr, uint8_t addr ){
+
+    if( obj == PIX_OBJ_TYPE ){
+
+        switch( attr ){
+            case PIX_ATTR_INDEX:
+                return pix_arrays[addr].index;
+                break;
+
+            case PIX_ATTR_COUNT:
+                // check if using virtual arrays
+                // AND if accessing master array
+                if( ( addr == 0 ) && ( virtual_array_length > 0 ) ){
+
+                    return virtual_array_length;          
+                }
+
+                return pix_arrays[addr].count;
+                break;
+
+            case PIX_ATTR_SIZE_X:
+                return pix_arrays[addr].size_x;
+                break;
 
             case PIX_ATTR_SIZE_Y:
                 return pix_arrays[addr].size_y;
@@ -361,7 +1199,23 @@ int32_t gfx_i32_get_obj_attr( uint8_t obj, uint8_t attr, uint8_t addr ){
 
 void gfx_v_set_pix_count( uint16_t setting ){
 
+    if( setting > MAX_PIXELS ){
+
+        setting = MAX_PIXELS;
+    }
+    else if( setting == 0 ){
+
+        setting = 1;
+    }
+
+    if( resize_store( setting ) < 0 ){
+
+        setting = pix_alloc;
+    }
+
     pix_count = setting;
+    index_map_valid = FALSE;
+    sync_all = TRUE;
 }
 
 uint16_t gfx_u16_get_pix_count( void ){
@@ -394,6 +1248,7 @@ uint16_t gfx_u16_get_submaster_dimmer( void ){
 void gfx_v_set_size_x( uint16_t size ){
 
     pix_size_x = size;
+    index_map_valid = FALSE;
 }
 
 uint16_t gfx_u16_get_size_x( void ){
@@ -404,6 +1259,7 @@ uint16_t gfx_u16_get_size_x( void ){
 void gfx_v_set_size_y( uint16_t size ){
 
     pix_size_y = size;
+    index_map_valid = FALSE;
 }
 
 uint16_t gfx_u16_get_size_y( void ){
@@ -414,6 +1270,7 @@ uint16_t gfx_u16_get_size_y( void ){
 void gfx_v_set_interleave_x( bool setting ){
 
     pix_interleave_x = setting;
+    index_map_valid = FALSE;
 }
 
 bool gfx_b_get_interleave_x( void ){
@@ -424,6 +1281,7 @@ bool gfx_b_get_interleave_x( void ){
 void gfx_v_set_transpose( bool setting ){
 
     pix_transpose = setting;
+    index_map_valid = FALSE;
 }
 
 bool gfx_b_get_transpose( void ){
@@ -453,75 +1311,103 @@ uint16_t gfx_u16_get_vfade( void ){
 
 
 
+static inline void mark_fader( uint16_t index ){
+
+    fader_active[index >> 5] |= (uint32_t)1 << ( index & 31 );
+}
+
+static void mark_fader_range( uint16_t index, uint16_t len ){
+
+    while( len > 0 ){
+
+        // whole words
+        if( ( ( index & 31 ) == 0 ) && ( len >= 32 ) ){
+
+            fader_active[index >> 5] = 0xffffffff;
+            index += 32;
+            len -= 32;
+
+            continue;
+        }
+
+        mark_fader( index );
+        index++;
+        len--;
+    }
+}
+
 void _gfx_v_set_hue_1d( uint16_t h, uint16_t index ){
 
     // bounds check
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
 
         return;
     }
 
     target_hue[index] = h;
+    mark_fader( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
+    SET_FADER_STEP( FADER_HUE, index, 0 );
 }
 
 void _gfx_v_set_sat_1d( uint16_t s, uint16_t index ){
 
     // bounds check
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
 
         return;
     }
 
     target_sat[index] = s;
+    mark_fader( index );
     
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    sat_step[index] = 0;
+    SET_FADER_STEP( FADER_SAT, index, 0 );
 }
 
 void _gfx_v_set_val_1d( uint16_t v, uint16_t index ){
 
     // bounds check
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
 
         return;
     }
 
     target_val[index] = v;
+    mark_fader( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    SET_FADER_STEP( FADER_VAL, index, 0 );
 }
 
 void _gfx_v_set_hs_fade_1d( uint16_t a, uint16_t index ){
 
     // bounds check
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
 
         return;
     }
 
-    hs_fade[index] = a;
+    HS_FADE( index ) = a;
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
-    sat_step[index] = 0;
+    SET_FADER_STEP( FADER_HUE, index, 0 );
+    SET_FADER_STEP( FADER_SAT, index, 0 );
 }
 
 void _gfx_v_set_v_fade_1d( uint16_t a, uint16_t index ){
 
     // bounds check
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
 
         return;
     }
 
-    v_fade[index] = a;
+    V_FADE( index ) = a;
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    SET_FADER_STEP( FADER_VAL, index, 0 );
 }
 
 
@@ -544,362 +1430,385 @@ static uint16_t* _gfx_u16p_get_array_ptr( uint8_t attr ){
     }
     else if( attr == PIX_ATTR_HS_FADE ){
 
-        ptr = hs_fade;
+        ptr = &HS_FADE( 0 );
     }
     else if( attr == PIX_ATTR_V_FADE ){
 
-        ptr = v_fade;
+        ptr = &V_FADE( 0 );
     }
 
     return ptr;
 }
 
-void gfx_v_array_move( uint8_t obj, uint8_t attr, int32_t src ){
+// Pixel array kernels
+//
+// Whole array ops run one kernel per (attribute, operation) over
+// contiguous runs of the attribute array, instead of branching on
+// the attribute for every pixel.
+// Hue wraps around, all other attributes saturate to 0-65535.
+//
+// Add and subtract work on two 16 bit lanes per 32 bit word (SWAR).
 
-    if( obj >= pix_array_count ){
+typedef uint32_t __attribute__((may_alias)) gfx_swar_t;
 
-        return;
-    }
+#define SWAR_HIGH_BITS  0x80008000
+#define SWAR_LOW_BITS   0x7fff7fff
 
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
+// lane-wise wrapping add
+static inline uint32_t swar_add( uint32_t x, uint32_t y ){
 
-        uint16_t index = i + pix_arrays[obj].index;
+    return ( ( x & SWAR_LOW_BITS ) + ( y & SWAR_LOW_BITS ) ) ^ ( ( x ^ y ) & SWAR_HIGH_BITS );
+}
 
-        index %= pix_count;
+// lane-wise saturating add
+static inline uint32_t swar_adds( uint32_t x, uint32_t y ){
 
-        int32_t a = src;
+    uint32_t sum = swar_add( x, y );
+    uint32_t carry = ( ( x & y ) | ( ( x | y ) & ~sum ) ) & SWAR_HIGH_BITS;
 
-        if( attr == PIX_ATTR_HUE ){
+    // expand carry bits to full lane masks
+    return sum | ( ( carry >> 15 ) * 0xffff );
+}
 
-            a %= 65536;
-        }
-        else{
+// lane-wise saturating subtract
+static inline uint32_t swar_subs( uint32_t x, uint32_t y ){
 
-            if( a > 65535 ){
+    uint32_t diff = ( ( x | SWAR_HIGH_BITS ) - ( y & SWAR_LOW_BITS ) ) ^ ( ( x ^ ~y ) & SWAR_HIGH_BITS );
+    uint32_t borrow = ( ( ~x & y ) | ( ~( x ^ y ) & diff ) ) & SWAR_HIGH_BITS;
 
-                a = 65535;
-            }
-            else if( a < 0 ){
+    return diff & ~( ( borrow >> 15 ) * 0xffff );
+}
 
-                a = 0;
-            }
-        }
+#define KERNEL_ADD      0
+#define KERNEL_ADDS     1
+#define KERNEL_SUBS     2
 
-        if( attr == PIX_ATTR_HUE ){
+static void kernel_swar( uint8_t kernel, uint16_t *ptr, uint16_t len, uint16_t s ){
 
-            _gfx_v_set_hue_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_SAT ){
+    uint16_t i = 0;
+
+    // align to 32 bits
+    if( ( i < len ) && ( ( (uintptr_t)&ptr[i] & 0x03 ) != 0 ) ){
+
+        uint32_t a = swar_add( ptr[i], s );
+
+        if( kernel == KERNEL_ADDS ){
 
-            _gfx_v_set_sat_1d( a, index );
+            a = swar_adds( ptr[i], s );
         }
-        else if( attr == PIX_ATTR_HS_FADE ){
+        else if( kernel == KERNEL_SUBS ){
 
-            _gfx_v_set_hs_fade_1d( a, index );
+            a = swar_subs( ptr[i], s );
         }
-        else if( attr == PIX_ATTR_V_FADE ){
 
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
-        else{
+        ptr[i] = a;
+        i++;
+    }
+
+    uint32_t s2 = ( (uint32_t)s << 16 ) | s;
+    gfx_swar_t *word = (gfx_swar_t *)&ptr[i];
 
-            _gfx_v_set_val_1d( a, index );
+    if( kernel == KERNEL_ADD ){
+
+        for( ; ( i + 2 ) <= len; i += 2 ){
+
+            *word = swar_add( *word, s2 );
+            word++;
         }
     }
-}
-
-void gfx_v_array_add( uint8_t obj, uint8_t attr, int32_t src ){
+    else if( kernel == KERNEL_ADDS ){
 
-    if( obj >= pix_array_count ){
+        for( ; ( i + 2 ) <= len; i += 2 ){
 
-        return;
+            *word = swar_adds( *word, s2 );
+            word++;
+        }
     }
+    else{
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
+        for( ; ( i + 2 ) <= len; i += 2 ){
 
-        uint16_t index = i + pix_arrays[obj].index;
+            *word = swar_subs( *word, s2 );
+            word++;
+        }
+    }
 
-        index %= pix_count;
+    // remaining lane.
+    // the upper lane is 0, so it cannot carry into the result.
+    if( i < len ){
 
-        int32_t a = *( ptr + index );
+        uint32_t a = swar_add( ptr[i], s );
 
-        a += src;
+        if( kernel == KERNEL_ADDS ){
 
-        if( attr == PIX_ATTR_HUE ){
+            a = swar_adds( ptr[i], s );
+        }
+        else if( kernel == KERNEL_SUBS ){
 
-            a %= 65536;
+            a = swar_subs( ptr[i], s );
         }
-        else{
 
-            if( a > 65535 ){
+        ptr[i] = a;
+    }
+}
 
-                a = 65535;
-            }
-            else if( a < 0 ){
+static void kernel_fill( uint16_t *ptr, uint16_t len, uint16_t s ){
 
-                a = 0;
-            }
-        }
+    for( uint16_t i = 0; i < len; i++ ){
 
-        if( attr == PIX_ATTR_HUE ){
+        ptr[i] = s;
+    }
+}
 
-            _gfx_v_set_hue_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_SAT ){
+static void kernel_mul_hue( uint16_t *ptr, uint16_t len, uint16_t s ){
 
-            _gfx_v_set_sat_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_HS_FADE ){
+    for( uint16_t i = 0; i < len; i++ ){
 
-            _gfx_v_set_hs_fade_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_V_FADE ){
+        ptr[i] = ptr[i] * s;
+    }
+}
 
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
-        else{
+// s must be 1 to 65536
+static void kernel_mul_sat( uint16_t *ptr, uint16_t len, uint32_t s ){
 
-            _gfx_v_set_val_1d( a, index );
-        }
+    for( uint16_t i = 0; i < len; i++ ){
+
+        uint32_t a = ptr[i] * s;
+
+        ptr[i] = ( a > 65535 ) ? 65535 : a;
     }
 }
 
+static void kernel_div( uint16_t *ptr, uint16_t len, int32_t s ){
 
-void gfx_v_array_sub( uint8_t obj, uint8_t attr, int32_t src ){
-
-    if( obj >= pix_array_count ){
+    for( uint16_t i = 0; i < len; i++ ){
 
-        return;
+        ptr[i] = (int32_t)ptr[i] / s;
     }
+}
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
+static void kernel_mod( uint16_t *ptr, uint16_t len, int32_t s ){
+
+    for( uint16_t i = 0; i < len; i++ ){
+
+        ptr[i] = (int32_t)ptr[i] % s;
+    }
+}
 
-        uint16_t index = i + pix_arrays[obj].index;
+#define ARRAY_OP_MOVE   0
+#define ARRAY_OP_ADD    1
+#define ARRAY_OP_SUB    2
+#define ARRAY_OP_MUL    3
+#define ARRAY_OP_DIV    4
+#define ARRAY_OP_MOD    5
 
-        index %= pix_count;
+static void _gfx_v_array_kernel( uint16_t *ptr, uint16_t len, bool wrap, uint8_t op, int32_t src ){
 
-        int32_t a = *( ptr + index );
+    if( op == ARRAY_OP_SUB ){
 
-        a -= src;
+        op = ARRAY_OP_ADD;
 
-        if( attr == PIX_ATTR_HUE ){
+        if( wrap ){
 
-            a %= 65536;
+            // only the lower 16 bits matter
+            src = (uint16_t)( 0 - (uint32_t)src );
         }
         else{
 
-            if( a > 65535 ){
+            // limit so negation cannot overflow, this does not change the result
+            if( src > 65536 ){
 
-                a = 65535;
+                src = 65536;
             }
-            else if( a < 0 ){
+            else if( src < -65536 ){
 
-                a = 0;
+                src = -65536;
             }
+
+            src = -src;
         }
+    }
 
-        if( attr == PIX_ATTR_HUE ){
+    if( op == ARRAY_OP_MOVE ){
 
-            _gfx_v_set_hue_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_SAT ){
+        if( wrap ){
 
-            _gfx_v_set_sat_1d( a, index );
+            kernel_fill( ptr, len, src );
         }
-        else if( attr == PIX_ATTR_HS_FADE ){
+        else{
 
-            _gfx_v_set_hs_fade_1d( a, index );
+            kernel_fill( ptr, len, ( src < 0 ) ? 0 : ( src > 65535 ) ? 65535 : src );
         }
-        else if( attr == PIX_ATTR_V_FADE ){
+    }
+    else if( op == ARRAY_OP_ADD ){
 
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
-        else{
+        if( wrap ){
 
-            _gfx_v_set_val_1d( a, index );
+            kernel_swar( KERNEL_ADD, ptr, len, src );
         }
-    }
-}
+        else if( src >= 65535 ){
 
+            kernel_fill( ptr, len, 65535 );
+        }
+        else if( src <= -65535 ){
 
-void gfx_v_array_mul( uint8_t obj, uint8_t attr, int32_t src ){
+            kernel_fill( ptr, len, 0 );
+        }
+        else if( src >= 0 ){
 
-    if( obj >= pix_array_count ){
+            kernel_swar( KERNEL_ADDS, ptr, len, src );
+        }
+        else{
 
-        return;
+            kernel_swar( KERNEL_SUBS, ptr, len, -src );
+        }
     }
+    else if( op == ARRAY_OP_MUL ){
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
+        if( wrap ){
 
-        uint16_t index = i + pix_arrays[obj].index;
-
-        index %= pix_count;
-
-        int32_t a = *( ptr + index );
-
-        a *= src;
-
-        if( attr == PIX_ATTR_HUE ){
+            kernel_mul_hue( ptr, len, src );
+        }
+        else if( src <= 0 ){
 
-            a %= 65536;
+            kernel_fill( ptr, len, 0 );
         }
         else{
 
-            if( a > 65535 ){
-
-                a = 65535;
-            }
-            else if( a < 0 ){
-
-                a = 0;
-            }
+            kernel_mul_sat( ptr, len, ( src > 65536 ) ? 65536 : src );
         }
+    }
+    // divide and modulo by 0 return 0, same as the scalar opcodes
+    else if( src == 0 ){
 
-        if( attr == PIX_ATTR_HUE ){
-
-            _gfx_v_set_hue_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_SAT ){
+        kernel_fill( ptr, len, 0 );
+    }
+    else if( op == ARRAY_OP_DIV ){
 
-            _gfx_v_set_sat_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_HS_FADE ){
+        if( !wrap && ( src < 0 ) ){
 
-            _gfx_v_set_hs_fade_1d( a, index );
+            kernel_fill( ptr, len, 0 );
         }
-        else if( attr == PIX_ATTR_V_FADE ){
-
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
         else{
 
-            _gfx_v_set_val_1d( a, index );
+            kernel_div( ptr, len, src );
         }
     }
-}
+    else if( op == ARRAY_OP_MOD ){
 
+        kernel_mod( ptr, len, src );
+    }
+}
 
-void gfx_v_array_div( uint8_t obj, uint8_t attr, int32_t src ){
+static void _gfx_v_array_op( uint8_t obj, uint8_t attr, uint8_t op, int32_t src ){
 
     if( obj >= pix_array_count ){
 
         return;
     }
 
+    if( pix_count == 0 ){
+
+        return;
+    }
+
     uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
+    bool wrap = ( attr == PIX_ATTR_HUE );
 
-        uint16_t index = i + pix_arrays[obj].index;
+    #ifdef GFX_SHARED_FADE_TIMES
+    // one fade time for all pixels, apply the op to it once.
+    // the fader steps below are still reset for the object's pixels.
+    bool shared = ( attr == PIX_ATTR_HS_FADE ) || ( attr == PIX_ATTR_V_FADE );
 
-        index %= pix_count;
+    if( shared ){
 
-        int32_t a = *( ptr + index );
+        _gfx_v_array_kernel( ptr, 1, FALSE, op, src );
+    }
+    #else
+    bool shared = FALSE;
+    #endif
 
-        a /= src;
+    uint16_t start = pix_arrays[obj].index % pix_count;
+    uint16_t remaining = pix_arrays[obj].count;
 
-        if( attr == PIX_ATTR_HUE ){
+    // process in contiguous runs, wrapping around the end of the pixel array
+    while( remaining > 0 ){
+
+        uint16_t len = pix_count - start;
+
+        if( len > remaining ){
 
-            a %= 65536;
+            len = remaining;
         }
-        else{
 
-            if( a > 65535 ){
+        // bounds check
+        if( ( start + len ) > pix_alloc ){
 
-                a = 65535;
-            }
-            else if( a < 0 ){
+            len = pix_alloc - start;
+        }
 
-                a = 0;
-            }
+        if( !shared ){
+
+            _gfx_v_array_kernel( &ptr[start], len, wrap, op, src );
+        }
+
+        if( ( attr == PIX_ATTR_HUE ) || ( attr == PIX_ATTR_SAT ) || ( attr == PIX_ATTR_VAL ) ){
+
+            mark_fader_range( start, len );
         }
 
+        // reset faders, this will trigger the fader process to recalculate the fader steps.
         if( attr == PIX_ATTR_HUE ){
 
-            _gfx_v_set_hue_1d( a, index );
+            reset_fader_steps( FADER_HUE, start, len );
         }
         else if( attr == PIX_ATTR_SAT ){
 
-            _gfx_v_set_sat_1d( a, index );
+            reset_fader_steps( FADER_SAT, start, len );
         }
         else if( attr == PIX_ATTR_HS_FADE ){
 
-            _gfx_v_set_hs_fade_1d( a, index );
+            reset_fader_steps( FADER_HUE, start, len );
+            reset_fader_steps( FADER_SAT, start, len );
         }
-        else if( attr == PIX_ATTR_V_FADE ){
-
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
         else{
 
-            _gfx_v_set_val_1d( a, index );
+            reset_fader_steps( FADER_VAL, start, len );
         }
-    }
-}
-
-
-void gfx_v_array_mod( uint8_t obj, uint8_t attr, int32_t src ){
-
-    if( obj >= pix_array_count ){
 
-        return;
+        remaining -= len;
+        start = 0;
     }
+}
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
-    for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
-
-        uint16_t index = i + pix_arrays[obj].index;
-
-        index %= pix_count;
-
-        int32_t a = *( ptr + index );
-
-        a %= src;
+void gfx_v_array_move( uint8_t obj, uint8_t attr, int32_t src ){
 
-        if( attr == PIX_ATTR_HUE ){
+    _gfx_v_array_op( obj, attr, ARRAY_OP_MOVE, src );
+}
 
-            a %= 65536;
-        }
-        else{
+void gfx_v_array_add( uint8_t obj, uint8_t attr, int32_t src ){
 
-            if( a > 65535 ){
+    _gfx_v_array_op( obj, attr, ARRAY_OP_ADD, src );
+}
 
-                a = 65535;
-            }
-            else if( a < 0 ){
+void gfx_v_array_sub( uint8_t obj, uint8_t attr, int32_t src ){
 
-                a = 0;
-            }
-        }
+    _gfx_v_array_op( obj, attr, ARRAY_OP_SUB, src );
+}
 
-        if( attr == PIX_ATTR_HUE ){
+void gfx_v_array_mul( uint8_t obj, uint8_t attr, int32_t src ){
 
-            _gfx_v_set_hue_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_SAT ){
+    _gfx_v_array_op( obj, attr, ARRAY_OP_MUL, src );
+}
 
-            _gfx_v_set_sat_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_HS_FADE ){
+void gfx_v_array_div( uint8_t obj, uint8_t attr, int32_t src ){
 
-            _gfx_v_set_hs_fade_1d( a, index );
-        }
-        else if( attr == PIX_ATTR_V_FADE ){
+    _gfx_v_array_op( obj, attr, ARRAY_OP_DIV, src );
+}
 
-            _gfx_v_set_v_fade_1d( a, index );
-        }   
-        else{
+void gfx_v_array_mod( uint8_t obj, uint8_t attr, int32_t src ){
 
-            _gfx_v_set_val_1d( a, index );
-        }
-    }
+    _gfx_v_array_op( obj, attr, ARRAY_OP_MOD, src );
 }
 
 
@@ -955,7 +1864,7 @@ uint16_t gfx_u16_get_pix0_blue( void ){
 
 void gfx_v_set_background_hsv( int32_t h, int32_t s, int32_t v ){
 
-    for( uint16_t i = 0; i < MAX_PIXELS; i++ ){
+    for( uint16_t i = 0; i < pix_alloc; i++ ){
 
         gfx_v_set_hsv( h, s, v, i );
     }
@@ -1040,6 +1949,151 @@ static uint16_t calc_index( uint8_t obj, uint16_t x, uint16_t y ){
     return index;
 }
 
+static void reset_index_maps( void ){
+
+    memset( index_map_sets, 0, sizeof(index_map_sets) );
+    index_map_used = 0;
+    index_map_set = 0;
+    index_map_valid = TRUE;
+}
+
+static void build_index_map( gfx_index_map_set_t *set ){
+
+    #ifdef VM_BENCH
+    index_map_builds++;
+    #endif
+
+    uint32_t free = (uint32_t)pix_alloc * GFX_INDEX_MAP_PER_PIXEL - index_map_used;
+    uint16_t *ptr = index_map + index_map_used;
+
+    memset( set, 0, sizeof(gfx_index_map_set_t) );
+    set->arrays = pix_arrays;
+    set->count = pix_array_count;
+
+    for( uint8_t obj = 0; ( obj < pix_array_count ) && ( obj < GFX_INDEX_MAP_OBJS ); obj++ ){
+
+        gfx_index_map_t *map = &set->maps[obj];
+
+        // cover the virtual array on 1D accesses, if there is one
+        uint16_t len_1d = pix_arrays[obj].count;
+
+        if( virtual_array_length > len_1d ){
+
+            len_1d = virtual_array_length;
+        }
+
+        if( len_1d <= free ){
+
+            map->offset_1d = ptr - index_map;
+            map->len_1d = len_1d;
+
+            for( uint16_t x = 0; x < len_1d; x++ ){
+
+                *ptr++ = calc_index( obj, x, 65535 );
+            }
+
+            free -= len_1d;
+        }
+
+        uint16_t size_x = pix_arrays[obj].size_x;
+        uint16_t size_y = pix_arrays[obj].size_y;
+
+        // transpose swaps the axes
+        if( pix_transpose ){
+
+            size_x = pix_arrays[obj].size_y;
+            size_y = pix_arrays[obj].size_x;
+        }
+
+        uint32_t len_2d = (uint32_t)size_x * size_y;
+
+        if( ( size_y > 1 ) && ( len_2d <= free ) ){
+
+            map->offset_2d = ptr - index_map;
+            map->size_x = size_x;
+            map->size_y = size_y;
+
+            for( uint16_t y = 0; y < size_y; y++ ){
+
+                for( uint16_t x = 0; x < size_x; x++ ){
+
+                    *ptr++ = calc_index( obj, x, y );
+                }
+            }
+
+            free -= len_2d;
+        }
+    }
+
+    index_map_used = ptr - index_map;
+}
+
+// find or build the map set for the current pixel arrays
+static gfx_index_map_set_t *get_index_map_set( void ){
+
+    if( !index_map_valid ){
+
+        reset_index_maps();
+    }
+
+    gfx_index_map_set_t *unused = 0;
+
+    for( uint8_t i = 0; i < GFX_INDEX_MAP_SETS; i++ ){
+
+        gfx_index_map_set_t *set = &index_map_sets[i];
+
+        if( set->arrays == 0 ){
+
+            if( unused == 0 ){
+
+                unused = set;
+            }
+        }
+        else if( ( set->arrays == pix_arrays ) && ( set->count == pix_array_count ) ){
+
+            return set;
+        }
+    }
+
+    // all sets in use, start over
+    if( unused == 0 ){
+
+        reset_index_maps();
+        unused = &index_map_sets[0];
+    }
+
+    build_index_map( unused );
+
+    return unused;
+}
+
+static uint16_t map_index( uint8_t obj, uint16_t x, uint16_t y ){
+
+    if( !index_map_valid || ( index_map_set == 0 ) ){
+
+        index_map_set = get_index_map_set();
+    }
+
+    if( obj < GFX_INDEX_MAP_OBJS ){
+
+        gfx_index_map_t *map = &index_map_set->maps[obj];
+
+        if( y == 65535 ){
+
+            if( x < map->len_1d ){
+
+                return index_map[map->offset_1d + x];
+            }
+        }
+        else if( ( x < map->size_x ) && ( y < map->size_y ) ){
+
+            return index_map[map->offset_2d + x + ( y * map->size_x )];
+        }
+    }
+
+    return calc_index( obj, x, y );
+}
+
 
 
 void gfx_v_set_hsv( int32_t h, int32_t s, int32_t v, uint16_t index ){
@@ -1062,9 +2116,9 @@ void gfx_v_set_hsv( int32_t h, int32_t s, int32_t v, uint16_t index ){
 
 void gfx_v_set_hsv_2d( int32_t h, int32_t s, int32_t v, uint16_t x, uint16_t y ){
 
-    uint16_t index = calc_index( 0, x, y );
+    uint16_t index = map_index( 0, x, y );
 
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
@@ -1073,9 +2127,9 @@ void gfx_v_set_hsv_2d( int32_t h, int32_t s, int32_t v, uint16_t x, uint16_t y )
 
 void gfx_v_set_hue( uint16_t h, uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
@@ -1085,18 +2139,18 @@ void gfx_v_set_hue( uint16_t h, uint16_t x, uint16_t y, uint8_t obj ){
 
 uint16_t gfx_u16_get_hue( uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    index %= MAX_PIXELS;
+    index %= pix_alloc;
 
     return target_hue[index];
 }
 
 void gfx_v_set_sat( uint16_t s, uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
@@ -1105,18 +2159,18 @@ void gfx_v_set_sat( uint16_t s, uint16_t x, uint16_t y, uint8_t obj ){
 
 uint16_t gfx_u16_get_sat( uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    index %= MAX_PIXELS;
+    index %= pix_alloc;
 
     return target_sat[index];
 }
 
 void gfx_v_set_val( uint16_t v, uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
@@ -1125,58 +2179,58 @@ void gfx_v_set_val( uint16_t v, uint16_t x, uint16_t y, uint8_t obj ){
 
 uint16_t gfx_u16_get_val( uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    index %= MAX_PIXELS;
+    index %= pix_alloc;
 
     return target_val[index];
 }
 
 void gfx_v_set_hs_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
 
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
-    hs_fade[index] = a;
+    HS_FADE( index ) = a;
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
-    sat_step[index] = 0;
+    SET_FADER_STEP( FADER_HUE, index, 0 );
+    SET_FADER_STEP( FADER_SAT, index, 0 );
 }
 
 uint16_t gfx_u16_get_hs_fade( uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    index %= MAX_PIXELS;
+    index %= pix_alloc;
 
-    return hs_fade[index];
+    return HS_FADE( index );
 }
 
 void gfx_v_set_v_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
 
-    if( index >= MAX_PIXELS ){
+    if( index >= pix_alloc ){
         return;
     }
 
-    v_fade[index] = a;
+    V_FADE( index ) = a;
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    SET_FADER_STEP( FADER_VAL, index, 0 );
 }
 
 uint16_t gfx_u16_get_v_fade( uint16_t x, uint16_t y, uint8_t obj ){
 
-    uint16_t index = calc_index( obj, x, y );
+    uint16_t index = map_index( obj, x, y );
     
-    index %= MAX_PIXELS;
+    index %= pix_alloc;
         
-    return v_fade[index];
+    return V_FADE( index );
 }
 
 
@@ -1184,15 +2238,20 @@ uint16_t gfx_u16_get_is_fading( uint16_t x, uint16_t y, uint8_t obj ){
 
     if( ( x == 65535 ) && ( y == 65535 ) ){
 
+        if( ( obj >= pix_array_count ) || ( pix_count == 0 ) ){
+
+            return 0;
+        }
+
         for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
             uint16_t index = i + pix_arrays[obj].index;
 
             index %= pix_count;
 
-            if( ( target_hue[i] != hue[i] ) ||
-                ( target_sat[i] != sat[i] ) ||
-                ( target_val[i] != val[i] ) ){
+            if( ( target_hue[index] != hue[index] ) ||
+                ( target_sat[index] != sat[index] ) ||
+                ( target_val[index] != val[index] ) ){
 
                 return 1;
             }
@@ -1202,403 +2261,1374 @@ uint16_t gfx_u16_get_is_fading( uint16_t x, uint16_t y, uint8_t obj ){
     }
     else{
 
-        uint16_t i = calc_index( obj, x, y );
+        uint16_t i = map_index( obj, x, y );
+
+        if( i < pix_alloc ){        
+            if( ( target_hue[i] == hue[i] ) &&
+                ( target_sat[i] == sat[i] ) &&
+                ( target_val[i] == val[i] ) ){
+
+                return 0;
+            }
+        }
+
+        return 1;    
+    }
+}
+
+
+// 2D primitives
+//
+// These work on a pixel object's x/y geometry, with coordinates
+// wrapping like the [x][y] accessors. They set targets the same way
+// as per pixel assignment, so the faders run as usual.
+// When an object maps to a plain row major range of the strip
+// (no transpose, interleave or reverse) rows are handled as spans.
+
+// drawable area of a pixel object, kept within its pixel count
+static bool prim_geometry( uint8_t obj, uint16_t *size_x, uint16_t *size_y ){
+
+    if( obj >= pix_array_count ){
+
+        return FALSE;
+    }
+
+    uint16_t count = pix_arrays[obj].count;
+    uint16_t sx = pix_arrays[obj].size_x;
+
+    if( ( count == 0 ) || ( sx == 0 ) || ( pix_arrays[obj].size_y == 0 ) ){
+
+        return FALSE;
+    }
+
+    if( sx > count ){
+
+        sx = count;
+    }
+
+    uint16_t sy = count / sx;
+
+    if( pix_arrays[obj].size_y < sy ){
+
+        sy = pix_arrays[obj].size_y;
+    }
+
+    *size_x = sx;
+    *size_y = sy;
+
+    return TRUE;
+}
+
+// first pixel of the object if it is a row major span of the strip,
+// -1 if it has to go through map_index
+static int32_t prim_linear_base( uint8_t obj, uint16_t size_x, uint16_t size_y ){
+
+    if( pix_transpose || pix_interleave_x || pix_arrays[obj].reverse ){
+
+        return -1;
+    }
+
+    uint32_t end = (uint32_t)pix_arrays[obj].index + (uint32_t)size_x * size_y;
+
+    if( end > pix_count ){
+
+        return -1;
+    }
+
+    return pix_arrays[obj].index;
+}
+
+static uint16_t prim_wrap( int32_t c, uint16_t size ){
+
+    c %= size;
+
+    if( c < 0 ){
+
+        c += size;
+    }
+
+    return c;
+}
+
+static int32_t prim_clamp( int32_t c ){
+
+    if( c < -32768 ){
+
+        return -32768;
+    }
+    else if( c > 32767 ){
+
+        return 32767;
+    }
+
+    return c;
+}
+
+static void prim_set_span( uint16_t start, uint16_t len, int32_t h, int32_t s, int32_t v ){
+
+    if( h >= 0 ){
+
+        kernel_fill( &target_hue[start], len, h );
+        reset_fader_steps( FADER_HUE, start, len );
+    }
+
+    if( s >= 0 ){
+
+        kernel_fill( &target_sat[start], len, s );
+        reset_fader_steps( FADER_SAT, start, len );
+    }
+
+    if( v >= 0 ){
+
+        kernel_fill( &target_val[start], len, v );
+        reset_fader_steps( FADER_VAL, start, len );
+    }
+
+    mark_fader_range( start, len );
+}
+
+static void prim_copy_span( uint16_t from, uint16_t to, uint16_t len ){
+
+    memmove( &target_hue[to], &target_hue[from], len * sizeof(uint16_t) );
+    memmove( &target_sat[to], &target_sat[from], len * sizeof(uint16_t) );
+    memmove( &target_val[to], &target_val[from], len * sizeof(uint16_t) );
+
+    reset_fader_steps( FADER_HUE, to, len );
+    reset_fader_steps( FADER_SAT, to, len );
+    reset_fader_steps( FADER_VAL, to, len );
+
+    mark_fader_range( to, len );
+}
+
+static void prim_set( uint8_t obj, uint16_t x, uint16_t y, int32_t h, int32_t s, int32_t v ){
+
+    uint16_t index = map_index( obj, x, y );
+
+    if( index >= pix_alloc ){
+
+        return;
+    }
+
+    gfx_v_set_hsv( h, s, v, index );
+}
+
+static void reverse_u16( uint16_t *ptr, uint16_t len ){
+
+    uint16_t *end = ptr + len - 1;
+
+    while( ptr < end ){
+
+        uint16_t temp = *ptr;
+        *ptr++ = *end;
+        *end-- = temp;
+    }
+}
+
+// rotate a span of targets by n pixels towards the end
+static void prim_rotate_span( uint16_t start, uint16_t len, uint16_t n ){
+
+    uint16_t *ptrs[3] = { target_hue, target_sat, target_val };
+
+    for( uint8_t ch = 0; ch < 3; ch++ ){
+
+        uint16_t *ptr = &ptrs[ch][start];
+
+        reverse_u16( ptr, len );
+        reverse_u16( ptr, n );
+        reverse_u16( ptr + n, len - n );
+
+        reset_fader_steps( ch, start, len );
+    }
+
+    mark_fader_range( start, len );
+}
+
+static uint16_t prim_line_index( uint8_t obj, bool along_y, uint16_t line, uint16_t pos ){
+
+    if( along_y ){
+
+        return map_index( obj, line, pos );
+    }
+
+    return map_index( obj, pos, line );
+}
+
+// rotate a row, or a column if along_y is set, by n pixels.
+// each pixel is moved once, following the cycles of the rotation.
+static void prim_rotate_line( uint8_t obj, bool along_y, uint16_t line, uint16_t len, uint16_t n ){
+
+    uint16_t cycles = len;
+    uint16_t temp = n;
+
+    // gcd of len and n
+    while( temp != 0 ){
+
+        uint16_t r = cycles % temp;
+        cycles = temp;
+        temp = r;
+    }
+
+    for( uint16_t start = 0; start < cycles; start++ ){
+
+        uint16_t cur = start;
+        uint16_t index = prim_line_index( obj, along_y, line, cur );
+
+        if( index >= pix_alloc ){
+
+            continue;
+        }
+
+        uint16_t h = target_hue[index];
+        uint16_t s = target_sat[index];
+        uint16_t v = target_val[index];
+
+        while( TRUE ){
+
+            uint16_t prev = ( cur + len - n ) % len;
+
+            if( prev == start ){
+
+                break;
+            }
+
+            uint16_t prev_index = prim_line_index( obj, along_y, line, prev );
+
+            if( prev_index < pix_alloc ){
+
+                gfx_v_set_hsv( target_hue[prev_index], target_sat[prev_index], target_val[prev_index], index );
+            }
+
+            cur = prev;
+            index = prev_index;
+
+            if( index >= pix_alloc ){
+
+                break;
+            }
+        }
+
+        if( index < pix_alloc ){
+
+            gfx_v_set_hsv( h, s, v, index );
+        }
+    }
+}
+
+void gfx_v_fill_rect( uint8_t obj, int32_t x, int32_t y, int32_t w, int32_t h, int32_t _hue, int32_t _sat, int32_t _val ){
+
+    uint16_t size_x, size_y;
+
+    if( !prim_geometry( obj, &size_x, &size_y ) ){
+
+        return;
+    }
+
+    if( ( w <= 0 ) || ( h <= 0 ) ){
+
+        return;
+    }
+
+    if( w > size_x ){
+
+        w = size_x;
+    }
+
+    if( h > size_y ){
+
+        h = size_y;
+    }
+
+    uint16_t x0 = prim_wrap( x, size_x );
+    uint16_t y0 = prim_wrap( y, size_y );
+
+    int32_t base = prim_linear_base( obj, size_x, size_y );
+
+    for( uint16_t row = 0; row < h; row++ ){
+
+        uint16_t py = ( y0 + row ) % size_y;
+
+        if( base >= 0 ){
+
+            uint16_t row_start = base + ( py * size_x );
+
+            // split where the rect wraps around the right edge
+            uint16_t len = size_x - x0;
+
+            if( len > w ){
+
+                len = w;
+            }
+
+            prim_set_span( row_start + x0, len, _hue, _sat, _val );
+
+            if( len < w ){
+
+                prim_set_span( row_start, w - len, _hue, _sat, _val );
+            }
+        }
+        else{
+
+            for( uint16_t col = 0; col < w; col++ ){
+
+                prim_set( obj, ( x0 + col ) % size_x, py, _hue, _sat, _val );
+            }
+        }
+    }
+}
+
+void gfx_v_draw_line( uint8_t obj, int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t _hue, int32_t _sat, int32_t _val ){
+
+    uint16_t size_x, size_y;
+
+    if( !prim_geometry( obj, &size_x, &size_y ) ){
+
+        return;
+    }
+
+    // bound the line length
+    x0 = prim_clamp( x0 );
+    y0 = prim_clamp( y0 );
+    x1 = prim_clamp( x1 );
+    y1 = prim_clamp( y1 );
+
+    // bresenham
+    int32_t dx = abs( x1 - x0 );
+    int32_t dy = -abs( y1 - y0 );
+    int8_t step_x = ( x0 < x1 ) ? 1 : -1;
+    int8_t step_y = ( y0 < y1 ) ? 1 : -1;
+    int32_t err = dx + dy;
+
+    while( TRUE ){
+
+        prim_set( obj, prim_wrap( x0, size_x ), prim_wrap( y0, size_y ), _hue, _sat, _val );
+
+        if( ( x0 == x1 ) && ( y0 == y1 ) ){
+
+            break;
+        }
+
+        int32_t e2 = err * 2;
+
+        if( e2 >= dy ){
+
+            err += dy;
+            x0 += step_x;
+        }
+
+        if( e2 <= dx ){
+
+            err += dx;
+            y0 += step_y;
+        }
+    }
+}
+
+// copy the targets of src into dest at x, y.
+// src and dest should not overlap.
+void gfx_v_blit( uint8_t dest, int32_t x, int32_t y, uint8_t src ){
+
+    uint16_t dest_x, dest_y, src_x, src_y;
+
+    if( !prim_geometry( dest, &dest_x, &dest_y ) ||
+        !prim_geometry( src, &src_x, &src_y ) ){
+
+        return;
+    }
+
+    uint16_t w = ( src_x < dest_x ) ? src_x : dest_x;
+    uint16_t h = ( src_y < dest_y ) ? src_y : dest_y;
+
+    uint16_t x0 = prim_wrap( x, dest_x );
+    uint16_t y0 = prim_wrap( y, dest_y );
+
+    int32_t dest_base = prim_linear_base( dest, dest_x, dest_y );
+    int32_t src_base = prim_linear_base( src, src_x, src_y );
+
+    for( uint16_t row = 0; row < h; row++ ){
+
+        uint16_t py = ( y0 + row ) % dest_y;
+
+        if( ( dest_base >= 0 ) && ( src_base >= 0 ) ){
+
+            uint16_t s = src_base + ( row * src_x );
+            uint16_t d = dest_base + ( py * dest_x );
+
+            // split where the copy wraps around the right edge
+            uint16_t len = dest_x - x0;
+
+            if( len > w ){
+
+                len = w;
+            }
+
+            prim_copy_span( s, d + x0, len );
+
+            if( len < w ){
+
+                prim_copy_span( s + len, d, w - len );
+            }
+        }
+        else{
+
+            for( uint16_t col = 0; col < w; col++ ){
+
+                uint16_t i = map_index( src, col, row );
+
+                if( i >= pix_alloc ){
+
+                    continue;
+                }
+
+                prim_set( dest, ( x0 + col ) % dest_x, py, target_hue[i], target_sat[i], target_val[i] );
+            }
+        }
+    }
+}
+
+// rotate an object's pixels by dx, dy, pixels leaving one edge come
+// back on the other.
+void gfx_v_scroll( uint8_t obj, int32_t dx, int32_t dy ){
+
+    uint16_t size_x, size_y;
+
+    if( !prim_geometry( obj, &size_x, &size_y ) ){
+
+        return;
+    }
+
+    uint16_t n_x = prim_wrap( dx, size_x );
+    uint16_t n_y = prim_wrap( dy, size_y );
+
+    int32_t base = prim_linear_base( obj, size_x, size_y );
+
+    if( n_x != 0 ){
+
+        for( uint16_t row = 0; row < size_y; row++ ){
+
+            if( base >= 0 ){
+
+                prim_rotate_span( base + ( row * size_x ), size_x, n_x );
+            }
+            else{
+
+                prim_rotate_line( obj, FALSE, row, size_x, n_x );
+            }
+        }
+    }
+
+    if( n_y != 0 ){
+
+        if( base >= 0 ){
+
+            // rows are contiguous, so this is one rotation of the block
+            prim_rotate_span( base, size_x * size_y, n_y * size_x );
+        }
+        else{
+
+            for( uint16_t col = 0; col < size_x; col++ ){
+
+                prim_rotate_line( obj, TRUE, col, size_y, n_y );
+            }
+        }
+    }
+}
+
+
+void gfx_v_clear( void ){
+
+    for( uint16_t i = 0; i < pix_count; i++ ){
+
+        gfx_v_set_hsv( -1, -1, 0, i );
+    }
+}
+
+void gfx_v_reset( void ){
+
+    // initialize pixel arrays to defaults    
+    // we do this on the entire store, regardless of pix_count.
+    init_pixels( 0, pix_alloc );
+
+    // targets and current values match, nothing is fading
+    memset( fader_active, 0, sizeof(fader_active) );
+
+    sync_all = TRUE;
+
+    // reset pixel objects
+    pix_array_count = 0;
+
+    gfx_v_init_noise();
+}
+
+void gfx_v_init_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count ){
+
+    gfx_v_set_pixel_arrays( array_ptr, count );
+
+    // new program, its arrays may differ even at the same address
+    index_map_valid = FALSE;
+
+    if( ( pix_arrays == 0 ) || ( part_count == 0 ) ){
+
+        return;
+    }
+
+    // move the script's arrays into the partition
+    uint16_t start = pix_arrays[0].index;
+    uint16_t end = start + pix_arrays[0].count;
+
+    for( uint8_t i = 1; i < pix_array_count; i++ ){
+
+        uint16_t index = pix_arrays[i].index + start;
+
+        if( index >= end ){
+
+            index = start;
+        }
+
+        if( ( index + pix_arrays[i].count ) > end ){
+
+            pix_arrays[i].count = end - index;
+        }
+
+        pix_arrays[i].index = index;
+    }
+}
+
+// switch to the pixel arrays of another VM instance, without
+// the partition adjustment done at init.
+void gfx_v_set_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count ){
+
+    // each instance keeps its own index maps, only the set changes
+    if( ( array_ptr != pix_arrays ) || ( count != pix_array_count ) ){
+
+        index_map_set = 0;
+    }
+
+    pix_arrays = array_ptr;
+    pix_array_count = count;
+
+    // first array is always the global array, we override with our data
+    setup_master_array();  
+}
+
+void gfx_v_set_partition( uint16_t index, uint16_t count ){
+
+    part_index = index;
+    part_count = count;
+}
+
+#ifdef VM_BENCH
+// make pixel store allocations fail, to check the fallback
+void gfx_v_set_store_alloc_fail( bool fail ){
+
+    store_alloc_fail = fail;
+}
+
+uint32_t gfx_u32_get_store_size( void ){
+
+    return layout_store( 0, pix_alloc );
+}
+
+uint32_t gfx_u32_get_index_map_builds( void ){
+
+    return index_map_builds;
+}
+#endif
+
+static uint16_t linterp_table_lookup( uint16_t x, uint16_t *table ){
+
+    uint8_t index = x >> 8;
+
+    uint16_t y0 = table[index];
+    uint16_t y1;
+    uint16_t x0 = index << 8;
+    uint16_t x1;
+
+    if( index < 255 ){
+
+        y1 = table[index + 1];
+        x1 = ( index + 1 ) << 8;
+    }
+    else{
+
+        y1 = 65535;
+        x1 = 65535;
+    }
+
+    uint16_t y = util_u16_linear_interp( x, x0, y0, x1, y1 );
+
+    return y;
+}
+
+uint16_t gfx_u16_get_dimmed_val( uint16_t _val ){
+
+    uint16_t x = ( (uint32_t)_val * current_dimmer ) / 65536;
+
+    return linterp_table_lookup( x, dimmer_lookup );
+}
+
+// run one frame of the fader for pixel i.
+// returns FALSE once the pixel has reached its target.
+static bool process_pixel_fader( uint16_t i ){
+
+    // check if fader step needs to be updated
+    if( ( FADER_STEP( FADER_HUE, i ) == 0 ) && ( target_hue[i] != hue[i] ) ){
+
+        int32_t diff, step;
+
+        uint16_t hs_fade_steps = HS_FADE( i ) / fader_rate;
+
+        if( hs_fade_steps <= 1 ){
+
+            hs_fade_steps = 2;
+        }
+
+        diff = (int32_t)target_hue[i] - (int32_t)hue[i];
+
+        // adjust to shortest distance and allow the fade to wrap around
+        // the hue circle
+        if( abs32(diff) > 32768 ){
+
+            if( diff > 0 ){
+
+                diff -= 65536;
+            }
+            else{
+
+                diff += 65536;
+            }
+        }
+
+        step = diff / hs_fade_steps;
+
+        if( step > 32768 ){
+
+            step = 32768;
+        }
+        else if( step < -32767 ){
+
+            step = -32767;
+        }
+        else if( step == 0 ){
+
+            if( diff >= 0 ){
+
+                step = 1;
+            }
+            else{
+
+                step = -1;
+            }
+        }
+
+        SET_FADER_STEP( FADER_HUE, i, step );
+    }
+
+    if( FADER_STEP( FADER_HUE, i ) != 0 ){
+
+        uint16_t h = hue[i];
+        uint16_t th = target_hue[i];
+        int16_t step_h = FADER_STEP( FADER_HUE, i );
+
+        int32_t diff = (int32_t)th - (int32_t)h;
+
+        if( abs32( diff ) < abs16( step_h ) ){
+
+            hue[i] = th;
+            SET_FADER_STEP( FADER_HUE, i, 0 );
+        }
+        else{
+
+            hue[i] += step_h;
+        }
+    }
+
+    // check if fader step needs to be updated
+    if( ( FADER_STEP( FADER_SAT, i ) == 0 ) && ( target_sat[i] != sat[i] ) ){
+
+        int32_t diff, step;
+
+        uint16_t hs_fade_steps = HS_FADE( i ) / fader_rate;
+
+        if( hs_fade_steps <= 1 ){
+
+            hs_fade_steps = 2;
+        }
+
+        diff = (int32_t)target_sat[i] - (int32_t)sat[i];
+        step = diff / hs_fade_steps;
+
+        if( step > 32768 ){
+
+            step = 32768;
+        }
+        else if( step < -32767 ){
+
+            step = -32767;
+        }
+        else if( step == 0 ){
+
+            if( diff >= 0 ){
+
+                step = 1;
+            }
+            else{
+
+                step = -1;
+            }
+        }
+
+        SET_FADER_STEP( FADER_SAT, i, step );
+    }
+
+    if( FADER_STEP( FADER_SAT, i ) != 0 ){
+
+        uint16_t s = sat[i];
+        uint16_t ts = target_sat[i];
+        int16_t step_s = FADER_STEP( FADER_SAT, i );
+
+        int32_t diff = (int32_t)ts - (int32_t)s;
+
+        if( abs32( diff ) < abs16( step_s ) ){
+
+            sat[i] = ts;
+            SET_FADER_STEP( FADER_SAT, i, 0 );
+        }
+        else{
+
+            sat[i] += step_s;
+        }
+    }
+
+    // check if fader step needs to be updated
+    if( ( FADER_STEP( FADER_VAL, i ) == 0 ) && ( target_val[i] != val[i] ) ){
+
+        int32_t diff, step;
+
+        uint16_t v_fade_steps = V_FADE( i ) / fader_rate;
+
+        if( v_fade_steps <= 1 ){
+
+            v_fade_steps = 2;
+        }
+
+        diff = (int32_t)target_val[i] - (int32_t)val[i];
+        step = diff / v_fade_steps;
+
+        if( step > 32768 ){
+
+            step = 32768;
+        }
+        else if( step < -32767 ){
+
+            step = -32767;
+        }
+        else if( step == 0 ){
+
+            if( diff >= 0 ){
+
+                step = 1;
+            }
+            else{
+
+                step = -1;
+            }
+        }
+
+        SET_FADER_STEP( FADER_VAL, i, step );   
+    }
+
+    if( FADER_STEP( FADER_VAL, i ) != 0 ){
+
+        uint16_t v = val[i];
+        uint16_t tv = target_val[i];
+        int16_t step_v = FADER_STEP( FADER_VAL, i );
+
+        int32_t diff = (int32_t)tv - (int32_t)v;
+
+        if( abs32( diff ) < abs16( step_v ) ){
+
+            val[i] = tv;
+            SET_FADER_STEP( FADER_VAL, i, 0 );
+        }
+        else{
+
+            val[i] += step_v;
+        }
+    }
+
+    return ( FADER_STEP( FADER_HUE, i ) != 0 ) || ( FADER_STEP( FADER_SAT, i ) != 0 ) || ( FADER_STEP( FADER_VAL, i ) != 0 );
+}
+
+static uint16_t isqrt32( uint32_t x ){
+
+    uint32_t result = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+
+    while( bit > x ){
+
+        bit >>= 2;
+    }
+
+    while( bit != 0 ){
+
+        if( x >= ( result + bit ) ){
+
+            x -= result + bit;
+            result = ( result >> 1 ) + bit;
+        }
+        else{
+
+            result >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return result;
+}
+
+// run one frame of an interpolating fader on one channel of every
+// active pixel.
+static void process_interp_channel( 
+    uint8_t ch,
+    uint16_t *current,
+    uint16_t *target,
+    uint8_t curve,
+    bool wrap ){
+
+    uint16_t words = ( pix_count + 31 ) / 32;
+
+    for( uint16_t w = 0; w < words; w++ ){
+
+        uint32_t bits = fader_active[w];
+
+        if( bits == 0 ){
+
+            continue;
+        }
+
+        for( uint16_t i = w * 32; ( bits != 0 ) && ( i < pix_count ); i++, bits >>= 1 ){
+
+            if( ( bits & 1 ) == 0 ){
+
+                continue;
+            }
+
+            if( FADER_STEP( ch, i ) == 0 ){
+
+                if( current[i] == target[i] ){
+
+                    continue;
+                }
+
+                // start a new fade from the current value
+                uint16_t fade_steps = ( ch == FADER_VAL ) ? V_FADE( i ) : HS_FADE( i );
+
+                fade_steps /= fader_rate;
+
+                if( fade_steps <= 1 ){
+
+                    fade_steps = 2;
+                }
+
+                FADER_START( ch, i ) = current[i];
+                FADER_PROGRESS( ch, i ) = 0;
+                SET_FADER_STEP( ch, i, (int16_t)( ( 65535 + fade_steps - 1 ) / fade_steps ) );
+            }
+
+            uint32_t p = (uint32_t)FADER_PROGRESS( ch, i ) + (uint16_t)FADER_STEP( ch, i );
+
+            if( p >= 65535 ){
+
+                current[i] = target[i];
+                SET_FADER_STEP( ch, i, 0 );
+
+                continue;
+            }
+
+            FADER_PROGRESS( ch, i ) = p;
+
+            if( curve == GFX_FADER_CURVE_PERCEPTUAL ){
+
+                // interpolate in sqrt space, roughly perceived brightness
+                int32_t l0 = isqrt32( (uint32_t)FADER_START( ch, i ) << 16 );
+                int32_t l1 = isqrt32( (uint32_t)target[i] << 16 );
+                uint32_t l = l0 + ( ( ( l1 - l0 ) * (int32_t)( p >> 1 ) ) >> 15 );
+
+                current[i] = ( l * l ) >> 16;
+
+                continue;
+            }
+
+            int32_t diff = (int32_t)target[i] - (int32_t)FADER_START( ch, i );
+
+            // take the shortest way around the hue circle
+            if( wrap && ( abs32( diff ) > 32768 ) ){
+
+                if( diff > 0 ){
+
+                    diff -= 65536;
+                }
+                else{
+
+                    diff += 65536;
+                }
+            }
+
+            uint16_t e = p;
+
+            if( curve != GFX_FADER_CURVE_LINEAR ){
+
+                e = linterp_table_lookup( p, fader_curve_lookup );
+            }
+
+            current[i] = FADER_START( ch, i ) + ( ( diff * (int32_t)( e >> 1 ) ) >> 15 );
+        }
+    }
+}
+
+static void process_interp_faders( void ){
+
+    // val gets the perceptual curve, hue and sat use linear
+    uint8_t hs_curve = fader_curve;
+
+    if( hs_curve == GFX_FADER_CURVE_PERCEPTUAL ){
+
+        hs_curve = GFX_FADER_CURVE_LINEAR;
+    }
+
+    // one channel at a time, so each pass only touches that channel's arrays
+    process_interp_channel( FADER_HUE, hue, target_hue, hs_curve, TRUE );
+    process_interp_channel( FADER_SAT, sat, target_sat, hs_curve, FALSE );
+    process_interp_channel( FADER_VAL, val, target_val, fader_curve, FALSE );
+
+    uint16_t words = ( pix_count + 31 ) / 32;
+
+    for( uint16_t w = 0; w < words; w++ ){
+
+        uint32_t bits = fader_active[w];
+
+        for( uint16_t i = w * 32; ( bits != 0 ) && ( i < pix_count ); i++, bits >>= 1 ){
+
+            if( ( bits & 1 ) &&
+                ( FADER_STEP( FADER_HUE, i ) == 0 ) && ( FADER_STEP( FADER_SAT, i ) == 0 ) && ( FADER_STEP( FADER_VAL, i ) == 0 ) ){
+
+                fader_active[w] &= ~( (uint32_t)1 << ( i & 31 ) );
+            }
+        }
+    }
+}
+
+void gfx_v_process_faders( void ){
+
+    // update master dimmer
+    if( dimmer_step != 0 ){
+
+        int32_t diff = (int32_t)target_dimmer - (int32_t)current_dimmer;
+
+        if( abs32( diff ) < abs16( dimmer_step ) ){
+
+            current_dimmer = target_dimmer;
+            dimmer_step = 0;
+        }
+        else{
+
+            current_dimmer += dimmer_step;
+        }
+
+        sync_all = TRUE;
+    }
+
+    // anything the faders touch this frame needs to be converted
+    for( uint16_t w = 0; w < ( ( pix_count + 31 ) / 32 ); w++ ){
+
+        sync_dirty[w] |= fader_active[w];
+    }
+
+    if( fader_curve != GFX_FADER_CURVE_STEP ){
+
+        process_interp_faders();
+
+        return;
+    }
+
+    uint16_t words = ( pix_count + 31 ) / 32;
 
-        if( i < MAX_PIXELS ){        
-            if( ( target_hue[i] == hue[i] ) &&
-                ( target_sat[i] == sat[i] ) &&
-                ( target_val[i] == val[i] ) ){
+    for( uint16_t w = 0; w < words; w++ ){
 
-                return 0;
-            }
+        uint32_t bits = fader_active[w];
+
+        // skip 32 idle pixels at a time
+        if( bits == 0 ){
+
+            continue;
         }
 
-        return 1;    
-    }
-}
+        uint16_t i = w * 32;
 
+        while( ( bits != 0 ) && ( i < pix_count ) ){
 
-void gfx_v_clear( void ){
+            if( ( bits & 1 ) && !process_pixel_fader( i ) ){
 
-    for( uint16_t i = 0; i < pix_count; i++ ){
+                fader_active[w] &= ~( (uint32_t)1 << ( i & 31 ) );
+            }
 
-        gfx_v_set_hsv( -1, -1, 0, i );
+            bits >>= 1;
+            i++;
+        }
     }
 }
 
-void gfx_v_reset( void ){
+void gfxlib_v_init( void ){
 
-    // initialize pixel arrays to defaults    
-    // we do this on the entire array, regardless of pix_count.
-    for( uint16_t i = 0; i < MAX_PIXELS; i++ ){
+    param_error_check();
 
-        hue[i] = 0;
-        sat[i] = 65535;
-        val[i] = 0;
+    compute_dimmer_lookup();
 
-        target_hue[i] = 0;
-        target_sat[i] = 65535;
-        target_val[i] = 0;
+    compute_fader_curve_lookup();
 
-        hue_step[i] = 0;
-        sat_step[i] = 0;
-        val_step[i] = 0;
+    compute_noise_fade_lookup();
 
-        hs_fade[i] = global_hs_fade;
-        v_fade[i]  = global_v_fade;
-    }
+    register_lib_funcs();
 
-    // reset pixel objects
-    pix_array_count = 0;
+    // initialize pixel arrays to defaults
+    gfx_v_reset();
 
-    gfx_v_init_noise();
+    update_master_fader();
 }
 
-void gfx_v_init_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count ){
-
-    pix_arrays = array_ptr;
-    pix_array_count = count;
+// master dimmer for one pixel, same result as gfx_u16_get_dimmed_val.
+// table segments are 256 wide except the last one, so the common case
+// interpolates with a shift instead of a divide.
+static inline uint16_t dim_val( uint16_t _val, uint16_t dimmer ){
 
-    // first array is always the global array, we override with our data
-    setup_master_array();  
-}
+    uint16_t x = ( (uint32_t)_val * dimmer ) >> 16;
+    uint8_t index = x >> 8;
 
-static uint16_t linterp_table_lookup( uint16_t x, uint16_t *table ){
+    if( index == 255 ){
 
-    uint8_t index = x >> 8;
+        return linterp_table_lookup( x, dimmer_lookup );
+    }
 
-    uint16_t y0 = table[index];
-    uint16_t y1;
-    uint16_t x0 = index << 8;
-    uint16_t x1;
+    uint16_t y0 = dimmer_lookup[index];
+    uint16_t y_diff = dimmer_lookup[index + 1] - y0;
 
-    if( index < 255 ){
+    return y0 + ( ( (uint32_t)( x & 0xff ) * y_diff ) >> 8 );
+}
 
-        y1 = table[index + 1];
-        x1 = ( index + 1 ) << 8;
-    }
-    else{
+// Batched HSV to RGB
+//
+// Converts a span of pixels in one pass, with the master dimmer applied.
+// Results match gfx_v_hsv_to_rgb and gfx_v_hsv_to_rgbw.
+//
+// The hue sector is turned into lane masks instead of a branch:
+// in sector n the falling ramp goes to channel n and the rising ramp
+// to channel n + 1, the third channel is 0.
 
-        y1 = 65535;
-        x1 = 65535;
-    }
+typedef struct{
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+} gfx_rgb16_t;
 
-    uint16_t y = util_u16_linear_interp( x, x0, y0, x1, y1 );
+static inline void hue_to_rgb( uint16_t h, gfx_rgb16_t *rgb ){
 
-    return y;
-}
+    uint16_t s1 = -( h > 21845 );
+    uint16_t s2 = -( h > 43690 );
 
-uint16_t gfx_u16_get_dimmed_val( uint16_t _val ){
+    uint16_t m0 = ~s1;
+    uint16_t m1 = s1 & ~s2;
 
-    uint16_t x = ( (uint32_t)_val * current_dimmer ) / 65536;
+    // end of the sector is 21845 * ( sector + 1 )
+    uint16_t fall = ( 21845 + ( 21845 & s1 ) + ( 21845 & s2 ) - h ) * 3;
+    uint16_t rise = 65535 - fall;
 
-    return linterp_table_lookup( x, dimmer_lookup );
+    rgb->r = ( fall & m0 ) | ( rise & s2 );
+    rgb->g = ( rise & m0 ) | ( fall & m1 );
+    rgb->b = ( rise & m1 ) | ( fall & s2 );
 }
 
-void gfx_v_process_faders( void ){
 
-    // update master dimmer
-    if( dimmer_step != 0 ){
+// keep the 16 bit result for the dither pass.
+// the xmega's own 2 bit dither is turned off, the carry replaces it.
+static inline void dither_store( uint16_t i, uint16_t r, uint16_t g, uint16_t b ){
 
-        int32_t diff = (int32_t)target_dimmer - (int32_t)current_dimmer;
+    dither_state[i].rgb[0] = r;
+    dither_state[i].rgb[1] = g;
+    dither_state[i].rgb[2] = b;
 
-        if( abs32( diff ) < abs16( dimmer_step ) ){
+    uint32_t bit = (uint32_t)1 << ( i % 32 );
 
-            current_dimmer = target_dimmer;
-            dimmer_step = 0;
-        }
-        else{
+    if( ( r | g | b ) & 0xff ){
 
-            current_dimmer += dimmer_step;
-        }
+        dither_active[i / 32] |= bit;
     }
+    else{
 
-    for( uint16_t i = 0; i < pix_count; i++ ){
+        dither_active[i / 32] &= ~bit;
+    }
 
-        // check if fader step needs to be updated
-        if( ( hue_step[i] == 0 ) && ( target_hue[i] != hue[i] ) ){
+    array_red[i] = r >> 8;
+    array_green[i] = g >> 8;
+    array_blue[i] = b >> 8;
+    array_misc[i] = 0;
+}
 
-            int32_t diff, step;
+static inline uint8_t dither_channel( uint16_t x, uint8_t *err ){
 
-            uint16_t hs_fade_steps = hs_fade[i] / FADER_RATE;
+    uint16_t acc = ( x & 0xff ) + *err;
+    uint16_t out = ( x >> 8 ) + ( acc >> 8 );
 
-            if( hs_fade_steps <= 1 ){
+    *err = acc;
 
-                hs_fade_steps = 2;
-            }
+    if( out > 255 ){
 
-            diff = (int32_t)target_hue[i] - (int32_t)hue[i];
+        out = 255;
+    }
 
-            // adjust to shortest distance and allow the fade to wrap around
-            // the hue circle
-            if( abs32(diff) > 32768 ){
+    return out;
+}
 
-                if( diff > 0 ){
+// advance the residuals one frame and write the 8 bit output
+// for every pixel that has a fraction to carry.
+static void dither_frame( void ){
 
-                    diff -= 65536;
-                }
-                else{
+    uint16_t words = ( pix_count + 31 ) / 32;
 
-                    diff += 65536;
-                }
-            }
+    for( uint16_t w = 0; w < words; w++ ){
 
-            step = diff / hs_fade_steps;
+        uint32_t bits = dither_active[w];
 
-            if( step > 32768 ){
+        for( uint16_t i = w * 32; bits != 0; i++, bits >>= 1 ){
 
-                step = 32768;
-            }
-            else if( step < -32767 ){
+            if( ( bits & 1 ) == 0 ){
 
-                step = -32767;
+                continue;
             }
-            else if( step == 0 ){
-
-                if( diff >= 0 ){
 
-                    step = 1;
-                }
-                else{
+            if( i >= pix_count ){
 
-                    step = -1;
-                }
+                break;
             }
 
-            hue_step[i] = step;
+            gfx_dither_t *d = &dither_state[i];
+
+            array_red[i] = dither_channel( d->rgb[0], &d->err[0] );
+            array_green[i] = dither_channel( d->rgb[1], &d->err[1] );
+            array_blue[i] = dither_channel( d->rgb[2], &d->err[2] );
         }
+    }
+}
 
-        if( hue_step[i] != 0 ){
+static void sync_span_rgb( uint16_t i, uint16_t end ){
 
-            uint16_t h = hue[i];
-            uint16_t th = target_hue[i];
-            int16_t step_h = hue_step[i];
+    uint16_t dimmer = current_dimmer;
 
-            int32_t diff = (int32_t)th - (int32_t)h;
+    // neighboring pixels often share a value, or the whole color.
+    // the dimmer lookup and the conversion are only done on a change.
+    uint16_t last_val = val[i];
+    uint32_t v = dim_val( last_val, dimmer );
+    uint32_t last_hs = 0;
+    bool convert = TRUE;
+    uint16_t r = 0, g = 0, b = 0;
 
-            if( abs32( diff ) < abs16( step_h ) ){
+    for( ; i < end; i++ ){
 
-                hue[i] = th;
-                hue_step[i] = 0;
-            }
-            else{
+        if( val[i] != last_val ){
 
-                hue[i] += step_h;
-            }
+            last_val = val[i];
+            v = dim_val( last_val, dimmer );
+
+            convert = TRUE;
         }
 
-        // check if fader step needs to be updated
-        if( ( sat_step[i] == 0 ) && ( target_sat[i] != sat[i] ) ){
+        uint32_t hs = ( (uint32_t)hue[i] << 16 ) | sat[i];
 
-            int32_t diff, step;
+        if( convert || ( hs != last_hs ) ){
 
-            uint16_t hs_fade_steps = hs_fade[i] / FADER_RATE;
+            last_hs = hs;
+            convert = FALSE;
 
-            if( hs_fade_steps <= 1 ){
+            gfx_rgb16_t rgb;
+            hue_to_rgb( hue[i], &rgb );
 
-                hs_fade_steps = 2;
-            }
+            // floor saturation
+            uint16_t floor_s = 65535 - sat[i];
 
-            diff = (int32_t)target_sat[i] - (int32_t)sat[i];
-            step = diff / hs_fade_steps;
+            if( rgb.r < floor_s ){
 
-            if( step > 32768 ){
+                rgb.r = floor_s;
+            }
+
+            if( rgb.g < floor_s ){
 
-                step = 32768;
+                rgb.g = floor_s;
             }
-            else if( step < -32767 ){
 
-                step = -32767;
+            if( rgb.b < floor_s ){
+
+                rgb.b = floor_s;
             }
-            else if( step == 0 ){
 
-                if( diff >= 0 ){
+            // apply brightness
+            r = ( rgb.r * v ) >> 16;
+            g = ( rgb.g * v ) >> 16;
+            b = ( rgb.b * v ) >> 16;
+        }
 
-                    step = 1;
-                }
-                else{
+        if( temporal_dither ){
 
-                    step = -1;
-                }
-            }
+            dither_store( i, r, g, b );
 
-            sat_step[i] = step;
+            continue;
         }
 
-        if( sat_step[i] != 0 ){
+        // 8 bit output, the next 2 bits go to the dither array
+        array_red[i] = r >> 8;
+        array_green[i] = g >> 8;
+        array_blue[i] = b >> 8;
+        array_misc[i] = ( ( ( r >> 6 ) & 0x0003 ) << 4 ) |
+                        ( ( ( g >> 6 ) & 0x0003 ) << 2 ) |
+                        ( ( b >> 6 ) & 0x0003 );
+    }
+}
 
-            uint16_t s = sat[i];
-            uint16_t ts = target_sat[i];
-            int16_t step_s = sat_step[i];
+static void sync_span_rgbw( uint16_t i, uint16_t end ){
 
-            int32_t diff = (int32_t)ts - (int32_t)s;
+    uint16_t dimmer = current_dimmer;
 
-            if( abs32( diff ) < abs16( step_s ) ){
+    uint16_t last_val = val[i];
+    uint32_t v = dim_val( last_val, dimmer );
 
-                sat[i] = ts;
-                sat_step[i] = 0;
-            }
-            else{
+    for( ; i < end; i++ ){
 
-                sat[i] += step_s;
-            }
+        if( val[i] != last_val ){
+
+            last_val = val[i];
+            v = dim_val( last_val, dimmer );
         }
 
-        // check if fader step needs to be updated
-        if( ( val_step[i] == 0 ) && ( target_val[i] != val[i] ) ){
+        gfx_rgb16_t rgb;
+        hue_to_rgb( hue[i], &rgb );
+
+        // apply saturation to RGB, white gets the rest.
+        // the unused channel is 0, so scaling all three is the same.
+        uint32_t s = sat[i];
+        rgb.r = ( rgb.r * s ) >> 16;
+        rgb.g = ( rgb.g * s ) >> 16;
+        rgb.b = ( rgb.b * s ) >> 16;
+        uint16_t w = 65535 - s;
+
+        // apply brightness
+        array_red[i] = ( ( rgb.r * v ) >> 16 ) >> 8;
+        array_green[i] = ( ( rgb.g * v ) >> 16 ) >> 8;
+        array_blue[i] = ( ( rgb.b * v ) >> 16 ) >> 8;
+        array_misc[i] = ( ( w * v ) >> 16 ) >> 8;
+    }
+}
 
-            int32_t diff, step;
+static void sync_span( uint16_t start, uint16_t end ){
 
-            uint16_t v_fade_steps = v_fade[i] / FADER_RATE;
+    if( end > pix_count ){
 
-            if( v_fade_steps <= 1 ){
+        end = pix_count;
+    }
 
-                v_fade_steps = 2;
-            }
+    if( start >= end ){
 
-            diff = (int32_t)target_val[i] - (int32_t)val[i];
-            step = diff / v_fade_steps;
+        return;
+    }
 
-            if( step > 32768 ){
+    if( pix_mode == PIX_MODE_SK6812_RGBW ){
 
-                step = 32768;
-            }
-            else if( step < -32767 ){
+        sync_span_rgbw( start, end );
+    }
+    else{
 
-                step = -32767;
-            }
-            else if( step == 0 ){
+        sync_span_rgb( start, end );
+    }
+}
 
-                if( diff >= 0 ){
+// convert contiguous runs of dirty pixels
+static void sync_dirty_spans( void ){
 
-                    step = 1;
-                }
-                else{
+    uint16_t words = ( pix_count + 31 ) / 32;
+    uint16_t run_start = 0;
+    uint16_t run_end = 0;
 
-                    step = -1;
-                }
-            }
+    for( uint16_t w = 0; w < words; w++ ){
 
-            val_step[i] = step;   
-        }
+        uint32_t bits = sync_dirty[w];
 
-        if( val_step[i] != 0 ){
+        if( bits == 0 ){
 
-            uint16_t v = val[i];
-            uint16_t tv = target_val[i];
-            int16_t step_v = val_step[i];
+            continue;
+        }
 
-            int32_t diff = (int32_t)tv - (int32_t)v;
+        sync_dirty[w] = 0;
 
-            if( abs32( diff ) < abs16( step_v ) ){
+        for( uint16_t i = w * 32; bits != 0; i++, bits >>= 1 ){
 
-                val[i] = tv;
-                val_step[i] = 0;
-            }
-            else{
+            if( ( bits & 1 ) == 0 ){
 
-                val[i] += step_v;
+                continue;
             }
-        }
-    }
-}
 
-void gfxlib_v_init( void ){
+            if( i != run_end ){
 
-    param_error_check();
+                sync_span( run_start, run_end );
 
-    compute_dimmer_lookup();
+                run_start = i;
+            }
 
-    // initialize pixel arrays to defaults
-    gfx_v_reset();
+            run_end = i + 1;
+        }
+    }
 
-    update_master_fader();
+    sync_span( run_start, run_end );
 }
 
-// convert all HSV to RGB
+// convert HSV to RGB for pixels that changed since the last sync.
+// unchanged pixels keep their RGB from the previous frame,
+// with dithering on the carried fractions still advance every call.
 void gfx_v_sync_array( void ){
 
-    uint16_t r, g, b, w;
-    uint8_t dither;
     uint16_t dimmed_val;
 
     // PWM modes will use pixel 0 and need 16 bits.
     // for simplicity's sake, and to avoid a compare-branch in the
     // HSV converversion loop, we'll just always compute the 16 bit values
     // here, and then go on with the 8 bit arrays.
+    if( sync_all || ( sync_dirty[0] & 1 ) ){
+
+        dimmed_val = gfx_u16_get_dimmed_val( val[0] );
+
+        gfx_v_hsv_to_rgb(
+            hue[0],
+            sat[0],
+            dimmed_val,
+            &pix0_16bit_red,
+            &pix0_16bit_green,
+            &pix0_16bit_blue
+        );
+    }
 
-    dimmed_val = gfx_u16_get_dimmed_val( val[0] );
-
-    gfx_v_hsv_to_rgb(
-        hue[0],
-        sat[0],
-        dimmed_val,
-        &pix0_16bit_red,
-        &pix0_16bit_green,
-        &pix0_16bit_blue
-    );
+    if( sync_all ){
 
-    if( pix_mode == PIX_MODE_SK6812_RGBW ){
+        sync_all = FALSE;
+        memset( sync_dirty, 0, sizeof(sync_dirty) );
 
-        for( uint16_t i = 0; i < pix_count; i++ ){
-
-            // process master dimmer
-            dimmed_val = gfx_u16_get_dimmed_val( val[i] );
-
-            gfx_v_hsv_to_rgbw(
-                hue[i],
-                sat[i],
-                dimmed_val,
-                &r,
-                &g,
-                &b,
-                &w
-            );
-      
-            r /= 256;
-            g /= 256;
-            b /= 256;
-            w /= 256;
-        
-            array_red[i] = r;
-            array_green[i] = g;
-            array_blue[i] = b;
-            array_misc[i] = w;
-        }
+        sync_span( 0, pix_count );
     }
     else{
 
-        for( uint16_t i = 0; i < pix_count; i++ ){
-
-            // process master dimmer
-            dimmed_val = gfx_u16_get_dimmed_val( val[i] );
-
-            gfx_v_hsv_to_rgb(
-                hue[i],
-                sat[i],
-                dimmed_val,
-                &r,
-                &g,
-                &b
-            );
-      
-            r /= 64;
-            g /= 64;
-            b /= 64;
-
-            dither =  ( r & 0x0003 ) << 4;
-            dither |= ( g & 0x0003 ) << 2;
-            dither |= ( b & 0x0003 );
-
-            r /= 4;
-            g /= 4;
-            b /= 4;
-        
-            array_red[i] = r;
-            array_green[i] = g;
-            array_blue[i] = b;
-            array_misc[i] = dither;
-        }
+        sync_dirty_spans();
+    }
+
+    // RGBW has no spare channel for the fraction, it is not dithered
+    if( temporal_dither && ( pix_mode != PIX_MODE_SK6812_RGBW ) ){
+
+        dither_frame();
     }
 }
 
@@ -1611,6 +3641,22 @@ void gfx_v_init_noise( void ){
 
         noise_table[i] = rnd_u8_get_int();
     }
+
+    // shuffle the gradient hash with the value table,
+    // so it does not use any more random numbers.
+    for( uint32_t i = 0; i < NOISE_TABLE_SIZE; i++ ){
+
+        noise_perm[i] = i;
+    }
+
+    for( uint32_t i = NOISE_TABLE_SIZE - 1; i > 0; i-- ){
+
+        uint8_t j = noise_table[i] % ( i + 1 );
+        uint8_t temp = noise_perm[i];
+
+        noise_perm[i] = noise_perm[j];
+        noise_perm[j] = temp;
+    }
 }
 
 static uint16_t lerp( uint8_t low, uint8_t high, uint8_t t ){
@@ -1631,6 +3677,184 @@ uint16_t gfx_u16_noise( uint16_t x ){
     return lerp( noise_table[x_min], noise_table[x_min + 1], t );
 }
 
+// Gradient noise
+//
+// Perlin's improved noise in fixed point. Coordinates have 8 fractional
+// bits, so 256 is one lattice cell, and the lattice repeats every 256
+// cells. Results are 16 bit, centered on 32768.
+
+#define NOISE_PERM( i )     noise_perm[(uint8_t)( i )]
+
+// dot product of the distance to a corner with one of 12 edge gradients.
+// distances are -256 to 256, the result has 4 extra fractional bits
+// so the interpolation keeps some precision.
+static inline int32_t noise_grad( uint8_t hash, int16_t x, int16_t y, int16_t z ){
+
+    uint8_t h = hash & 15;
+    int16_t u = ( h < 8 ) ? x : y;
+    int16_t v = ( h < 4 ) ? y : ( ( h == 12 ) || ( h == 14 ) ) ? x : z;
+
+    return ( ( ( h & 1 ) ? -u : u ) + ( ( h & 2 ) ? -v : v ) ) * 16;
+}
+
+static inline int32_t noise_lerp( int32_t a, int32_t b, uint16_t t ){
+
+    return a + ( ( ( b - a ) * (int32_t)t ) >> 16 );
+}
+
+// raw noise, about -4096 to 4096
+static int32_t noise_3d( int32_t x, int32_t y, int32_t z ){
+
+    uint8_t xi = x >> 8;
+    uint8_t yi = y >> 8;
+    uint8_t zi = z >> 8;
+
+    int16_t fx = x & 0xff;
+    int16_t fy = y & 0xff;
+    int16_t fz = z & 0xff;
+
+    uint16_t u = noise_fade_lookup[fx];
+    uint16_t v = noise_fade_lookup[fy];
+    uint16_t w = noise_fade_lookup[fz];
+
+    uint8_t a = NOISE_PERM( xi ) + yi;
+    uint8_t aa = NOISE_PERM( a ) + zi;
+    uint8_t ab = NOISE_PERM( a + 1 ) + zi;
+    uint8_t b = NOISE_PERM( xi + 1 ) + yi;
+    uint8_t ba = NOISE_PERM( b ) + zi;
+    uint8_t bb = NOISE_PERM( b + 1 ) + zi;
+
+    int32_t x0 = noise_lerp( noise_grad( NOISE_PERM( aa ), fx, fy, fz ),
+                             noise_grad( NOISE_PERM( ba ), fx - 256, fy, fz ), u );
+    int32_t x1 = noise_lerp( noise_grad( NOISE_PERM( ab ), fx, fy - 256, fz ),
+                             noise_grad( NOISE_PERM( bb ), fx - 256, fy - 256, fz ), u );
+    int32_t y0 = noise_lerp( x0, x1, v );
+
+    // z is on the lattice, skip the upper layer
+    if( fz == 0 ){
+
+        return y0;
+    }
+
+    x0 = noise_lerp( noise_grad( NOISE_PERM( aa + 1 ), fx, fy, fz - 256 ),
+                     noise_grad( NOISE_PERM( ba + 1 ), fx - 256, fy, fz - 256 ), u );
+    x1 = noise_lerp( noise_grad( NOISE_PERM( ab + 1 ), fx, fy - 256, fz - 256 ),
+                     noise_grad( NOISE_PERM( bb + 1 ), fx - 256, fy - 256, fz - 256 ), u );
+    int32_t y1 = noise_lerp( x0, x1, v );
+
+    return noise_lerp( y0, y1, w );
+}
+
+static uint16_t noise_scale( int32_t n ){
+
+    n = 32768 + ( n * 8 );
+
+    if( n < 0 ){
+
+        return 0;
+    }
+    else if( n > 65535 ){
+
+        return 65535;
+    }
+
+    return n;
+}
+
+uint16_t gfx_u16_noise_2d( int32_t x, int32_t y ){
+
+    return noise_scale( noise_3d( x, y, 0 ) );
+}
+
+uint16_t gfx_u16_noise_3d( int32_t x, int32_t y, int32_t z ){
+
+    return noise_scale( noise_3d( x, y, z ) );
+}
+
+// fractal noise: each octave doubles the frequency and halves the
+// amplitude. octaves are offset so they do not line up at the origin.
+uint16_t gfx_u16_noise_fbm( int32_t x, int32_t y, int32_t z, uint8_t octaves ){
+
+    int32_t sum = 0;
+    int32_t total = 0;
+    int32_t amp = 128;
+
+    if( octaves == 0 ){
+
+        octaves = 1;
+    }
+
+    for( uint8_t i = 0; i < octaves; i++ ){
+
+        sum += noise_3d( x, y, z ) * amp;
+        total += amp;
+        amp >>= 1;
+
+        x = (int32_t)( (uint32_t)x << 1 ) + 0x3b7;
+        y = (int32_t)( (uint32_t)y << 1 ) + 0x1d3;
+        z = (int32_t)( (uint32_t)z << 1 ) + 0x2c5;
+    }
+
+    return noise_scale( sum / total );
+}
+
+// fill a hue, sat or val of a pixel object with fractal noise.
+// pixel x, y samples the noise at ( x0 + x * scale, y0 + y * scale, z ).
+void gfx_v_noise_fill( uint8_t obj, uint8_t attr, int32_t x0, int32_t y0, int32_t z, int32_t scale, uint8_t octaves ){
+
+    uint16_t size_x, size_y;
+
+    if( !prim_geometry( obj, &size_x, &size_y ) ){
+
+        return;
+    }
+
+    if( octaves < 1 ){
+
+        octaves = 1;
+    }
+    else if( octaves > GFX_NOISE_MAX_OCTAVES ){
+
+        octaves = GFX_NOISE_MAX_OCTAVES;
+    }
+
+    int32_t base = prim_linear_base( obj, size_x, size_y );
+
+    for( uint16_t y = 0; y < size_y; y++ ){
+
+        int32_t ny = y0 + ( y * scale );
+
+        for( uint16_t x = 0; x < size_x; x++ ){
+
+            uint16_t n = gfx_u16_noise_fbm( x0 + ( x * scale ), ny, z, octaves );
+
+            uint16_t index;
+
+            if( base >= 0 ){
+
+                index = base + x + ( y * size_x );
+            }
+            else{
+
+                index = map_index( obj, x, y );
+            }
+
+            if( attr == PIX_ATTR_HUE ){
+
+                _gfx_v_set_hue_1d( n, index );
+            }
+            else if( attr == PIX_ATTR_SAT ){
+
+                _gfx_v_set_sat_1d( n, index );
+            }
+            else if( attr == PIX_ATTR_VAL ){
+
+                _gfx_v_set_val_1d( n, index );
+            }
+        }
+    }
+}
+
 
 
 
@@ -2038,15 +4262,6 @@ Other HSV to RGB code for reference
 // static bool wrap;
 
 
-// void gfx_v_set_fader_rate( uint8_t setting ){
-//
-//     pix_fader_rate = setting;
-// }
-//
-// uint8_t gfx_u8_get_fader_rate( void ){
-//
-//     return pix_fader_rate;
-// }
 
 
 // void gfx_v_set_pen( int32_t h, int32_t s, int32_t v ){
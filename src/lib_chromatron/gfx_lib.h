@@ -29,11 +29,14 @@
 #include "bool.h"
 #include "catbus_common.h"
 
+// host sim builds can override this for large virtual installations
+#ifndef MAX_PIXELS
 #define MAX_PIXELS              320
+#endif
 
 #define FADER_RATE              20
 
-#define GFX_VERSION             1
+#define GFX_VERSION             3
 
 typedef struct  __attribute__((packed)){
     uint8_t version;
@@ -51,6 +54,8 @@ typedef struct  __attribute__((packed)){
     uint16_t dimmer_curve;
     uint16_t virtual_array_start;
     uint16_t virtual_array_length;
+    uint8_t fader_curve;
+    bool dither;
 } gfx_params_t;
 
 typedef struct  __attribute__((packed)){
@@ -61,6 +66,17 @@ typedef struct  __attribute__((packed)){
 
 #define GFX_DIMMER_CURVE_DEFAULT    128
 
+// fader curves.
+// STEP is the original fixed step fader, the others interpolate from
+// the value at the start of the fade and land exactly on the target.
+#define GFX_FADER_CURVE_STEP            0
+#define GFX_FADER_CURVE_LINEAR          1
+#define GFX_FADER_CURVE_SMOOTHERSTEP    2
+#define GFX_FADER_CURVE_EXP             3
+// linear on hue/sat, val fades linearly in perceived brightness
+#define GFX_FADER_CURVE_PERCEPTUAL      4
+#define GFX_FADER_CURVE_COUNT           5
+
 #define ARRAY_OBJ_TYPE      0
 #define PIX_OBJ_TYPE        1
 
@@ -84,13 +100,39 @@ typedef struct  __attribute__((packed)){
     uint8_t padding[3];
 } gfx_pixel_array_t;
 
+// native library functions, called from the VM with lib_call.
+// rng_seed is the calling VM's random generator state.
+typedef int32_t ( *gfx_lib_func_ptr_t )( int32_t *params, uint16_t param_len, uint64_t *rng_seed );
+
+typedef struct{
+    catbus_hash_t32 hash;
+    gfx_lib_func_ptr_t func;
+    uint8_t arity;
+    uint8_t flags;
+} gfx_lib_func_t;
+
+#define GFX_LIB_MAX_FUNCS           32
+
+// arity is the minimum number of parameters
+#define GFX_LIB_FLAGS_VAR_ARGS      0x01
+
 
 uint16_t gfx_u16_get_vm_frame_rate( void );
 
+void gfx_v_set_fader_rate( uint16_t setting );
+uint16_t gfx_u16_get_fader_rate( void );
+
 void gfx_v_set_params( gfx_params_t *params );
 void gfx_v_get_params( gfx_params_t *params );
 
-int32_t gfx_i32_lib_call( catbus_hash_t32 func_hash, int32_t *params, uint16_t param_len );
+int8_t gfx_i8_lib_register(
+    catbus_hash_t32 hash,
+    gfx_lib_func_ptr_t func,
+    uint8_t arity,
+    uint8_t flags );
+int32_t gfx_i32_lib_call( catbus_hash_t32 func_hash, int32_t *params, uint16_t param_len, uint64_t *rng_seed );
+int16_t gfx_i16_get_lib_index( catbus_hash_t32 func_hash, uint8_t param_len );
+int32_t gfx_i32_lib_call_index( uint8_t index, int32_t *params, uint16_t param_len, uint64_t *rng_seed );
 
 int32_t gfx_i32_get_obj_attr( uint8_t obj, uint8_t attr, uint8_t addr );
 
@@ -163,6 +205,11 @@ uint16_t gfx_u16_get_v_fade( uint16_t x, uint16_t y, uint8_t obj );
 
 uint16_t gfx_u16_get_is_fading( uint16_t x, uint16_t y, uint8_t obj );
 
+void gfx_v_fill_rect( uint8_t obj, int32_t x, int32_t y, int32_t w, int32_t h, int32_t _hue, int32_t _sat, int32_t _val );
+void gfx_v_draw_line( uint8_t obj, int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t _hue, int32_t _sat, int32_t _val );
+void gfx_v_blit( uint8_t dest, int32_t x, int32_t y, uint8_t src );
+void gfx_v_scroll( uint8_t obj, int32_t dx, int32_t dy );
+
 uint16_t gfx_u16_get_pix0_red( void );
 uint16_t gfx_u16_get_pix0_green( void );
 uint16_t gfx_u16_get_pix0_blue( void );
@@ -193,8 +240,22 @@ void gfx_v_hsv_to_rgbw(
 
 void gfx_v_reset( void );
 void gfx_v_init_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count );
+void gfx_v_set_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count );
+void gfx_v_set_partition( uint16_t index, uint16_t count );
+
+#ifdef VM_BENCH
+void gfx_v_set_store_alloc_fail( bool fail );
+uint32_t gfx_u32_get_store_size( void );
+uint32_t gfx_u32_get_index_map_builds( void );
+#endif
+
+#define GFX_NOISE_MAX_OCTAVES       8
 
 void gfx_v_init_noise( void );
 uint16_t gfx_u16_noise( uint16_t x );
+uint16_t gfx_u16_noise_2d( int32_t x, int32_t y );
+uint16_t gfx_u16_noise_3d( int32_t x, int32_t y, int32_t z );
+uint16_t gfx_u16_noise_fbm( int32_t x, int32_t y, int32_t z, uint8_t octaves );
+void gfx_v_noise_fill( uint8_t obj, uint8_t attr, int32_t x0, int32_t y0, int32_t z, int32_t scale, uint8_t octaves );
 
 #endif
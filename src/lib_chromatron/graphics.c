@@ -50,18 +50,22 @@ static bool gfx_interleave_x;
 static bool gfx_transpose;
 static uint16_t gfx_frame_rate = 100;
 static uint8_t gfx_dimmer_curve = GFX_DIMMER_CURVE_DEFAULT;
+static uint8_t gfx_fader_curve = GFX_FADER_CURVE_STEP;
+static bool gfx_dither;
 
 static uint16_t gfx_virtual_array_start;
 static uint16_t gfx_virtual_array_length;
 
 static bool pixel_transfer_enable = TRUE;
 
-static mem_handle_t subscribed_keys_h = -1;
+// read keys for each VM instance, set to -1 in gfx_v_init()
+static mem_handle_t subscribed_keys_h[VM_MAX_VMS];
 
 static volatile uint8_t run_flags;
 #define FLAG_RUN_PARAMS         0x01
 #define FLAG_RUN_VM_LOOP        0x02
 #define FLAG_RUN_FADER          0x04
+#define FLAG_REQUEST_KEYFRAME   0x08
 
 static uint16_t vm_timer_rate; 
 
@@ -143,6 +147,11 @@ static void param_error_check( void ){
 
         gfx_dimmer_curve = GFX_DIMMER_CURVE_DEFAULT;
     }
+
+    if( gfx_fader_curve >= GFX_FADER_CURVE_COUNT ){
+
+        gfx_fader_curve = GFX_FADER_CURVE_STEP;
+    }
 }
 
 
@@ -179,6 +188,8 @@ KV_SECTION_META kv_meta_t gfx_info_kv[] = {
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_PERSIST, &v_fade,                      gfx_i8_kv_handler,   "gfx_vfade" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_PERSIST, &gfx_frame_rate,              gfx_i8_kv_handler,   "gfx_frame_rate" },
     { SAPPHIRE_TYPE_UINT8,   0, KV_FLAGS_PERSIST, &gfx_dimmer_curve,            gfx_i8_kv_handler,   "gfx_dimmer_curve" },
+    { SAPPHIRE_TYPE_UINT8,   0, KV_FLAGS_PERSIST, &gfx_fader_curve,             gfx_i8_kv_handler,   "gfx_fader_curve" },
+    { SAPPHIRE_TYPE_BOOL,    0, KV_FLAGS_PERSIST, &gfx_dither,                  gfx_i8_kv_handler,   "gfx_dither" },
     
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_PERSIST, &gfx_virtual_array_start,     gfx_i8_kv_handler,   "gfx_varray_start" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_PERSIST, &gfx_virtual_array_length,    gfx_i8_kv_handler,   "gfx_varray_length" },
@@ -204,6 +215,8 @@ void gfx_v_set_params( gfx_params_t *params ){
     gfx_dimmer_curve            = params->dimmer_curve;
     gfx_virtual_array_start     = params->virtual_array_start;
     gfx_virtual_array_length    = params->virtual_array_length;
+    gfx_fader_curve             = params->fader_curve;
+    gfx_dither                  = params->dither;
 
     // we cannot set pix mode via this function
     // pix_mode                = params->pix_mode;
@@ -232,6 +245,8 @@ void gfx_v_get_params( gfx_params_t *params ){
 
     params->virtual_array_start   = gfx_virtual_array_start;
     params->virtual_array_length  = gfx_virtual_array_length;
+    params->fader_curve           = gfx_fader_curve;
+    params->dither                = gfx_dither;
 
     // override dimmer curve for the Pixie, since it already has curves built in
     if( pixel_u8_get_mode() == PIX_MODE_PIXIE ){
@@ -330,6 +345,11 @@ ISR(GFX_TIMER_CCC_vect){
 
 void gfx_v_init( void ){
 
+    for( uint8_t i = 0; i < VM_MAX_VMS; i++ ){
+
+        subscribed_keys_h[i] = -1;
+    }
+
     if( pixel_u8_get_mode() == PIX_MODE_ANALOG ){
 
         // override size settings
@@ -383,6 +403,15 @@ bool gfx_b_running( void ){
 
 void gfx_v_pixel_bridge_enable( void ){
 
+    // the pixels were changed while the bridge was off,
+    // so the next frame needs to be sent in full.
+    if( !pixel_transfer_enable ){
+
+        ATOMIC;
+        run_flags |= FLAG_REQUEST_KEYFRAME;
+        END_ATOMIC;
+    }
+
     pixel_transfer_enable = TRUE;
 }
 
@@ -414,32 +443,45 @@ static int8_t send_run_vm_cmd( void ){
 
 static int8_t send_read_keys( void ){
 
-    if( subscribed_keys_h < 0 ){
-
-        return 0;
-    }
-
     wifi_msg_kv_batch_t batch;
     batch.count = 0;
 
-    uint32_t read_keys_count = mem2_u16_get_size( subscribed_keys_h ) / sizeof(uint32_t);
-    uint32_t *read_key = mem2_vp_get_ptr_fast( subscribed_keys_h );
+    // network time is always sent, for the VM's network_time() library call
+    batch.entries[batch.count].hash = __KV__net_time;
+    batch.entries[batch.count].data = time_u32_get_network_time();
+    batch.count++;
 
-    if( read_keys_count > WIFI_KV_BATCH_LEN ){
+    for( uint8_t vm_id = 0; vm_id < VM_MAX_VMS; vm_id++ ){
 
-        read_keys_count = WIFI_KV_BATCH_LEN;
+        if( subscribed_keys_h[vm_id] < 0 ){
 
-        log_v_debug_P( PSTR("read keys limited to %d"), WIFI_KV_BATCH_LEN );
-    }
+            continue;
+        }
 
-    for( uint8_t i = 0; i < read_keys_count; i++ ){
-    
-        batch.entries[i].hash = *read_key;
+        uint32_t read_keys_count = mem2_u16_get_size( subscribed_keys_h[vm_id] ) / sizeof(uint32_t);
+        uint32_t *read_key = mem2_vp_get_ptr_fast( subscribed_keys_h[vm_id] );
+
+        if( read_keys_count > (uint32_t)( WIFI_KV_BATCH_LEN - batch.count ) ){
+
+            read_keys_count = WIFI_KV_BATCH_LEN - batch.count;
+
+            log_v_debug_P( PSTR("read keys limited to %d"), WIFI_KV_BATCH_LEN - batch.count );
+        }
+
+        for( uint8_t i = 0; i < read_keys_count; i++ ){
+        
+            batch.entries[batch.count].hash = *read_key;
+
+            catbus_i8_get( *read_key, &batch.entries[batch.count].data );
+
+            read_key++;
+            batch.count++;
+        }
+    }
 
-        catbus_i8_get( *read_key, &batch.entries[i].data );
+    if( batch.count == 0 ){
 
-        read_key++;
-        batch.count++;
+        return 0;
     }
 
     return wifi_i8_send_msg( WIFI_DATA_ID_KV_BATCH, (uint8_t *)&batch, sizeof(batch) );  
@@ -450,6 +492,20 @@ static int8_t send_run_fader_cmd( void ){
     return wifi_i8_send_msg( WIFI_DATA_ID_RUN_FADER, 0, 0 );   
 }
 
+// present on the next frame boundary in network time,
+// so nodes running the same frame rate latch together.
+static uint32_t get_present_time( void ){
+
+    uint32_t now = time_u32_get_network_time();
+
+    return ( ( now / gfx_frame_rate ) + 1 ) * gfx_frame_rate;
+}
+
+static int8_t send_request_keyframe_cmd( void ){
+
+    return wifi_i8_send_msg( WIFI_DATA_ID_REQUEST_RGB_KEYFRAME, 0, 0 );   
+}
+
 #ifdef ENABLE_TIME_SYNC
 static int8_t send_request_frame_sync_cmd( void ){
     
@@ -464,6 +520,23 @@ static int8_t send_request_frame_sync_cmd( void ){
 static uint16_t current_frame;
 #endif
 
+// with pix_latch, the next frame is held off until a presented one
+// is sent, see gfx thread. data arriving anyway would show up in the
+// waiting frame, so it is dropped and the next frame sent in full.
+static bool pixel_load_blocked( void ){
+
+    if( !pixel_b_present_busy() ){
+
+        return FALSE;
+    }
+
+    ATOMIC;
+    run_flags |= FLAG_REQUEST_KEYFRAME;
+    END_ATOMIC;
+
+    return TRUE;
+}
+
 int8_t wifi_i8_msg_handler( uint8_t data_id, uint8_t *data, uint8_t len ){
     
     if( data_id == WIFI_DATA_ID_RGB_PIX0 ){
@@ -482,7 +555,7 @@ int8_t wifi_i8_msg_handler( uint8_t data_id, uint8_t *data, uint8_t len ){
     }  
     else if( data_id == WIFI_DATA_ID_RGB_ARRAY ){
 
-        if( pixel_transfer_enable ){
+        if( pixel_transfer_enable && !pixel_load_blocked() ){
 
             wifi_msg_rgb_array_t *msg = (wifi_msg_rgb_array_t *)data;
 
@@ -495,6 +568,23 @@ int8_t wifi_i8_msg_handler( uint8_t data_id, uint8_t *data, uint8_t len ){
             pixel_v_load_rgb( msg->index, msg->count, r, g, b, d );   
         }
     }
+    else if( data_id == WIFI_DATA_ID_RGB_DELTA ){
+
+        if( pixel_transfer_enable && !pixel_load_blocked() ){
+
+            if( pixel_i8_load_rgb_delta( data, len ) < 0 ){
+
+                return -1;
+            }
+        }
+    }
+    else if( data_id == WIFI_DATA_ID_RGB_PRESENT ){
+
+        if( pixel_transfer_enable ){
+
+            pixel_v_present_at( get_present_time() );
+        }
+    }
     else if( data_id == WIFI_DATA_ID_VM_INFO ){
 
         if( len != sizeof(vm_info_t) ){
@@ -504,6 +594,15 @@ int8_t wifi_i8_msg_handler( uint8_t data_id, uint8_t *data, uint8_t len ){
 
         vm_v_received_info( (vm_info_t *)data );
     }
+    else if( data_id == WIFI_DATA_ID_VM_PROFILE ){
+
+        if( len != sizeof(wifi_msg_vm_profile_t) ){
+
+            return -1;
+        }
+
+        vm_v_received_profile( (wifi_msg_vm_profile_t *)data );
+    }
     #ifdef ENABLE_TIME_SYNC
     else if( data_id == WIFI_DATA_ID_VM_FRAME_SYNC ){
         
@@ -648,19 +747,39 @@ void gfx_v_reset_frame_sync( void ){
 }
 #endif
 
-void gfx_v_set_subscribed_keys( mem_handle_t h ){
+// set the read keys for a VM instance, replacing any it had.
+// takes ownership of h, -1 clears the instance's keys.
+void gfx_v_set_subscribed_keys( uint8_t vm_id, mem_handle_t h ){
+
+    if( vm_id >= VM_MAX_VMS ){
+
+        if( h > 0 ){
+
+            mem2_v_free( h );
+        }
+
+        return;
+    }
+
+    if( subscribed_keys_h[vm_id] > 0 ){
+
+        mem2_v_free( subscribed_keys_h[vm_id] );
+    }
+
+    if( h <= 0 ){
 
-    subscribed_keys_h = h;
+        h = -1;
+    }
+
+    subscribed_keys_h[vm_id] = h;
 }
 
 void gfx_v_reset_subscribed( void ){
 
-    if( subscribed_keys_h > 0 ){
+    for( uint8_t i = 0; i < VM_MAX_VMS; i++ ){
 
-        mem2_v_free( subscribed_keys_h );
+        gfx_v_set_subscribed_keys( i, -1 );
     }
-
-    subscribed_keys_h = -1;
 }
 
 
@@ -673,6 +792,7 @@ PT_BEGIN( pt );
     #endif
 
     static uint8_t flags;
+    static bool fader_deferred;
 
     // wait until wifi is attached before starting up pixel driver
     THREAD_WAIT_WHILE( pt, !wifi_b_attached() );
@@ -682,7 +802,8 @@ PT_BEGIN( pt );
 
     while(1){
 
-        THREAD_WAIT_WHILE( pt, run_flags == 0 );        
+        THREAD_WAIT_WHILE( pt, ( run_flags == 0 ) && 
+                               ( !fader_deferred || pixel_b_present_busy() ) );
 
         ATOMIC;
         flags = run_flags;
@@ -738,20 +859,31 @@ PT_BEGIN( pt );
                 send_request_frame_sync_cmd();
                 last_frame_sync_time = tmr_u32_get_system_time_ms();
             }
-            #else
+            #endif
+
             THREAD_WAIT_WHILE( pt, !wifi_b_comm_ready() );
             send_read_keys();
 
             THREAD_WAIT_WHILE( pt, !wifi_b_comm_ready() );
             send_run_vm_cmd();
-            #endif
         }
 
 end:
-        if( flags & FLAG_RUN_FADER ){   
+        if( ( flags & FLAG_RUN_FADER ) || fader_deferred ){   
 
-            THREAD_WAIT_WHILE( pt, !wifi_b_comm_ready() );
-            send_run_fader_cmd();
+            // each fader run sends a frame, hold it until a latched
+            // frame has been sent so it does not load over it.
+            if( pixel_b_present_busy() ){
+
+                fader_deferred = TRUE;
+            }
+            else{
+
+                fader_deferred = FALSE;
+
+                THREAD_WAIT_WHILE( pt, !wifi_b_comm_ready() );
+                send_run_fader_cmd();
+            }
         }
 
         if( flags & FLAG_RUN_PARAMS ){
@@ -760,6 +892,12 @@ end:
             send_params( FALSE );
         }
 
+        if( flags & FLAG_REQUEST_KEYFRAME ){
+
+            THREAD_WAIT_WHILE( pt, !wifi_b_comm_ready() );
+            send_request_keyframe_cmd();
+        }
+
         THREAD_YIELD( pt ); 
     }
 
@@ -54,7 +54,7 @@ void gfx_v_reset_frame_sync( void );
 
 void gfx_v_sync_params( void );
 
-void gfx_v_set_subscribed_keys( mem_handle_t h );
+void gfx_v_set_subscribed_keys( uint8_t vm_id, mem_handle_t h );
 void gfx_v_reset_subscribed( void );
 
 #endif
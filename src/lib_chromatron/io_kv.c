@@ -26,6 +26,7 @@
 #include "sapphire.h"
 #include "io_kv.h"
 #include "io_intf.h"
+#include "pixel.h"
 
 
 static uint8_t analog_mode;
@@ -175,6 +176,12 @@ static int8_t _iokv_i8_cfg_handler(
     }
     else if( op == KV_OP_SET ){
 
+        // pixel output 2 is using this pin
+        if( pixel_b_io_in_use( hash_to_pin( hash ) ) ){
+
+            return 0;
+        }
+
         uint8_t pin_mode = *( (uint8_t *)data );
         uint8_t mode = 0;
 
@@ -290,6 +297,12 @@ static int8_t _iokv_i8_val_handler(
     }
     else if( op == KV_OP_SET ){
 
+        // pixel output 2 is using this pin
+        if( pixel_b_io_in_use( hash_to_pin( hash ) ) ){
+
+            return 0;
+        }
+
         // check analog mode
         if( ( hash == __KV__io_cfg_adc0_4 ) && ( analog_mode & 0x01 ) ){
 
@@ -33,6 +33,7 @@
 
 #include "logging.h"
 #include "hal_dma.h"
+#include "timesync.h"
 
 #include "event_log.h"
 
@@ -44,6 +45,9 @@
 #define PWM_FADE_TIMER_WATCHDOG_VALUE 25000
 
 #define PIXEL_TIMER_RATE TC_CLKSEL_DIV64_gc
+#define PIXEL_TIMER_TICKS_PER_MS 500
+
+#define PIX_PRESENT_MAX_DELAY 1000 // ms
 
 static bool pix_dither;
 static uint8_t pix_mode;
@@ -51,6 +55,8 @@ static uint8_t pix_mode;
 static uint8_t pix_clock;
 static uint8_t pix_rgb_order;
 static uint8_t pix_apa102_dimmer = 31;
+static uint8_t pix_outputs;
+static bool pix_latch;
 static bool apa102_trailer;
 
 static uint8_t array_r[MAX_PIXELS];
@@ -64,10 +70,42 @@ static union{
 static uint8_t pixels_per_buf;
 
 static uint16_t current_pixel;
+static uint16_t end_pixel;
 static uint8_t pix_buf_A[PIX_DMA_BUF_SIZE];
 static uint8_t pix_buf_B[PIX_DMA_BUF_SIZE];
 static uint8_t dither_cycle;
 
+// with two outputs, the pixels are split in half and each output
+// gets half of pix_buf_A and pix_buf_B.
+// output 2 has a single DMA channel, so it alternates between its
+// two buffers, filling one while the other is sent.
+static uint8_t output_count;
+static uint8_t outputs_active;
+static uint16_t current_pixel2;
+static uint16_t end_pixel2;
+static uint8_t *pix2_buf[2];
+static uint8_t *pix2_next;
+static uint8_t pix2_count;
+static bool apa102_trailer2;
+
+// output 1 is chained in hardware, so its interrupts have a whole
+// buffer to refill the idle channel.
+// output 2 has to restart its channel before the line idles for a
+// WS2811 reset (50 us), so with two outputs it gets the high level
+// and output 1 drops to medium.
+static uint8_t output1_int_level;
+
+// with pix_latch set, frames are only sent when presented with
+// pixel_v_present_at(), instead of continuously.
+// the pixel timer counts down to the present time.
+static uint8_t latch_state;
+#define LATCH_IDLE      0 // pixels hold the last frame
+#define LATCH_WAIT      1 // waiting for the present time
+#define LATCH_OUTPUT    2 // frame is being sent
+
+static bool present_pending; // presented while the last frame was being sent
+static uint32_t present_ticks;
+
 
 int8_t pix_i8_kv_handler(
     kv_op_t8 op,
@@ -102,6 +140,8 @@ KV_SECTION_META kv_meta_t pixel_info_kv[] = {
     { SAPPHIRE_TYPE_BOOL,    0, KV_FLAGS_PERSIST,                 &pix_dither,          0,                    "pix_dither" },
     { SAPPHIRE_TYPE_UINT8,   0, KV_FLAGS_PERSIST,                 &pix_mode,            pix_i8_kv_handler,    "pix_mode" },
     { SAPPHIRE_TYPE_UINT8,   0, KV_FLAGS_PERSIST,                 &pix_apa102_dimmer,   pix_i8_kv_handler,    "pix_apa102_dimmer" },
+    { SAPPHIRE_TYPE_UINT8,   0, KV_FLAGS_PERSIST,                 &pix_outputs,         pix_i8_kv_handler,    "pix_outputs" },
+    { SAPPHIRE_TYPE_BOOL,    0, KV_FLAGS_PERSIST,                 &pix_latch,           pix_i8_kv_handler,    "pix_latch" },
 };
 
 static const PROGMEM uint8_t ws2811_lookup[256][3] = {
@@ -179,6 +219,176 @@ static void setup_tx_dma_B( uint8_t *buf, uint8_t len ){
     DMA.PIXEL_DMA_CH_B.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc | DMA_CH_REPEAT_bm;
 }
 
+static void setup_tx_dma_2( uint8_t *buf, uint8_t len ){
+
+    DMA.PIXEL2_DMA_CH.CTRLA = 0;
+
+    if( len == 0 ){
+
+        return;
+    }
+
+    DMA.INTFLAGS = PIXEL2_DMA_CH_TRNIF_FLAG; // clear transaction complete interrupt
+
+    DMA.PIXEL2_DMA_CH.REPCNT = 1;
+    DMA.PIXEL2_DMA_CH.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    DMA.PIXEL2_DMA_CH.TRIGSRC = PIXEL2_USART_DMA_TRIG;
+    DMA.PIXEL2_DMA_CH.TRFCNT = len;
+
+    DMA.PIXEL2_DMA_CH.DESTADDR0 = ( ( (uint16_t)&PIXEL2_DATA_PORT.DATA ) >> 0 ) & 0xFF;
+    DMA.PIXEL2_DMA_CH.DESTADDR1 = ( ( (uint16_t)&PIXEL2_DATA_PORT.DATA ) >> 8 ) & 0xFF;
+    DMA.PIXEL2_DMA_CH.DESTADDR2 = 0;
+
+    DMA.PIXEL2_DMA_CH.SRCADDR0 = ( ( (uint16_t)buf ) >> 0 ) & 0xFF;
+    DMA.PIXEL2_DMA_CH.SRCADDR1 = ( ( (uint16_t)buf ) >> 8 ) & 0xFF;
+    DMA.PIXEL2_DMA_CH.SRCADDR2 = 0;
+
+    DMA.PIXEL2_DMA_CH.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+}
+
+// per frame encoder state.
+// wire_array holds the channel arrays in the strip's color order.
+// wire_dither_inc maps a pixel's dither bits (00rrggbb) to the wire
+// channels that round up this frame, bit 0 is the first channel.
+static uint8_t *wire_array[3];
+static bool wire_dither;
+static uint8_t wire_dither_inc[64];
+static uint8_t wire_apa102_header;
+
+static void setup_frame_encoding( void ){
+
+    uint8_t order[3]; // 0 = red, 1 = green, 2 = blue
+
+    if( pix_rgb_order == PIX_ORDER_RBG ){
+
+        order[0] = 0;
+        order[1] = 2;
+        order[2] = 1;
+    }
+    else if( pix_rgb_order == PIX_ORDER_GRB ){
+
+        order[0] = 1;
+        order[1] = 0;
+        order[2] = 2;
+    }
+    else if( pix_rgb_order == PIX_ORDER_BGR ){
+
+        order[0] = 2;
+        order[1] = 1;
+        order[2] = 0;
+    }
+    else if( pix_rgb_order == PIX_ORDER_BRG ){
+
+        order[0] = 2;
+        order[1] = 0;
+        order[2] = 1;
+    }
+    else if( pix_rgb_order == PIX_ORDER_GBR ){
+
+        order[0] = 1;
+        order[1] = 2;
+        order[2] = 0;
+    }
+    else{ // PIX_ORDER_RGB
+
+        order[0] = 0;
+        order[1] = 1;
+        order[2] = 2;
+    }
+
+    uint8_t wire_bit[3]; // wire channel bit of red, green and blue
+
+    for( uint8_t c = 0; c < 3; c++ ){
+
+        if( order[c] == 0 ){
+
+            wire_array[c] = array_r;
+        }
+        else if( order[c] == 1 ){
+
+            wire_array[c] = array_g;
+        }
+        else{
+
+            wire_array[c] = array_b;
+        }
+
+        wire_bit[order[c]] = 1 << c;
+    }
+
+    wire_apa102_header = 0xe0 | pix_apa102_dimmer; // APA102 global brightness control
+
+    // RGBW uses the dither array for white
+    wire_dither = pix_dither && ( pix_mode != PIX_MODE_SK6812_RGBW );
+
+    if( !wire_dither ){
+
+        return;
+    }
+
+    // a channel rounds up when its dither bits are above this frame's level
+    uint8_t level = dither_cycle & 0x03;
+    uint8_t i = 0;
+
+    for( uint8_t rd = 0; rd < 4; rd++ ){
+
+        for( uint8_t gd = 0; gd < 4; gd++ ){
+
+            for( uint8_t bd = 0; bd < 4; bd++ ){
+
+                uint8_t inc = 0;
+
+                if( rd > level ){
+
+                    inc |= wire_bit[0];
+                }
+
+                if( gd > level ){
+
+                    inc |= wire_bit[1];
+                }
+
+                if( bd > level ){
+
+                    inc |= wire_bit[2];
+                }
+
+                wire_dither_inc[i++] = inc;
+            }
+        }
+    }
+}
+
+// pixel's channels in wire order, with dithering applied
+static void load_wire_data( uint16_t pixel, uint8_t data[3] ){
+
+    data[0] = wire_array[0][pixel];
+    data[1] = wire_array[1][pixel];
+    data[2] = wire_array[2][pixel];
+
+    if( !wire_dither ){
+
+        return;
+    }
+
+    uint8_t inc = wire_dither_inc[array_misc.dither[pixel] & 0x3f];
+
+    if( ( inc & 0x01 ) && ( data[0] < 255 ) ){
+
+        data[0]++;
+    }
+
+    if( ( inc & 0x02 ) && ( data[1] < 255 ) ){
+
+        data[1]++;
+    }
+
+    if( ( inc & 0x04 ) && ( data[2] < 255 ) ){
+
+        data[2]++;
+    }
+}
+
 // static bool dma_done( void ){
 //
 //     // check if not enabled
@@ -190,10 +400,21 @@ static void setup_tx_dma_B( uint8_t *buf, uint8_t len ){
 //     return ( DMA.INTFLAGS & PIXEL_DMA_CH_A_TRNIF_FLAG ) != 0;
 // }
 
-static uint8_t setup_pixel_buffer( uint8_t *buf, uint8_t len ){
-
+// fill buf with the pixels from *pixel up to end in wire format,
+// and advance *pixel.
+// the encoding is set up once per frame by setup_frame_encoding(),
+// so this only checks the mode per buffer, not per pixel.
+//
+// this runs in the DMA interrupts, one buffer ahead of the DMA.
+// a whole frame in wire format does not fit in RAM (WS2811 is 9
+// bytes per pixel), and a thread filling the buffers could not be
+// relied on to keep up: a WS2811 buffer is sent in about 0.6 ms,
+// and running late would latch a partial frame.
+static uint8_t setup_pixel_buffer( uint8_t *buf, uint16_t *pixel, uint16_t end ){
+
+    uint16_t current = *pixel;
     uint8_t transfer_pixel_count = pixels_per_buf;
-    uint16_t pixels_remaining = gfx_u16_get_pix_count() - current_pixel;
+    uint16_t pixels_remaining = end - current;
 
     if( transfer_pixel_count > pixels_remaining ){
 
@@ -206,126 +427,271 @@ static uint8_t setup_pixel_buffer( uint8_t *buf, uint8_t len ){
     }
 
     uint8_t buf_index = 0;
+    uint8_t data[3];
 
-    uint8_t r, g, b, dither;
-    uint8_t rd, gd, bd;
+    if( ( pix_mode == PIX_MODE_WS2811 ) ||
+        ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
 
-    for( uint8_t i = 0; i < transfer_pixel_count; i++ ){
+        // ws2811 bitstream lookup
+        for( uint8_t i = 0; i < transfer_pixel_count; i++ ){
 
-        r = array_r[current_pixel];
-        g = array_g[current_pixel];
-        b = array_b[current_pixel];
+            load_wire_data( current, data );
 
-        if( pix_mode == PIX_MODE_SK6812_RGBW ){
+            for( uint8_t c = 0; c < 3; c++ ){
 
-        }
-        else if( pix_dither ){
+                const uint8_t *bits = ws2811_lookup[data[c]];
 
-            dither = array_misc.dither[current_pixel];
+                buf[buf_index++] = pgm_read_byte( &bits[0] );
+                buf[buf_index++] = pgm_read_byte( &bits[1] );
+                buf[buf_index++] = pgm_read_byte( &bits[2] );
+            }
 
-            rd = ( dither >> 4 ) & 0x03;
-            gd = ( dither >> 2 ) & 0x03;
-            bd = ( dither >> 0 ) & 0x03;
+            if( pix_mode == PIX_MODE_SK6812_RGBW ){
 
-            if( ( r < 255 ) && ( rd > ( dither_cycle & 0x03 ) ) ){
+                const uint8_t *bits = ws2811_lookup[array_misc.white[current]];
 
-                r++;
+                buf[buf_index++] = pgm_read_byte( &bits[0] );
+                buf[buf_index++] = pgm_read_byte( &bits[1] );
+                buf[buf_index++] = pgm_read_byte( &bits[2] );
             }
 
-            if( ( g < 255 ) && ( gd > ( dither_cycle & 0x03 ) ) ){
+            current++;
+        }
+    }
+    else if( pix_mode == PIX_MODE_APA102 ){
 
-                g++;
-            }
+        for( uint8_t i = 0; i < transfer_pixel_count; i++ ){
 
-            if( ( b < 255 ) && ( bd > ( dither_cycle & 0x03 ) ) ){
+            load_wire_data( current, data );
 
-                b++;
-            }
+            buf[buf_index++] = wire_apa102_header;
+            buf[buf_index++] = data[0];
+            buf[buf_index++] = data[1];
+            buf[buf_index++] = data[2];
+
+            current++;
         }
+    }
+    else{
+
+        for( uint8_t i = 0; i < transfer_pixel_count; i++ ){
+
+            load_wire_data( current, data );
 
-        if( pix_mode == PIX_MODE_APA102 ){
+            buf[buf_index++] = data[0];
+            buf[buf_index++] = data[1];
+            buf[buf_index++] = data[2];
 
-            buf[buf_index++] = 0xe0 | pix_apa102_dimmer; // APA102 global brightness control
+            current++;
         }
+    }
 
-        uint8_t data0, data1, data2;
+    *pixel = current;
 
-        if( pix_rgb_order == PIX_ORDER_RGB ){
+    return buf_index;
+}
 
-            data0 = r;
-            data1 = g;
-            data2 = b;
-        }
-        else if( pix_rgb_order == PIX_ORDER_RBG ){
+static uint8_t setup_output2_buffer( uint8_t *buf ){
 
-            data0 = r;
-            data1 = b;
-            data2 = g;
-        }
-        else if( pix_rgb_order == PIX_ORDER_GRB ){
+    uint8_t count = setup_pixel_buffer( buf, &current_pixel2, end_pixel2 );
 
-            data0 = g;
-            data1 = r;
-            data2 = b;
-        }
-        else if( pix_rgb_order == PIX_ORDER_BGR ){
+    if( ( count == 0 ) && ( pix_mode == PIX_MODE_APA102 ) && ( !apa102_trailer2 ) ){
 
-            data0 = b;
-            data1 = g;
-            data2 = r;
-        }
-        else if( pix_rgb_order == PIX_ORDER_BRG ){
+        apa102_trailer2 = TRUE;
 
-            data0 = b;
-            data1 = r;
-            data2 = g;
-        }
-        else if( pix_rgb_order == PIX_ORDER_GBR ){
+        // APA102 trailer, see ISR(PIXEL_DMA_CH_A_vect)
+        memset( buf, 0xff, 19 );
+        count = 19;
+    }
 
-            data0 = g;
-            data1 = b;
-            data2 = r;
-        }
+    return count;
+}
 
-        if( ( pix_mode == PIX_MODE_WS2811 ) ||
-            ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
+// run the pixel timer for ticks, chaining timer periods as needed,
+// then send the frame.
+static void arm_present_timer( uint32_t ticks ){
 
-            // ws2811 bitstream lookup
+    uint16_t period = 0xffff;
 
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data0][0] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data0][1] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data0][2] );
+    if( ticks < period ){
 
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data1][0] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data1][1] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data1][2] );
+        period = ticks;
+    }
 
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data2][0] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data2][1] );
-            buf[buf_index++] = pgm_read_byte( &ws2811_lookup[data2][2] );
+    if( period < 2 ){
 
-            if( pix_mode == PIX_MODE_SK6812_RGBW ){
+        period = 2;
+    }
 
-                uint8_t white = array_misc.white[current_pixel];
+    present_ticks = 0;
 
-                buf[buf_index++] = pgm_read_byte( &ws2811_lookup[white][0] );
-                buf[buf_index++] = pgm_read_byte( &ws2811_lookup[white][1] );
-                buf[buf_index++] = pgm_read_byte( &ws2811_lookup[white][2] );
-            }
-        }
-        else{
+    if( ticks > period ){
 
-            buf[buf_index++] = data0;
-            buf[buf_index++] = data1;
-            buf[buf_index++] = data2;
-        }
+        present_ticks = ticks - period;
+    }
+
+    latch_state = LATCH_WAIT;
+
+    // the timer overflows every PER + 1 ticks
+    PIXEL_TIMER.CTRLA = 0;
+    PIXEL_TIMER.CNT = 0;
+    PIXEL_TIMER.PER = period - 1;
+    PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+}
 
-        current_pixel++;
+// latched frame is done, elapsed is the pixel timer count since it started
+static void latch_frame_done( uint16_t elapsed ){
+
+    PIXEL_TIMER.CTRLA = 0;
+
+    latch_state = LATCH_IDLE;
+
+    if( !present_pending ){
+
+        return;
     }
 
-    return buf_index;
+    present_pending = FALSE;
+
+    uint32_t ticks = 0;
+
+    if( present_ticks > elapsed ){
+
+        ticks = present_ticks - elapsed;
+    }
+
+    arm_present_timer( ticks );
+}
+
+// stop the outputs in the middle of a frame
+static void stop_frame_dma( void ){
+
+    DMA.PIXEL_DMA_CH_A.CTRLA = 0;
+    DMA.PIXEL_DMA_CH_B.CTRLA = 0;
+
+    DMA.PIXEL_DMA_CH_A.CTRLB &= ~DMA_CH_TRNINTLVL_gm;
+    DMA.PIXEL_DMA_CH_B.CTRLB &= ~DMA_CH_TRNINTLVL_gm;
+
+    disable_double_buffer();
+
+    DMA.INTFLAGS = PIXEL_DMA_CH_A_TRNIF_FLAG;
+    DMA.INTFLAGS = PIXEL_DMA_CH_B_TRNIF_FLAG;
+
+    if( output_count > 1 ){
+
+        DMA.PIXEL2_DMA_CH.CTRLA = 0;
+        DMA.PIXEL2_DMA_CH.CTRLB &= ~DMA_CH_TRNINTLVL_gm;
+
+        DMA.INTFLAGS = PIXEL2_DMA_CH_TRNIF_FLAG;
+    }
+
+    outputs_active = 0;
+}
+
+// pixel timer expired while latched, returns TRUE to send the frame
+static bool latch_timer_expired( void ){
+
+    if( latch_state == LATCH_OUTPUT ){
+
+        // watchdog, the frame did not finish.
+        // stop it, so a late DMA interrupt can't finish it again.
+        stop_frame_dma();
+
+        latch_frame_done( PWM_FADE_TIMER_WATCHDOG_VALUE );
+
+        return FALSE;
+    }
+
+    if( latch_state != LATCH_WAIT ){
+
+        return FALSE;
+    }
+
+    if( present_ticks > 0 ){
+
+        arm_present_timer( present_ticks );
+
+        return FALSE;
+    }
+
+    latch_state = LATCH_OUTPUT;
+
+    return TRUE;
 }
 
+// called as each output finishes its frame.
+// when the last one is done, restart the frame timer.
+static void output_done( uint8_t output ){
+
+    outputs_active &= ~( 1 << output );
+
+    if( outputs_active != 0 ){
+
+        return;
+    }
+
+    if( pix_latch ){
+
+        latch_frame_done( PIXEL_TIMER.CNT );
+
+        return;
+    }
+
+    // reset timer
+    PIXEL_TIMER.CTRLA = 0;
+    PIXEL_TIMER.CNT = 0;
+    PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE;
+
+    if( ( pix_mode == PIX_MODE_WS2811 ) ||
+        ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
+
+        PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_WS2811;
+    }
+    else if( pix_mode == PIX_MODE_PIXIE ){
+
+        PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_PIXIE;
+    }
+
+    PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+}
+
+
+static void output2_start_frame( void ){
+
+    DMA.PIXEL2_DMA_CH.CTRLA = 0;
+    DMA.PIXEL2_DMA_CH.TRFCNT = 0;
+
+    if( current_pixel2 >= end_pixel2 ){
+
+        return;
+    }
+
+    apa102_trailer2 = FALSE;
+
+    uint8_t count;
+
+    if( pix_mode == PIX_MODE_APA102 ){
+
+        // APA102 header
+        memset( pix2_buf[0], 0, 4 );
+        count = 4;
+    }
+    else{
+
+        count = setup_output2_buffer( pix2_buf[0] );
+    }
+
+    setup_tx_dma_2( pix2_buf[0], count );
+
+    // fill the second buffer while the first is sent
+    pix2_next = pix2_buf[1];
+    pix2_count = setup_output2_buffer( pix2_next );
+
+    outputs_active |= ( 1 << 1 );
+
+    DMA.PIXEL2_DMA_CH.CTRLB |= DMA_CH_TRNINTLVL_HI_gc;
+    DMA.PIXEL2_DMA_CH.CTRLA |= DMA_CH_ENABLE_bm;
+}
 
 static void pixel_v_start_frame( void ){
 
@@ -338,10 +704,24 @@ static void pixel_v_start_frame( void ){
 
     dither_cycle++;
 
+    setup_frame_encoding();
+
     uint8_t count = 0;
 
-    // reset counter
+    // reset counters
     current_pixel = 0;
+    end_pixel = gfx_u16_get_pix_count();
+
+    if( output_count > 1 ){
+
+        // output 1 gets the first half, output 2 the rest
+        end_pixel = ( end_pixel + 1 ) / 2;
+
+        current_pixel2 = end_pixel;
+        end_pixel2 = gfx_u16_get_pix_count();
+    }
+
+    outputs_active = ( 1 << 0 );
 
     DMA.PIXEL_DMA_CH_A.CTRLA = 0;
     DMA.PIXEL_DMA_CH_B.CTRLA = 0;
@@ -359,23 +739,23 @@ static void pixel_v_start_frame( void ){
         pix_buf_A[3] = 0;
         setup_tx_dma_A( pix_buf_A, 4 );
 
-        count = setup_pixel_buffer( pix_buf_B, sizeof(pix_buf_B) );
+        count = setup_pixel_buffer( pix_buf_B, &current_pixel, end_pixel );
         setup_tx_dma_B( pix_buf_B, count );
 
         enable_double_buffer();
 
-        DMA.PIXEL_DMA_CH_A.CTRLB |= DMA_CH_TRNINTLVL_HI_gc;
-        DMA.PIXEL_DMA_CH_B.CTRLB |= DMA_CH_TRNINTLVL_HI_gc;
+        DMA.PIXEL_DMA_CH_A.CTRLB |= output1_int_level;
+        DMA.PIXEL_DMA_CH_B.CTRLB |= output1_int_level;
     }
     else{
 
-        count = setup_pixel_buffer( pix_buf_A, sizeof(pix_buf_A) );
+        count = setup_pixel_buffer( pix_buf_A, &current_pixel, end_pixel );
 
         setup_tx_dma_A( pix_buf_A, count );
 
-        DMA.PIXEL_DMA_CH_A.CTRLB |= DMA_CH_TRNINTLVL_HI_gc;
+        DMA.PIXEL_DMA_CH_A.CTRLB |= output1_int_level;
 
-        count = setup_pixel_buffer( pix_buf_B, sizeof(pix_buf_B) );
+        count = setup_pixel_buffer( pix_buf_B, &current_pixel, end_pixel );
 
         // set up second buffer
         if( count > 0 ){
@@ -384,10 +764,15 @@ static void pixel_v_start_frame( void ){
 
             setup_tx_dma_B( pix_buf_B, count );
 
-            DMA.PIXEL_DMA_CH_B.CTRLB |= DMA_CH_TRNINTLVL_HI_gc;
+            DMA.PIXEL_DMA_CH_B.CTRLB |= output1_int_level;
         }
     }
 
+    if( output_count > 1 ){
+
+        output2_start_frame();
+    }
+
     // start transmission
     DMA.PIXEL_DMA_CH_A.CTRLA |= DMA_CH_ENABLE_bm;
 }
@@ -398,7 +783,7 @@ OS_IRQ_BEGIN(PIXEL_DMA_CH_A_vect);
 
     uint8_t count;
 
-    count = setup_pixel_buffer( pix_buf_A, sizeof(pix_buf_A) );
+    count = setup_pixel_buffer( pix_buf_A, &current_pixel, end_pixel );
 
     setup_tx_dma_A( pix_buf_A, count );
 
@@ -422,21 +807,12 @@ OS_IRQ_BEGIN(PIXEL_DMA_CH_A_vect);
 
             disable_double_buffer();
 
-            PIXEL_TIMER.CTRLA = 0;
-            PIXEL_TIMER.CNT = 0;
-            PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE;
-
-            if( ( pix_mode == PIX_MODE_WS2811 ) ||
-                ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
+            // the other channel may still be sending the last buffer,
+            // its interrupt finishes the frame.
+            if( !( DMA.PIXEL_DMA_CH_B.CTRLA & DMA_CH_ENABLE_bm ) ){
 
-                PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_WS2811;
+                output_done( 0 );
             }
-            else if( pix_mode == PIX_MODE_PIXIE ){
-
-                PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_PIXIE;
-            }
-
-            PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
         }
     }
 
@@ -448,7 +824,7 @@ OS_IRQ_BEGIN(PIXEL_DMA_CH_B_vect);
 
     uint8_t count;
 
-    count = setup_pixel_buffer( pix_buf_B, sizeof(pix_buf_B) );
+    count = setup_pixel_buffer( pix_buf_B, &current_pixel, end_pixel );
 
     setup_tx_dma_B( pix_buf_B, count );
 
@@ -472,23 +848,48 @@ OS_IRQ_BEGIN(PIXEL_DMA_CH_B_vect);
 
             disable_double_buffer();
 
-            // reset timer
-            PIXEL_TIMER.CTRLA = 0;
-            PIXEL_TIMER.CNT = 0;
-            PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE;
+            // the other channel may still be sending the last buffer,
+            // its interrupt finishes the frame.
+            if( !( DMA.PIXEL_DMA_CH_A.CTRLA & DMA_CH_ENABLE_bm ) ){
 
-            if( ( pix_mode == PIX_MODE_WS2811 ) ||
-                ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
-
-                PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_WS2811;
+                output_done( 0 );
             }
-            else if( pix_mode == PIX_MODE_PIXIE ){
+        }
+    }
 
-                PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE_PIXIE;
-            }
+OS_IRQ_END();
+}
+
+ISR(PIXEL2_DMA_CH_vect){
+OS_IRQ_BEGIN(PIXEL2_DMA_CH_vect);
+
+    // start the buffer filled on the last interrupt right away,
+    // the line pauses until this runs.
+    uint8_t *buf = pix2_next;
 
-            PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+    setup_tx_dma_2( buf, pix2_count );
+
+    if( pix2_count > 0 ){
+
+        DMA.PIXEL2_DMA_CH.CTRLA |= DMA_CH_ENABLE_bm;
+
+        // fill the other buffer
+        if( buf == pix2_buf[0] ){
+
+            pix2_next = pix2_buf[1];
         }
+        else{
+
+            pix2_next = pix2_buf[0];
+        }
+
+        pix2_count = setup_output2_buffer( pix2_next );
+    }
+    else{
+
+        DMA.PIXEL2_DMA_CH.CTRLB &= ~DMA_CH_TRNINTLVL_gm;
+
+        output_done( 1 );
     }
 
 OS_IRQ_END();
@@ -500,12 +901,22 @@ OS_IRQ_BEGIN(PIXEL_TIMER_OVF_vect);
 
     PIXEL_TIMER.CTRLA = 0;
 
-    pixel_v_start_frame();
+    bool start = TRUE;
 
-    // reset timer with watchdog value
-    PIXEL_TIMER.CNT = 0;
-    PIXEL_TIMER.PER = PWM_FADE_TIMER_WATCHDOG_VALUE;
-    PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+    if( pix_latch ){
+
+        start = latch_timer_expired();
+    }
+
+    if( start ){
+
+        pixel_v_start_frame();
+
+        // reset timer with watchdog value
+        PIXEL_TIMER.CNT = 0;
+        PIXEL_TIMER.PER = PWM_FADE_TIMER_WATCHDOG_VALUE;
+        PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+    }
 
 OS_IRQ_END();
 }
@@ -536,6 +947,19 @@ void pixel_v_enable( void ){
 
         PIX_CLK_PORT.PIN3CTRL |= PORT_INVEN_bm;
     }
+
+    if( output_count > 1 ){
+
+        PIXEL2_DATA_PORT.CTRLB |= USART_TXEN_bm;
+
+        // the IO header does not have the inverting pixel buffer,
+        // so only the WS2811 data (which is stored inverted) is inverted.
+        if( ( pix_mode == PIX_MODE_WS2811 ) ||
+            ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
+
+            PIX2_DATA_PORT.PIN7CTRL |= PORT_INVEN_bm;
+        }
+    }
 }
 
 void pixel_v_disable( void ){
@@ -548,6 +972,32 @@ void pixel_v_disable( void ){
     // un-invert
     PIX_CLK_PORT.PIN3CTRL &= ~PORT_INVEN_bm;
     PIX_CLK_PORT.PIN1CTRL &= ~PORT_INVEN_bm;
+
+    // only release output 2 if we had it,
+    // the IO header USART is shared with the user SPI port.
+    if( output_count > 1 ){
+
+        PIXEL2_DATA_PORT.CTRLB &= ~USART_TXEN_bm;
+        PIX2_DATA_PORT.PIN7CTRL &= ~PORT_INVEN_bm;
+
+        PIX2_CLK_PORT.DIRCLR = ( 1 << PIX2_CLK_PIN );
+        PIX2_DATA_PORT.DIRCLR = ( 1 << PIX2_DATA_PIN );
+
+        output_count = 1;
+
+        dma_v_claim_ch( FALSE );
+    }
+}
+
+// IO 1 and IO 2 carry output 2 while it is enabled
+bool pixel_b_io_in_use( uint8_t io_pin ){
+
+    if( output_count < 2 ){
+
+        return FALSE;
+    }
+
+    return ( io_pin == IO_PIN_1_XCK ) || ( io_pin == IO_PIN_2_TXD );
 }
 
 void pixel_v_set_analog_rgb( uint16_t r, uint16_t g, uint16_t b ){
@@ -615,6 +1065,12 @@ void pixel_v_init( void ){
     DMA.PIXEL_DMA_CH_B.CTRLA = 0;
     DMA.PIXEL_DMA_CH_B.CTRLA = DMA_CH_RESET_bm;
 
+    if( output_count > 1 ){
+
+        DMA.PIXEL2_DMA_CH.CTRLA = 0;
+        DMA.PIXEL2_DMA_CH.CTRLA = DMA_CH_RESET_bm;
+    }
+
     END_ATOMIC;
 
     // set up pixel enable
@@ -666,7 +1122,36 @@ void pixel_v_init( void ){
         bytes_per_pixel = 12; // SK6812 RGBW
     }
 
-    pixels_per_buf = sizeof(pix_buf_A) / bytes_per_pixel;
+    if( pix_outputs > PIX_MAX_OUTPUTS ){
+
+        pix_outputs = PIX_MAX_OUTPUTS;
+    }
+
+    output_count = 1;
+
+    // Pixie is UART only, so it stays on one output
+    if( ( pix_outputs > 1 ) && ( pix_mode != PIX_MODE_PIXIE ) ){
+
+        output_count = 2;
+    }
+
+    // output 2 borrows the memcpy/CRC DMA channel
+    dma_v_claim_ch( output_count > 1 );
+
+    output1_int_level = DMA_CH_TRNINTLVL_HI_gc;
+
+    if( output_count > 1 ){
+
+        output1_int_level = DMA_CH_TRNINTLVL_MED_gc;
+    }
+
+    // each output gets an equal share of the DMA buffers
+    uint8_t buf_len = sizeof(pix_buf_A) / output_count;
+
+    pixels_per_buf = buf_len / bytes_per_pixel;
+
+    pix2_buf[0] = &pix_buf_A[buf_len];
+    pix2_buf[1] = &pix_buf_B[buf_len];
 
     // clear transaction complete flag
     DMA.INTFLAGS = PIXEL_DMA_CH_A_TRNIF_FLAG;
@@ -721,14 +1206,34 @@ void pixel_v_init( void ){
         PIXEL_DATA_PORT.BAUDCTRLB = 0;
     }
 
+    if( output_count > 1 ){
+
+        DMA.INTFLAGS = PIXEL2_DMA_CH_TRNIF_FLAG;
+
+        PIX2_CLK_PORT.DIRSET = ( 1 << PIX2_CLK_PIN );
+        PIX2_DATA_PORT.DIRSET = ( 1 << PIX2_DATA_PIN );
+
+        // same master SPI setup as output 1
+        PIXEL2_DATA_PORT.CTRLC = USART_CMODE_MSPI_gc | ( 0 << UDORD ) | ( 0 << UCPHA );
+        PIXEL2_DATA_PORT.BAUDCTRLA = pix_clock;
+        PIXEL2_DATA_PORT.BAUDCTRLB = 0;
+    }
+
 
     // enable overflow interrupt and set priority level to high
     PIXEL_TIMER.INTCTRLA |= TC_OVFINTLVL_HI_gc;
 
     PIXEL_TIMER.PER = PWM_FADE_TIMER_VALUE;
 
-    // start timer
-    PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+    latch_state = LATCH_IDLE;
+    present_pending = FALSE;
+
+    // start timer.
+    // if latched, it starts on the first present.
+    if( !pix_latch ){
+
+        PIXEL_TIMER.CTRLA = PIXEL_TIMER_RATE;
+    }
 
     pixel_v_enable();
 }
@@ -743,6 +1248,51 @@ uint8_t pixel_u8_get_mode( void ){
     return pix_mode;
 }
 
+// send the current pixel arrays at net_time (ms), if pix_latch is set.
+// a later present replaces one that is still waiting.
+void pixel_v_present_at( uint32_t net_time ){
+
+    if( !pix_latch || ( pix_mode == PIX_MODE_ANALOG ) || ( pix_mode == PIX_MODE_OFF ) ){
+
+        return;
+    }
+
+    int32_t delay = net_time - time_u32_get_network_time();
+
+    if( delay < 0 ){
+
+        delay = 0;
+    }
+    else if( delay > PIX_PRESENT_MAX_DELAY ){
+
+        delay = PIX_PRESENT_MAX_DELAY;
+    }
+
+    uint32_t ticks = (uint32_t)delay * PIXEL_TIMER_TICKS_PER_MS;
+
+    ATOMIC;
+
+    if( latch_state == LATCH_OUTPUT ){
+
+        // the pixel timer is counting from the start of that frame
+        present_ticks = ticks + PIXEL_TIMER.CNT;
+        present_pending = TRUE;
+    }
+    else{
+
+        arm_present_timer( ticks );
+    }
+
+    END_ATOMIC;
+}
+
+// TRUE while a latched frame is waiting or being sent.
+// the pixel arrays must not be loaded until it is done.
+bool pixel_b_present_busy( void ){
+
+    return latch_state != LATCH_IDLE;
+}
+
 void pixel_v_load_rgb(
     uint16_t index,
     uint16_t len,
@@ -778,6 +1328,79 @@ void pixel_v_load_rgb(
     END_ATOMIC;
 }
 
+static void fill_rgb(
+    uint16_t index,
+    uint16_t len,
+    uint8_t r,
+    uint8_t g,
+    uint8_t b,
+    uint8_t d ){
+
+    if( ( index + len ) > MAX_PIXELS ){
+
+        log_v_debug_P( PSTR("pix transfer out of bounds") );
+        return;
+    }
+
+    ATOMIC;
+
+    memset( &array_r[index], r, len );
+    memset( &array_g[index], g, len );
+    memset( &array_b[index], b, len );
+    memset( &array_misc.dither[index], d, len );
+
+    END_ATOMIC;
+}
+
+// apply a WIFI_DATA_ID_RGB_DELTA message, see wifi_cmd.h
+int8_t pixel_i8_load_rgb_delta( uint8_t *data, uint16_t len ){
+
+    uint8_t *end = data + len;
+
+    while( data < end ){
+
+        if( ( data + sizeof(wifi_rgb_run_t) ) > end ){
+
+            return -1;
+        }
+
+        wifi_rgb_run_t *run = (wifi_rgb_run_t *)data;
+        data += sizeof(wifi_rgb_run_t);
+
+        uint8_t count = run->count & WIFI_RGB_RUN_MAX_COUNT;
+
+        if( run->count & WIFI_RGB_RUN_FILL ){
+
+            if( ( data + 4 ) > end ){
+
+                return -1;
+            }
+
+            fill_rgb( run->index, count, data[0], data[1], data[2], data[3] );
+
+            data += 4;
+        }
+        else{
+
+            if( ( data + ( count * 4 ) ) > end ){
+
+                return -1;
+            }
+
+            pixel_v_load_rgb( run->index, 
+                              count, 
+                              data, 
+                              data + count, 
+                              data + ( count * 2 ), 
+                              data + ( count * 3 ) );
+
+            data += count * 4;
+        }
+    }
+
+    return 0;
+}
+
 void pixel_v_get_rgb_totals( uint16_t *r, uint16_t *g, uint16_t *b ){
 
     *r = 0;
@@ -68,11 +68,33 @@
 #define PIXEL_USART_DMA_TRIG    DMA_CH_TRIGSRC_USARTC0_DRE_gc
 
 
+// second output, on the IO header (IO 1 and IO 2).
+// these are also the user SPI pins (hal_user_spi.h), the io_cfg and
+// io_val keys leave them alone while the output is enabled.
+#define PIX_MAX_OUTPUTS         2
+
+#define PIX2_CLK_PORT   PORTC
+#define PIX2_CLK_PIN    5
+
+#define PIX2_DATA_PORT  PORTC
+#define PIX2_DATA_PIN   7
+
+#define PIXEL2_DATA_PORT             USARTC1
+
+// claimed from dma_v_memcpy()/dma_u16_crc() while output 2 is enabled
+#define PIXEL2_DMA_CH               CH3
+#define PIXEL2_DMA_CH_TRNIF_FLAG    DMA_CH3TRNIF_bm
+#define PIXEL2_DMA_CH_vect          DMA_CH3_vect
+
+#define PIXEL2_USART_DMA_TRIG   DMA_CH_TRIGSRC_USARTC1_DRE_gc
+
+
 void pixel_v_init( void );
 
 void pixel_v_set_analog_rgb( uint16_t r, uint16_t g, uint16_t b );
 
 bool pixel_b_enabled( void );
+bool pixel_b_io_in_use( uint8_t io_pin );
 
 uint8_t pixel_u8_get_mode( void );
 
@@ -84,6 +106,11 @@ void pixel_v_load_rgb(
     uint8_t *b,
     uint8_t *d );
 
+int8_t pixel_i8_load_rgb_delta( uint8_t *data, uint16_t len );
+
+void pixel_v_present_at( uint32_t net_time );
+bool pixel_b_present_busy( void );
+
 void pixel_v_get_rgb_totals( uint16_t *r, uint16_t *g, uint16_t *b );
 
 #endif
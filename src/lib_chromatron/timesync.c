@@ -101,15 +101,22 @@ PT_THREAD( time_master_thread( pt_t *pt, void *state ) );
 
 static socket_t sock;
 
+// network time is net_time at local_time (system time).
+// the node that has been up the longest broadcasts its time,
+// the others track it and estimate their clock drift against it.
+#define TIME_SYNC_INTERVAL      8000
+#define TIME_MASTER_TIMEOUT     32000
+
 static uint32_t local_time;
 static uint32_t net_time;
 static ip_addr_t master_ip;
-// static uint32_t master_uptime;
+static uint32_t master_uptime;
 static uint32_t last_frame_sync;
 
 static ip_addr_t frame_master_ip;
 
 static int16_t filtered_drift;
+static bool drift_known;
 
 static uint8_t frame_sync_state;
 #define FRAME_SYNC_OFF      0
@@ -244,8 +251,6 @@ void time_v_send_frame_sync( wifi_msg_vm_frame_sync_t *sync ){
 
 uint32_t time_u32_get_network_time( void ){
 
-    return 0;
-
     uint32_t adjusted_net_time;
 
     ATOMIC;
@@ -253,7 +258,12 @@ uint32_t time_u32_get_network_time( void ){
     int32_t elapsed = tmr_u32_elapsed_time_ms( local_time );
 
     // now adjust for drift
-    int32_t drift = ( filtered_drift * elapsed ) / 65536;
+    int32_t drift = 0;
+
+    if( drift_known ){
+
+        drift = ( (int32_t)filtered_drift * elapsed ) / 65536;
+    }
 
     adjusted_net_time = net_time + ( elapsed - drift );
 
@@ -263,6 +273,83 @@ uint32_t time_u32_get_network_time( void ){
 }
 
 
+static void process_sync_msg( time_msg_sync_t *msg, ip_addr_t ip ){
+
+    uint32_t now = tmr_u32_get_system_time_ms();
+
+    bool is_master = ip_b_addr_compare( ip, master_ip );
+
+    // check if this is a better master to sync to
+    if( ( !is_master ) &&
+        ( ( msg->uptime > master_uptime ) ||
+          ( ( msg->uptime == master_uptime ) &&
+            ( ip_u32_to_int( ip ) < ip_u32_to_int( master_ip ) ) ) ) ){
+
+        log_v_debug_P( PSTR("assigning new master: %d.%d.%d.%d"),
+            ip.ip3, ip.ip2, ip.ip1, ip.ip0 );
+
+        master_ip       = ip;
+        master_uptime   = msg->uptime;
+
+        ATOMIC;
+        net_time        = msg->network_time;
+        local_time      = now;
+        drift_known     = FALSE;
+        END_ATOMIC;
+
+        return;
+    }
+
+    if( !is_master ){
+
+        return;
+    }
+
+    if( msg->uptime < master_uptime ){
+
+        // the master rebooted, the next broadcast picks a new one
+        log_v_debug_P( PSTR("master invalid") );
+
+        master_ip       = ip_a_addr(0,0,0,0);
+        master_uptime   = 0;
+
+        return;
+    }
+
+    int32_t net_diff = msg->network_time - net_time;
+    int32_t local_diff = now - local_time;
+    int32_t diff = local_diff - net_diff;
+
+    // drift is local clock error, scaled by 65536
+    if( ( net_diff > 0 ) && ( diff > -1000 ) && ( diff < 1000 ) ){
+
+        int32_t drift = ( diff * 65536 ) / net_diff;
+
+        if( ( drift > -500 ) && ( drift < 500 ) ){
+
+            ATOMIC;
+
+            if( !drift_known ){
+
+                filtered_drift = drift;
+                drift_known = TRUE;
+            }
+            else{
+
+                filtered_drift = ( ( 8 * drift ) + ( 120 * (int32_t)filtered_drift ) ) / 128;
+            }
+
+            END_ATOMIC;
+        }
+    }
+
+    ATOMIC;
+    net_time        = msg->network_time;
+    local_time      = now;
+    END_ATOMIC;
+
+    master_uptime   = msg->uptime;
+}
 
 PT_THREAD( time_server_thread( pt_t *pt, void *state ) )
 {
@@ -304,7 +391,14 @@ PT_BEGIN( pt );
 
             uint8_t *type = version + 1;
 
-            if( *type == TIME_MSG_FRAME_SYNC ){
+            if( *type == TIME_MSG_SYNC ){
+
+                sock_addr_t raddr;
+                sock_v_get_raddr( sock, &raddr );
+
+                process_sync_msg( (time_msg_sync_t *)magic, raddr.ipaddr );
+            }
+            else if( *type == TIME_MSG_FRAME_SYNC ){
 
                 time_msg_frame_sync_t *msg = (time_msg_frame_sync_t *)magic;
 
@@ -390,87 +484,53 @@ PT_BEGIN( pt );
     
     THREAD_WAIT_WHILE( pt, !cfg_b_ip_configured() );
 
-    // cfg_i8_get( CFG_PARAM_IP_ADDRESS, &master_ip );
-    // cfg_i8_get( CFG_PARAM_IP_ADDRESS, &frame_master_ip );
+    // we are master until we hear from a node that has been up longer
+    cfg_i8_get( CFG_PARAM_IP_ADDRESS, &master_ip );
     
     while(1){
 
-        // if( frame_sync_state == FRAME_SYNC_WAIT ){
-
-        //     TMR_WAIT( pt, 8000 );
-        // }
-
-        // if( frame_sync_state == FRAME_SYNC_WAIT ){
-
-        //     log_v_debug_P( PSTR("setting frame master") );
-        //     frame_sync_state = FRAME_SYNC_MASTER;
-        // }
+        TMR_WAIT( pt, TIME_SYNC_INTERVAL );
 
-        // if( frame_sync_state == FRAME_SYNC_MASTER ){
+        // check if we haven't received a timestamp in a while
+        if( tmr_u32_elapsed_time_ms( local_time ) > TIME_MASTER_TIMEOUT ){
 
+            log_v_debug_P( PSTR("master timeout, resetting us to master") );
+            cfg_i8_get( CFG_PARAM_IP_ADDRESS, &master_ip );
+        }
 
-        // }
-        // else if( frame_sync_state == FRAME_SYNC_SLAVE ){
-            
-
-        // }
-
-
-
-        // // check if we haven't received a timestamp in a while
-        // if( tmr_u32_elapsed_time_ms( local_time ) > 32000 ){
-
-        //     log_v_debug_P( PSTR("master timeout, resetting us to master") );
-        //     cfg_i8_get( CFG_PARAM_IP_ADDRESS, &master_ip );
-        // }
-
-        // ip_addr_t local_ip;
-        // cfg_i8_get( CFG_PARAM_IP_ADDRESS, &local_ip );
-
-        // // check if we are master
-        // if( ip_b_addr_compare( local_ip, master_ip ) ){
-
-        //     filtered_drift = 0xffff;
-
-        //     master_uptime       = tmr_u64_get_system_time_us() / 1000000;
-
-        //     // build sync msg
-        //     time_msg_sync_t msg;
-        //     msg.magic           = TIME_PROTOCOL_MAGIC;
-        //     msg.type            = TIME_MSG_SYNC;
-        //     msg.uptime          = master_uptime;
-
-        //     // set up broadcast address
-        //     sock_addr_t raddr;
-        //     raddr.port = TIME_SERVER_PORT;
-        //     raddr.ipaddr = ip_a_addr(255,255,255,255);
-
-        //     // set timestamp at last possible instant and send
-        //     uint32_t now = tmr_u32_get_system_time_ms();
-        //     net_time += tmr_u32_elapsed_times( local_time, now );
-
-        //     // log_v_debug_P( PSTR("sending net time: %lu"), net_time );
+        ip_addr_t local_ip;
+        cfg_i8_get( CFG_PARAM_IP_ADDRESS, &local_ip );
 
-        //     msg.network_time = net_time;
+        // check if we are master
+        if( !ip_b_addr_compare( local_ip, master_ip ) ){
 
-        //     sock_i16_sendto( sock, &msg, sizeof(msg), &raddr );
+            continue;
+        }
 
-        //     local_time = now;
-        // }   
+        master_uptime = tmr_u64_get_system_time_us() / 1000000;
 
-        // THREAD_YIELD( pt );
+        // build sync msg
+        time_msg_sync_t msg;
+        msg.magic           = TIME_PROTOCOL_MAGIC;
+        msg.version         = TIME_PROTOCOL_VERSION;
+        msg.type            = TIME_MSG_SYNC;
+        msg.uptime          = master_uptime;
 
-        // // check if we haven't received a timestamp in a while
-        // if( tmr_u32_elapsed_time_ms( last_frame_sync ) > 32000 ){
+        // set up broadcast address
+        sock_addr_t raddr;
+        raddr.port = TIME_SERVER_PORT;
+        raddr.ipaddr = ip_a_addr(255,255,255,255);
 
-        //     log_v_debug_P( PSTR("frame master timeout, resetting us to master") );
-        //     cfg_i8_get( CFG_PARAM_IP_ADDRESS, &frame_master_ip );
-        // }
+        // set timestamp at last possible instant and send
+        msg.network_time = time_u32_get_network_time();
 
-        
+        ATOMIC;
+        net_time        = msg.network_time;
+        local_time      = tmr_u32_get_system_time_ms();
+        drift_known     = FALSE;
+        END_ATOMIC;
 
-        TMR_WAIT( pt, 100 );
-        THREAD_YIELD( pt );
+        sock_i16_sendto( sock, &msg, sizeof(msg), &raddr );
     }
 
 PT_END( pt );
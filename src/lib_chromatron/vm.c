@@ -40,6 +40,7 @@
 
 static bool vm_reset;
 static bool vm_run;
+static bool vm_hot_reload;
 
 #define VM_STARTUP              0
 #define VM_RUNNING              1
@@ -52,6 +53,17 @@ static bool vm_running;
 
 static vm_info_t vm_info;
 
+// status for the overlay instances, vm_info is instance 0
+static vm_info_t overlay_info[VM_MAX_VMS - 1];
+
+// pixel range for each instance, a count of 0 is the full strip
+static uint16_t vm_pix_start[VM_MAX_VMS];
+static uint16_t vm_pix_count[VM_MAX_VMS];
+
+// profile entries received from the wifi processor,
+// only allocated when the VM is built with the profiler.
+static mem_handle_t profile_h = -1;
+
 int8_t vm_i8_kv_handler(
     kv_op_t8 op,
     catbus_hash_t32 hash,
@@ -85,6 +97,7 @@ KV_SECTION_META kv_meta_t vm_info_kv[] = {
     { SAPPHIRE_TYPE_BOOL,     0, 0,                   &vm_reset,             vm_i8_kv_handler,   "vm_reset" },
     { SAPPHIRE_TYPE_BOOL,     0, 0,                   0,                     vm_i8_kv_handler,   "vm_shutdown" },
     { SAPPHIRE_TYPE_BOOL,     0, KV_FLAGS_PERSIST,    &vm_run,               0,                  "vm_run" },
+    { SAPPHIRE_TYPE_BOOL,     0, 0,                   &vm_hot_reload,        0,                  "vm_hot_reload" },
     { SAPPHIRE_TYPE_STRING32, 0, KV_FLAGS_PERSIST,    0,                     0,                  "vm_prog" },
     { SAPPHIRE_TYPE_STRING32, 0, KV_FLAGS_PERSIST,    0,                     0,                  "vm_startup_prog" },
     { SAPPHIRE_TYPE_STRING32, 0, KV_FLAGS_PERSIST,    0,                     0,                  "vm_shutdown_prog" },
@@ -93,7 +106,30 @@ KV_SECTION_META kv_meta_t vm_info_kv[] = {
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.loop_time,    0,                  "vm_loop_time" },
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.fader_time,   0,                  "vm_fade_time" },
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.max_cycles,   0,                  "vm_max_cycles" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.overruns,     0,                  "vm_overruns" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.skipped_frames, 0,                "vm_skipped_frames" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.max_overrun,  0,                  "vm_max_overrun" },
+    { SAPPHIRE_TYPE_UINT8,    0, KV_FLAGS_READ_ONLY,  &vm_info.fader_divisor, 0,                 "vm_fade_divisor" },
     { SAPPHIRE_TYPE_UINT8,    0, KV_FLAGS_READ_ONLY,  0,                     vm_i8_kv_handler,   "vm_isa" },
+
+    { SAPPHIRE_TYPE_STRING32, 0, KV_FLAGS_PERSIST,    0,                     0,                  "vm_prog1" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_PERSIST,    &vm_pix_start[1],      0,                  "vm_pix_start1" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_PERSIST,    &vm_pix_count[1],      0,                  "vm_pix_count1" },
+    { SAPPHIRE_TYPE_INT8,     0, KV_FLAGS_READ_ONLY,  &overlay_info[0].status, 0,                "vm_status1" },
+    { SAPPHIRE_TYPE_STRING32, 0, KV_FLAGS_PERSIST,    0,                     0,                  "vm_prog2" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_PERSIST,    &vm_pix_start[2],      0,                  "vm_pix_start2" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_PERSIST,    &vm_pix_count[2],      0,                  "vm_pix_count2" },
+    { SAPPHIRE_TYPE_INT8,     0, KV_FLAGS_READ_ONLY,  &overlay_info[1].status, 0,                "vm_status2" },
+};
+
+#if VM_MAX_VMS != 3
+#error "vm_info_kv needs a set of keys for each overlay"
+#endif
+
+// program keys for the overlay instances, starting at instance 1
+static const PROGMEM uint32_t overlay_progs[] = {
+    __KV__vm_prog1,
+    __KV__vm_prog2,
 };
 
 #ifndef VM_TARGET_ESP
@@ -207,9 +243,19 @@ static file_t get_program_handle( catbus_hash_t32 hash ){
 
 #ifdef VM_TARGET_ESP
 
-static int8_t load_vm_wifi( catbus_hash_t32 hash ){
+// flags are WIFI_SELECT_VM_FLAGS_*.
+// a hot swap leaves the running program, its published data and the
+// pixel state in place until the new program takes over.
+static int8_t load_vm_wifi( catbus_hash_t32 hash, uint8_t vm_id, uint8_t flags ){
 
-    gfx_v_reset_subscribed();
+    // loading the base program resets everything,
+    // overlays are loaded on top of it.
+    bool reset = ( vm_id == 0 ) && ( ( flags & WIFI_SELECT_VM_FLAGS_HOT_SWAP ) == 0 );
+
+    if( reset ){
+
+        gfx_v_reset_subscribed();
+    }
 
     file_t f = get_program_handle( hash );
 
@@ -218,18 +264,32 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
         return -1;
     }
 
-    if( wifi_i8_send_msg_blocking( WIFI_DATA_ID_RESET_VM, 0, 0 ) < 0 ){
+    if( reset ){
 
-        goto error;
+        if( wifi_i8_send_msg_blocking( WIFI_DATA_ID_RESET_VM, 0, 0 ) < 0 ){
+
+            goto error;
+        }
+
+        reset_published_data();
+
+        gfx_v_pixel_bridge_enable();
+
+        gfx_v_sync_params();
     }
 
-    reset_published_data();
+    wifi_msg_select_vm_t select;
+    select.vm_id        = vm_id;
+    select.flags        = flags;
+    select.pix_index    = vm_pix_start[vm_id];
+    select.pix_count    = vm_pix_count[vm_id];
 
-    gfx_v_pixel_bridge_enable();
+    if( wifi_i8_send_msg_blocking( WIFI_DATA_ID_SELECT_VM, (uint8_t *)&select, sizeof(select) ) < 0 ){
 
-    gfx_v_sync_params();
+        goto error;
+    }
 
-    log_v_debug_P( PSTR("Loading VM") );
+    log_v_debug_P( PSTR("Loading VM: %d"), vm_id );
 
     // file found, get program size from file header
     int32_t vm_size;
@@ -281,7 +341,10 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
     if( file_hash != computed_file_hash ){
 
         log_v_debug_P( PSTR("VM load error: %d"), VM_STATUS_ERR_BAD_FILE_HASH );
-        vm_run = FALSE;
+        if( reset ){
+
+            vm_run = FALSE;
+        }
         goto error;
     }
 
@@ -297,7 +360,10 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
     if( status < 0 ){
 
         log_v_debug_P( PSTR("VM load error: %d"), status );
-        vm_run = FALSE;
+        if( reset ){
+
+            vm_run = FALSE;
+        }
         goto error;
     }
 
@@ -379,10 +445,11 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
             
             read_key_hashes++;
         }
-
-        gfx_v_set_subscribed_keys( h );        
     }
 
+    // replaces the keys of a program being hot swapped
+    gfx_v_set_subscribed_keys( vm_id, h );
+
     // check write keys
     fs_v_seek( f, sizeof(vm_size) + state.write_keys_start );
 
@@ -409,7 +476,14 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
             // check for match
             if( restricted_key == write_hash ){
 
-                vm_info.status = VM_STATUS_RESTRICTED_KEY;
+                if( vm_id == 0 ){
+
+                    vm_info.status = VM_STATUS_RESTRICTED_KEY;
+                }
+                else{
+
+                    overlay_info[vm_id - 1].status = VM_STATUS_RESTRICTED_KEY;
+                }
 
                 log_v_debug_P( PSTR("Restricted key: %lu"), write_hash );
 
@@ -421,10 +495,23 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
     fs_f_close( f );
 
 
-    vm_info.status = -127;
-    vm_info.return_code = -127;
-    vm_info.loop_time = 0;
-    vm_info.fader_time = 0;
+    if( reset ){
+
+        vm_info.status = -127;
+        vm_info.return_code = -127;
+        vm_info.loop_time = 0;
+        vm_info.fader_time = 0;
+        vm_info.overruns = 0;
+        vm_info.skipped_frames = 0;
+        vm_info.max_overrun = 0;
+        vm_info.fader_divisor = 1;
+
+        for( uint8_t i = 0; i < cnt_of_array(overlay_info); i++ ){
+
+            overlay_info[i].status = -127;
+            overlay_info[i].return_code = -127;
+        }
+    }
 
     return 0;
 
@@ -434,6 +521,18 @@ error:
     return -1;
 }
 
+// overlays are optional, an instance without a program is skipped
+static void load_overlays_wifi( void ){
+
+    for( uint8_t i = 0; i < cnt_of_array(overlay_progs); i++ ){
+
+        uint32_t prog_key = 0;
+        memcpy_P( (uint8_t *)&prog_key, &overlay_progs[i], sizeof(prog_key) );
+
+        load_vm_wifi( prog_key, i + 1, 0 );
+    }
+}
+
 #else
 
 static int8_t load_vm_local( kv_id_t8 prog_id ){
@@ -510,26 +609,32 @@ PT_BEGIN( pt );
 
         TMR_WAIT( pt, 100 );
 
+        // overlays only run with the main program,
+        // not the startup and shutdown programs.
         if( vm_mode == VM_STARTUP ){
 
-            if( load_vm_wifi( __KV__vm_startup_prog ) < 0 ){
+            if( load_vm_wifi( __KV__vm_startup_prog, 0, 0 ) < 0 ){
 
-                if( load_vm_wifi( __KV__vm_prog ) < 0 ){
+                if( load_vm_wifi( __KV__vm_prog, 0, 0 ) < 0 ){
 
                     goto error;
                 }
+
+                load_overlays_wifi();
             }
         }
         else if( vm_mode == VM_RUNNING ){
 
-            if( load_vm_wifi( __KV__vm_prog ) < 0 ){
+            if( load_vm_wifi( __KV__vm_prog, 0, 0 ) < 0 ){
 
                 goto error;
             }
+
+            load_overlays_wifi();
         }
         else{
 
-            if( load_vm_wifi( __KV__vm_shutdown_prog ) < 0 ){
+            if( load_vm_wifi( __KV__vm_shutdown_prog, 0, 0 ) < 0 ){
 
                 goto error;
             }   
@@ -556,10 +661,34 @@ PT_BEGIN( pt );
         gfx_v_reset_frame_sync();
         #endif
         vm_reset = FALSE;
-        THREAD_WAIT_WHILE( pt, ( vm_reset == FALSE ) &&
-                               ( vm_run == TRUE ) &&
-                               ( vm_info.status == 0 ) &&
-                               ( vm_info.return_code == 0 ) );
+
+        while(1){
+
+            vm_hot_reload = FALSE;
+
+            THREAD_WAIT_WHILE( pt, ( vm_reset == FALSE ) &&
+                                   ( vm_hot_reload == FALSE ) &&
+                                   ( vm_run == TRUE ) &&
+                                   ( vm_info.status == 0 ) &&
+                                   ( vm_info.return_code == 0 ) );
+
+            if( !vm_hot_reload || vm_reset || !vm_run ||
+                ( vm_info.status != 0 ) || ( vm_info.return_code != 0 ) ){
+
+                break;
+            }
+
+            // swap in the current program without stopping the VM.
+            // on failure, the running program is kept.
+            if( load_vm_wifi( __KV__vm_prog, 0, WIFI_SELECT_VM_FLAGS_HOT_SWAP ) < 0 ){
+
+                log_v_debug_P( PSTR("VM hot reload failed") );
+            }
+            else{
+
+                vm_mode = VM_RUNNING;
+            }
+        }
 
         wifi_i8_send_msg_blocking( WIFI_DATA_ID_RESET_VM, 0, 0 );
 
@@ -673,6 +802,42 @@ PT_END( pt );
 
 
 
+static uint16_t profile_vfile_handler( vfile_op_t8 op, uint32_t pos, void *ptr, uint16_t len ){
+
+    // the pos and len values are already bounds checked by the FS driver
+    switch( op ){
+
+        case FS_VFILE_OP_READ:
+            if( profile_h < 0 ){
+
+                len = 0;
+            }
+            else{
+
+                memcpy( ptr, (uint8_t *)mem2_vp_get_ptr( profile_h ) + pos, len );
+            }
+            break;
+
+        case FS_VFILE_OP_SIZE:
+            if( profile_h < 0 ){
+
+                len = 0;
+            }
+            else{
+
+                len = mem2_u16_get_size( profile_h );
+            }
+            break;
+
+        default:
+            len = 0;
+
+            break;
+    }
+
+    return len;
+}
+
 void vm_v_init( void ){
 
     if( sys_u8_get_mode() == SYS_MODE_SAFE ){
@@ -685,6 +850,8 @@ void vm_v_init( void ){
                  0,
                  0 );
 
+    fs_f_create_virtual( PSTR("vm_profile"), profile_vfile_handler );
+
     #ifndef VM_TARGET_ESP
     vm_thread = -1;
     #endif
@@ -732,7 +899,59 @@ void vm_v_set_program( char progname[VM_MAX_FILENAME_LEN] ){
 
 void vm_v_received_info( vm_info_t *info ){
 
-    vm_info = *info;
+    if( info->vm_id == 0 ){
+
+        vm_info = *info;
+    }
+    else if( info->vm_id < VM_MAX_VMS ){
+
+        overlay_info[info->vm_id - 1] = *info;
+    }
+}
+
+void vm_v_received_profile( wifi_msg_vm_profile_t *msg ){
+
+    // start of a new profile
+    if( ( msg->index == 0 ) && ( profile_h >= 0 ) ){
+
+        mem2_v_free( profile_h );
+        profile_h = -1;
+    }
+
+    if( msg->count > WIFI_VM_PROFILE_ENTRIES ){
+
+        return;
+    }
+
+    uint16_t len = msg->count * sizeof(wifi_vm_profile_entry_t);
+
+    if( len == 0 ){
+
+        return;
+    }
+
+    uint16_t offset = 0;
+
+    if( profile_h < 0 ){
+
+        profile_h = mem2_h_alloc( len );
+
+        if( profile_h < 0 ){
+
+            return;
+        }
+    }
+    else{
+
+        offset = mem2_u16_get_size( profile_h );
+
+        if( mem2_i8_realloc( profile_h, offset + len ) < 0 ){
+
+            return;
+        }
+    }
+
+    memcpy( (uint8_t *)mem2_vp_get_ptr( profile_h ) + offset, msg->entries, len );
 }
 
 bool vm_b_running( void ){
@@ -24,6 +24,7 @@
 #define _VM_H
 
 #include "vm_core.h"
+#include "wifi_cmd.h"
 
 #define VM_MAX_FILENAME_LEN 32
 
@@ -40,6 +41,7 @@ void vm_v_set_program_P( PGM_P ptr );
 void vm_v_set_program( char progname[VM_MAX_FILENAME_LEN] );
 
 void vm_v_received_info( vm_info_t *info );
+void vm_v_received_profile( wifi_msg_vm_profile_t *msg );
 
 bool vm_b_running( void );
 
@@ -38,13 +38,146 @@
 
 static uint16_t cycles;
 
+#ifdef VM_ENABLE_OPCODE_COUNTS
+static uint32_t opcode_counts[VM_N_OPCODES];
+#endif
+
+#ifdef VM_ENABLE_PROFILE
+
+#ifndef VM_PROFILE_TICKS
+#error "VM_ENABLE_PROFILE requires VM_PROFILE_TICKS() in vm_config.h"
+#endif
+
+#define PROFILE_NO_OPCODE 0xff
+
+static vm_profile_t opcode_profile[VM_PROFILE_N_OPCODES];
+static vm_func_profile_t func_profile[VM_PROFILE_MAX_FUNCS];
+static uint8_t func_profile_count;
+
+// opcode and function that are currently being charged for ticks
+static uint8_t profile_opcode = PROFILE_NO_OPCODE;
+static int8_t profile_func = -1;
+static uint32_t profile_last_tick;
+
+// charge ticks since the last sample to the current opcode and function
+static void _vm_v_profile_sample( void ){
+
+    uint32_t now = VM_PROFILE_TICKS();
+    uint32_t elapsed = now - profile_last_tick;
+    profile_last_tick = now;
+
+    if( profile_opcode < VM_PROFILE_N_OPCODES ){
+
+        opcode_profile[profile_opcode].ticks += elapsed;
+    }
+
+    if( profile_func >= 0 ){
+
+        func_profile[profile_func].ticks += elapsed;
+    }
+}
+
+static void _vm_v_profile_opcode( uint8_t opcode ){
+
+    _vm_v_profile_sample();
+
+    profile_opcode = opcode;
+
+    if( opcode < VM_PROFILE_N_OPCODES ){
+
+        opcode_profile[opcode].count++;
+    }
+}
+
+// returns the previous function, to pass to _vm_v_profile_exit
+static int8_t _vm_i8_profile_enter( uint16_t addr ){
+
+    _vm_v_profile_sample();
+
+    int8_t prev = profile_func;
+
+    profile_func = -1;
+
+    for( uint8_t i = 0; i < func_profile_count; i++ ){
+
+        if( func_profile[i].addr == addr ){
+
+            profile_func = i;
+            break;
+        }
+    }
+
+    if( ( profile_func < 0 ) && ( func_profile_count < VM_PROFILE_MAX_FUNCS ) ){
+
+        profile_func = func_profile_count;
+        func_profile_count++;
+
+        func_profile[profile_func].addr = addr;
+    }
+
+    if( profile_func >= 0 ){
+
+        func_profile[profile_func].calls++;
+    }
+
+    return prev;
+}
+
+static void _vm_v_profile_exit( int8_t prev ){
+
+    _vm_v_profile_sample();
+
+    profile_func = prev;
+
+    // time until the caller's next instruction belongs to the call
+    if( prev >= 0 ){
+
+        profile_opcode = VM_OPCODE_CALL;
+    }
+    else{
+
+        profile_opcode = PROFILE_NO_OPCODE;
+    }
+}
+
+#endif
+
 static int8_t _vm_i8_run_stream(
     uint8_t *stream,
     uint16_t offset,
     uint64_t *rng_seed,
-    int32_t *data ){
+    int32_t *data,
+    uint32_t *write_keys );
+
+// runs a function, starting at offset
+static int8_t _vm_i8_run_function(
+    uint8_t *stream,
+    uint16_t offset,
+    uint64_t *rng_seed,
+    int32_t *data,
+    uint32_t *write_keys ){
+
+    #ifdef VM_ENABLE_PROFILE
+    int8_t prev = _vm_i8_profile_enter( offset );
+    #endif
+
+    int8_t status = _vm_i8_run_stream( stream, offset, rng_seed, data, write_keys );
+
+    #ifdef VM_ENABLE_PROFILE
+    _vm_v_profile_exit( prev );
+    #endif
 
-#ifdef ESP8266
+    return status;
+}
+
+static int8_t _vm_i8_run_stream(
+    uint8_t *stream,
+    uint16_t offset,
+    uint64_t *rng_seed,
+    int32_t *data,
+    uint32_t *write_keys ){
+
+#if defined(ESP8266) || defined(__SIM__)
     static void *opcode_table[] = {
 #else
     static void *const opcode_table[] PROGMEM = {
@@ -109,23 +242,23 @@ static int8_t _vm_i8_run_stream(
         &&opcode_not,	            // 56
         &&opcode_db_load,	        // 57
         &&opcode_db_store,	        // 58
-        &&opcode_trap,	            // 59
-        &&opcode_trap,	            // 60
-        &&opcode_trap,	            // 61
-        &&opcode_trap,	            // 62
-        &&opcode_trap,	            // 63
-        &&opcode_trap,	            // 64
-        &&opcode_trap,	            // 65
-        &&opcode_trap,	            // 66
-        &&opcode_trap,	            // 67
-        &&opcode_trap,	            // 68
-        &&opcode_trap,	            // 69
-        &&opcode_trap,	            // 70
-        &&opcode_trap,	            // 71
-        &&opcode_trap,	            // 72
-        &&opcode_trap,	            // 73
-        &&opcode_trap,	            // 74
-        &&opcode_trap,	            // 75
+        &&opcode_compeq_jmp_if_z,   // 59
+        &&opcode_compneq_jmp_if_z,  // 60
+        &&opcode_compgt_jmp_if_z,   // 61
+        &&opcode_compgte_jmp_if_z,  // 62
+        &&opcode_complt_jmp_if_z,   // 63
+        &&opcode_complte_jmp_if_z,  // 64
+        &&opcode_mov_add,           // 65
+        &&opcode_mov_sub,           // 66
+        &&opcode_hue_add,           // 67
+        &&opcode_hue_sub,           // 68
+        &&opcode_sat_add,           // 69
+        &&opcode_sat_sub,           // 70
+        &&opcode_val_add,           // 71
+        &&opcode_val_sub,           // 72
+        &&opcode_db_load_key,       // 73
+        &&opcode_db_store_key,      // 74
+        &&opcode_lib_call_index,    // 75
         &&opcode_trap,	            // 76
         &&opcode_trap,	            // 77
         &&opcode_trap,	            // 78
@@ -325,7 +458,17 @@ dispatch:
 
     opcode = *pc++;
 
-#ifdef ESP8266
+    #ifdef VM_ENABLE_OPCODE_COUNTS
+    opcode_counts[opcode]++;
+    #endif
+
+    #ifdef VM_ENABLE_PROFILE
+    _vm_v_profile_opcode( opcode );
+    #endif
+
+#if defined(ESP8266) || defined(__SIM__)
+    // note pgm_read_word() on the simulator is only 16 bits wide,
+    // which would truncate a host pointer.
     goto *opcode_table[opcode];
 #else
     void *target = (void*)pgm_read_word( &opcode_table[opcode] );
@@ -641,7 +784,7 @@ opcode_call:
     addr += ( *pc++ ) << 8;
 
     // call function, by recursively calling into VM
-    int8_t status = _vm_i8_run_stream( stream, addr, rng_seed, data );
+    int8_t status = _vm_i8_run_function( stream, addr, rng_seed, data, write_keys );
     if( status < 0 ){
 
         return status;
@@ -1101,7 +1244,7 @@ opcode_lib_call:
     }
 
     #ifdef VM_ENABLE_GFX
-    data[dest] = gfx_i32_lib_call( hash, params, param_len );
+    data[dest] = gfx_i32_lib_call( hash, params, param_len, rng_seed );
     #else   
     data[dest] = 0;
     #endif
@@ -1197,18 +1340,639 @@ opcode_db_store:
     goto dispatch;
 
 
+// fused opcodes.
+// each of these has the same effect as the instruction sequence
+// the compiler replaced with it.
+
+opcode_compeq_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 == op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_compneq_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 != op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_compgt_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 > op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_compgte_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 >= op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_complt_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 < op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_complte_jmp_if_z:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    data[result] = op1 <= op2;
+
+    if( data[result] == 0 ){
+
+        pc = stream + addr;
+    }
+
+    goto dispatch;
+
+
+opcode_mov_add:
+
+    dest = *pc++;
+    src  = *pc++;
+    op2_addr = *pc++;
+
+    data[dest] = data[src];
+    data[dest] = data[dest] + data[op2_addr];
+
+    goto dispatch;
+
+
+opcode_mov_sub:
+
+    dest = *pc++;
+    src  = *pc++;
+    op2_addr = *pc++;
+
+    data[dest] = data[src];
+    data[dest] = data[dest] - data[op2_addr];
+
+    goto dispatch;
+
+
+opcode_hue_add:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_hue( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] + data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // wraparound to 16 bit range.
+    op1 = data[dest] % 65536;
+
+    gfx_v_set_hue( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+opcode_hue_sub:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_hue( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] - data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // wraparound to 16 bit range.
+    op1 = data[dest] % 65536;
+
+    gfx_v_set_hue( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+opcode_sat_add:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_sat( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] + data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // clamp to our 16 bit range.
+    op1 = data[dest];
+
+    if( op1 > 65535 ){
+
+        op1 = 65535;
+    }
+    else if( op1 < 0 ){
+
+        op1 = 0;
+    }
+
+    gfx_v_set_sat( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+opcode_sat_sub:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_sat( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] - data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // clamp to our 16 bit range.
+    op1 = data[dest];
+
+    if( op1 > 65535 ){
+
+        op1 = 65535;
+    }
+    else if( op1 < 0 ){
+
+        op1 = 0;
+    }
+
+    gfx_v_set_sat( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+opcode_val_add:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_val( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] + data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // clamp to our 16 bit range.
+    op1 = data[dest];
+
+    if( op1 > 65535 ){
+
+        op1 = 65535;
+    }
+    else if( op1 < 0 ){
+
+        op1 = 0;
+    }
+
+    gfx_v_set_val( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+opcode_val_sub:
+
+    dest  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+    op2_addr = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_u16_get_val( data[index_x], data[index_y], obj );
+    #endif
+
+    data[dest] = data[dest] - data[op2_addr];
+
+    #ifdef VM_ENABLE_GFX
+    // clamp to our 16 bit range.
+    op1 = data[dest];
+
+    if( op1 > 65535 ){
+
+        op1 = 65535;
+    }
+    else if( op1 < 0 ){
+
+        op1 = 0;
+    }
+
+    gfx_v_set_val( op1, data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+
+// pre-decoded opcodes.
+// these are not emitted by the compiler, the load pass
+// rewrites db_load, db_store and lib_call to these forms.
+// db keys carry a kvdb slot, set by _vm_v_bind_keys.
+opcode_db_load_key:
+    pc++; // key index, only used when binding
+    addr        = *pc++;
+    addr       |= (uint16_t)( *pc++ ) << 8;
+    pc++;
+
+    dest        = *pc++;
+
+    #ifdef VM_ENABLE_KVDB
+    kvdb_i8_get_by_index( (int16_t)addr, &data[dest] );
+    #endif
+
+    goto dispatch;
+
+opcode_db_store_key:
+    index       = *pc++;
+    addr        = *pc++;
+    addr       |= (uint16_t)( *pc++ ) << 8;
+    pc++;
+
+    op1_addr    = *pc++;
+
+    #ifdef VM_ENABLE_KVDB
+    kvdb_i8_set_by_index( (int16_t)addr, data[op1_addr] );
+    kvdb_i8_publish( write_keys[index] );
+    #endif
+
+    goto dispatch;
+
+opcode_lib_call_index:
+    index       = *pc;
+    pc += 4;
+
+    dest        = *pc++;
+    param_len   = *pc++;
+
+    for( uint32_t i = 0; i < param_len; i++ ){
+
+        params[i] = data[*pc];
+        pc++;
+    }
+
+    #ifdef VM_ENABLE_GFX
+    data[dest] = gfx_i32_lib_call_index( index, params, param_len, rng_seed );
+    #else
+    data[dest] = 0;
+    #endif
+
+    goto dispatch;
+
+
 opcode_trap:
     return VM_STATUS_TRAP;
 }
 
 
+// returns length of instruction at pc, or 0 if the opcode is invalid
+static uint8_t _vm_u8_instruction_len( uint8_t *pc ){
+
+    uint8_t opcode = *pc;
+
+    switch( opcode ){
+
+        case VM_OPCODE_HALT:
+            return 1;
+
+        case VM_OPCODE_CLR:
+        case VM_OPCODE_PRINT:
+        case VM_OPCODE_RET:
+        case VM_OPCODE_ASSERT:
+            return 2;
+
+        case VM_OPCODE_MOV:
+        case VM_OPCODE_JMP:
+        case VM_OPCODE_CALL:
+        case VM_OPCODE_NOT:
+            return 3;
+
+        case VM_OPCODE_JMP_IF_Z:
+        case VM_OPCODE_JMP_IF_NOT_Z:
+        case VM_OPCODE_JMP_IF_Z_DEC:
+        case VM_OPCODE_RAND:
+        case VM_OPCODE_MOV_ADD:
+        case VM_OPCODE_MOV_SUB:
+            return 4;
+
+        case VM_OPCODE_JMP_IF_GTE:
+        case VM_OPCODE_JMP_IF_L_PRE_INC:
+        case VM_OPCODE_LTA:
+        case VM_OPCODE_LFA:
+        case VM_OPCODE_IS_FADING:
+        case VM_OPCODE_OBJ_LOAD:
+        case VM_OPCODE_OBJ_STORE:
+            return 5;
+
+        case VM_OPCODE_DB_LOAD:
+        case VM_OPCODE_DB_STORE:
+        case VM_OPCODE_DB_LOAD_KEY:
+        case VM_OPCODE_DB_STORE_KEY:
+            return 6;
+
+        case VM_OPCODE_LFA2D:
+        case VM_OPCODE_LTA2D:
+            return 7;
+
+        case VM_OPCODE_LIB_CALL:
+        case VM_OPCODE_LIB_CALL_INDEX:
+            // variable length, param_len is the 7th byte
+            return 7 + pc[6];
+
+        default:
+            break;
+    }
+
+    // binary ops
+    if( ( opcode >= VM_OPCODE_COMPEQ ) && ( opcode <= VM_OPCODE_MOD ) ){
+
+        return 4;
+    }
+
+    // pixel array loads and stores
+    if( ( ( opcode >= VM_OPCODE_LTAH ) && ( opcode <= VM_OPCODE_LFAV ) ) ||
+        ( ( opcode >= VM_OPCODE_LFAHSF ) && ( opcode <= VM_OPCODE_LTAVF ) ) ){
+
+        return 5;
+    }
+
+    // array ops
+    if( ( opcode >= VM_OPCODE_ARRAY_ADD ) && ( opcode <= VM_OPCODE_ARRAY_MOV ) ){
+
+        return 6;
+    }
+
+    // fused compare and jump, pixel read-modify-write
+    if( ( ( opcode >= VM_OPCODE_COMPEQ_JMP_IF_Z ) && ( opcode <= VM_OPCODE_COMPLTE_JMP_IF_Z ) ) ||
+        ( ( opcode >= VM_OPCODE_HUE_ADD ) && ( opcode <= VM_OPCODE_VAL_SUB ) ) ){
+
+        return 6;
+    }
+
+    return 0;
+}
+
+static int16_t _vm_i16_find_key( uint32_t hash, uint32_t *keys, uint8_t count ){
+
+    for( uint8_t i = 0; i < count; i++ ){
+
+        if( keys[i] == hash ){
+
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// load pass:
+// rewrites hashed operands in the code stream to table indexes,
+// so the dispatcher does not need to rebuild the hash on
+// every execution.
+// instruction lengths do not change, so jump addresses are preserved.
+static int8_t _vm_i8_predecode( uint8_t *stream, uint16_t code_len, vm_state_t *state ){
+
+    uint8_t *code = stream + state->code_start;
+    uint32_t *read_keys = (uint32_t *)( stream + state->read_keys_start );
+    uint32_t *write_keys = (uint32_t *)( stream + state->write_keys_start );
+
+    uint16_t offset = 0;
+
+    while( offset < code_len ){
+
+        uint8_t *pc = code + offset;
+        uint8_t len = _vm_u8_instruction_len( pc );
+
+        // the last instruction is followed by up to 4 bytes of padding,
+        // which may not decode to a full instruction.
+        if( ( len == 0 ) || ( ( offset + len ) > code_len ) ){
+
+            break;
+        }
+
+        uint8_t opcode = *pc;
+
+        if( ( opcode == VM_OPCODE_DB_LOAD ) ||
+            ( opcode == VM_OPCODE_DB_STORE ) ||
+            ( opcode == VM_OPCODE_LIB_CALL ) ){
+
+            catbus_hash_t32 hash;
+            hash =  (catbus_hash_t32)pc[1] << 24;
+            hash |= (catbus_hash_t32)pc[2] << 16;
+            hash |= (catbus_hash_t32)pc[3] << 8;
+            hash |= (catbus_hash_t32)pc[4] << 0;
+
+            int16_t index = -1;
+            uint8_t new_opcode = opcode;
+
+            if( opcode == VM_OPCODE_DB_LOAD ){
+
+                index = _vm_i16_find_key( hash, read_keys, state->read_keys_count );
+                new_opcode = VM_OPCODE_DB_LOAD_KEY;
+            }
+            else if( opcode == VM_OPCODE_DB_STORE ){
+
+                index = _vm_i16_find_key( hash, write_keys, state->write_keys_count );
+                new_opcode = VM_OPCODE_DB_STORE_KEY;
+            }
+            #ifdef VM_ENABLE_GFX
+            else if( opcode == VM_OPCODE_LIB_CALL ){
+
+                index = gfx_i16_get_lib_index( hash, pc[6] );
+                new_opcode = VM_OPCODE_LIB_CALL_INDEX;
+            }
+            #endif
+
+            // unresolved operands are left in hashed form
+            if( ( index >= 0 ) && ( index <= 255 ) ){
+
+                pc[0] = new_opcode;
+                pc[1] = index;
+                pc[2] = 0;
+                pc[3] = 0;
+                pc[4] = 0;
+            }
+        }
+
+        offset += len;
+    }
+
+    return VM_STATUS_OK;
+}
+
+// binds pre-decoded db keys to their kvdb slots.
+// the slot is stored in the otherwise unused operand bytes.
+// kvdb slots move when the database is re-sorted,
+// so this needs to rerun whenever the kvdb generation changes.
+static void _vm_v_bind_keys( uint8_t *stream, vm_state_t *state ){
+
+    #ifdef VM_ENABLE_KVDB
+    uint8_t *code = stream + state->code_start;
+    uint16_t code_len = ( state->data_start - sizeof(uint32_t) ) - state->code_start;
+    uint32_t *read_keys = (uint32_t *)( stream + state->read_keys_start );
+    uint32_t *write_keys = (uint32_t *)( stream + state->write_keys_start );
+
+    uint16_t offset = 0;
+
+    while( offset < code_len ){
+
+        uint8_t *pc = code + offset;
+        uint8_t len = _vm_u8_instruction_len( pc );
+
+        if( ( len == 0 ) || ( ( offset + len ) > code_len ) ){
+
+            break;
+        }
+
+        catbus_hash_t32 hash = 0;
+
+        if( *pc == VM_OPCODE_DB_LOAD_KEY ){
+
+            hash = read_keys[pc[1]];
+        }
+        else if( *pc == VM_OPCODE_DB_STORE_KEY ){
+
+            hash = write_keys[pc[1]];
+        }
+
+        if( hash != 0 ){
+
+            // -1 (not found) is stored as 0xffff, which the
+            // index access functions reject.
+            uint16_t slot = (uint16_t)kvdb_i16_get_index_for_hash( hash );
+
+            pc[2] = slot & 0xff;
+            pc[3] = slot >> 8;
+        }
+
+        offset += len;
+    }
+
+    state->kvdb_generation = kvdb_u16_get_generation();
+    #endif
+}
+
+static void _vm_v_check_bindings( uint8_t *stream, vm_state_t *state ){
+
+    #ifdef VM_ENABLE_KVDB
+    if( state->kvdb_generation != kvdb_u16_get_generation() ){
+
+        _vm_v_bind_keys( stream, state );
+    }
+    #endif
+}
+
+
 int8_t vm_i8_run(
     uint8_t *stream,
     uint16_t offset,
     vm_state_t *state,
     int32_t *data ){
 
-    return _vm_i8_run_stream( stream, offset, &state->rng_seed, data );
+    // stream points to the start of code
+    uint8_t *image = stream - state->code_start;
+    uint32_t *write_keys = (uint32_t *)( image + state->write_keys_start );
+
+    _vm_v_check_bindings( image, state );
+
+    return _vm_i8_run_function( stream, offset, &state->rng_seed, data, write_keys );
 }
 
 
@@ -1225,7 +1989,11 @@ int8_t vm_i8_run_init(
 
     uint16_t offset = state->init_start;
 
-    int8_t status = _vm_i8_run_stream( code, offset, &state->rng_seed, data );
+    uint32_t *write_keys = (uint32_t *)( stream + state->write_keys_start );
+
+    _vm_v_check_bindings( stream, state );
+
+    int8_t status = _vm_i8_run_function( code, offset, &state->rng_seed, data, write_keys );
 
     if( cycles > state->max_cycles ){
 
@@ -1248,7 +2016,11 @@ int8_t vm_i8_run_loop(
 
     uint16_t offset = state->loop_start;
 
-    int8_t status = _vm_i8_run_stream( code, offset, &state->rng_seed, data );
+    uint32_t *write_keys = (uint32_t *)( stream + state->write_keys_start );
+
+    _vm_v_check_bindings( stream, state );
+
+    int8_t status = _vm_i8_run_function( code, offset, &state->rng_seed, data, write_keys );
 
     if( cycles > state->max_cycles ){
 
@@ -1439,6 +2211,20 @@ int8_t vm_i8_load_program(
 
     state->data_start += sizeof(uint32_t);
 
+    int8_t status = _vm_i8_predecode( stream, prog_header->code_len, state );
+
+    if( status < 0 ){
+
+        return status;
+    }
+
+    _vm_v_bind_keys( stream, state );
+
+    #ifdef VM_ENABLE_PROFILE
+    // function addresses are only valid for this program
+    vm_v_reset_profile();
+    #endif
+
     // init RNG seed
     state->rng_seed = 1;
 
@@ -1454,7 +2240,8 @@ int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result ){
 
     cycles = 0;
 
-    int8_t status = _vm_i8_run_stream( stream, 0, &rng_seed, data );
+    // eval streams are not predecoded, so there is no key table
+    int8_t status = _vm_i8_run_stream( stream, 0, &rng_seed, data, 0 );
 
     rnd_v_seed( rng_seed );
 
@@ -1463,4 +2250,50 @@ int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result ){
     return status;
 }
 
+#ifdef VM_ENABLE_OPCODE_COUNTS
+void vm_v_reset_opcode_counts( void ){
+
+    memset( opcode_counts, 0, sizeof(opcode_counts) );
+}
+
+uint32_t *vm_u32p_get_opcode_counts( void ){
+
+    return opcode_counts;
+}
+#endif
+
+#ifdef VM_ENABLE_PROFILE
+void vm_v_reset_profile( void ){
+
+    memset( opcode_profile, 0, sizeof(opcode_profile) );
+    memset( func_profile, 0, sizeof(func_profile) );
+    func_profile_count = 0;
+
+    profile_opcode = PROFILE_NO_OPCODE;
+    profile_func = -1;
+}
+
+int8_t vm_i8_get_opcode_profile( uint8_t opcode, vm_profile_t *profile ){
+
+    if( opcode >= VM_PROFILE_N_OPCODES ){
+
+        return -1;
+    }
+
+    *profile = opcode_profile[opcode];
+
+    return 0;
+}
+
+int8_t vm_i8_get_func_profile( uint8_t index, vm_func_profile_t *profile ){
+
+    if( index >= func_profile_count ){
+
+        return -1;
+    }
+
+    *profile = func_profile[index];
 
+    return 0;
+}
+#endif
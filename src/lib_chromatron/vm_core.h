@@ -26,7 +26,7 @@
 #include <stdint.h>
 
 
-#define VM_ISA_VERSION              8
+#define VM_ISA_VERSION              9
 
 #define RETURN_VAL_ADDR             0
 
@@ -40,6 +40,86 @@
 
 #define DATA_LEN                    4
 
+#define VM_N_OPCODES                256
+
+// opcodes
+#define VM_OPCODE_MOV                   0
+#define VM_OPCODE_CLR                   1
+#define VM_OPCODE_COMPEQ                2
+#define VM_OPCODE_COMPNEQ               3
+#define VM_OPCODE_COMPGT                4
+#define VM_OPCODE_COMPGTE               5
+#define VM_OPCODE_COMPLT                6
+#define VM_OPCODE_COMPLTE               7
+#define VM_OPCODE_AND                   8
+#define VM_OPCODE_OR                    9
+#define VM_OPCODE_ADD                   10
+#define VM_OPCODE_SUB                   11
+#define VM_OPCODE_MUL                   12
+#define VM_OPCODE_DIV                   13
+#define VM_OPCODE_MOD                   14
+#define VM_OPCODE_JMP                   15
+#define VM_OPCODE_JMP_IF_Z              16
+#define VM_OPCODE_JMP_IF_NOT_Z          17
+#define VM_OPCODE_JMP_IF_Z_DEC          18
+#define VM_OPCODE_JMP_IF_GTE            19
+#define VM_OPCODE_JMP_IF_L_PRE_INC      20
+#define VM_OPCODE_PRINT                 21
+#define VM_OPCODE_RET                   22
+#define VM_OPCODE_CALL                  23
+#define VM_OPCODE_LTA                   24
+#define VM_OPCODE_LFA                   25
+#define VM_OPCODE_LFA2D                 26
+#define VM_OPCODE_LTA2D                 27
+#define VM_OPCODE_LTAH                  28
+#define VM_OPCODE_LTAS                  29
+#define VM_OPCODE_LTAV                  30
+#define VM_OPCODE_LFAH                  31
+#define VM_OPCODE_LFAS                  32
+#define VM_OPCODE_LFAV                  33
+#define VM_OPCODE_ARRAY_ADD             34
+#define VM_OPCODE_ARRAY_SUB             35
+#define VM_OPCODE_ARRAY_MUL             36
+#define VM_OPCODE_ARRAY_DIV             37
+#define VM_OPCODE_ARRAY_MOD             38
+#define VM_OPCODE_ARRAY_MOV             39
+#define VM_OPCODE_RAND                  40
+#define VM_OPCODE_ASSERT                41
+#define VM_OPCODE_HALT                  42
+#define VM_OPCODE_IS_FADING             43
+#define VM_OPCODE_LIB_CALL              44
+#define VM_OPCODE_LFAHSF                49
+#define VM_OPCODE_LFAVF                 50
+#define VM_OPCODE_LTAHSF                51
+#define VM_OPCODE_LTAVF                 52
+#define VM_OPCODE_OBJ_LOAD              54
+#define VM_OPCODE_OBJ_STORE             55
+#define VM_OPCODE_NOT                   56
+#define VM_OPCODE_DB_LOAD               57
+#define VM_OPCODE_DB_STORE              58
+
+// fused opcodes
+#define VM_OPCODE_COMPEQ_JMP_IF_Z       59
+#define VM_OPCODE_COMPNEQ_JMP_IF_Z      60
+#define VM_OPCODE_COMPGT_JMP_IF_Z       61
+#define VM_OPCODE_COMPGTE_JMP_IF_Z      62
+#define VM_OPCODE_COMPLT_JMP_IF_Z       63
+#define VM_OPCODE_COMPLTE_JMP_IF_Z      64
+#define VM_OPCODE_MOV_ADD               65
+#define VM_OPCODE_MOV_SUB               66
+#define VM_OPCODE_HUE_ADD               67
+#define VM_OPCODE_HUE_SUB               68
+#define VM_OPCODE_SAT_ADD               69
+#define VM_OPCODE_SAT_SUB               70
+#define VM_OPCODE_VAL_ADD               71
+#define VM_OPCODE_VAL_SUB               72
+
+// pre-decoded opcodes, produced by the program load pass
+#define VM_OPCODE_DB_LOAD_KEY           73
+#define VM_OPCODE_DB_STORE_KEY          74
+#define VM_OPCODE_LIB_CALL_INDEX        75
+
+#define VM_OPCODE_LAST                  VM_OPCODE_LIB_CALL_INDEX
 
 #define VM_STATUS_OK                    0
 #define VM_STATUS_ERR_BAD_CRC           -1
@@ -70,6 +150,10 @@
 
 #define VM_LOAD_FLAGS_CHECK_HEADER      1
 
+// number of concurrent VM instances on the wifi processor.
+// instance 0 is the base program, the others are overlays.
+#define VM_MAX_VMS                      3
+
 
 typedef struct __attribute__((packed)){
     int8_t status;
@@ -77,8 +161,31 @@ typedef struct __attribute__((packed)){
     uint16_t loop_time;
     uint16_t fader_time;
     uint16_t max_cycles;
+    uint16_t overruns;
+    uint16_t skipped_frames;
+    uint16_t max_overrun;
+    uint8_t fader_divisor;
+    uint8_t vm_id;
 } vm_info_t;
 
+// profiler data.
+// ticks are in units of VM_PROFILE_TICKS(), which is target specific.
+#define VM_PROFILE_N_OPCODES            ( VM_OPCODE_LAST + 1 )
+#define VM_PROFILE_MAX_FUNCS            16
+
+typedef struct{
+    uint32_t count;
+    uint32_t ticks;
+} vm_profile_t;
+
+// functions are identified by their start address in the code stream.
+// ticks do not include time spent in called functions.
+typedef struct{
+    uint16_t addr;
+    uint32_t calls;
+    uint32_t ticks;
+} vm_func_profile_t;
+
 // note this needs to pad to 32 bit alignment!
 typedef struct __attribute__((packed)){
     uint32_t hash;
@@ -135,6 +242,8 @@ typedef struct{
     uint8_t pix_obj_count;
     uint16_t pix_obj_start;
 
+    uint16_t kvdb_generation;
+
     uint8_t byte0;
 } vm_state_t;
 
@@ -178,4 +287,13 @@ int8_t vm_i8_load_program(
 
 int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result );
 
+// only available if VM_ENABLE_OPCODE_COUNTS is defined in vm_config.h
+void vm_v_reset_opcode_counts( void );
+uint32_t *vm_u32p_get_opcode_counts( void );
+
+// only available if VM_ENABLE_PROFILE is defined in vm_config.h
+void vm_v_reset_profile( void );
+int8_t vm_i8_get_opcode_profile( uint8_t opcode, vm_profile_t *profile );
+int8_t vm_i8_get_func_profile( uint8_t index, vm_func_profile_t *profile );
+
 #endif
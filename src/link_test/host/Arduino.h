@@ -0,0 +1,134 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+// Stand-in for the Arduino core header. The C side only needs the
+// basics bool.h expects, the ESP8266 link also gets a serial port
+// that the test feeds from the simulated line.
+
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define TRUE true
+#define FALSE false
+
+#ifdef __cplusplus
+
+void sim_v_esp_tx( const uint8_t *data, size_t len );
+
+class SerialSim{
+public:
+    uint8_t *buf;
+    size_t size;
+    size_t rd;
+    size_t wr;
+    long overflows;
+
+    SerialSim() : buf( 0 ), size( 256 ), rd( 0 ), wr( 0 ), overflows( 0 ) {}
+
+    void setRxBufferSize( size_t n ){
+
+        free( buf );
+        size = n;
+        buf = (uint8_t *)malloc( size );
+        rd = wr = 0;
+    }
+
+    void begin( long baud ){
+
+        if( !buf ){
+
+            buf = (uint8_t *)malloc( size );
+        }
+    }
+
+    // one slot is kept open, as in the ESP8266 core
+    int available( void ){
+
+        return ( wr + size - rd ) % size;
+    }
+
+    int read( void ){
+
+        if( available() == 0 ){
+
+            return -1;
+        }
+
+        uint8_t c = buf[rd];
+        rd = ( rd + 1 ) % size;
+
+        return c;
+    }
+
+    size_t readBytes( uint8_t *data, size_t len ){
+
+        for( size_t i = 0; i < len; i++ ){
+
+            int c = read();
+
+            if( c < 0 ){
+
+                return i;
+            }
+
+            data[i] = c;
+        }
+
+        return len;
+    }
+
+    size_t write( const uint8_t *data, size_t len ){
+
+        sim_v_esp_tx( data, len );
+
+        return len;
+    }
+
+    void flush( void ){}
+
+    // a byte arriving from the line
+    void push( uint8_t c ){
+
+        if( ( ( wr + 1 ) % size ) == rd ){
+
+            overflows++;
+            return;
+        }
+
+        buf[wr] = c;
+        wr = ( wr + 1 ) % size;
+    }
+};
+
+extern SerialSim Serial;
+
+uint32_t micros( void );
+uint32_t millis( void );
+
+#endif
+
+#endif
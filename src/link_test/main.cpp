@@ -0,0 +1,359 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+#include <stdio.h>
+#include <deque>
+
+#include "Arduino.h"
+#include "comm_link.h"
+#include "irq_line.h"
+
+extern "C"{
+    #include "wifi_link.h"
+    #include "memory.h"
+    #include "timers.h"
+}
+
+// one byte time at 2 Mbaud
+#define BYTE_TIME_US        5
+
+// how often each side runs its link
+#define ESP_PERIOD_US       20
+#define XMEGA_PERIOD_US     50
+
+#define RUN_TIME_US         2000000
+#define DRAIN_TIME_US       200000
+#define STALL_TIME_US       500000
+
+SerialSim Serial;
+
+static uint64_t sim_us;
+static double bit_error_rate;
+static long bit_flips;
+
+// bytes on the line in each direction
+static std::deque<uint8_t> esp_to_xmega;
+static std::deque<uint8_t> xmega_to_esp;
+
+// receive DMA of the xmega
+static uint16_t dma_pos;
+
+static bool reset_done;
+
+static uint16_t esp_tx_seq;
+static uint16_t esp_rx_seq;
+static uint16_t xmega_tx_seq;
+static uint16_t xmega_rx_seq;
+static long errors;
+static long wrapped_frames;
+
+static uint8_t heap[1024];
+
+
+uint32_t micros( void ){
+
+    return (uint32_t)sim_us;
+}
+
+uint32_t millis( void ){
+
+    return (uint32_t)( sim_us / 1000 );
+}
+
+uint32_t tmr_u32_get_system_time_ms( void ){
+
+    return millis();
+}
+
+uint32_t tmr_u32_elapsed_time_ms( uint32_t start_time ){
+
+    return millis() - start_time;
+}
+
+void irqline_v_enable( void ){
+
+}
+
+void irqline_v_strobe_irq( void ){
+
+    reset_done = true;
+}
+
+static uint8_t corrupt( uint8_t c ){
+
+    if( ( bit_error_rate > 0 ) && ( ( rand() / (double)RAND_MAX ) < bit_error_rate ) ){
+
+        bit_flips++;
+
+        c ^= 1 << ( rand() % 8 );
+    }
+
+    return c;
+}
+
+void sim_v_esp_tx( const uint8_t *data, size_t len ){
+
+    esp_to_xmega.insert( esp_to_xmega.end(), data, data + len );
+}
+
+// payloads carry a sequence number, their length and content follow from it
+static uint8_t payload_len( uint16_t seq, uint8_t max_len ){
+
+    return 2 + ( ( seq * 37 ) % ( max_len - 1 ) );
+}
+
+static void make_payload( uint16_t seq, uint8_t *data, uint8_t len ){
+
+    memcpy( data, &seq, sizeof(seq) );
+
+    for( uint8_t i = sizeof(seq); i < len; i++ ){
+
+        data[i] = seq * 7 + i;
+    }
+}
+
+static void check_payload( const char *dir, uint16_t *expected, uint8_t max_len, uint8_t *data, uint16_t len ){
+
+    uint8_t buf[256];
+    uint16_t seq;
+    memcpy( &seq, data, sizeof(seq) );
+
+    if( seq != *expected ){
+
+        if( errors++ == 0 ){
+
+            printf( "%s: frame %u, expected %u\n", dir, seq, *expected );
+        }
+    }
+    else{
+
+        make_payload( seq, buf, payload_len( seq, max_len ) );
+
+        if( ( len != payload_len( seq, max_len ) ) || ( memcmp( buf, data, len ) != 0 ) ){
+
+            if( errors++ == 0 ){
+
+                printf( "%s: frame %u corrupted\n", dir, seq );
+            }
+        }
+    }
+
+    *expected = seq + 1;
+}
+
+// ESP8266 side
+void intf_v_link_reset( void ){
+
+}
+
+void intf_v_receive_msg( uint8_t data_id, uint8_t *data, uint16_t len ){
+
+    check_payload( "xmega -> esp", &xmega_rx_seq, WIFI_MAX_DATA_LEN, data, len );
+}
+
+// xmega side
+uint16_t wifi_u16_rx_dma_pos( void ){
+
+    return dma_pos;
+}
+
+void wifi_v_line_write( uint8_t *data, uint16_t len ){
+
+    xmega_to_esp.insert( xmega_to_esp.end(), data, data + len );
+}
+
+int8_t wifi_i8_receive_frame( wifi_data_header_t *header, uint8_t *data ){
+
+    if( ( data < wifi_link_rx_buf ) || ( data >= &wifi_link_rx_buf[WIFI_LINK_RX_BUF_SIZE] ) ){
+
+        wrapped_frames++;
+    }
+
+    check_payload( "esp -> xmega", &esp_rx_seq, WIFI_MAIN_MAX_DATA_LEN, data, header->len );
+
+    return 0;
+}
+
+static void xmega_reset( void ){
+
+    dma_pos = 0;
+    wifi_link_v_reset();
+
+    uint8_t c = WIFI_COMM_RESET;
+    uint32_t magic = WIFI_COMM_RESET_MAGIC;
+    wifi_v_line_write( &c, sizeof(c) );
+    wifi_v_line_write( (uint8_t *)&magic, sizeof(magic) );
+}
+
+static void tick( bool send ){
+
+    sim_us += BYTE_TIME_US;
+
+    if( !xmega_to_esp.empty() ){
+
+        Serial.push( corrupt( xmega_to_esp.front() ) );
+        xmega_to_esp.pop_front();
+    }
+
+    if( !esp_to_xmega.empty() ){
+
+        wifi_link_rx_buf[dma_pos] = corrupt( esp_to_xmega.front() );
+        esp_to_xmega.pop_front();
+
+        if( ++dma_pos >= WIFI_LINK_RX_BUF_SIZE ){
+
+            dma_pos = 0;
+        }
+    }
+
+    if( ( sim_us % ESP_PERIOD_US ) == 0 ){
+
+        link_v_process();
+
+        if( send && link_b_ready() ){
+
+            uint8_t data[WIFI_MAIN_MAX_DATA_LEN];
+            uint8_t len = payload_len( esp_tx_seq, WIFI_MAIN_MAX_DATA_LEN );
+            make_payload( esp_tx_seq, data, len );
+
+            if( link_i8_send_msg( WIFI_DATA_ID_DEBUG_PRINT, data, len ) == 0 ){
+
+                esp_tx_seq++;
+            }
+        }
+    }
+
+    if( ( sim_us % XMEGA_PERIOD_US ) == 0 ){
+
+        if( !wifi_link_b_idle() ){
+
+            wifi_link_v_process();
+        }
+
+        if( send && wifi_link_b_tx_ready() ){
+
+            uint8_t data[WIFI_MAX_DATA_LEN];
+            uint8_t len = payload_len( xmega_tx_seq, WIFI_MAX_DATA_LEN );
+            make_payload( xmega_tx_seq, data, len );
+
+            if( wifi_link_i8_send( WIFI_DATA_ID_KV_BATCH, data, len ) == 0 ){
+
+                xmega_tx_seq++;
+            }
+        }
+    }
+
+    if( ( sim_us % 1000 ) == 0 ){
+
+        mem2_v_collect_garbage();
+    }
+}
+
+int main( int argc, char **argv ){
+
+    bit_error_rate = argc > 1 ? atof( argv[1] ) : 0;
+
+    srand( argc > 2 ? atoi( argv[2] ) : 1234 );
+
+    mem2_v_init( heap, sizeof(heap) );
+
+    link_v_init();
+    wifi_link_v_init();
+
+    while( !reset_done ){
+
+        xmega_reset();
+
+        for( uint32_t i = 0; ( i < 2000 ) && !reset_done; i++ ){
+
+            tick( false );
+        }
+    }
+
+    wifi_link_v_start();
+
+    uint64_t last_progress = sim_us;
+    uint32_t last_count = 0;
+
+    while( sim_us < RUN_TIME_US ){
+
+        tick( true );
+
+        uint32_t count = esp_rx_seq + xmega_rx_seq;
+
+        if( count != last_count ){
+
+            last_count = count;
+            last_progress = sim_us;
+        }
+        else if( ( sim_us - last_progress ) > STALL_TIME_US ){
+
+            printf( "stalled at %llu us\n", (unsigned long long)sim_us );
+            errors++;
+
+            break;
+        }
+    }
+
+    // let the windows empty out
+    uint64_t drain_end = sim_us + DRAIN_TIME_US;
+
+    while( sim_us < drain_end ){
+
+        tick( false );
+    }
+
+    if( ( esp_rx_seq != esp_tx_seq ) || ( xmega_rx_seq != xmega_tx_seq ) ){
+
+        printf( "frames lost: esp sent %u xmega got %u, xmega sent %u esp got %u\n",
+                esp_tx_seq, esp_rx_seq, xmega_tx_seq, xmega_rx_seq );
+        errors++;
+    }
+
+    mem_rt_data_t rt_data;
+    mem2_v_get_rt_data( &rt_data );
+
+    if( rt_data.handles_used != 0 ){
+
+        printf( "%u mem2 handles still in use\n", rt_data.handles_used );
+        errors++;
+    }
+
+    if( Serial.overflows != 0 ){
+
+        printf( "ESP8266 receive buffer overflowed %ld times\n", Serial.overflows );
+        errors++;
+    }
+
+    // the ring wraps every couple of frames, some of them must straddle it
+    if( wrapped_frames == 0 ){
+
+        printf( "no frame wrapped around the receive ring\n" );
+        errors++;
+    }
+
+    printf( "bit error rate %g: %ld bit flips, esp -> xmega %u frames (%ld wrapped), xmega -> esp %u frames, esp comm errors %u: %s\n",
+            bit_error_rate, bit_flips, esp_rx_seq, wrapped_frames, xmega_rx_seq,
+            link_u16_get_comm_errors(), errors == 0 ? "ok" : "FAIL" );
+
+    return errors != 0;
+}
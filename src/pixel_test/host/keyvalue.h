@@ -0,0 +1,51 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+#ifndef _KEYVALUE_H
+#define _KEYVALUE_H
+
+#include <stdint.h>
+
+typedef uint8_t kv_op_t8;
+typedef uint32_t catbus_hash_t32;
+
+#define KV_OP_SET                   1
+#define KV_FLAGS_PERSIST            0x01
+#define SAPPHIRE_TYPE_BOOL          1
+#define SAPPHIRE_TYPE_UINT8         2
+
+#define __KV__pix_apa102_dimmer     1
+
+typedef int8_t (*kv_handler_t)( kv_op_t8 op, catbus_hash_t32 hash, void *data, uint16_t len );
+
+typedef struct{
+    uint8_t type;
+    uint8_t array_len;
+    uint8_t flags;
+    void *ptr;
+    kv_handler_t handler;
+    const char *name;
+} kv_meta_t;
+
+#define KV_SECTION_META
+
+#endif
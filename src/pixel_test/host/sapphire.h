@@ -0,0 +1,61 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+// Stand-in for the SapphireOS headers, with just what the pixel
+// driver uses. The xmega peripherals are plain structs, so the test
+// can read back what the driver programmed into them.
+
+#ifndef _SAPPHIRE_H
+#define _SAPPHIRE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bool.h"
+
+typedef int8_t mem_handle_t;
+
+#define PROGMEM
+#define pgm_read_byte( addr ) ( *(const uint8_t *)( addr ) )
+#define PSTR( s ) s
+
+#define ATOMIC
+#define END_ATOMIC
+
+// interrupt handlers become plain functions the test calls
+#define ISR( vect ) void vect( void )
+#define DMA_CH0_vect    isr_dma_ch0
+#define DMA_CH1_vect    isr_dma_ch1
+#define DMA_CH2_vect    isr_dma_ch2
+#define DMA_CH3_vect    isr_dma_ch3
+#define TCD1_OVF_vect   isr_tcd1_ovf
+
+// IO header pins used by the second output
+#define IO_PIN_1_XCK    1
+#define IO_PIN_2_TXD    2
+
+uint32_t tmr_u32_get_system_time_ms( void );
+
+#include "xmega_regs.h"
+#include "keyvalue.h"
+
+#endif
@@ -0,0 +1,117 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+// The xmega registers the pixel driver touches.
+
+#ifndef _XMEGA_REGS_H
+#define _XMEGA_REGS_H
+
+#include <stdint.h>
+
+typedef struct{
+    uint8_t CTRLA;
+    uint8_t CTRLB;
+    uint8_t ADDRCTRL;
+    uint8_t TRIGSRC;
+    uint16_t TRFCNT;
+    uint8_t REPCNT;
+    uint8_t SRCADDR0;
+    uint8_t SRCADDR1;
+    uint8_t SRCADDR2;
+    uint8_t DESTADDR0;
+    uint8_t DESTADDR1;
+    uint8_t DESTADDR2;
+} DMA_CH_t;
+
+typedef struct{
+    uint8_t CTRL;
+    uint8_t INTFLAGS;
+    DMA_CH_t CH0;
+    DMA_CH_t CH1;
+    DMA_CH_t CH2;
+    DMA_CH_t CH3;
+} DMA_t;
+
+typedef struct{
+    uint8_t DATA;
+    uint8_t CTRLB;
+    uint8_t CTRLC;
+    uint8_t BAUDCTRLA;
+    uint8_t BAUDCTRLB;
+} USART_t;
+
+typedef struct{
+    uint8_t CTRLA;
+    uint8_t CTRLB;
+    uint8_t INTCTRLA;
+    uint16_t CNT;
+    uint16_t PER;
+} TC1_t;
+
+typedef struct{
+    uint8_t DIRSET;
+    uint8_t DIRCLR;
+    uint8_t OUTSET;
+    uint8_t OUTCLR;
+    uint8_t PIN1CTRL;
+    uint8_t PIN3CTRL;
+    uint8_t PIN5CTRL;
+    uint8_t PIN7CTRL;
+} PORT_t;
+
+extern DMA_t DMA;
+extern USART_t USARTC0;
+extern USART_t USARTC1;
+extern TC1_t TCD1;
+extern PORT_t PORTA;
+extern PORT_t PORTC;
+
+#define DMA_CH_ENABLE_bm                0x80
+#define DMA_CH_RESET_bm                 0x40
+#define DMA_CH_REPEAT_bm                0x20
+#define DMA_CH_SINGLE_bm                0x04
+#define DMA_CH_BURSTLEN_1BYTE_gc        0x00
+#define DMA_CH_TRNINTLVL_gm             0x03
+#define DMA_CH_TRNINTLVL_MED_gc         0x02
+#define DMA_CH_TRNINTLVL_HI_gc          0x03
+#define DMA_CH_SRCRELOAD_NONE_gc        0x00
+#define DMA_CH_SRCDIR_INC_gc            0x10
+#define DMA_CH_DESTRELOAD_NONE_gc       0x00
+#define DMA_CH_DESTDIR_FIXED_gc         0x00
+#define DMA_CH_TRIGSRC_USARTC0_DRE_gc   0x4C
+#define DMA_CH_TRIGSRC_USARTC1_DRE_gc   0x4F
+#define DMA_DBUFMODE_gm                 0x0C
+#define DMA_DBUFMODE_CH01_gc            0x04
+#define DMA_CH0TRNIF_bm                 0x01
+#define DMA_CH1TRNIF_bm                 0x02
+#define DMA_CH2TRNIF_bm                 0x04
+#define DMA_CH3TRNIF_bm                 0x08
+
+#define USART_TXEN_bm                   0x08
+#define USART_CMODE_MSPI_gc             0xC0
+
+#define TC_CLKSEL_DIV64_gc              0x05
+#define TC_OVFINTLVL_HI_gc              0x03
+
+#define PORT_INVEN_bm                   0x40
+
+#endif
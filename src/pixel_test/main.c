@@ -0,0 +1,653 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+// Host checks for the pixel driver. The driver is built into this file
+// with its registers stubbed out (see host/), and the DMA is played
+// back here, so the bytes that would go out on each output can be
+// compared with a plain reference encoder.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pixel.c"
+
+DMA_t DMA;
+USART_t USARTC0;
+USART_t USARTC1;
+TC1_t TCD1;
+PORT_t PORTA;
+PORT_t PORTC;
+
+static uint16_t pix_count;
+static bool dma_claimed;
+static uint32_t net_now;
+static uint8_t frame_int_level[2]; // output 1 and output 2 at the start of the last frame
+
+#define STREAM_SIZE ( MAX_PIXELS * 12 + 64 )
+
+typedef struct{
+    uint8_t data[STREAM_SIZE];
+    uint16_t len;
+} stream_t;
+
+
+uint16_t gfx_u16_get_pix_count( void ){
+
+    return pix_count;
+}
+
+void dma_v_claim_ch( bool claim ){
+
+    dma_claimed = claim;
+}
+
+uint32_t tmr_u32_get_system_time_ms( void ){
+
+    return 0;
+}
+
+uint32_t time_u32_get_network_time( void ){
+
+    return net_now;
+}
+
+// the DMA only has the low 16 bits of the buffer address
+static uint8_t *dma_buf( DMA_CH_t *ch ){
+
+    uint16_t addr = ch->SRCADDR0 | ( ch->SRCADDR1 << 8 );
+
+    if( addr == (uint16_t)(uintptr_t)pix_buf_A ){
+
+        return pix_buf_A;
+    }
+    else if( addr == (uint16_t)(uintptr_t)pix_buf_B ){
+
+        return pix_buf_B;
+    }
+    else if( addr == (uint16_t)(uintptr_t)pix2_buf[0] ){
+
+        return pix2_buf[0];
+    }
+    else if( addr == (uint16_t)(uintptr_t)pix2_buf[1] ){
+
+        return pix2_buf[1];
+    }
+
+    printf( "DMA source is not a pixel buffer\n" );
+    exit( 1 );
+}
+
+static void emit( stream_t *stream, DMA_CH_t *ch ){
+
+    if( ( stream->len + ch->TRFCNT ) > STREAM_SIZE ){
+
+        printf( "output stream overflow\n" );
+        exit( 1 );
+    }
+
+    memcpy( &stream->data[stream->len], dma_buf( ch ), ch->TRFCNT );
+    stream->len += ch->TRFCNT;
+}
+
+// one DMA output being played back
+typedef struct{
+    DMA_CH_t *ch; // channel sending, 0 when idle
+    uint32_t done; // end of the transfer, in byte times
+    stream_t *stream;
+} output_sim_t;
+
+static void start_transfer( output_sim_t *out, DMA_CH_t *ch, uint32_t now ){
+
+    emit( out->stream, ch );
+
+    out->ch = ch;
+    out->done = now + ch->TRFCNT;
+}
+
+static void channel_done( output_sim_t *out, uint32_t now ){
+
+    DMA_CH_t *ch = out->ch;
+
+    out->ch = 0;
+
+    // the hardware clears the enable when the transfer completes
+    ch->CTRLA &= ~DMA_CH_ENABLE_bm;
+
+    if( ch == &DMA.CH3 ){
+
+        if( ch->CTRLB & DMA_CH_TRNINTLVL_gm ){
+
+            isr_dma_ch3();
+        }
+
+        if( ch->CTRLA & DMA_CH_ENABLE_bm ){
+
+            start_transfer( out, ch, now );
+        }
+
+        return;
+    }
+
+    // output 1: CH0 and CH1 take turns in double buffer mode,
+    // the hardware enables the other channel as one finishes.
+    DMA_CH_t *other = ( ch == &DMA.CH0 ) ? &DMA.CH1 : &DMA.CH0;
+
+    if( ( ( DMA.CTRL & DMA_DBUFMODE_gm ) == DMA_DBUFMODE_CH01_gc ) &&
+        ( other->CTRLA != 0 ) ){
+
+        other->CTRLA |= DMA_CH_ENABLE_bm;
+
+        start_transfer( out, other, now );
+    }
+
+    if( ch->CTRLB & DMA_CH_TRNINTLVL_gm ){
+
+        if( ch == &DMA.CH0 ){
+
+            isr_dma_ch0();
+        }
+        else{
+
+            isr_dma_ch1();
+        }
+    }
+}
+
+// play back both outputs of a frame that has been started until they
+// are done, running the DMA interrupts in the order the transfers finish.
+static void play_frame( stream_t *out1, stream_t *out2 ){
+
+    output_sim_t outputs[2] = {
+        { 0, 0, out1 },
+        { 0, 0, out2 },
+    };
+
+    out1->len = 0;
+    out2->len = 0;
+
+    frame_int_level[0] = DMA.CH0.CTRLB & DMA_CH_TRNINTLVL_gm;
+    frame_int_level[1] = DMA.CH3.CTRLB & DMA_CH_TRNINTLVL_gm;
+
+    if( DMA.CH0.CTRLA & DMA_CH_ENABLE_bm ){
+
+        start_transfer( &outputs[0], &DMA.CH0, 0 );
+    }
+
+    if( DMA.CH3.CTRLA & DMA_CH_ENABLE_bm ){
+
+        start_transfer( &outputs[1], &DMA.CH3, 0 );
+    }
+
+    while( outputs[0].ch || outputs[1].ch ){
+
+        // output 2 is on the higher interrupt level, so it goes first on a tie
+        output_sim_t *out = &outputs[1];
+
+        if( ( out->ch == 0 ) ||
+            ( ( outputs[0].ch != 0 ) && ( outputs[0].done < out->done ) ) ){
+
+            out = &outputs[0];
+        }
+
+        channel_done( out, out->done );
+    }
+}
+
+static void run_frame( stream_t *out1, stream_t *out2 ){
+
+    pixel_v_start_frame();
+
+    play_frame( out1, out2 );
+}
+
+static void expect( bool ok, const char *msg ){
+
+    if( !ok ){
+
+        printf( "%s\n", msg );
+        exit( 1 );
+    }
+}
+
+static void init_driver( uint8_t mode, uint8_t outputs ){
+
+    memset( &DMA, 0, sizeof(DMA) );
+
+    pix_mode = mode;
+    pix_outputs = outputs;
+
+    pixel_v_init();
+}
+
+static void random_pixels( void ){
+
+    for( uint16_t i = 0; i < MAX_PIXELS; i++ ){
+
+        array_r[i] = rand();
+        array_g[i] = rand();
+        array_b[i] = rand();
+        array_misc.dither[i] = rand();
+
+        // exercise the dither saturation
+        if( ( rand() % 8 ) == 0 ){
+
+            array_r[i] = 255;
+        }
+
+        if( ( rand() % 8 ) == 0 ){
+
+            array_b[i] = 255;
+        }
+    }
+}
+
+// reference encoder: the wire format of pixels first to last - 1,
+// written out pixel by pixel.
+static void ref_frame( stream_t *stream, uint8_t cycle, uint16_t first, uint16_t last ){
+
+    static const uint8_t orders[6][3] = {
+        { 0, 1, 2 }, // RGB
+        { 0, 2, 1 }, // RBG
+        { 1, 0, 2 }, // GRB
+        { 2, 1, 0 }, // BGR
+        { 2, 0, 1 }, // BRG
+        { 1, 2, 0 }, // GBR
+    };
+
+    uint8_t *buf = stream->data;
+    uint16_t len = 0;
+
+    stream->len = 0;
+
+    if( first >= last ){
+
+        return;
+    }
+
+    if( pix_mode == PIX_MODE_APA102 ){
+
+        memset( buf, 0, 4 );
+        len += 4;
+    }
+
+    for( uint16_t i = first; i < last; i++ ){
+
+        uint8_t rgb[3] = { array_r[i], array_g[i], array_b[i] };
+
+        if( pix_dither && ( pix_mode != PIX_MODE_SK6812_RGBW ) ){
+
+            for( uint8_t c = 0; c < 3; c++ ){
+
+                uint8_t d = ( array_misc.dither[i] >> ( 4 - c * 2 ) ) & 0x03;
+
+                if( ( rgb[c] < 255 ) && ( d > ( cycle & 0x03 ) ) ){
+
+                    rgb[c]++;
+                }
+            }
+        }
+
+        if( pix_mode == PIX_MODE_APA102 ){
+
+            buf[len++] = 0xe0 | pix_apa102_dimmer;
+        }
+
+        for( uint8_t c = 0; c < 3; c++ ){
+
+            uint8_t value = rgb[orders[pix_rgb_order][c]];
+
+            if( ( pix_mode == PIX_MODE_WS2811 ) || ( pix_mode == PIX_MODE_SK6812_RGBW ) ){
+
+                memcpy( &buf[len], ws2811_lookup[value], 3 );
+                len += 3;
+            }
+            else{
+
+                buf[len++] = value;
+            }
+        }
+
+        if( pix_mode == PIX_MODE_SK6812_RGBW ){
+
+            memcpy( &buf[len], ws2811_lookup[array_misc.white[i]], 3 );
+            len += 3;
+        }
+    }
+
+    if( pix_mode == PIX_MODE_APA102 ){
+
+        memset( &buf[len], 0xff, 19 );
+        len += 19;
+    }
+
+    stream->len = len;
+}
+
+static int compare( const char *name, stream_t *ref, stream_t *out ){
+
+    if( ref->len != out->len ){
+
+        printf( "%s: %u bytes, expected %u\n", name, out->len, ref->len );
+
+        return -1;
+    }
+
+    for( uint16_t i = 0; i < ref->len; i++ ){
+
+        if( ref->data[i] != out->data[i] ){
+
+            printf( "%s: byte %u is 0x%02x, expected 0x%02x\n", name, i, out->data[i], ref->data[i] );
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static const uint8_t modes[] = {
+    PIX_MODE_WS2801,
+    PIX_MODE_APA102,
+    PIX_MODE_WS2811,
+    PIX_MODE_SK6812_RGBW,
+};
+
+// every mode, color order and dither setting,
+// for pixel counts that end on and off a buffer boundary.
+static void check_encoder( void ){
+
+    static stream_t ref, out, out2;
+    char name[64];
+    uint32_t frames = 0;
+
+    for( uint8_t m = 0; m < sizeof(modes); m++ ){
+
+        for( uint8_t order = 0; order < 6; order++ ){
+
+            for( uint8_t dither = 0; dither < 2; dither++ ){
+
+                pix_rgb_order = order;
+                pix_dither = dither;
+                pix_apa102_dimmer = rand() % 32;
+
+                init_driver( modes[m], 1 );
+
+                for( uint8_t t = 0; t < 8; t++ ){
+
+                    pix_count = ( t == 0 ) ? MAX_PIXELS : 1 + ( rand() % MAX_PIXELS );
+
+                    random_pixels();
+
+                    run_frame( &out, &out2 );
+
+                    // start_frame advanced the dither cycle
+                    ref_frame( &ref, dither_cycle, 0, pix_count );
+
+                    snprintf( name, sizeof(name), "encoder mode %u order %u dither %u pixels %u",
+                              modes[m], order, dither, pix_count );
+
+                    if( compare( name, &ref, &out ) < 0 ){
+
+                        exit( 1 );
+                    }
+
+                    if( out2.len != 0 ){
+
+                        printf( "%s: output 2 sent %u bytes\n", name, out2.len );
+                        exit( 1 );
+                    }
+
+                    if( frame_int_level[0] != DMA_CH_TRNINTLVL_HI_gc ){
+
+                        printf( "%s: output 1 interrupt level %u\n", name, frame_int_level[0] );
+                        exit( 1 );
+                    }
+
+                    frames++;
+                }
+            }
+        }
+    }
+
+    printf( "wire encoding, %u frames: ok\n", frames );
+}
+
+// two outputs: output 1 sends the first half of the pixels and
+// output 2 the rest, with their interrupts interleaved.
+static void check_outputs( void ){
+
+    static stream_t ref, out, out2;
+    char name[64];
+    uint32_t frames = 0;
+
+    for( uint8_t m = 0; m < sizeof(modes); m++ ){
+
+        for( uint8_t order = 0; order < 6; order++ ){
+
+            for( uint8_t dither = 0; dither < 2; dither++ ){
+
+                pix_rgb_order = order;
+                pix_dither = dither;
+                pix_apa102_dimmer = rand() % 32;
+
+                init_driver( modes[m], 2 );
+
+                snprintf( name, sizeof(name), "outputs mode %u order %u dither %u",
+                          modes[m], order, dither );
+
+                // output 2 owns DMA CH3 and IO 1 and 2
+                if( !dma_claimed ||
+                    !pixel_b_io_in_use( IO_PIN_1_XCK ) ||
+                    !pixel_b_io_in_use( IO_PIN_2_TXD ) ||
+                    pixel_b_io_in_use( 0 ) ){
+
+                    printf( "%s: DMA channel or IO not claimed\n", name );
+                    exit( 1 );
+                }
+
+                for( uint8_t t = 0; t < 8; t++ ){
+
+                    pix_count = ( t == 0 ) ? MAX_PIXELS : 1 + ( rand() % MAX_PIXELS );
+
+                    // an odd count puts the extra pixel on output 1
+                    uint16_t split = ( pix_count + 1 ) / 2;
+
+                    random_pixels();
+
+                    run_frame( &out, &out2 );
+
+                    snprintf( name, sizeof(name), "output 1 mode %u order %u dither %u pixels %u",
+                              modes[m], order, dither, pix_count );
+
+                    ref_frame( &ref, dither_cycle, 0, split );
+
+                    if( compare( name, &ref, &out ) < 0 ){
+
+                        exit( 1 );
+                    }
+
+                    snprintf( name, sizeof(name), "output 2 mode %u order %u dither %u pixels %u",
+                              modes[m], order, dither, pix_count );
+
+                    ref_frame( &ref, dither_cycle, split, pix_count );
+
+                    if( compare( name, &ref, &out2 ) < 0 ){
+
+                        exit( 1 );
+                    }
+
+                    // output 2 restarts its channel in software,
+                    // so it must not wait behind output 1's interrupts.
+                    if( ( frame_int_level[0] != DMA_CH_TRNINTLVL_MED_gc ) ||
+                        ( ( out2.len > 0 ) && ( frame_int_level[1] != DMA_CH_TRNINTLVL_HI_gc ) ) ){
+
+                        printf( "%s: interrupt levels %u and %u\n", name, frame_int_level[0], frame_int_level[1] );
+                        exit( 1 );
+                    }
+
+                    frames++;
+                }
+
+                // back to one output releases the channel and the IO
+                init_driver( modes[m], 1 );
+
+                if( dma_claimed || pixel_b_io_in_use( IO_PIN_1_XCK ) ){
+
+                    printf( "%s: DMA channel or IO not released\n", name );
+                    exit( 1 );
+                }
+            }
+        }
+    }
+
+    printf( "two outputs, %u frames: ok\n", frames );
+}
+
+static bool frame_started( void ){
+
+    return ( DMA.CH0.CTRLA & DMA_CH_ENABLE_bm ) != 0;
+}
+
+// the timer period that was armed, in ticks
+static uint32_t timer_period( void ){
+
+    expect( TCD1.CTRLA != 0, "pixel timer is not running" );
+
+    return (uint32_t)TCD1.PER + 1;
+}
+
+// pix_latch: frames are sent at the presented network time,
+// and a frame that does not finish is stopped by the watchdog.
+static void check_latch( void ){
+
+    static stream_t out, out2;
+
+    pix_latch = TRUE;
+    pix_dither = FALSE;
+    pix_rgb_order = PIX_ORDER_RGB;
+
+    for( uint8_t outputs = 1; outputs <= 2; outputs++ ){
+
+        pix_count = MAX_PIXELS;
+
+        init_driver( PIX_MODE_WS2811, outputs );
+        random_pixels();
+
+        expect( ( TCD1.CTRLA == 0 ) && !pixel_b_present_busy(), "latch: timer runs without a present" );
+
+        net_now = 100000;
+
+        // present 10 ms from now
+        pixel_v_present_at( net_now + 10 );
+
+        expect( pixel_b_present_busy(), "latch: not busy after present" );
+        expect( timer_period() == ( 10 * PIXEL_TIMER_TICKS_PER_MS ), "latch: wrong present delay" );
+        expect( !frame_started(), "latch: frame sent early" );
+
+        isr_tcd1_ovf();
+
+        expect( frame_started(), "latch: frame not sent at present time" );
+        expect( ( TCD1.CTRLA != 0 ) && ( TCD1.PER == PWM_FADE_TIMER_WATCHDOG_VALUE ), "latch: watchdog not armed" );
+
+        play_frame( &out, &out2 );
+
+        expect( !pixel_b_present_busy() && ( TCD1.CTRLA == 0 ), "latch: not idle after frame" );
+
+        // longer than a timer period, so the periods are chained
+        uint32_t ticks = 0;
+
+        pixel_v_present_at( net_now + 700 );
+
+        while( !frame_started() ){
+
+            ticks += timer_period();
+
+            isr_tcd1_ovf();
+        }
+
+        expect( ticks == ( 700 * PIXEL_TIMER_TICKS_PER_MS ), "latch: chained delay is wrong" );
+
+        play_frame( &out, &out2 );
+
+        // a present in the past goes out right away
+        pixel_v_present_at( net_now - 50 );
+
+        expect( timer_period() == 2, "latch: late present was delayed" );
+
+        isr_tcd1_ovf();
+        expect( frame_started(), "latch: late present not sent" );
+
+        // present while that frame is sent, it waits for the frame
+        pixel_v_present_at( net_now + 5 );
+
+        TCD1.CNT = 100;
+
+        play_frame( &out, &out2 );
+
+        expect( pixel_b_present_busy(), "latch: held present was lost" );
+        expect( timer_period() == ( 5 * PIXEL_TIMER_TICKS_PER_MS - 100 ), "latch: held present delay is wrong" );
+
+        isr_tcd1_ovf();
+        expect( frame_started(), "latch: held present not sent" );
+
+        play_frame( &out, &out2 );
+
+        // watchdog: the frame is started but the DMA never finishes
+        pixel_v_present_at( net_now );
+        isr_tcd1_ovf();
+
+        expect( frame_started(), "watchdog: frame not started" );
+        expect( ( outputs == 1 ) || ( DMA.CH3.CTRLA & DMA_CH_ENABLE_bm ), "watchdog: output 2 not started" );
+
+        isr_tcd1_ovf();
+
+        expect( ( DMA.CH0.CTRLA == 0 ) && ( DMA.CH1.CTRLA == 0 ) && ( DMA.CH3.CTRLA == 0 ),
+                "watchdog: DMA still running" );
+        expect( ( ( DMA.CH0.CTRLB | DMA.CH1.CTRLB | DMA.CH3.CTRLB ) & DMA_CH_TRNINTLVL_gm ) == 0,
+                "watchdog: DMA interrupts still enabled" );
+        expect( ( DMA.CTRL & DMA_DBUFMODE_gm ) == 0, "watchdog: double buffer still on" );
+        expect( !pixel_b_present_busy() && ( TCD1.CTRLA == 0 ), "watchdog: not idle" );
+
+        // and the next present still works
+        pixel_v_present_at( net_now );
+        isr_tcd1_ovf();
+        play_frame( &out, &out2 );
+
+        expect( out.len > 0, "watchdog: no frame after reset" );
+        expect( !pixel_b_present_busy(), "watchdog: not idle after next frame" );
+    }
+
+    pix_latch = FALSE;
+
+    printf( "latched present and watchdog: ok\n" );
+}
+
+int main( void ){
+
+    srand( 1234 );
+
+    check_encoder();
+    check_outputs();
+    check_latch();
+
+    return 0;
+}
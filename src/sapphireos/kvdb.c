@@ -65,6 +65,11 @@ typedef struct __attribute__((packed)){
 static int16_t cached_index = -1;
 static catbus_hash_t32 cached_hash;
 
+// incremented whenever entries change position in the database.
+// indexes obtained from kvdb_i16_get_index_for_hash are valid
+// until the generation changes.
+static uint16_t generation;
+
 static int16_t _kvdb_i16_search_hash( catbus_hash_t32 hash ){
 
     if( hash == 0 ){
@@ -133,6 +138,10 @@ static void _kvdb_v_sort( void ){
         }                
 
     } while( swapped );
+
+    // entries may have moved
+    cached_index = -1;
+    generation++;
 }
 
 #ifdef KVDB_ENABLE_NAME_LOOKUP
@@ -303,6 +312,26 @@ int8_t kvdb_i8_add( catbus_hash_t32 hash, int32_t data, uint8_t tag, char name[C
     return KVDB_STATUS_OK;
 }
 
+static void _kvdb_v_set_index( int16_t index, int32_t data ){
+
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+
+    bool changed = entry[index].data != data;
+
+    entry[index].data = data;
+
+    // check if there is a notifier and data is changing
+    if( ( kvdb_v_notify_set != 0 ) && ( changed ) ){
+
+        catbus_hash_t32 hash = entry[index].hash;
+
+        catbus_meta_t meta;
+        kvdb_i8_get_meta( hash, &meta );
+
+        kvdb_v_notify_set( hash, &meta, &data );
+    }
+}
+
 int8_t kvdb_i8_set( catbus_hash_t32 hash, int32_t data ){
 
     if( hash == 0 ){
@@ -321,20 +350,7 @@ int8_t kvdb_i8_set( catbus_hash_t32 hash, int32_t data ){
     // check if found
     if( index >= 0 ){
 
-        db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
-
-        bool changed = entry[index].data != data;
-
-        entry[index].data = data;
-
-        // check if there is a notifier and data is changing
-        if( ( kvdb_v_notify_set != 0 ) && ( changed ) ){
-
-            catbus_meta_t meta;
-            kvdb_i8_get_meta( hash, &meta );
-
-            kvdb_v_notify_set( hash, &meta, &data );
-        }
+        _kvdb_v_set_index( index, data );
 
         return KVDB_STATUS_OK;
     }
@@ -528,6 +544,42 @@ int16_t kvdb_i16_get_index_for_hash( catbus_hash_t32 hash ){
     return _kvdb_i16_search_hash( hash );
 }
 
+uint16_t kvdb_u16_get_generation( void ){
+
+    return generation;
+}
+
+// index based access.
+// index must be obtained from kvdb_i16_get_index_for_hash and
+// is only valid while kvdb_u16_get_generation is unchanged.
+int8_t kvdb_i8_get_by_index( int16_t index, int32_t *data ){
+
+    if( ( handle < 0 ) || ( index < 0 ) || ( index >= (int16_t)db_size ) ){
+
+        *data = 0;
+
+        return KVDB_STATUS_NOT_FOUND;
+    }
+
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+
+    *data = entry[index].data;
+
+    return KVDB_STATUS_OK;
+}
+
+int8_t kvdb_i8_set_by_index( int16_t index, int32_t data ){
+
+    if( ( handle < 0 ) || ( index < 0 ) || ( index >= (int16_t)db_size ) ){
+
+        return KVDB_STATUS_NOT_FOUND;
+    }
+
+    _kvdb_v_set_index( index, data );
+
+    return KVDB_STATUS_OK;
+}
+
 // direct retrieval functions, for those who like to throw caution to the wind!
 uint16_t kvdb_u16_read( catbus_hash_t32 hash ){
 
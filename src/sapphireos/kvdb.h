@@ -45,6 +45,9 @@ int8_t kvdb_i8_lookup_name( catbus_hash_t32 hash, char name[CATBUS_STRING_LEN] )
 #endif
 catbus_hash_t32 kvdb_h_get_hash_for_index( uint16_t index );
 int16_t kvdb_i16_get_index_for_hash( catbus_hash_t32 hash );
+uint16_t kvdb_u16_get_generation( void );
+int8_t kvdb_i8_get_by_index( int16_t index, int32_t *data );
+int8_t kvdb_i8_set_by_index( int16_t index, int32_t data );
 
 uint16_t kvdb_u16_read( catbus_hash_t32 hash );
 uint8_t kvdb_u8_read( catbus_hash_t32 hash );
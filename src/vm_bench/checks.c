@@ -0,0 +1,679 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+
+/*
+
+Checks for the gfx lib's optimized pixel paths.
+
+Each check runs the library on random pixel data and compares the
+result with a plain per pixel reference, written the way the code
+looked before it was optimized. Run them with 'vm_bench -t' or
+'make test'.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bool.h"
+#include "gfx_lib.h"
+#include "pix_modes.h"
+#include "random.h"
+#include "checks.h"
+
+#define CHECK_TRIALS        16
+
+static gfx_pixel_array_t check_arrays[2];
+
+
+static void setup_gfx_params( uint16_t pixels, gfx_params_t *params ){
+
+    gfx_v_init_pixel_arrays( 0, 0 );
+
+    gfx_v_get_params( params );
+
+    params->pix_count               = pixels;
+    params->pix_size_x              = pixels;
+    params->pix_size_y              = 1;
+    params->pix_mode                = PIX_MODE_WS2811;
+    params->master_dimmer           = 65535;
+    params->sub_dimmer              = 65535;
+    params->hs_fade                 = 0;
+    params->v_fade                  = 0;
+    params->dimmer_curve            = GFX_DIMMER_CURVE_DEFAULT;
+    params->fader_curve             = GFX_FADER_CURVE_STEP;
+    params->virtual_array_start     = 0;
+    params->virtual_array_length    = 0;
+    params->dither                  = FALSE;
+}
+
+static void setup_gfx( uint16_t pixels ){
+
+    gfx_params_t params;
+    setup_gfx_params( pixels, &params );
+
+    gfx_v_set_params( &params );
+
+    gfx_v_reset();
+}
+
+// with 0 fade times every fade finishes within a few frames
+static void settle_faders( void ){
+
+    for( uint8_t i = 0; i < 64; i++ ){
+
+        gfx_v_process_faders();
+    }
+}
+
+// object 0 is the master array, object 1 is the one under test
+static void setup_object( uint16_t index, uint16_t count ){
+
+    memset( check_arrays, 0, sizeof(check_arrays) );
+
+    check_arrays[1].index   = index;
+    check_arrays[1].count   = count;
+    check_arrays[1].size_x  = count;
+    check_arrays[1].size_y  = 1;
+
+    gfx_v_init_pixel_arrays( check_arrays, 2 );
+}
+
+static uint16_t get_attr( uint8_t attr, uint16_t i ){
+
+    if( attr == PIX_ATTR_HUE ){
+
+        return gfx_u16p_get_hue()[i];
+    }
+    else if( attr == PIX_ATTR_SAT ){
+
+        return gfx_u16p_get_sat()[i];
+    }
+    else if( attr == PIX_ATTR_VAL ){
+
+        return gfx_u16p_get_val()[i];
+    }
+    else if( attr == PIX_ATTR_HS_FADE ){
+
+        return gfx_u16_get_hs_fade( i, 65535, 0 );
+    }
+
+    return gfx_u16_get_v_fade( i, 65535, 0 );
+}
+
+static void set_attr( uint8_t attr, uint16_t i, uint16_t a ){
+
+    if( attr == PIX_ATTR_HUE ){
+
+        gfx_u16p_get_hue()[i] = a;
+    }
+    else if( attr == PIX_ATTR_SAT ){
+
+        gfx_u16p_get_sat()[i] = a;
+    }
+    else if( attr == PIX_ATTR_VAL ){
+
+        gfx_u16p_get_val()[i] = a;
+    }
+    else if( attr == PIX_ATTR_HS_FADE ){
+
+        gfx_v_set_hs_fade( a, i, 65535, 0 );
+    }
+    else{
+
+        gfx_v_set_v_fade( a, i, 65535, 0 );
+    }
+}
+
+static int32_t random_src( void ){
+
+    static const int32_t edges[] = {
+        0, 1, -1, 2, 65535, 65536, -65535, -65536, 70000, -70000, 2147483647, -2147483647
+    };
+
+    uint16_t r = rnd_u16_get_int();
+
+    if( ( r & 3 ) == 0 ){
+
+        return edges[( r >> 2 ) % ( sizeof(edges) / sizeof(edges[0]) )];
+    }
+    else if( ( r & 3 ) == 1 ){
+
+        return (int16_t)rnd_u16_get_int() % 16;
+    }
+
+    return (int32_t)( ( (uint32_t)rnd_u16_get_int() << 16 ) | rnd_u16_get_int() ) >> ( r % 24 );
+}
+
+
+// Array ops
+
+#define ARRAY_OP_MOVE   0
+#define ARRAY_OP_ADD    1
+#define ARRAY_OP_SUB    2
+#define ARRAY_OP_MUL    3
+#define ARRAY_OP_DIV    4
+#define ARRAY_OP_MOD    5
+#define ARRAY_OP_COUNT  6
+
+typedef void ( *array_op_t )( uint8_t obj, uint8_t attr, int32_t src );
+
+static const array_op_t array_ops[ARRAY_OP_COUNT] = {
+    gfx_v_array_move,
+    gfx_v_array_add,
+    gfx_v_array_sub,
+    gfx_v_array_mul,
+    gfx_v_array_div,
+    gfx_v_array_mod,
+};
+
+static const char *array_op_names[ARRAY_OP_COUNT] = {
+    "move", "add", "sub", "mul", "div", "mod",
+};
+
+// hue wraps around, everything else saturates.
+// divide and modulo by 0 are 0, like the scalar opcodes.
+static uint16_t ref_array_op( uint8_t op, uint8_t attr, uint16_t value, int32_t src ){
+
+    int64_t a = value;
+
+    if( op == ARRAY_OP_MOVE ){
+
+        a = src;
+    }
+    else if( op == ARRAY_OP_ADD ){
+
+        a += src;
+    }
+    else if( op == ARRAY_OP_SUB ){
+
+        a -= src;
+    }
+    else if( op == ARRAY_OP_MUL ){
+
+        a *= src;
+    }
+    else if( src == 0 ){
+
+        a = 0;
+    }
+    else if( op == ARRAY_OP_DIV ){
+
+        a /= src;
+    }
+    else{
+
+        a %= src;
+    }
+
+    if( attr == PIX_ATTR_HUE ){
+
+        return a % 65536;
+    }
+    else if( a > 65535 ){
+
+        return 65535;
+    }
+    else if( a < 0 ){
+
+        return 0;
+    }
+
+    return a;
+}
+
+static uint16_t check_array_ops( uint16_t pixels ){
+
+    // object index and count, including wrap around the end of the strip
+    const uint16_t objects[][2] = {
+        { 0,            pixels },
+        { 1,            pixels - 1 },
+        { pixels - 7,   20 },
+        { pixels + 3,   pixels },
+        { 5,            1 },
+        { 11,           0 },
+    };
+
+    static uint16_t expected[MAX_PIXELS];
+    uint16_t errors = 0;
+
+    setup_gfx( pixels );
+
+    for( uint8_t o = 0; o < ( sizeof(objects) / sizeof(objects[0]) ); o++ ){
+
+        setup_object( objects[o][0], objects[o][1] );
+
+        for( uint8_t attr = PIX_ATTR_HUE; attr <= PIX_ATTR_V_FADE; attr++ ){
+
+            for( uint8_t op = 0; op < ARRAY_OP_COUNT; op++ ){
+
+                for( uint8_t trial = 0; trial < CHECK_TRIALS; trial++ ){
+
+                    int32_t src = random_src();
+
+                    for( uint16_t i = 0; i < pixels; i++ ){
+
+                        set_attr( attr, i, rnd_u16_get_int() );
+                        expected[i] = get_attr( attr, i );
+                    }
+
+                    for( uint16_t i = 0; i < objects[o][1]; i++ ){
+
+                        uint16_t index = ( objects[o][0] + i ) % pixels;
+
+                        expected[index] = ref_array_op( op, attr, expected[index], src );
+                    }
+
+                    array_ops[op]( 1, attr, src );
+
+                    for( uint16_t i = 0; i < pixels; i++ ){
+
+                        if( get_attr( attr, i ) == expected[i] ){
+
+                            continue;
+                        }
+
+                        printf( "  array %s attr %u src %d obj %u/%u pixel %u: %u != %u\n",
+                                array_op_names[op],
+                                attr,
+                                src,
+                                objects[o][0],
+                                objects[o][1],
+                                i,
+                                get_attr( attr, i ),
+                                expected[i] );
+
+                        errors++;
+
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+
+// HSV to RGB
+
+// per pixel conversion, the way gfx_v_sync_array did it before the
+// span converter. reads the target arrays, so the faders must have settled.
+void checks_v_ref_sync( uint8_t pix_mode, uint16_t pixels, uint8_t *red, uint8_t *green, uint8_t *blue, uint8_t *misc ){
+
+    uint16_t *h = gfx_u16p_get_hue();
+    uint16_t *s = gfx_u16p_get_sat();
+    uint16_t *v = gfx_u16p_get_val();
+
+    for( uint16_t i = 0; i < pixels; i++ ){
+
+        uint16_t r, g, b, w;
+        uint16_t dimmed_val = gfx_u16_get_dimmed_val( v[i] );
+
+        if( pix_mode == PIX_MODE_SK6812_RGBW ){
+
+            gfx_v_hsv_to_rgbw( h[i], s[i], dimmed_val, &r, &g, &b, &w );
+
+            red[i]      = r / 256;
+            green[i]    = g / 256;
+            blue[i]     = b / 256;
+            misc[i]     = w / 256;
+        }
+        else{
+
+            gfx_v_hsv_to_rgb( h[i], s[i], dimmed_val, &r, &g, &b );
+
+            r /= 64;
+            g /= 64;
+            b /= 64;
+
+            red[i]      = r / 4;
+            green[i]    = g / 4;
+            blue[i]     = b / 4;
+            misc[i]     = ( ( r & 0x0003 ) << 4 ) | ( ( g & 0x0003 ) << 2 ) | ( b & 0x0003 );
+        }
+    }
+}
+
+// random HSV, with the hue sector edges and the ends of the ranges mixed in
+static uint16_t random_hsv( void ){
+
+    static const uint16_t edges[] = {
+        0, 1, 21844, 21845, 21846, 43689, 43690, 43691, 65534, 65535
+    };
+
+    uint16_t r = rnd_u16_get_int();
+
+    if( ( r & 3 ) == 0 ){
+
+        return edges[( r >> 2 ) % ( sizeof(edges) / sizeof(edges[0]) )];
+    }
+
+    return rnd_u16_get_int();
+}
+
+static uint16_t check_sync( uint8_t pix_mode, uint16_t pixels ){
+
+    static uint8_t ref[4][MAX_PIXELS];
+    uint16_t errors = 0;
+
+    for( uint8_t trial = 0; trial < CHECK_TRIALS; trial++ ){
+
+        gfx_params_t params;
+        setup_gfx_params( pixels, &params );
+
+        params.pix_mode         = pix_mode;
+        params.dimmer_curve     = rnd_u16_get_int();
+        params.master_dimmer    = ( trial == 0 ) ? 65535 : random_hsv();
+        params.sub_dimmer       = ( trial == 1 ) ? 65535 : random_hsv();
+
+        gfx_v_set_params( &params );
+        gfx_v_reset();
+
+        for( uint16_t i = 0; i < pixels; i++ ){
+
+            gfx_v_set_hsv( random_hsv(), random_hsv(), random_hsv(), i );
+        }
+
+        settle_faders();
+        gfx_v_sync_array();
+
+        checks_v_ref_sync( pix_mode, pixels, ref[0], ref[1], ref[2], ref[3] );
+
+        uint8_t *out[4] = {
+            gfx_u8p_get_red(),
+            gfx_u8p_get_green(),
+            gfx_u8p_get_blue(),
+            gfx_u8p_get_dither(),
+        };
+
+        for( uint16_t i = 0; i < pixels; i++ ){
+
+            if( ( out[0][i] == ref[0][i] ) &&
+                ( out[1][i] == ref[1][i] ) &&
+                ( out[2][i] == ref[2][i] ) &&
+                ( out[3][i] == ref[3][i] ) ){
+
+                continue;
+            }
+
+            printf( "  sync mode %u curve %u dimmer %u/%u pixel %u: %u %u %u %u != %u %u %u %u\n",
+                    pix_mode,
+                    params.dimmer_curve,
+                    params.master_dimmer,
+                    params.sub_dimmer,
+                    i,
+                    out[0][i], out[1][i], out[2][i], out[3][i],
+                    ref[0][i], ref[1][i], ref[2][i], ref[3][i] );
+
+            errors++;
+
+            break;
+        }
+    }
+
+    return errors;
+}
+
+
+// Temporal dithering
+
+// over 256 frames the carried fraction adds up to exactly the low byte,
+// so the 8 bit outputs sum to the 16 bit value. values that would
+// carry past 255 are clamped and left out.
+static uint16_t check_dither( uint16_t pixels ){
+
+    static uint16_t ref[3][MAX_PIXELS];
+    static uint32_t sum[3][MAX_PIXELS];
+    static uint8_t ref8[4][MAX_PIXELS];
+    uint16_t errors = 0;
+    gfx_params_t params;
+
+    setup_gfx_params( pixels, &params );
+    gfx_v_set_params( &params );
+
+    uint32_t size_off = gfx_u32_get_store_size();
+
+    params.dither = TRUE;
+    gfx_v_set_params( &params );
+    gfx_v_reset();
+
+    if( gfx_u32_get_store_size() <= size_off ){
+
+        printf( "  dither on: store size %u <= %u\n", gfx_u32_get_store_size(), size_off );
+        errors++;
+    }
+
+    for( uint16_t i = 0; i < pixels; i++ ){
+
+        gfx_v_set_hsv( random_hsv(), random_hsv(), random_hsv(), i );
+    }
+
+    settle_faders();
+
+    uint16_t *h = gfx_u16p_get_hue();
+    uint16_t *s = gfx_u16p_get_sat();
+    uint16_t *v = gfx_u16p_get_val();
+
+    for( uint16_t i = 0; i < pixels; i++ ){
+
+        gfx_v_hsv_to_rgb( h[i], s[i], gfx_u16_get_dimmed_val( v[i] ), &ref[0][i], &ref[1][i], &ref[2][i] );
+    }
+
+    memset( sum, 0, sizeof(sum) );
+
+    for( uint16_t frame = 0; frame < 256; frame++ ){
+
+        gfx_v_sync_array();
+
+        for( uint16_t i = 0; i < pixels; i++ ){
+
+            sum[0][i] += gfx_u8p_get_red()[i];
+            sum[1][i] += gfx_u8p_get_green()[i];
+            sum[2][i] += gfx_u8p_get_blue()[i];
+        }
+    }
+
+    for( uint16_t i = 0; i < pixels; i++ ){
+
+        for( uint8_t c = 0; c < 3; c++ ){
+
+            uint16_t x = ref[c][i];
+
+            if( x >= 0xff00 ){
+
+                continue;
+            }
+
+            uint32_t expected = (uint32_t)( x >> 8 ) * 256 + ( x & 0xff );
+
+            if( sum[c][i] == expected ){
+
+                continue;
+            }
+
+            // first mismatch only
+            if( errors == 0 ){
+
+                printf( "  dither pixel %u channel %u: %u != %u\n", i, c, sum[c][i], expected );
+            }
+
+            errors++;
+            break;
+        }
+    }
+
+    // off again, the pixels are kept and the dither state is freed
+    params.dither = FALSE;
+    gfx_v_set_params( &params );
+
+    if( gfx_u32_get_store_size() != size_off ){
+
+        printf( "  dither off: store size %u != %u\n", gfx_u32_get_store_size(), size_off );
+        errors++;
+    }
+
+    gfx_v_sync_array();
+
+    checks_v_ref_sync( PIX_MODE_WS2811, pixels, ref8[0], ref8[1], ref8[2], ref8[3] );
+
+    if( ( memcmp( gfx_u8p_get_red(), ref8[0], pixels ) != 0 ) ||
+        ( memcmp( gfx_u8p_get_green(), ref8[1], pixels ) != 0 ) ||
+        ( memcmp( gfx_u8p_get_blue(), ref8[2], pixels ) != 0 ) ||
+        ( memcmp( gfx_u8p_get_dither(), ref8[3], pixels ) != 0 ) ){
+
+        printf( "  dither off: output differs from the reference\n" );
+        errors++;
+    }
+
+    return errors;
+}
+
+
+// Pixel store allocation
+
+// pix_count must stay above 0 when the store can't grow,
+// the index and virtual array paths divide by it.
+static uint16_t check_store_alloc( void ){
+
+    uint16_t errors = 0;
+    gfx_params_t params;
+
+    setup_gfx( 150 );
+
+    gfx_v_set_store_alloc_fail( TRUE );
+
+    // a failed resize keeps the old store
+    setup_gfx_params( 300, &params );
+    params.virtual_array_start  = 50;
+    params.virtual_array_length = 300;
+    gfx_v_set_params( &params );
+
+    if( gfx_u16_get_pix_count() != 150 ){
+
+        printf( "  failed resize: pix count %u != 150\n", gfx_u16_get_pix_count() );
+        errors++;
+    }
+
+    // one pixel doesn't need the heap
+    gfx_v_set_pix_count( 1 );
+    gfx_v_set_params( &params );
+
+    if( gfx_u16_get_pix_count() != 1 ){
+
+        printf( "  one pixel store: pix count %u != 1\n", gfx_u16_get_pix_count() );
+        errors++;
+    }
+
+    // everything that indexes by pix_count still runs
+    setup_object( 0, 4 );
+
+    for( uint8_t op = 0; op < ARRAY_OP_COUNT; op++ ){
+
+        array_ops[op]( 1, PIX_ATTR_VAL, 3 );
+    }
+
+    gfx_v_set_hsv( 1000, 2000, 3000, 0 );
+    settle_faders();
+    gfx_v_sync_array();
+
+    // dithering lays the one pixel store out again in place
+    for( uint8_t dither = 0; dither < 2; dither++ ){
+
+        params.dither = !dither;
+        gfx_v_set_params( &params );
+        gfx_v_sync_array();
+
+        if( ( gfx_u16p_get_hue()[0] != 1000 ) || ( gfx_u16p_get_val()[0] != 3000 ) ){
+
+            printf( "  one pixel store: pixel lost with dither %u\n", !dither );
+            errors++;
+        }
+    }
+
+    gfx_v_set_store_alloc_fail( FALSE );
+
+    setup_gfx( 150 );
+
+    if( gfx_u16_get_pix_count() != 150 ){
+
+        printf( "  regrow: pix count %u != 150\n", gfx_u16_get_pix_count() );
+        errors++;
+    }
+
+    return errors;
+}
+
+
+uint16_t checks_u16_run( void ){
+
+    uint16_t failed = 0;
+
+    // odd and even strip lengths, for the 32 bit lane alignment
+    for( uint16_t pixels = 149; pixels <= 150; pixels++ ){
+
+        uint16_t errors = check_array_ops( pixels );
+
+        printf( "array ops, %u pixels: %s\n", pixels, errors == 0 ? "ok" : "FAILED" );
+
+        if( errors > 0 ){
+
+            failed++;
+        }
+    }
+
+    const uint8_t sync_modes[] = { PIX_MODE_WS2811, PIX_MODE_SK6812_RGBW };
+
+    for( uint8_t m = 0; m < sizeof(sync_modes); m++ ){
+
+        uint16_t errors = check_sync( sync_modes[m], MAX_PIXELS );
+
+        printf( "HSV to RGB, pix mode %u: %s\n", sync_modes[m], errors == 0 ? "ok" : "FAILED" );
+
+        if( errors > 0 ){
+
+            failed++;
+        }
+    }
+
+    uint16_t errors = check_dither( MAX_PIXELS );
+
+    printf( "temporal dither: %s\n", errors == 0 ? "ok" : "FAILED" );
+
+    if( errors > 0 ){
+
+        failed++;
+    }
+
+    errors = check_store_alloc();
+
+    printf( "pixel store allocation: %s\n", errors == 0 ? "ok" : "FAILED" );
+
+    if( errors > 0 ){
+
+        failed++;
+    }
+
+    return failed;
+}
@@ -0,0 +1,34 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+
+#ifndef _CHECKS_H
+#define _CHECKS_H
+
+#include <stdint.h>
+
+// returns the number of failed checks
+uint16_t checks_u16_run( void );
+
+void checks_v_ref_sync( uint8_t pix_mode, uint16_t pixels, uint8_t *red, uint8_t *green, uint8_t *blue, uint8_t *misc );
+
+#endif
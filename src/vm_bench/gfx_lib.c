@@ -0,0 +1 @@
+../lib_chromatron/gfx_lib.c
\ No newline at end of file
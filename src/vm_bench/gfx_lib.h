@@ -0,0 +1 @@
+../lib_chromatron/gfx_lib.h
\ No newline at end of file
@@ -0,0 +1,57 @@
+#
+# <license>
+# 
+#     This file is part of the Sapphire Operating System.
+# 
+#     Copyright (C) 2013-2018  Jeremy Billheimer
+# 
+# 
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+# 
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+# 
+#     You should have received a copy of the GNU General Public License
+#     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+# </license>
+#
+
+# Generates the __KV__ hash defines for the host bench build.
+# The firmware builders pass these on the command line, the bench
+# collects them into a header instead.
+#
+# Usage: kv_hashes.py output.h source ...
+
+import re
+import sys
+
+
+def catbus_string_hash(s):
+    # FNV-1a, 32 bit, same as catbus_string_hash in the build tools
+    h = 2166136261
+
+    for c in bytearray(s.encode('ascii')):
+        h ^= c
+        h = (h * 16777619) & 0xffffffff
+
+    return h
+
+
+if __name__ == '__main__':
+    keys = set()
+
+    for path in sys.argv[2:]:
+        with open(path) as f:
+            keys.update(re.findall(r'__KV__(\w+)', f.read()))
+
+    with open(sys.argv[1], 'w') as f:
+        f.write('// generated by kv_hashes.py\n')
+
+        for key in sorted(keys):
+            f.write('#define __KV__%s ((catbus_hash_t32)%du)\n' % (key, catbus_string_hash(key)))
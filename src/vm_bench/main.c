@@ -0,0 +1,840 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+/*
+
+Host benchmark for the FX VM.
+
+Loads compiled FX images (.fxb) and runs them on the host,
+reporting execution time per frame, instruction counts per opcode
+and the max cycles high water mark.
+
+Usage:
+    vm_bench [-n frames] [-p pixels] [file.fxb ...]
+    vm_bench -f [-n frames] [-p pixels]
+    vm_bench -i [-n frames] [-p pixels] [file.fxb ...]
+    vm_bench -s [-n frames] [-p pixels]
+    vm_bench -t
+
+If no files are given, all .fxb files in the corpus directory are run.
+'make' builds the bench against the wifi side support files and
+compiles the bundled FX/*.fx scripts into the corpus directory.
+
+-f runs the faders and HSV conversion without a script, with a share
+of the pixels starting new fades every frame. To compare pixel state
+layouts, build with and without GFX_PACKED_FADER_STATE. MAX_PIXELS can
+be raised in CFLAGS to test large installations, e.g. -DMAX_PIXELS=10240.
+
+-i runs two instances of each script, each on half of the pixels, the
+way the wifi vm runner switches between VMs. The pixel index maps must
+not be rebuilt after the first frame, this is reported as an error.
+
+-s times the HSV to RGB conversion in gfx_v_sync_array against the per
+pixel conversion it replaced, for a few pixel patterns. The bench is
+built without auto-vectorization, the ESP8266 has no SIMD.
+
+-t runs the checks in checks.c, which compare the gfx lib's optimized
+pixel paths with per pixel reference code. The exit code is the number
+of failed checks.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "vm_core.h"
+#include "vm_config.h"
+#include "gfx_lib.h"
+#include "kvdb.h"
+#include "memory.h"
+#include "random.h"
+#include "hash.h"
+#include "checks.h"
+#include "pix_modes.h"
+
+#ifndef VM_BENCH_CORPUS_DIR
+#define VM_BENCH_CORPUS_DIR     "fxb"
+#endif
+
+#define VM_BENCH_DEFAULT_FRAMES 1000
+#define VM_BENCH_DEFAULT_PIXELS 150
+
+#define VM_BENCH_KV_TAG         1
+
+#define VM_BENCH_HEAP_SIZE      32768
+
+// 1 in N pixels get a new target each frame in the fader benchmark
+#define VM_BENCH_FADER_CHURN    16
+
+#define VM_BENCH_INSTANCES      2
+
+static const char *opcode_names[] = {
+    "mov",
+    "clr",
+    "compeq",
+    "compneq",
+    "compgt",
+    "compgte",
+    "complt",
+    "complte",
+    "and",
+    "or",
+    "add",
+    "sub",
+    "mul",
+    "div",
+    "mod",
+    "jmp",
+    "jmp_if_z",
+    "jmp_if_not_z",
+    "jmp_if_z_dec",
+    "jmp_if_gte",
+    "jmp_if_l_pre_inc",
+    "print",
+    "ret",
+    "call",
+    "lta",
+    "lfa",
+    "lfa2d",
+    "lta2d",
+    "ltah",
+    "ltas",
+    "ltav",
+    "lfah",
+    "lfas",
+    "lfav",
+    "array_add",
+    "array_sub",
+    "array_mul",
+    "array_div",
+    "array_mod",
+    "array_mov",
+    "rand",
+    "assert",
+    "halt",
+    "is_fading",
+    "lib_call",
+    0,
+    0,
+    0,
+    0,
+    "lfahsf",
+    "lfavf",
+    "ltahsf",
+    "ltavf",
+    0,
+    "obj_load",
+    "obj_store",
+    "not",
+    "db_load",
+    "db_store",
+    "compeq_jmp_if_z",
+    "compneq_jmp_if_z",
+    "compgt_jmp_if_z",
+    "compgte_jmp_if_z",
+    "complt_jmp_if_z",
+    "complte_jmp_if_z",
+    "mov_add",
+    "mov_sub",
+    "hue_add",
+    "hue_sub",
+    "sat_add",
+    "sat_sub",
+    "val_add",
+    "val_sub",
+    "db_load_key",
+    "db_store_key",
+    "lib_call_index",
+};
+
+static uint8_t vm_slab[VM_MAX_IMAGE_SIZE];
+static vm_state_t vm_state;
+
+static uint16_t bench_frames = VM_BENCH_DEFAULT_FRAMES;
+static uint16_t bench_pixels = VM_BENCH_DEFAULT_PIXELS;
+static bool instance_bench;
+
+
+static uint64_t elapsed_ns( struct timespec *start, struct timespec *end ){
+
+    return ( (uint64_t)( end->tv_sec - start->tv_sec ) * 1000000000 ) +
+           ( end->tv_nsec - start->tv_nsec );
+}
+
+#ifdef VM_ENABLE_PROFILE
+// profiler ticks are in nanoseconds
+uint32_t vm_bench_u32_get_ticks( void ){
+
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( (uint32_t)now.tv_sec * 1000000000 ) + now.tv_nsec;
+}
+#endif
+
+static int8_t load_image( const char *fname ){
+
+    FILE *f = fopen( fname, "rb" );
+
+    if( f == 0 ){
+
+        return -1;
+    }
+
+    // program length is prepended to the image
+    int32_t vm_size = 0;
+
+    if( fread( &vm_size, sizeof(vm_size), 1, f ) != 1 ){
+
+        fclose( f );
+        return -2;
+    }
+
+    if( ( vm_size <= 0 ) || ( vm_size > (int32_t)sizeof(vm_slab) ) ){
+
+        fclose( f );
+        return VM_STATUS_IMAGE_TOO_LARGE;
+    }
+
+    memset( vm_slab, 0, sizeof(vm_slab) );
+
+    if( fread( vm_slab, vm_size, 1, f ) != 1 ){
+
+        fclose( f );
+        return -2;
+    }
+
+    fclose( f );
+
+    return vm_i8_load_program( 0, vm_slab, vm_size, &vm_state );
+}
+
+static void add_keys( uint32_t *hash, uint32_t count ){
+
+    while( count > 0 ){
+
+        kvdb_i8_add( *hash, 0, VM_BENCH_KV_TAG, 0 );
+
+        hash++;
+        count--;
+    }
+}
+
+// set up the database the same way the wifi vm runner does
+static void load_keys( void ){
+
+    kvdb_v_delete_tag( VM_BENCH_KV_TAG );
+
+    add_keys( (uint32_t *)&vm_slab[vm_state.write_keys_start], vm_state.write_keys_count );
+    add_keys( (uint32_t *)&vm_slab[vm_state.read_keys_start], vm_state.read_keys_count );
+
+    vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+
+    for( uint8_t i = 0; i < vm_state.publish_count; i++ ){
+
+        kvdb_i8_add( publish[i].hash, 0, VM_BENCH_KV_TAG, 0 );
+    }
+}
+
+static void reset_gfx( void ){
+
+    // detach pixel arrays from the previous image,
+    // otherwise setting params will write into the new one.
+    gfx_v_init_pixel_arrays( 0, 0 );
+
+    gfx_params_t params;
+    gfx_v_get_params( &params );
+
+    params.pix_count        = bench_pixels;
+    params.pix_size_x       = bench_pixels;
+    params.pix_size_y       = 1;
+    params.master_dimmer    = 65535;
+    params.sub_dimmer       = 65535;
+
+    gfx_v_set_params( &params );
+
+    gfx_v_reset();
+}
+
+// hash of the pixel and data state after the run.
+// this should not change when the VM is optimized.
+static uint32_t state_hash( void ){
+
+    uint32_t hash = hash_u32_start();
+
+    hash = hash_u32_partial( hash, (uint8_t *)gfx_u16p_get_hue(), bench_pixels * sizeof(uint16_t) );
+    hash = hash_u32_partial( hash, (uint8_t *)gfx_u16p_get_sat(), bench_pixels * sizeof(uint16_t) );
+    hash = hash_u32_partial( hash, (uint8_t *)gfx_u16p_get_val(), bench_pixels * sizeof(uint16_t) );
+    hash = hash_u32_partial( hash, vm_slab + vm_state.data_start, vm_state.data_len );
+
+    return hash;
+}
+
+static void print_opcode_counts( uint16_t frames ){
+
+    uint32_t *counts = vm_u32p_get_opcode_counts();
+    uint32_t total = 0;
+
+    for( uint16_t i = 0; i < VM_N_OPCODES; i++ ){
+
+        total += counts[i];
+    }
+
+    printf( "  instructions/frame: %u\n", total / frames );
+
+    for( uint16_t i = 0; i < VM_N_OPCODES; i++ ){
+
+        if( counts[i] == 0 ){
+
+            continue;
+        }
+
+        const char *name = "trap";
+
+        if( ( i < ( sizeof(opcode_names) / sizeof(opcode_names[0]) ) ) &&
+            ( opcode_names[i] != 0 ) ){
+
+            name = opcode_names[i];
+        }
+
+        printf( "    %3u %-18s %10u %5.1f%%\n",
+                i,
+                name,
+                counts[i],
+                ( (float)counts[i] * 100.0 ) / total );
+    }
+}
+
+#ifdef VM_ENABLE_PROFILE
+static void print_profile( void ){
+
+    printf( "  profile (ns):\n" );
+
+    vm_profile_t profile;
+
+    for( uint16_t i = 0; vm_i8_get_opcode_profile( i, &profile ) == 0; i++ ){
+
+        if( profile.count == 0 ){
+
+            continue;
+        }
+
+        printf( "    %3u %-18s %10u %10u %6u/op\n",
+                i,
+                opcode_names[i],
+                profile.count,
+                profile.ticks,
+                profile.ticks / profile.count );
+    }
+
+    vm_func_profile_t func;
+
+    for( uint8_t i = 0; vm_i8_get_func_profile( i, &func ) == 0; i++ ){
+
+        printf( "    func @%-5u        %10u %10u %6u/call\n",
+                func.addr,
+                func.calls,
+                func.ticks,
+                func.ticks / func.calls );
+    }
+}
+#endif
+
+static int8_t run_bench( const char *fname ){
+
+    printf( "%s\n", fname );
+
+    int8_t status = load_image( fname );
+
+    if( status < 0 ){
+
+        printf( "  load error: %d\n", status );
+
+        return status;
+    }
+
+    load_keys();
+    reset_gfx();
+
+    gfx_v_init_pixel_arrays( (gfx_pixel_array_t *)( vm_slab + vm_state.pix_obj_start ), vm_state.pix_obj_count );
+
+    struct timespec start, end;
+
+    status = vm_i8_run_init( vm_slab, &vm_state );
+
+    if( status < 0 ){
+
+        printf( "  init error: %d\n", status );
+
+        return status;
+    }
+
+    vm_v_reset_opcode_counts();
+
+    uint64_t vm_time = 0;
+    uint64_t fader_time = 0;
+    uint16_t frames = 0;
+
+    while( frames < bench_frames ){
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        status = vm_i8_run_loop( vm_slab, &vm_state );
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        vm_time += elapsed_ns( &start, &end );
+
+        if( status < 0 ){
+
+            printf( "  loop error: %d on frame %u\n", status, frames );
+
+            break;
+        }
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        gfx_v_process_faders();
+        gfx_v_sync_array();
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        fader_time += elapsed_ns( &start, &end );
+
+        frames++;
+
+        if( status == VM_STATUS_HALT ){
+
+            break;
+        }
+    }
+
+    if( frames == 0 ){
+
+        return status;
+    }
+
+    printf( "  frames: %u pixels: %u\n", frames, bench_pixels );
+    printf( "  vm ns/frame:        %llu\n", (unsigned long long)( vm_time / frames ) );
+    printf( "  fader ns/frame:     %llu\n", (unsigned long long)( fader_time / frames ) );
+    printf( "  max cycles:         %u / %u\n", vm_state.max_cycles, VM_MAX_CYCLES );
+    printf( "  state hash:         0x%08x\n", state_hash() );
+
+    print_opcode_counts( frames );
+
+    #ifdef VM_ENABLE_PROFILE
+    print_profile();
+    #endif
+
+    return status;
+}
+
+static int8_t run_instance_bench( const char *fname ){
+
+    printf( "%s (%u instances)\n", fname, VM_BENCH_INSTANCES );
+
+    int8_t status = load_image( fname );
+
+    if( status < 0 ){
+
+        printf( "  load error: %d\n", status );
+
+        return status;
+    }
+
+    load_keys();
+    reset_gfx();
+
+    static uint8_t slabs[VM_BENCH_INSTANCES][VM_MAX_IMAGE_SIZE];
+    static vm_state_t states[VM_BENCH_INSTANCES];
+    uint16_t part_count = bench_pixels / VM_BENCH_INSTANCES;
+
+    for( uint8_t n = 0; n < VM_BENCH_INSTANCES; n++ ){
+
+        memcpy( slabs[n], vm_slab, sizeof(vm_slab) );
+        states[n] = vm_state;
+
+        gfx_v_set_partition( n * part_count, part_count );
+        gfx_v_init_pixel_arrays( (gfx_pixel_array_t *)( slabs[n] + states[n].pix_obj_start ), states[n].pix_obj_count );
+
+        status = vm_i8_run_init( slabs[n], &states[n] );
+
+        if( status < 0 ){
+
+            printf( "  init error: %d on instance %u\n", status, n );
+
+            break;
+        }
+    }
+
+    struct timespec start, end;
+    uint64_t vm_time = 0;
+    uint16_t frames = 0;
+    uint32_t first_builds = 0;
+
+    while( ( status >= 0 ) && ( status != VM_STATUS_HALT ) && ( frames < bench_frames ) ){
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+
+        for( uint8_t n = 0; n < VM_BENCH_INSTANCES; n++ ){
+
+            gfx_v_set_partition( n * part_count, part_count );
+            gfx_v_set_pixel_arrays( (gfx_pixel_array_t *)( slabs[n] + states[n].pix_obj_start ), states[n].pix_obj_count );
+
+            status = vm_i8_run_loop( slabs[n], &states[n] );
+
+            if( status < 0 ){
+
+                printf( "  loop error: %d on frame %u instance %u\n", status, frames, n );
+
+                break;
+            }
+        }
+
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        vm_time += elapsed_ns( &start, &end );
+
+        gfx_v_process_faders();
+        gfx_v_sync_array();
+
+        if( frames == 0 ){
+
+            first_builds = gfx_u32_get_index_map_builds();
+        }
+
+        frames++;
+    }
+
+    // restore the full strip for the next image
+    gfx_v_set_partition( 0, 0 );
+
+    if( frames == 0 ){
+
+        return status;
+    }
+
+    uint32_t rebuilds = gfx_u32_get_index_map_builds() - first_builds;
+
+    printf( "  frames: %u pixels: %u\n", frames, bench_pixels );
+    printf( "  vm ns/frame:        %llu\n", (unsigned long long)( vm_time / frames ) );
+    printf( "  index map rebuilds: %u\n", rebuilds );
+
+    if( rebuilds > 0 ){
+
+        printf( "  error: index maps rebuilt while switching instances\n" );
+
+        return -1;
+    }
+
+    return status;
+}
+
+static int8_t run_image( const char *fname ){
+
+    if( instance_bench ){
+
+        return run_instance_bench( fname );
+    }
+
+    return run_bench( fname );
+}
+
+static int run_fader_bench( void ){
+
+    reset_gfx();
+
+    // master array only, filled in by the gfx lib
+    static gfx_pixel_array_t master;
+    gfx_v_init_pixel_arrays( &master, 1 );
+
+    #ifdef GFX_PACKED_FADER_STATE
+    printf( "fader bench, packed state\n" );
+    #else
+    printf( "fader bench, state arrays\n" );
+    #endif
+
+    struct timespec start, end;
+    uint64_t fader_time = 0;
+    uint64_t sync_time = 0;
+
+    for( uint16_t frame = 0; frame < bench_frames; frame++ ){
+
+        for( uint16_t i = 0; i < ( bench_pixels / VM_BENCH_FADER_CHURN ); i++ ){
+
+            uint16_t index = rnd_u16_get_int() % bench_pixels;
+
+            gfx_v_set_hs_fade( 100 + ( rnd_u16_get_int() % 2000 ), index, 65535, 0 );
+            gfx_v_set_v_fade( 100 + ( rnd_u16_get_int() % 2000 ), index, 65535, 0 );
+            gfx_v_set_hsv( rnd_u16_get_int(), rnd_u16_get_int(), rnd_u16_get_int(), index );
+        }
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        gfx_v_process_faders();
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        fader_time += elapsed_ns( &start, &end );
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        gfx_v_sync_array();
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        sync_time += elapsed_ns( &start, &end );
+    }
+
+    printf( "  frames: %u pixels: %u\n", bench_frames, bench_pixels );
+    printf( "  fader ns/frame:     %llu\n", (unsigned long long)( fader_time / bench_frames ) );
+    printf( "  sync ns/frame:      %llu\n", (unsigned long long)( sync_time / bench_frames ) );
+    printf( "  state hash:         0x%08x\n", state_hash() );
+
+    return 0;
+}
+
+#define SYNC_PATTERN_RANDOM     0
+#define SYNC_PATTERN_RAINBOW    1
+#define SYNC_PATTERN_SOLID      2
+#define SYNC_PATTERN_COUNT      3
+
+static const char *sync_pattern_names[SYNC_PATTERN_COUNT] = {
+    "random", "rainbow", "solid",
+};
+
+static void set_sync_pattern( uint8_t pattern ){
+
+    for( uint16_t i = 0; i < bench_pixels; i++ ){
+
+        if( pattern == SYNC_PATTERN_RANDOM ){
+
+            gfx_v_set_hsv( rnd_u16_get_int(), rnd_u16_get_int(), rnd_u16_get_int(), i );
+        }
+        else if( pattern == SYNC_PATTERN_RAINBOW ){
+
+            gfx_v_set_hsv( ( (uint32_t)i * 65536 ) / bench_pixels, 65535, 65535, i );
+        }
+        else{
+
+            gfx_v_set_hsv( 10000, 50000, 40000, i );
+        }
+    }
+
+    // 0 fade times finish in a few frames
+    for( uint8_t i = 0; i < 64; i++ ){
+
+        gfx_v_process_faders();
+    }
+}
+
+static int run_sync_bench( void ){
+
+    static uint8_t ref[4][MAX_PIXELS];
+    const uint8_t modes[] = { PIX_MODE_WS2811, PIX_MODE_SK6812_RGBW };
+
+    printf( "sync bench, %u pixels, ns/frame\n", bench_pixels );
+
+    for( uint8_t m = 0; m < sizeof(modes); m++ ){
+
+        for( uint8_t pattern = 0; pattern < SYNC_PATTERN_COUNT; pattern++ ){
+
+            gfx_v_init_pixel_arrays( 0, 0 );
+
+            gfx_params_t params;
+            gfx_v_get_params( &params );
+
+            params.pix_count        = bench_pixels;
+            params.pix_size_x       = bench_pixels;
+            params.pix_size_y       = 1;
+            params.pix_mode         = modes[m];
+            params.master_dimmer    = 49152;
+            params.sub_dimmer       = 65535;
+            params.hs_fade          = 0;
+            params.v_fade           = 0;
+            params.dither           = FALSE;
+
+            gfx_v_set_params( &params );
+            gfx_v_reset();
+
+            set_sync_pattern( pattern );
+
+            struct timespec start, end;
+            uint64_t sync_time = 0;
+            uint64_t ref_time = 0;
+
+            for( uint16_t frame = 0; frame < bench_frames; frame++ ){
+
+                // setting the params converts every pixel on the next sync
+                gfx_v_set_params( &params );
+
+                clock_gettime( CLOCK_MONOTONIC, &start );
+                gfx_v_sync_array();
+                clock_gettime( CLOCK_MONOTONIC, &end );
+
+                sync_time += elapsed_ns( &start, &end );
+
+                clock_gettime( CLOCK_MONOTONIC, &start );
+                checks_v_ref_sync( modes[m], bench_pixels, ref[0], ref[1], ref[2], ref[3] );
+                clock_gettime( CLOCK_MONOTONIC, &end );
+
+                ref_time += elapsed_ns( &start, &end );
+            }
+
+            printf( "  mode %u %-8s sync: %6llu per pixel: %6llu\n",
+                    modes[m],
+                    sync_pattern_names[pattern],
+                    (unsigned long long)( sync_time / bench_frames ),
+                    (unsigned long long)( ref_time / bench_frames ) );
+        }
+    }
+
+    return 0;
+}
+
+static int run_corpus( const char *path ){
+
+    DIR *dir = opendir( path );
+
+    if( dir == 0 ){
+
+        printf( "Cannot open %s\n", path );
+
+        return -1;
+    }
+
+    int errors = 0;
+    struct dirent *entry;
+    char fname[512];
+
+    while( ( entry = readdir( dir ) ) != 0 ){
+
+        const char *ext = strrchr( entry->d_name, '.' );
+
+        if( ( ext == 0 ) || ( strcmp( ext, ".fxb" ) != 0 ) ){
+
+            continue;
+        }
+
+        snprintf( fname, sizeof(fname), "%s/%s", path, entry->d_name );
+
+        if( run_image( fname ) < 0 ){
+
+            errors++;
+        }
+    }
+
+    closedir( dir );
+
+    return errors;
+}
+
+int main( int argc, char *argv[] ){
+
+    int i = 1;
+    bool fader_bench = FALSE;
+    bool sync_bench = FALSE;
+    bool run_checks = FALSE;
+
+    while( ( i < argc ) && ( argv[i][0] == '-' ) ){
+
+        if( ( strcmp( argv[i], "-n" ) == 0 ) && ( ( i + 1 ) < argc ) ){
+
+            bench_frames = atoi( argv[i + 1] );
+            i += 2;
+        }
+        else if( ( strcmp( argv[i], "-p" ) == 0 ) && ( ( i + 1 ) < argc ) ){
+
+            bench_pixels = atoi( argv[i + 1] );
+            i += 2;
+        }
+        else if( strcmp( argv[i], "-f" ) == 0 ){
+
+            fader_bench = TRUE;
+            i++;
+        }
+        else if( strcmp( argv[i], "-i" ) == 0 ){
+
+            instance_bench = TRUE;
+            i++;
+        }
+        else if( strcmp( argv[i], "-s" ) == 0 ){
+
+            sync_bench = TRUE;
+            i++;
+        }
+        else if( strcmp( argv[i], "-t" ) == 0 ){
+
+            run_checks = TRUE;
+            i++;
+        }
+        else{
+
+            printf( "Usage: %s [-n frames] [-p pixels] [-f] [-i] [-s] [-t] [file.fxb ...]\n", argv[0] );
+
+            return -1;
+        }
+    }
+
+    if( bench_frames == 0 ){
+
+        bench_frames = 1;
+    }
+
+    if( bench_pixels > MAX_PIXELS ){
+
+        bench_pixels = MAX_PIXELS;
+    }
+
+    static uint8_t heap[VM_BENCH_HEAP_SIZE];
+
+    rnd_v_init();
+    mem2_v_init( heap, sizeof(heap) );
+    kvdb_v_init();
+    gfxlib_v_init();
+
+    int errors = 0;
+
+    if( run_checks ){
+
+        errors = checks_u16_run();
+    }
+    else if( fader_bench ){
+
+        errors = run_fader_bench();
+    }
+    else if( sync_bench ){
+
+        errors = run_sync_bench();
+    }
+    else if( i >= argc ){
+
+        errors = run_corpus( VM_BENCH_CORPUS_DIR );
+    }
+    else{
+
+        for( ; i < argc; i++ ){
+
+            if( run_image( argv[i] ) < 0 ){
+
+                errors++;
+            }
+        }
+    }
+
+    return errors;
+}
@@ -0,0 +1 @@
+../lib_chromatron/pix_modes.h
\ No newline at end of file
@@ -0,0 +1 @@
+../lib_chromatron/trig.h
\ No newline at end of file
@@ -0,0 +1,42 @@
+// <license>
+// 
+//     This file is part of the Sapphire Operating System.
+// 
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+// 
+// 
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// </license>
+
+#ifndef _VM_CONFIG_H
+#define _VM_CONFIG_H
+
+#define VM_ENABLE_GFX
+#define VM_ENABLE_KVDB
+#define VM_ENABLE_OPCODE_COUNTS
+
+#define VM_MAX_IMAGE_SIZE   4096
+
+// the profiler adds overhead to the timing results,
+// so it is off by default.
+// #define VM_ENABLE_PROFILE
+
+#ifdef VM_ENABLE_PROFILE
+#include <stdint.h>
+uint32_t vm_bench_u32_get_ticks( void );
+#define VM_PROFILE_TICKS() vm_bench_u32_get_ticks()
+#endif
+
+#endif
@@ -0,0 +1 @@
+../lib_chromatron/vm_core.c
\ No newline at end of file
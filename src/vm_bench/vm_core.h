@@ -0,0 +1 @@
+../lib_chromatron/vm_core.h
\ No newline at end of file